@@ -0,0 +1,48 @@
+#ifndef ARCHIVE_FORMAT_H
+#define ARCHIVE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARCHIVE_TAR_BLOCK 512
+#define ARCHIVE_TAR_TRAILER 1024            // Two zero blocks end the archive
+#define ARCHIVE_ZIP_LOCAL_HEADER 30         // Plus the name
+#define ARCHIVE_ZIP_DESCRIPTOR 16
+#define ARCHIVE_ZIP_CENTRAL_HEADER 46       // Plus the name
+#define ARCHIVE_ZIP_END 22
+#define ARCHIVE_ZIP_MAX_ENTRIES 65535       // No ZIP64
+#define ARCHIVE_HEADER_MAX 512              // Largest single record any of these writes
+
+// Byte layouts for streaming TAR (ustar) and uncompressed ZIP archives. Every
+// record is written into a caller buffer of at most ARCHIVE_HEADER_MAX bytes, and
+// ZIP entries use data descriptors so the CRC can follow the data. Sizes are
+// known up front, so the whole archive length can be computed before the first
+// byte. No Arduino or FreeRTOS dependencies, so a host build can feed the output
+// to tar/unzip.
+class ArchiveFormat {
+public:
+  // Standard CRC-32, chainable: start from 0 and pass the previous result
+  static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len);
+
+  // TAR: one header block, the data, then zero padding to the next block
+  static size_t tarHeader(uint8_t* out, const char* name, uint32_t size, uint32_t mtime);
+  static uint32_t tarPadding(uint32_t size);
+  static uint64_t tarEntryBytes(uint32_t size);
+
+  // ZIP: local header, the data, a descriptor; then one central header per entry
+  // and the end record
+  static size_t zipLocalHeader(uint8_t* out, const char* name, uint32_t size, uint32_t mtime);
+  static size_t zipDescriptor(uint8_t* out, uint32_t crc, uint32_t size);
+  static size_t zipCentralHeader(uint8_t* out, const char* name, uint32_t size, uint32_t crc,
+                                 uint32_t mtime, uint32_t localOffset);
+  static size_t zipEnd(uint8_t* out, uint16_t entries, uint32_t centralSize, uint32_t centralOffset);
+  static uint64_t zipEntryBytes(size_t nameLen, uint32_t size);     // Local part only
+  static uint64_t zipCentralBytes(size_t nameLen);
+
+private:
+  static void dosDateTime(uint32_t unixTime, uint16_t& date, uint16_t& time);
+  static void put16(uint8_t* p, uint16_t v);
+  static void put32(uint8_t* p, uint32_t v);
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef AVI_FORMAT_H
+#define AVI_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AVI_HEADER_BYTES 224               // RIFF, hdrl list and the movi list header
+#define AVI_CHUNK_HEADER 8                 // '00dc' + size before each frame
+#define AVI_INDEX_ENTRY 16
+#define AVI_MOVI_OFFSET 212                // File offset of the movi LIST header
+
+// What the AVI headers describe; frame sizes come from the caller's photo list
+struct AviStreamInfo {
+  uint16_t width;
+  uint16_t height;
+  uint32_t fps;
+  uint32_t frames;
+  uint32_t moviBytes;                      // Sum of frameBytes() over the frames
+  uint32_t maxFrameBytes;
+};
+
+// Byte layout of an MJPEG AVI (RIFF AVI 1.0 with an idx1 index). Each JPEG is one
+// '00dc' chunk, stored as-is. All sizes follow from the JPEG sizes, so the full
+// file length is known before any frame is read. No Arduino dependencies.
+class AviFormat {
+public:
+  static size_t header(uint8_t* out, const AviStreamInfo& info);     // AVI_HEADER_BYTES
+  static size_t frameHeader(uint8_t* out, uint32_t size);            // AVI_CHUNK_HEADER
+  static uint32_t framePadding(uint32_t size) { return size & 1; }   // Chunks are word aligned
+  static uint32_t frameBytes(uint32_t size) { return AVI_CHUNK_HEADER + size + framePadding(size); }
+
+  // idx1: header, then one entry per frame. offset is the frame chunk's position
+  // relative to the 'movi' fourcc (the first frame is at 4).
+  static size_t indexHeader(uint8_t* out, uint32_t frames);
+  static size_t indexEntry(uint8_t* out, uint32_t offset, uint32_t size);
+
+  static uint64_t fileBytes(const AviStreamInfo& info);
+
+private:
+  static void put16(uint8_t* p, uint16_t v);
+  static void put32(uint8_t* p, uint32_t v);
+  static void putFourcc(uint8_t* p, const char* fourcc);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef AVI_RECORDER_H
+#define AVI_RECORDER_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "AviFormat.h"
+
+#define RECORDER_DIR "/recordings"
+#define RECORDER_DEFAULT_MINUTES 10
+#define RECORDER_DEFAULT_MB 64
+#define RECORDER_DEFAULT_FPS 10             // Playback rate written into each segment
+#define RECORDER_MAX_FRAMES 8192            // Per segment; sizes kept in RAM for idx1
+#define RECORDER_STAGING 8192               // DMA-capable write buffer, whole sectors
+#define RECORDER_SYNC_MS 5000               // Most recording a power cut can lose
+#define RECORDER_PATH_LEN 48
+#define RECORDER_SD_LOCK_MS 3000
+
+// Recording settings, persisted in Preferences
+struct RecorderConfig {
+  bool enabled;
+  uint16_t segmentMinutes;
+  uint16_t segmentMB;
+  uint8_t fps;
+};
+
+struct RecorderStats {
+  uint32_t segments;                        // Finalized by rotation or stop
+  uint32_t frames;
+  uint64_t bytes;
+  uint32_t recovered;                       // Segments repaired at boot
+  uint32_t recoveredFrames;
+  uint32_t writeErrors;
+  uint32_t syncs;
+  uint32_t maxSyncMs;
+};
+
+// Continuous recording: while enabled, the capture task hands each frame to
+// append() instead of writing a photo file, and frames go into one open MJPEG AVI
+// segment (/recordings/rec_000001.avi) as '00dc' chunks. Writes are combined in a
+// sector-aligned staging buffer, so a frame costs no file create or close.
+//
+// Every RECORDER_SYNC_MS the file is synced so FATFS commits its length. A segment
+// is finalized on rotation (every N minutes or MB) or stop: idx1 is appended from
+// the frame sizes kept in RAM and the header is rewritten with the real counts.
+// A segment cut off by a power loss still has the placeholder header (RIFF size
+// 0); begin() walks its chunks, truncates any partial frame and finalizes it the
+// same way, so every segment on the card ends up playable.
+class AviRecorder {
+private:
+  Preferences preferences;
+  RecorderConfig config;
+  RecorderStats stats;
+  SemaphoreHandle_t sdMutex;
+  std::atomic<bool> recording;
+
+  int fd;
+  char path[RECORDER_PATH_LEN];
+  uint32_t nextSegment;
+  uint32_t segmentStartMs;
+  AviStreamInfo info;
+  uint32_t* frameSizes;
+  uint8_t* staging;
+  uint32_t stagingLen;
+  uint32_t stagingOffset;                   // File offset of staging[0]
+  uint32_t lastSyncMs;
+
+public:
+  AviRecorder();
+
+  // After the card is mounted (boot, or after a format under sdMutex): loads the
+  // settings and repairs segments left open by a power loss
+  bool begin(SemaphoreHandle_t sdMutexHandle);
+
+  bool isRecording() const { return recording.load(std::memory_order_relaxed); }
+  RecorderConfig getConfig() const { return config; }
+
+  // Capture task, with sdMutex held. False when the frame could not be stored.
+  bool append(const uint8_t* jpeg, size_t len, uint16_t width, uint16_t height);
+
+  // Finalizes the open segment (caller holds sdMutex)
+  void closeSegment();
+
+  // Web handlers; take sdMutex themselves
+  bool setEnabled(bool enabled);
+  void setLimits(uint16_t minutes, uint16_t megabytes, uint8_t fps);
+
+  static uint32_t removeAll();              // Caller holds sdMutex, recorder closed
+  void writeStatusJson(Print& out);
+
+  // Number of a rec_000001.avi segment name; false when it is not one
+  static bool parseSegmentNumber(const char* name, uint32_t& number);
+
+private:
+  bool openSegment(uint16_t width, uint16_t height);
+  bool finalize(int segmentFd, const AviStreamInfo& segmentInfo, const uint32_t* sizes);
+  bool stage(const uint8_t* data, size_t len);
+  bool flushStaging(bool partial);
+  void syncSegment();
+  bool recoverSegment(const char* segmentPath);
+  void loadConfig();
+  void saveConfig();
+};
+
+extern AviRecorder aviRecorder;
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef BOOT_SEQUENCER_H
+#define BOOT_SEQUENCER_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#define BOOT_MAX_STEPS 8
+#define BOOT_MAX_MILESTONES 4
+#define BOOT_DEP(stepId) (1UL << (stepId))   // Dependency mask for addStep()
+
+typedef bool (*BootStepFunction)();
+
+// One boot step, run as its own FreeRTOS task once its dependencies are done
+struct BootStep {
+  const char* name;
+  BootStepFunction function;
+  uint32_t dependsOn;
+  uint32_t runsAfter;         // Ordering only: waits for these, runs even if they failed
+  BaseType_t core;
+  uint32_t stackSize;
+  volatile int64_t startUs;   // esp_timer time when the step started running
+  volatile int64_t endUs;     // esp_timer time when the step finished
+  volatile BaseType_t ranOnCore;
+  volatile bool succeeded;
+  volatile bool skipped;      // A dependency failed, step was not run
+};
+
+// Named one-shot timestamps such as time-to-first-photo
+struct BootMilestone {
+  const char* name;
+  volatile int64_t timeUs;
+};
+
+class BootSequencer {
+private:
+  BootStep steps[BOOT_MAX_STEPS];
+  BootMilestone milestones[BOOT_MAX_MILESTONES];
+  int stepCount;
+  int milestoneCount;
+  EventGroupHandle_t doneBits;
+  int64_t startedUs;
+
+public:
+  BootSequencer();
+
+  // Registration (before start)
+  int addStep(const char* name, BootStepFunction function, uint32_t dependsOn = 0,
+              BaseType_t core = tskNO_AFFINITY, uint32_t stackSize = 4096);
+  void addMilestone(const char* name);
+
+  // Holds a step back until the given steps (BOOT_DEP mask) have finished,
+  // whether or not they succeeded
+  void runAfter(int stepId, uint32_t stepMask);
+
+  // Launch all steps; returns immediately
+  bool start();
+
+  // Synchronisation for code outside the step graph
+  bool waitFor(int stepId, TickType_t timeout = portMAX_DELAY);
+  bool waitForAll(TickType_t timeout = portMAX_DELAY);
+  bool isDone(int stepId) const;
+  bool succeeded(int stepId) const;
+
+  // Record a milestone the first time it is reached
+  void mark(const char* name);
+
+  void writeProfileJson(Print& out) const;
+
+private:
+  static void stepTask(void* parameter);
+  void runStep(int stepId);
+};
+
+#endif
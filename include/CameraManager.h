@@ -4,27 +4,34 @@
 #include <Arduino.h>
 #include "esp_camera.h"
 #include "config.h"
+#include "CameraTuner.h"
+#include "PhotoWriter.h"
 
 class CameraManager {
 private:
   camera_config_t camera_config;
+  CameraTuner tuner;
   bool cameraInitialized;
   unsigned long lastCaptureTime;
-  String lastPhotoFilename;
+  char lastPhotoFilename[PHOTO_PATH_LEN];
+  uint32_t lastPhotoNumber;
+  uint32_t lastPhotoSize;
 
 public:
   CameraManager();
   bool begin();
   bool capturePhoto();
-  String getLastPhotoFilename() const;
+  const char* getLastPhotoFilename() const;
+  uint32_t getLastPhotoNumber() const { return lastPhotoNumber; }
+  uint32_t getLastPhotoSize() const { return lastPhotoSize; }
   bool isCameraReady() const;
   bool shouldTakePhoto() const;
   void handleLoop();
   
 private:
   void initCameraConfig();
-  String generatePhotoFilename();
-  bool savePhotoToSD(camera_fb_t* fb, const String& filename);
+  unsigned long generatePhotoFilename(char* out, size_t size);
+  bool savePhotoToSD(camera_fb_t* fb, const char* filename);
 };
 
 #endif
\ No newline at end of file
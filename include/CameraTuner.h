@@ -0,0 +1,78 @@
+#ifndef CAMERA_TUNER_H
+#define CAMERA_TUNER_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "esp_camera.h"
+
+// Calibration benchmark settings
+#define CALIBRATION_WARMUP_FRAMES 3    // Frames discarded after each init
+#define CALIBRATION_FRAMES 20          // Frames measured per configuration
+#define CALIBRATION_MAX_ERROR_PCT 5    // Configurations above this error rate are rejected
+#define CALIBRATION_MAX_RESULTS 36     // 3 XCLK x 3 fb_count x 2 grab modes x 2 locations
+
+// Benchmark result for one driver configuration
+struct CameraTuningResult {
+  int xclkFreqHz;
+  uint8_t fbCount;
+  camera_grab_mode_t grabMode;
+  camera_fb_location_t fbLocation;
+  bool initOk;
+  uint16_t frames;
+  uint16_t errors;
+  float fps;
+  uint32_t avgLatencyUs;
+  uint32_t maxLatencyUs;
+  int32_t heapCost;   // Internal heap consumed by the driver
+  int32_t psramCost;  // PSRAM consumed by the driver
+};
+
+// Driver settings chosen by calibration (persisted in NVS)
+struct CameraTuning {
+  bool valid;
+  int xclkFreqHz;
+  uint8_t fbCount;
+  camera_grab_mode_t grabMode;
+  camera_fb_location_t fbLocation;
+
+  CameraTuning() : valid(false), xclkFreqHz(0), fbCount(0),
+                   grabMode(CAMERA_GRAB_WHEN_EMPTY), fbLocation(CAMERA_FB_IN_DRAM) {}
+};
+
+class CameraTuner {
+private:
+  Preferences preferences;
+  CameraTuning tuning;
+  CameraTuningResult results[CALIBRATION_MAX_RESULTS];
+  size_t resultCount;
+  int bestIndex;
+
+public:
+  CameraTuner();
+  void begin();
+
+  // Stored tuning
+  bool hasTuning() const;
+  CameraTuning getTuning() const;
+  void applyTo(camera_config_t& config) const;
+  void clearTuning();
+
+  // One-shot calibration mode (requested via NVS flag, consumed on next boot)
+  void requestCalibration();
+  bool isCalibrationRequested();
+  bool runCalibration(const camera_config_t& baseConfig);
+
+  // Results of the calibration run in this boot (empty otherwise)
+  size_t getResultCount() const;
+  const CameraTuningResult& getResult(size_t index) const;
+  void writeStatusJson(Print& out) const;
+
+private:
+  bool benchmark(const camera_config_t& config, CameraTuningResult& result);
+  bool isBetter(const CameraTuningResult& candidate, const CameraTuningResult& best) const;
+  bool isValidFrame(const camera_fb_t* fb) const;
+  void saveTuning(const CameraTuning& newTuning);
+  CameraTuning loadTuning();
+};
+
+#endif
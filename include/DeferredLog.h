@@ -0,0 +1,126 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Log levels
+#define DLOG_LEVEL_NONE 0
+#define DLOG_LEVEL_ERROR 1
+#define DLOG_LEVEL_WARN 2
+#define DLOG_LEVEL_INFO 3
+#define DLOG_LEVEL_DEBUG 4
+
+// Records above this level compile to nothing (override with -DDLOG_LEVEL=...)
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+
+// Ring sizes
+#define DLOG_MAX_ARGS 6
+#define DLOG_RING_SIZE 64          // Pending records per core (power of two)
+#define DLOG_HISTORY_SIZE 256      // Emitted records kept for /logs (power of two)
+#define DLOG_FLUSH_MS 50
+#define DLOG_TASK_STACK 4096
+
+// One binary record: the format literal is the id, arguments are raw 32-bit words.
+// Arguments must be integers or pointers to strings that outlive the record (literals).
+struct DeferredLogRecord {
+  uint32_t timestampMs;
+  const char* format;
+  uint8_t level;
+  uint8_t core;
+  uint8_t argCount;
+  uint32_t args[DLOG_MAX_ARGS];
+};
+
+class DeferredLog {
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;   // Commit marker: ticket + 1 once the record is written
+    DeferredLogRecord record;
+  };
+
+  // Bounded multi-producer / single-consumer ring, one per core
+  struct Ring {
+    Slot* slots;
+    std::atomic<uint32_t> head;   // Next ticket handed to a producer
+    std::atomic<uint32_t> tail;   // Next ticket the log task will read
+  };
+
+  Ring rings[portNUM_PROCESSORS];
+  DeferredLogRecord* history;
+  uint32_t historyCount;          // Total records ever moved into history
+  SemaphoreHandle_t historyMutex;
+  TaskHandle_t taskHandle;
+  std::atomic<uint32_t> written;
+  std::atomic<uint32_t> dropped;
+  bool started;
+
+public:
+  DeferredLog();
+  bool begin();
+
+  // Hot-path entry point - never blocks, drops the record if the ring is full
+  template <typename... Args>
+  void write(uint8_t level, const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= DLOG_MAX_ARGS, "too many deferred log arguments");
+    uint32_t packed[sizeof...(Args) + 1] = { toWord(args)..., 0 };
+    push(level, format, packed, sizeof...(Args));
+  }
+
+  uint32_t getWritten() const { return written.load(std::memory_order_relaxed); }
+  uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+  // Formats the recent history (oldest first) - used by /logs
+  void writeHistory(Print& out, uint8_t maxLevel = DLOG_LEVEL_DEBUG);
+
+private:
+  template <typename T>
+  static uint32_t toWord(T value) {
+    static_assert(std::is_integral<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value,
+                  "deferred log arguments must be integers or string literals");
+    static_assert(sizeof(T) <= sizeof(uint32_t), "deferred log arguments must fit in 32 bits");
+    return (uint32_t)(uintptr_t)value;
+  }
+
+  void push(uint8_t level, const char* format, const uint32_t* args, uint8_t argCount);
+  bool peek(uint8_t core, DeferredLogRecord*& record);
+  bool popOldest(DeferredLogRecord& record);
+  static size_t formatRecord(const DeferredLogRecord& record, char* buffer, size_t size);
+  static void logTask(void* parameter);
+  void drain();
+};
+
+extern DeferredLog deferredLog;
+
+// Level-gated macros - disabled levels generate no code at all
+#if DLOG_LEVEL >= DLOG_LEVEL_ERROR
+#define DLOGE(format, ...) deferredLog.write(DLOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+#define DLOGE(format, ...) do {} while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_WARN
+#define DLOGW(format, ...) deferredLog.write(DLOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#else
+#define DLOGW(format, ...) do {} while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_INFO
+#define DLOGI(format, ...) deferredLog.write(DLOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define DLOGI(format, ...) do {} while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_DEBUG
+#define DLOGD(format, ...) deferredLog.write(DLOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define DLOGD(format, ...) do {} while (0)
+#endif
+
+#endif
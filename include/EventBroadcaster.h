@@ -0,0 +1,69 @@
+#ifndef EVENT_BROADCASTER_H
+#define EVENT_BROADCASTER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+
+#define EVENT_RING_SIZE 64              // Power of two, shared by every client
+#define EVENT_DATA_LEN 112              // JSON payload of one event
+#define EVENT_MAX_CLIENTS 4
+#define EVENT_CLIENT_BACKLOG 16         // Events a client may fall behind before it is resynced
+#define EVENT_KEEPALIVE_MS 15000
+#define EVENT_RETRY_MS 3000             // Browser reconnect delay
+
+enum EventType : uint8_t {
+  EVENT_PHOTO,                          // Photo committed to the card
+  EVENT_JOB,                            // Progress of a long-running job (upload, clear, ...)
+  EVENT_SD,                             // Card mounted, lost or formatted
+  EVENT_MEMORY,                         // Memory governor level change
+  EVENT_TYPE_COUNT
+};
+
+struct BroadcastEvent {
+  std::atomic<uint32_t> sequence;       // 0 while being written, ticket + 1 once complete
+  uint8_t type;
+  char data[EVENT_DATA_LEN];
+};
+
+struct EventBroadcasterStats {
+  uint32_t published;
+  uint32_t delivered;
+  uint32_t skipped;                     // Events a slow client never saw
+  uint32_t connects;
+  uint32_t rejected;                    // Clients turned away at EVENT_MAX_CLIENTS
+};
+
+// Server-Sent Events feed at /events. Producers on any task format a small JSON
+// payload straight into a lock-free ring and return; nothing is sent from their
+// context. Each connected browser is a long-lived chunked response whose filler
+// runs on the web server task (on ACKs and its ~500 ms poll), keeps its own read
+// position in the ring and answers RESPONSE_TRY_AGAIN when it is caught up. A
+// client's queue is therefore bounded by EVENT_CLIENT_BACKLOG: one that falls
+// further behind skips ahead and is told to resync.
+class EventBroadcaster {
+private:
+  BroadcastEvent* ring;
+  std::atomic<uint32_t> nextTicket;
+  std::atomic<uint8_t> clients;
+  EventBroadcasterStats stats;
+
+public:
+  EventBroadcaster();
+  bool begin();
+
+  // Any task; never blocks or allocates. Payload is a JSON object.
+  void publish(EventType type, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+  // Handler for /events; answers 503 when EVENT_MAX_CLIENTS are connected
+  void handleRequest(AsyncWebServerRequest* request);
+
+  uint8_t getClientCount() const { return clients.load(std::memory_order_relaxed); }
+  void writeStatusJson(Print& out);
+
+  static const char* typeName(EventType type);
+};
+
+extern EventBroadcaster eventBroadcaster;
+
+#endif
@@ -3,19 +3,11 @@
 
 #include <Arduino.h>
 
+// Pages are written straight into the response buffer (usually a RequestArena).
+// Static pages live in web/ and are served by WebAssets.
 class HTMLTemplates {
 public:
-  static String getConfigPage();
-  static String getResetPage(const String& ssid, const String& ip);
-  static String getCameraStatusPage(const String& ssid, const String& ip, const String& mac, 
-                                   int rssi, const String& uptime, 
-                                   bool cameraReady, const String& lastPhoto);
-  static String getConnectingPage(const String& ssid);
-  static String getResetConfirmPage();
-
-private:
-  static String getCameraStatusClass(bool ready);
-  static String getCameraStatusText(bool ready);
+  static void writeConnectingPage(Print& out, const char* ssid);
 };
 
-#endif 
\ No newline at end of file
+#endif
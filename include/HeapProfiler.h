@@ -0,0 +1,130 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// Optional allocation profiler. Build the "heapprof" PlatformIO environment, which
+// sets HEAP_PROFILER=1 and links with -Wl,--wrap=malloc,free,calloc,realloc, so every
+// malloc-family call (including operator new and String) passes through the hooks in
+// HeapProfiler.cpp. Allocations are tagged with the calling task and its active
+// context (the HTTP route being handled, or a HEAP_PROFILE_SCOPE name).
+//
+// The hooks and tables do not depend on Arduino or FreeRTOS, so a host build compiled
+// with the same define and linker flags can use getTotals() to assert on allocation
+// counts around a call; test/host/run.sh builds and runs heap_profiler_test that way.
+#ifndef HEAP_PROFILER
+#define HEAP_PROFILER 0
+#endif
+
+#define HEAP_PROFILER_MAX_TAGS 48
+#define HEAP_PROFILER_MAX_LIVE 4096       // Live allocations tracked (power of two)
+#define HEAP_PROFILER_MAX_CONTEXTS 8      // Tasks that can have a context at the same time
+#define HEAP_PROFILER_NAME_LEN 16
+
+// Per task + context figures
+struct HeapTagStats {
+  const void* task;
+  const char* context;                    // nullptr when the task had no active context
+  char taskName[HEAP_PROFILER_NAME_LEN];
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t bytes;                         // Total bytes ever requested
+  uint32_t liveBytes;
+  uint32_t peakLiveBytes;
+  uint32_t largest;
+};
+
+struct HeapProfilerTotals {
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t liveBytes;
+  uint32_t peakLiveBytes;
+  uint32_t liveBlocks;
+  uint32_t untracked;                     // Allocations that did not fit in the live table
+};
+
+enum HeapProfileSort {
+  HEAP_SORT_PEAK,
+  HEAP_SORT_BYTES,
+  HEAP_SORT_COUNT
+};
+
+class HeapProfiler {
+private:
+  struct LiveEntry {
+    uintptr_t ptr;        // 0 = empty slot
+    uint32_t size;
+    uint8_t tag;
+  };
+  struct ActiveContext {
+    const void* task;
+    const char* context;
+  };
+
+  // Tables are allocated by begin() so a normal build only pays for the pointers
+  LiveEntry* live;
+  HeapTagStats* tags;
+  HeapTagStats* report;
+  uint32_t liveCount;
+  uint8_t tagCount;
+  ActiveContext contexts[HEAP_PROFILER_MAX_CONTEXTS];
+  HeapProfilerTotals totals;
+
+public:
+  // Allocates the live table; allocations made before this are not tracked
+  bool begin();
+  bool isActive() const { return live != nullptr; }
+
+  // Called from the wrapped allocator
+  void recordAlloc(void* ptr, size_t size);
+  void recordFree(void* ptr);
+
+  // Context for the calling task; returns the previous one so scopes can nest
+  const char* enterContext(const char* context);
+  void leaveContext(const char* previous);
+
+  void reset();                            // Clears counters, keeps live tracking
+  HeapProfilerTotals getTotals();
+  uint32_t getTaskAllocs(const void* task);
+
+  // Copies the tags sorted by the given key; returns how many were written
+  uint8_t getTopTags(HeapTagStats* out, uint8_t max, HeapProfileSort sort);
+
+#ifdef ARDUINO
+  // Report for /heap-profile
+  void writeReportJson(Print& out, uint8_t top, HeapProfileSort sort);
+#endif
+
+private:
+  uint8_t findTag(const void* task, const char* context, const char* taskName);
+  const char* currentContext(const void* task) const;
+  static uint32_t slotFor(uintptr_t ptr);
+  bool insertLive(uintptr_t ptr, uint32_t size, uint8_t tag);
+  bool removeLive(uintptr_t ptr, uint32_t& size, uint8_t& tag);
+};
+
+extern HeapProfiler heapProfiler;
+
+// Marks allocations made by the calling task until the end of the enclosing scope
+class HeapProfileScope {
+private:
+  const char* previous;
+
+public:
+  explicit HeapProfileScope(const char* context) : previous(heapProfiler.enterContext(context)) {}
+  ~HeapProfileScope() { heapProfiler.leaveContext(previous); }
+};
+
+#if HEAP_PROFILER
+#define HEAP_PROFILE_CONCAT_(a, b) a##b
+#define HEAP_PROFILE_CONCAT(a, b) HEAP_PROFILE_CONCAT_(a, b)
+#define HEAP_PROFILE_SCOPE(context) HeapProfileScope HEAP_PROFILE_CONCAT(heapScope, __LINE__)(context)
+#else
+#define HEAP_PROFILE_SCOPE(context) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef JPEG_HUFFMAN_H
+#define JPEG_HUFFMAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JPEG_HUFF_SLOTS 8                   // DC0-3 then AC0-3
+#define JPEG_MAX_COMPONENTS 4
+
+enum JpegOptimizeResult {
+  JPEG_OPT_OK,
+  JPEG_OPT_NOT_SMALLER,                     // Already optimal, or out of room
+  JPEG_OPT_UNSUPPORTED,                     // Progressive, arithmetic, multi-scan, ...
+  JPEG_OPT_CORRUPT,
+  JPEG_OPT_NO_MEMORY
+};
+
+// Lossless re-encoding of baseline JPEGs with Huffman tables built for the image
+// (ITU T.81 Annex K.2, code lengths limited to 16 bits per K.3). The scan is
+// entropy-decoded twice: the first pass counts symbols, the second writes each
+// symbol with its new code and copies the extra bits unchanged, so the DCT
+// coefficients - and therefore the decoded pixels - are bit-identical. Restart
+// intervals are kept. Every segment other than DHT is copied through as-is.
+// Plain C++ with no Arduino dependencies, so it also builds on the host
+// (test/host/huffman_test.cpp).
+class JpegHuffman {
+public:
+  // in and out must not overlap. The result is JPEG_OPT_OK only when it is
+  // smaller than the input; *outLen then receives its length.
+  static JpegOptimizeResult optimize(const uint8_t* in, size_t len, uint8_t* out, size_t outSize,
+                                     size_t* outLen);
+
+  static const char* resultName(JpegOptimizeResult result);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef LATEST_FRAME_H
+#define LATEST_FRAME_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "PhotoWriter.h"
+
+// In-memory copies of the most recent JPEGs (PSRAM when fitted)
+#define FRAME_CACHE_SLOTS 3            // Latest, the one being replaced, one pinned by a slow reader
+#define FRAME_CACHE_SLOT_SIZE 65536    // QVGA JPEGs are ~5-20 KB; larger frames are simply not cached
+
+// (generation << 4) | slot, 0 = not cached
+typedef uint32_t FrameCacheHandle;
+
+struct FrameCacheStats {
+  uint32_t stored;
+  uint32_t skipped;      // Too large, disabled, or every slot pinned
+  uint32_t hits;
+  uint32_t misses;       // Handle no longer valid (slot recycled)
+};
+
+// Single writer (the capture task), any number of readers. A reader pins a slot
+// while it streams from it; the writer never reuses a pinned slot.
+class FrameCache {
+private:
+  struct Slot {
+    uint8_t* data;
+    uint32_t size;
+    std::atomic<uint32_t> generation;   // 0 while being written
+    std::atomic<uint32_t> refs;
+  };
+
+  Slot slots[FRAME_CACHE_SLOTS];
+  uint32_t nextGeneration;
+  uint8_t lastSlot;
+  std::atomic<bool> enabled;
+  FrameCacheStats stats;
+
+public:
+  FrameCache();
+  bool begin();
+
+  FrameCacheHandle store(const uint8_t* data, size_t len);
+  FrameCacheHandle store(const PhotoWritePart* parts, size_t count);   // Concatenated
+
+  // Pins the slot behind a handle; false when it has been recycled
+  bool pin(FrameCacheHandle handle, const uint8_t** data, size_t* len);
+  void unpin(FrameCacheHandle handle);
+
+  void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void writeStatusJson(Print& out) const;
+};
+
+// Where the latest frame can be read from
+enum FrameStorage : uint8_t {
+  FRAME_STORED_NONE = 0,
+  FRAME_STORED_SD = 1 << 0,
+  FRAME_STORED_CACHE = 1 << 1
+};
+
+// POD snapshot of the newest committed photo
+struct LatestFrameInfo {
+  uint32_t number;            // Photo number, 0 = none yet
+  uint32_t size;              // JPEG bytes (0 when unknown)
+  uint32_t capturedMs;        // millis() at capture
+  uint32_t unixTime;          // Wall-clock seconds, 0 until the clock is set
+  uint8_t storage;            // FrameStorage bits
+  FrameCacheHandle cache;
+  char path[PHOTO_PATH_LEN];  // Path on the card ("" when none)
+};
+
+// Double-buffered publication of LatestFrameInfo. The writer fills the inactive
+// buffer and flips the index with one atomic store; readers copy the active buffer
+// and retry only if a second publish started meanwhile, so they never block the
+// writer and never return a torn snapshot.
+// Single writer: the capture task and the clear/format handlers, all under sdMutex.
+class LatestFrame {
+private:
+  LatestFrameInfo buffers[2];
+  std::atomic<uint32_t> published;   // Index flip: buffers[published & 1] is current
+  std::atomic<uint32_t> begun;       // Publish in progress writes buffers[begun & 1]
+  mutable std::atomic<uint32_t> retries;   // Reads that overlapped two publishes
+
+public:
+  LatestFrame();
+
+  void publish(const LatestFrameInfo& info);
+  void publishStored(uint32_t number);   // Number/path only (e.g. after clearing photos)
+
+  LatestFrameInfo read() const;
+  uint32_t getNumber() const { return read().number; }
+  uint32_t getVersion() const { return published.load(std::memory_order_acquire); }
+  uint32_t getRetries() const { return retries.load(std::memory_order_relaxed); }
+};
+
+extern FrameCache frameCache;
+extern LatestFrame latestFrame;
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <atomic>
+
+// Graded pressure levels; each level keeps the responses of the ones below it
+enum MemoryPressure {
+  MEMORY_NORMAL,
+  MEMORY_ELEVATED,    // Shrink caches, pause background work
+  MEMORY_HIGH,        // Cap concurrent HTTP clients
+  MEMORY_CRITICAL,    // Lower the capture profile
+  MEMORY_EMERGENCY,   // Pause capture
+  MEMORY_LEVEL_COUNT
+};
+
+// Heap capabilities tracked separately (fragmentation matters more than total free)
+enum MemoryRegion {
+  MEMORY_REGION_INTERNAL,
+  MEMORY_REGION_DMA,
+  MEMORY_REGION_PSRAM,
+  MEMORY_REGION_COUNT
+};
+
+#define MEMORY_GOVERNOR_MAX_HANDLERS 8
+#define MEMORY_GOVERNOR_PERIOD_MS 1000
+
+struct MemoryRegionSample {
+  uint32_t freeBytes;
+  uint32_t largestBlock;
+  uint32_t minFree;     // Low-water mark since boot
+  uint32_t totalBytes;
+};
+
+// Entry thresholds: a region reaches level L+1 when free or largest block drops below [L].
+// Stepping back down requires recoveryPercent of headroom above the threshold.
+struct MemoryThresholds {
+  uint32_t freeBytes[MEMORY_REGION_COUNT][MEMORY_LEVEL_COUNT - 1];
+  uint32_t largestBlock[MEMORY_REGION_COUNT][MEMORY_LEVEL_COUNT - 1];
+  uint8_t recoveryPercent;
+  uint8_t maxClientsUnderPressure;
+};
+
+struct MemoryGovernorStats {
+  uint32_t transitions;
+  uint32_t entered[MEMORY_LEVEL_COUNT];
+  uint32_t rejectedRequests;
+  uint32_t skippedCaptures;
+  uint32_t lastTransitionMs;
+};
+
+// Called with true when the governor reaches the handler's level, false when it drops below
+typedef void (*MemoryReliefHandler)(bool active);
+
+class MemoryGovernor {
+private:
+  struct ReliefHandler {
+    const char* name;
+    MemoryPressure level;
+    MemoryReliefHandler handler;
+    bool active;
+  };
+
+  Preferences preferences;
+  MemoryThresholds thresholds;
+  MemoryGovernorStats stats;
+  MemoryRegionSample regions[MEMORY_REGION_COUNT];
+  ReliefHandler handlers[MEMORY_GOVERNOR_MAX_HANDLERS];
+  uint8_t handlerCount;
+  std::atomic<uint8_t> level;
+  std::atomic<bool> thresholdsChanged;      // Set by the HTTP task, consumed by update()
+  unsigned long lastUpdate;
+
+public:
+  MemoryGovernor();
+  void begin();
+
+  // Relief actions registered by the modules that own the memory
+  void addReliefHandler(const char* name, MemoryPressure atLevel, MemoryReliefHandler handler);
+
+  // Re-evaluates pressure at most once per period, or right away after the
+  // thresholds changed; call from loop() only (relief handlers run here)
+  MemoryPressure update(bool force = false);
+
+  MemoryPressure getLevel() const { return (MemoryPressure)level.load(std::memory_order_relaxed); }
+  bool isCapturePaused() const { return getLevel() >= MEMORY_EMERGENCY; }
+  bool allowCapture();                       // Counts refusals
+  bool admitRequest(uint32_t inFlight);      // HTTP client cap under pressure
+
+  // Tuning (persisted in Preferences); out-of-range values are rejected.
+  // The new thresholds take effect on the next update() in loop().
+  bool setThreshold(const String& region, const String& kind, const String& csvValues);
+  bool setRecoveryPercent(long percent);    // 0-100
+  bool setMaxClients(long clients);         // 1-255
+  void resetThresholds();
+
+  static const char* levelName(MemoryPressure pressure);
+  MemoryRegionSample getRegion(MemoryRegion region) const { return regions[region]; }
+  MemoryGovernorStats getStats() const { return stats; }
+  void writeStatusJson(Print& out) const;
+
+private:
+  void sample();
+  MemoryPressure classify(uint8_t headroomPercent) const;
+  void transition(MemoryPressure from, MemoryPressure to);
+  void loadThresholds();
+  void saveThresholds();
+  static void defaultThresholds(MemoryThresholds& out);
+};
+
+extern MemoryGovernor memoryGovernor;
+
+#endif
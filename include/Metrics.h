@@ -0,0 +1,145 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+
+// Registry capacity (all storage is static - registering never allocates)
+#define METRICS_MAX_COUNTERS 64
+#define METRICS_MAX_GAUGES 24
+#define METRICS_MAX_HISTOGRAMS 8
+#define METRICS_MAX_BUCKETS 12
+#define METRICS_MAX_COLLECTORS 8
+
+// Monotonic 64-bit counter built from 32-bit atomics (64-bit atomics are not
+// lock-free on the ESP32). Safe to update from any task without locking.
+class MetricCounter {
+private:
+  std::atomic<uint32_t> low;
+  std::atomic<uint32_t> high;
+
+public:
+  MetricCounter() : low(0), high(0) {}
+
+  void inc() { add(1); }
+
+  void add(uint32_t amount) {
+    uint32_t previous = low.fetch_add(amount, std::memory_order_relaxed);
+    if ((uint32_t)(previous + amount) < previous) {
+      high.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Mirror a counter maintained elsewhere (e.g. a module's stats struct)
+  void store(uint64_t value) {
+    high.store((uint32_t)(value >> 32), std::memory_order_relaxed);
+    low.store((uint32_t)value, std::memory_order_relaxed);
+  }
+
+  uint64_t value() const {
+    uint32_t hi, lo;
+    do {
+      hi = high.load(std::memory_order_relaxed);
+      lo = low.load(std::memory_order_relaxed);
+    } while (hi != high.load(std::memory_order_relaxed));
+    return ((uint64_t)hi << 32) | lo;
+  }
+};
+
+// Last-value gauge
+class MetricGauge {
+private:
+  std::atomic<int32_t> current;
+
+public:
+  MetricGauge() : current(0) {}
+  void set(int32_t value) { current.store(value, std::memory_order_relaxed); }
+  void add(int32_t delta) { current.fetch_add(delta, std::memory_order_relaxed); }
+  int32_t value() const { return current.load(std::memory_order_relaxed); }
+};
+
+// Fixed-bucket histogram with integer upper bounds (Prometheus "le" buckets)
+class MetricHistogram {
+private:
+  const uint32_t* bounds;
+  uint8_t bucketCount;
+  std::atomic<uint32_t> buckets[METRICS_MAX_BUCKETS + 1];   // Last bucket is +Inf
+  MetricCounter sum;
+
+public:
+  MetricHistogram() : bounds(nullptr), bucketCount(0) {
+    for (auto& bucket : buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void setBounds(const uint32_t* upperBounds, uint8_t count) {
+    bounds = upperBounds;
+    bucketCount = count > METRICS_MAX_BUCKETS ? METRICS_MAX_BUCKETS : count;
+  }
+
+  void observe(uint32_t value) {
+    uint8_t i = 0;
+    while (i < bucketCount && value > bounds[i]) {
+      i++;
+    }
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    sum.add(value);
+  }
+
+  uint8_t getBucketCount() const { return bucketCount; }
+  uint32_t getBound(uint8_t i) const { return bounds[i]; }
+  uint32_t getBucket(uint8_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+  uint64_t getSum() const { return sum.value(); }
+};
+
+// Callback that refreshes sampled gauges right before a scrape
+typedef void (*MetricsCollector)();
+
+class MetricsRegistry {
+private:
+  struct Entry {
+    const char* name;
+    const char* help;
+    const char* labels;   // Pre-rendered label set, e.g. route="/gallery"
+  };
+
+  MetricCounter counters[METRICS_MAX_COUNTERS];
+  MetricGauge gauges[METRICS_MAX_GAUGES];
+  MetricHistogram histograms[METRICS_MAX_HISTOGRAMS];
+  Entry counterEntries[METRICS_MAX_COUNTERS];
+  Entry gaugeEntries[METRICS_MAX_GAUGES];
+  Entry histogramEntries[METRICS_MAX_HISTOGRAMS];
+  MetricsCollector collectors[METRICS_MAX_COLLECTORS];
+  uint8_t counterCount;
+  uint8_t gaugeCount;
+  uint8_t histogramCount;
+  uint8_t collectorCount;
+  portMUX_TYPE registrationLock;
+
+  // Shared sinks so a full registry degrades to "not exported" instead of crashing
+  MetricCounter overflowCounter;
+  MetricGauge overflowGauge;
+  MetricHistogram overflowHistogram;
+
+public:
+  MetricsRegistry();
+
+  // Registration - returns a stable pointer; call once per metric, not per update
+  MetricCounter* counter(const char* name, const char* help, const char* labels = nullptr);
+  MetricGauge* gauge(const char* name, const char* help, const char* labels = nullptr);
+  MetricHistogram* histogram(const char* name, const char* help,
+                             const uint32_t* upperBounds, uint8_t boundCount);
+  void addCollector(MetricsCollector collector);
+
+  // Prometheus text exposition format (version 0.0.4)
+  void writePrometheus(Print& out);
+
+private:
+  void writeHeader(Print& out, const Entry& entry, const char* type, const Entry* previous);
+};
+
+extern MetricsRegistry metrics;
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef PHOTO_AGING_H
+#define PHOTO_AGING_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "PhotoIndex.h"
+#include "PhotoJob.h"
+
+#define AGING_STATE_FILE "/aging.cur"          // "<half through> <eighth through> <bytes reclaimed> <pending>"
+#define AGING_HALF_AFTER_HOURS 24              // Defaults; 0 turns a tier off
+#define AGING_EIGHTH_AFTER_HOURS (7 * 24)
+#define AGING_HALF_QUALITY 80                  // fmt2jpg quality (1-100)
+#define AGING_EIGHTH_QUALITY 70
+#define AGING_BUDGET_KBPS 64                   // Card reads plus writes, averaged
+#define AGING_MAX_SOURCE (512 * 1024)
+#define AGING_READ_CHUNK (32 * 1024)           // Read per sdMutex hold
+// fmt2jpg keeps its jpge encoder object (~13 KB of Huffman tables and output
+// buffer) on the caller's stack; jpg2rgb565, JpegHuffman (~0.6 KB), FATFS and
+// printf come on top. Check against the high-water mark logged after the first pass.
+#define AGING_TASK_STACK (20 * 1024)
+
+struct AgingConfig {
+  uint16_t halfAfterHours;
+  uint16_t eighthAfterHours;
+  uint16_t budgetKBps;
+};
+
+struct AgingStats {
+  uint32_t halved;
+  uint32_t eighthed;
+  uint32_t kept;                               // Re-encode was not smaller
+  uint32_t failed;                             // Unreadable, too large, or replaced meanwhile
+  uint32_t budgetWaits;
+};
+
+// Tiered aging: instead of keeping every photo at full resolution until it is
+// deleted, photos older than halfAfterHours are re-encoded at half width and
+// height, and those older than eighthAfterHours at 1/8 scale (the JPEG decoder
+// scales by powers of two for free, as for thumbnails). The capture metadata
+// segment is carried over and the result gets optimized Huffman tables.
+//
+// Runs as a PhotoJob like the optimizer. On top of that the card traffic is
+// held to budgetKBps by a token bucket and photos are read in AGING_READ_CHUNK
+// pieces, so a capture never waits long for sdMutex.
+// Photos age in number order because their timestamps never decrease along the
+// index; one cursor per tier is therefore all the state needed to restore the
+// tiers in the index after a reboot. A photo that could not be shrunk keeps
+// its file but is counted as aged.
+class PhotoAging {
+private:
+  Preferences preferences;
+  AgingConfig config;
+  AgingStats stats;
+  uint32_t halfThrough;                        // Highest photo number at half scale or below
+  uint32_t eighthThrough;                      // Highest photo number at 1/8 scale
+  PhotoJob job;
+  int64_t budgetBytes;                         // Token bucket; negative after a large photo
+  uint32_t budgetRefillMs;
+  bool startable;                              // Index built and PSRAM present
+
+public:
+  PhotoAging();
+
+  // After the card is mounted, before the index is built: finishes a replace
+  // cut short by a power loss
+  void begin(SemaphoreHandle_t sdMutexHandle);
+
+  // Once the index is built: marks the tiers reached so far and starts the task
+  // if aging is enabled (its stack is too large to spend while it is off)
+  bool start();
+
+  // Persists the setting; the first enable after boot starts the task
+  void setEnabled(bool on);
+  void setPaused(bool pause) { job.setPaused(pause); }
+  void setConfig(const AgingConfig& newConfig);
+  AgingConfig getConfig() const { return config; }
+
+  // After a format: start over from the first photo
+  void reset() { job.reset(); }
+
+  void writeStatusJson(Print& out);
+
+private:
+  bool createTask();
+  static void agingTask(void* parameter);
+  void run();
+  bool findNext(PhotoEntry& photo, uint8_t& tier, bool& wait);
+  uint32_t agedThrough(uint16_t hours, time_t now);
+  bool takeBudget(uint32_t& waitMs);
+  void age(const PhotoEntry& photo, uint8_t tier);
+  bool readPhoto(uint32_t number, uint8_t* buffer, size_t size, bool& busy);
+  void markAged(uint32_t number, uint8_t tier);
+};
+
+extern PhotoAging photoAging;
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef PHOTO_EXPORT_H
+#define PHOTO_EXPORT_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+
+#define EXPORT_MAX_ACTIVE 2              // Each export keeps two read-ahead streams busy
+#define EXPORT_NAME_LEN 32               // "photos/photo_000123.jpg" inside the archive
+#define TIMELAPSE_DEFAULT_FPS 10
+#define TIMELAPSE_MAX_FPS 60
+#define TIMELAPSE_PROBE_BYTES 1024       // Read from the first frame to find its size
+#define TIMELAPSE_INDEX_BATCH 32         // idx1 entries built per record
+
+// One photo of an export, copied from the index when the request arrives
+struct ExportEntry {
+  uint32_t number;
+  uint32_t size;
+  uint32_t timestamp;
+  union {
+    uint32_t crc;                        // ZIP: filled in as the data streams past
+    uint32_t offset;                     // Time-lapse: frame chunk offset from the 'movi' fourcc
+  };
+};
+
+struct PhotoExportStats {
+  uint32_t started;
+  uint32_t completed;
+  uint32_t aborted;                      // Client went away or a photo changed under us
+  uint32_t rejected;                     // Turned away at EXPORT_MAX_ACTIVE
+  uint64_t bytes;
+};
+
+// /export?from=&to=&format=tar|zip: a photo range as one download, built on the
+// fly. The range is resolved against the index up front, so the exact archive
+// length is known and sent as Content-Length. Headers, ZIP data descriptors and
+// the central directory are generated record by record into a fixed buffer, CRCs
+// are computed as the data passes, and photo data comes from sdReadAhead with the
+// next photo already being read while the current one drains. Only a 16-byte
+// entry per photo is held in memory, never file contents.
+//
+// /timelapse.avi?from=&to=&fps=&stride= sends the same kind of range as an MJPEG
+// AVI: every stride-th photo becomes one frame, stored as-is, and the AVI header
+// and idx1 index are computed from the index sizes. Byte ranges are served too, so
+// players can seek: the frame holding the first byte is found by binary search
+// over the frame offsets, and reading starts inside it.
+class PhotoExport {
+private:
+  std::atomic<uint8_t> active;
+  PhotoExportStats stats;
+
+public:
+  PhotoExport();
+
+  void handleRequest(AsyncWebServerRequest* request);
+  void handleTimelapse(AsyncWebServerRequest* request);
+
+  // Called by the export response when it is destroyed
+  void finished(bool complete, uint64_t bytes);
+
+  void writeStatusJson(Print& out);
+
+private:
+  // Resolves from/to, claims an export slot and copies every stride-th photo of
+  // the range. On failure it has answered the request and returns nullptr.
+  ExportEntry* beginExport(AsyncWebServerRequest* request, uint32_t stride, uint32_t maxEntries, uint32_t& count);
+  void cancelExport(ExportEntry* entries);
+  static void readFrameSize(uint32_t number, uint16_t& width, uint16_t& height);
+};
+
+extern PhotoExport photoExport;
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PHOTO_HTTP_H
+#define PHOTO_HTTP_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "LatestFrame.h"
+
+// Cache-Control values for photo responses
+#define PHOTO_CACHE_IMMUTABLE "public, max-age=31536000, immutable"   // Numbered photos and thumbnails
+#define PHOTO_CACHE_REVALIDATE "no-cache"                             // /latest: keep it, but ask every time
+#define PHOTO_CACHE_NONE "no-store"                                  // Stand-ins that must not be kept
+#define PHOTO_ETAG_LEN 32
+
+enum HttpRangeResult {
+  HTTP_RANGE_NONE,            // No usable Range header: send the whole body
+  HTTP_RANGE_PARTIAL,         // Send [start, start + length) as 206
+  HTTP_RANGE_UNSATISFIABLE    // Answer 416
+};
+
+// HTTP caching for photo responses. A numbered photo never changes once written, so
+// its strong ETag is just its number and size ("p123-45678", thumbnails "t...") and
+// can be checked against If-None-Match from the in-memory index without touching
+// the card. Numbers can come back after a clear or format, so pages link photos
+// with ?v=<size> to keep immutable browser copies from outliving their file.
+class PhotoHttp {
+public:
+  static void formatETag(char* out, size_t size, char kind, uint32_t number, uint32_t bytes);
+  static void formatHttpDate(char* out, size_t size, uint32_t unixTime);
+
+  // Link to a numbered photo that is safe to cache forever
+  static void formatPhotoUrl(char* out, size_t size, uint32_t number, uint32_t bytes);
+
+  // Answers 304 when If-None-Match already names this version; true when it did
+  static bool sendNotModified(AsyncWebServerRequest* request, const char* etag, const char* cacheControl);
+
+  // Card-backed response with validators and byte ranges (etag may be nullptr for
+  // unnumbered files, contentType "" picks one from the extension)
+  static void sendFile(AsyncWebServerRequest* request, const char* path, const char* contentType,
+                       const char* etag, uint32_t unixTime, const char* cacheControl);
+
+  // Response served from a pinned frame-cache slot, ranges included; false when the
+  // slot was recycled
+  static bool sendCached(AsyncWebServerRequest* request, FrameCacheHandle handle, const char* contentType,
+                         const char* etag, uint32_t unixTime, const char* cacheControl);
+
+  // Number of a /photos/photo_000123.jpg path, 0 when it is not one
+  static uint32_t parsePhotoPath(const char* path);
+
+  // Single byte range from Range (multi-range requests get the whole body). A
+  // stale If-Range validator also means the whole body.
+  static HttpRangeResult parseRange(AsyncWebServerRequest* request, uint32_t size, const char* etag,
+                                    uint32_t& start, uint32_t& length);
+  static void sendRangeNotSatisfiable(AsyncWebServerRequest* request, uint32_t size);
+
+  static const char* contentTypeFor(const char* path);
+
+private:
+  static void addValidators(AsyncWebServerResponse* response, const char* etag, uint32_t unixTime,
+                            const char* cacheControl);
+};
+
+// Hands every GET under a URL prefix to one handler. Replaces serveStatic() for
+// /photos/ so photo responses get validators and the route keeps its metrics.
+class PrefixRequestHandler : public AsyncWebHandler {
+private:
+  const char* prefix;
+  ArRequestHandlerFunction handler;
+
+public:
+  PrefixRequestHandler(const char* urlPrefix, ArRequestHandlerFunction onRequest)
+    : prefix(urlPrefix), handler(onRequest) {}
+
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override { handler(request); }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef PHOTO_INDEX_H
+#define PHOTO_INDEX_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define PHOTO_INDEX_CAPACITY 16384       // 16 bytes each, PSRAM when fitted
+#define PHOTO_INDEX_BATCH 8              // Entries copied per lock by the list response
+#define PHOTO_LIST_DEFAULT_LIMIT 100
+#define PHOTO_LIST_MAX_LIMIT 500
+#define PHOTO_TIME_VALID 1600000000UL    // Earlier timestamps mean the clock was never set
+#define PHOTO_FATFS_DRIVE "0:"           // FatFs drive of the card (its only FAT volume)
+
+// PhotoEntry.flags
+#define PHOTO_FLAG_TIME_ESTIMATED 0x01   // No wall-clock time; copied from the previous photo
+#define PHOTO_FLAG_THUMB 0x02            // Thumbnail is cached on the card
+#define PHOTO_FLAG_OPTIMIZED 0x04        // Huffman tables re-optimized in the background
+#define PHOTO_TIER_SHIFT 4               // Bits 4-5: aging tier (PhotoTier)
+#define PHOTO_TIER_MASK 0x30
+
+// Resolution a photo has been aged down to by PhotoAging
+enum PhotoTier {
+  PHOTO_TIER_FULL = 0,
+  PHOTO_TIER_HALF = 1,                   // Half width and height
+  PHOTO_TIER_EIGHTH = 2                  // 1/8 scale, thumbnail-sized
+};
+
+struct PhotoEntry {
+  uint32_t number;
+  uint32_t size;
+  uint32_t timestamp;                    // Unix seconds, never decreasing along the index
+  uint32_t flags;
+};
+
+inline uint8_t photoTier(const PhotoEntry& photo) {
+  return (photo.flags & PHOTO_TIER_MASK) >> PHOTO_TIER_SHIFT;
+}
+
+// Parameters of one /api/photos call
+struct PhotoListQuery {
+  uint32_t cursor;                       // Last number of the previous page, 0 = start
+  uint32_t limit;
+  uint32_t from;                         // Inclusive timestamp bounds, 0 = open
+  uint32_t to;
+  bool ascending;
+};
+
+// In-memory list of the photos on the card, sorted by number. Built once at boot
+// from a directory scan and then kept current by the capture task and the clear
+// and format routes, so listing and time-range queries never touch the card.
+// Timestamps are clamped to be non-decreasing, which keeps both the number and
+// time orderings binary-searchable over the same array.
+class PhotoIndex {
+private:
+  PhotoEntry* entries;
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t dropped;                      // Photos that did not fit
+  SemaphoreHandle_t mutex;
+
+public:
+  PhotoIndex();
+  bool begin(uint32_t maxEntries = PHOTO_INDEX_CAPACITY);
+
+  // Scans the card (mounted) and replaces the index; returns the photo count
+  uint32_t rebuild();
+
+  // Capture task, after a photo was committed
+  void append(uint32_t number, uint32_t size, uint32_t unixTime);
+  void setFlags(uint32_t number, uint32_t flags);
+
+  // Background jobs, after a photo's file was replaced: new size, flags added
+  void setSize(uint32_t number, uint32_t size, uint32_t flags);
+
+  // Aging job, after a photo was downsampled: new size and tier. The file is a
+  // fresh encode, so PHOTO_FLAG_OPTIMIZED is replaced by optimized.
+  void setTier(uint32_t number, uint32_t size, uint8_t tier, bool optimized);
+
+  // After rebuild(): tiers recorded by the aging job's cursors (photos up to
+  // halfThrough are at least half scale, up to eighthThrough 1/8 scale)
+  void applyTiers(uint32_t halfThrough, uint32_t eighthThrough);
+
+  // Clear and format routes
+  uint32_t removeBatch(uint32_t* numbers, uint32_t n);   // Sorts numbers in place
+  void clear();
+
+  uint32_t getCount();
+  uint32_t getLastNumber();
+  bool find(uint32_t number, PhotoEntry& out);
+
+  // Copies up to max entries, newest first, after skipping the newest skip entries
+  uint32_t copyNewest(uint32_t skip, PhotoEntry* out, uint32_t max);
+
+  // Copies up to max entries with numbers in [minNumber, maxNumber] that come after
+  // cursor in the requested direction (cursor 0 = from the start)
+  uint32_t copyPage(uint32_t cursor, bool ascending, uint32_t minNumber, uint32_t maxNumber,
+                    PhotoEntry* out, uint32_t max);
+
+  // Number bounds of the photos taken in [from, to] (0 = open); returns how many
+  uint32_t resolveTimeRange(uint32_t from, uint32_t to, uint32_t& minNumber, uint32_t& maxNumber);
+
+  // Streams the /api/photos JSON for one query
+  AsyncWebServerResponse* beginListResponse(AsyncWebServerRequest* request, const PhotoListQuery& query);
+
+  void writeStatusJson(Print& out);
+
+private:
+  uint32_t lowerBoundNumber(uint32_t number) const;
+  uint32_t lowerBoundTime(uint32_t timestamp) const;
+  uint32_t upperBoundTime(uint32_t timestamp) const;
+  void scanThumbnails();
+  static bool parseNumber(const char* name, const char* prefix, uint32_t& number);
+};
+
+extern PhotoIndex photoIndex;
+
+#endif
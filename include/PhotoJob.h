@@ -0,0 +1,95 @@
+#ifndef PHOTO_JOB_H
+#define PHOTO_JOB_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "PhotoWriter.h"
+
+#define PHOTO_JOB_SD_LOCK_MS 50                // Per card step, so a capture never waits long
+#define PHOTO_JOB_IDLE_POLL_MS 1000            // Between checks while busy or caught up
+#define PHOTO_JOB_MAX_CURSORS 2
+#define PHOTO_JOB_STATE_LEN 64
+
+// Scaffolding shared by the idle-time jobs that rewrite photos in place
+// (PhotoOptimizer, PhotoAging). The job runs on its own task at idle priority,
+// touches a photo only while no HTTP response is in flight and once the
+// uploader has sent it, and takes sdMutex for one file operation at a time.
+// Files are swapped with PhotoWriter::replacePhoto(); the old one stays as .bak
+// until no response that may have opened it is left, so its number is part of
+// the job state. That state - the job's cursors (photo numbers), the bytes
+// reclaimed and the pending .bak - is one line of text in a small file on the
+// card, so the work done survives reboots and starts over after a format.
+class PhotoJob {
+private:
+  const char* name;                            // Task name
+  const char* stateFile;                       // "<cursors...> <bytes reclaimed> <pending>"
+  uint32_t* cursors[PHOTO_JOB_MAX_CURSORS];    // Owned by the job
+  uint8_t cursorCount;
+  uint32_t stackSize;
+  SemaphoreHandle_t sdMutex;
+  TaskHandle_t taskHandle;
+  std::atomic<bool> enabled;
+  std::atomic<bool> paused;                    // Memory pressure, not persisted
+  std::atomic<bool> resetRequested;
+  bool stackLogged;
+  uint32_t pending;                            // Replaced, .bak not yet removed
+  uint32_t deferred;                           // Waited for requests, uploads or the card
+  uint64_t bytesReclaimed;                     // Since the card was formatted
+  uint32_t lastMs;
+  uint32_t maxMs;
+
+public:
+  PhotoJob(const char* taskName, const char* stateFileName, uint32_t taskStack, uint32_t* cursor,
+           uint32_t* secondCursor = nullptr);
+
+  // After the card is mounted, before the index is built: loads the state and
+  // finishes a replace cut short by a power loss
+  void begin(SemaphoreHandle_t sdMutexHandle, bool on);
+
+  // Idle priority on core 1: runs only when nothing else there (capture) wants the CPU
+  bool startTask(TaskFunction_t task, void* owner);
+  bool isRunning() const { return taskHandle != NULL; }
+
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+  void setPaused(bool pause) { paused.store(pause, std::memory_order_relaxed); }
+  void reset() { resetRequested.store(true, std::memory_order_relaxed); }
+
+  // Job task, top of each pass: applies a reset, removes a .bak nothing reads any
+  // more, and says whether the job may look for a photo
+  bool ready();
+  void sleep() { vTaskDelay(pdMS_TO_TICKS(PHOTO_JOB_IDLE_POLL_MS)); }
+  bool idle() const;
+
+  // The uploader streams a photo across several lock holds
+  bool uploaded(uint32_t number) const;
+
+  bool lockCard(TickType_t wait = pdMS_TO_TICKS(PHOTO_JOB_SD_LOCK_MS));
+  void unlockCard() { xSemaphoreGive(sdMutex); }
+
+  // Caller holds sdMutex. Records the photo as pending around the swap, so a
+  // power loss in between is rolled forward or back by begin().
+  bool replace(uint32_t number, const PhotoWritePart* parts, size_t count, uint32_t expectedSize);
+  void saveState();                            // Caller holds sdMutex
+  void saveProgress();                         // Takes sdMutex if it can; retried with the next save
+
+  void defer() { deferred++; }
+  void replaced(uint32_t bytesSaved, uint32_t startMs);
+
+  // After the first photo, which has seen the deepest stack
+  void logStack();
+
+  uint64_t getBytesReclaimed() const { return bytesReclaimed; }
+
+  // The common fields before and after the job's own in its status JSON
+  void writeStatusHead(Print& out);
+  void writeStatusTail(Print& out);
+
+private:
+  void loadState();                            // Caller holds sdMutex
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PHOTO_METADATA_H
+#define PHOTO_METADATA_H
+
+#include <Arduino.h>
+
+#define PHOTO_META_MARKER 0xEB                 // APP11
+#define PHOTO_META_ID "ESPCAM"                 // Followed by a NUL, then the JSON payload
+#define PHOTO_META_ID_LEN 7
+#define PHOTO_META_MAX 256                     // Whole segment, marker included
+#define PHOTO_META_PROBE 512                   // Bytes read from a photo to find the segment
+#define PHOTO_META_BUILD __DATE__ " " __TIME__
+
+// Capture settings recorded with each photo
+struct PhotoMetadata {
+  uint32_t number;
+  uint32_t unixTime;                           // 0 until the clock is set
+  uint32_t uptimeMs;
+  uint16_t exposure;                           // sensor_t aec_value
+  uint8_t gain;                                // sensor_t agc_gain
+  uint8_t aec;                                 // Auto exposure on
+  uint8_t aec2;                                // AEC DSP on
+  int8_t aeLevel;
+  uint8_t agc;                                 // Auto gain on
+  uint8_t quality;                             // JPEG quality (lower is better)
+  uint8_t framesize;
+  int8_t rssi;                                 // 0 when not connected as a station
+};
+
+// A small APP11 segment inserted after SOI (after APP0 when the frame has a JFIF
+// header) with the capture settings as JSON. Decoders skip unknown APPn
+// segments, so the image data is untouched and nothing is re-encoded; the
+// segment is written ahead of the frame buffer in one gathered write.
+class PhotoMetadataFormat {
+public:
+  // Current sensor settings and link quality for a photo about to be written
+  static void capture(PhotoMetadata& meta, uint32_t number, uint32_t unixTime);
+
+  // Builds the segment; returns its length (0 if it does not fit)
+  static size_t buildSegment(uint8_t* out, size_t size, const PhotoMetadata& meta);
+
+  // Where the segment goes in a frame: 0 when the buffer is not a JPEG
+  static size_t insertionOffset(const uint8_t* jpeg, size_t len);
+
+  // Finds the whole segment (marker included) in a JPEG; returns its length, 0 if none
+  static size_t findSegment(const uint8_t* jpeg, size_t len, size_t& offset);
+
+  // Copies the JSON payload of the segment found in the first bytes of a photo
+  static bool parse(const uint8_t* head, size_t len, char* json, size_t size);
+
+  // Reads the payload from a stored photo (caller holds sdMutex)
+  static bool readFromFile(uint32_t number, char* json, size_t size);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef PHOTO_OPTIMIZER_H
+#define PHOTO_OPTIMIZER_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "PhotoIndex.h"
+#include "PhotoJob.h"
+
+#define OPTIMIZER_STATE_FILE "/optimize.cur"   // "<done> <bytes reclaimed> <pending>"
+#define OPTIMIZER_MIN_AGE_S 600                // Recent photos are still being viewed
+#define OPTIMIZER_SKIP_NEWEST 10               // Same, for photos without a real timestamp
+#define OPTIMIZER_MAX_SOURCE (512 * 1024)
+// JpegHuffman keeps its tables on the heap and needs ~0.6 KB of stack; the rest
+// is FATFS and printf. Check against the high-water mark logged after the first pass.
+#define OPTIMIZER_TASK_STACK 6144
+
+struct OptimizerStats {
+  uint32_t optimized;
+  uint32_t unchanged;                          // Already optimal, or not baseline
+  uint32_t failed;                             // Read, write or replace failed
+};
+
+// Idle-time job (PhotoJob) that rewrites older photos with Huffman tables built
+// for each image (JpegHuffman). The camera encodes with the generic Annex K
+// tables; the rewritten file decodes to identical pixels and is typically a few
+// percent smaller. Photos are visited in number order, so one cursor is all the
+// progress there is to keep.
+class PhotoOptimizer {
+private:
+  Preferences preferences;
+  OptimizerStats stats;
+  uint32_t done;                               // Highest photo number visited
+  PhotoJob job;
+
+public:
+  PhotoOptimizer();
+
+  // After the card is mounted, before the index is built: finishes a replace
+  // cut short by a power loss
+  void begin(SemaphoreHandle_t sdMutexHandle);
+
+  // Once the index is built
+  bool start();
+
+  void setEnabled(bool on);
+  void setPaused(bool pause) { job.setPaused(pause); }
+
+  // After a format: start over from the first photo
+  void reset() { job.reset(); }
+
+  void writeStatusJson(Print& out);
+
+private:
+  static void optimizerTask(void* parameter);
+  void run();
+  bool findNext(PhotoEntry& photo, bool& wait);
+  void optimize(const PhotoEntry& photo);
+  bool readPhoto(uint32_t number, uint8_t* buffer, size_t size);   // Releases sdMutex
+};
+
+extern PhotoOptimizer photoOptimizer;
+
+#endif
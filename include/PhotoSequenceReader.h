@@ -0,0 +1,42 @@
+#ifndef PHOTO_SEQUENCE_READER_H
+#define PHOTO_SEQUENCE_READER_H
+
+#include <Arduino.h>
+#include "SdReadAhead.h"
+
+// Reads photos back to back for responses that concatenate many of them (archive
+// and time-lapse exports). Each photo goes through sdReadAhead, and the next one
+// is opened as soon as the current one starts, so its first chunk is already in
+// RAM when the current photo runs out. A photo whose size no longer matches the
+// index fails to open: the caller has already committed to a Content-Length.
+class PhotoSequenceReader {
+private:
+  int fd;                    // Direct-read fallback when no read-ahead stream was free
+  ReadAheadStream* stream;
+  int nextFd;
+  ReadAheadStream* nextStream;
+  uint32_t nextNumber;       // 0 = nothing opened ahead
+  uint32_t remaining;
+
+public:
+  PhotoSequenceReader();
+  ~PhotoSequenceReader();
+
+  // Starts photo number (expected size bytes) at byte offset, and opens nextNumber
+  // ahead (0 = last)
+  bool begin(uint32_t number, uint32_t size, uint32_t nextNumber, uint32_t nextSize, uint32_t offset = 0);
+
+  // Web server side: RESPONSE_TRY_AGAIN when the card is behind, 0 on a read error
+  size_t read(uint8_t* out, size_t maxLen);
+
+  uint32_t getRemaining() const { return remaining; }
+
+  // Closes the current photo; close(true) also drops the one opened ahead
+  void close(bool all = false);
+
+private:
+  static bool openPhoto(uint32_t number, uint32_t size, uint32_t offset, int& outFd, ReadAheadStream*& outStream);
+  static void closePhoto(int& photoFd, ReadAheadStream*& photoStream);
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef PHOTO_UPLOADER_H
+#define PHOTO_UPLOADER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Uploader settings
+#define UPLOADER_CURSOR_FILE "/outbox.cur"   // Last photo number acknowledged by the collector
+#define UPLOADER_CHUNK_SIZE 4096             // Bytes read from SD per HTTP chunk
+#define UPLOADER_DEFAULT_BATCH 8             // Photos per keep-alive connection
+#define UPLOADER_MAX_BATCH 32
+#define UPLOADER_SD_LOCK_MS 50               // Never hold the SD mutex long enough to stall capture
+#define UPLOADER_TIMEOUT_MS 5000
+#define UPLOADER_RETRY_MAX_MS 60000
+#define UPLOADER_TASK_STACK 6144
+#define UPLOADER_NO_REWIND UINT32_MAX
+#define UPLOADER_HOST_LEN 64
+#define UPLOADER_PATH_LEN 96
+
+// Collector endpoint, persisted in Preferences. Fixed buffers: the web server
+// task changes it while the uploader task works from a copy.
+struct UploaderConfig {
+  bool enabled;
+  char host[UPLOADER_HOST_LEN];
+  uint16_t port;
+  char path[UPLOADER_PATH_LEN];
+  uint8_t batchSize;
+
+  UploaderConfig() : enabled(false), port(80), batchSize(UPLOADER_DEFAULT_BATCH) {
+    host[0] = '\0';
+    strcpy(path, "/");
+  }
+};
+
+// Throughput and backlog metrics
+struct UploaderStats {
+  uint32_t photosUploaded;
+  uint64_t bytesUploaded;
+  uint32_t batches;
+  uint32_t connections;
+  uint32_t failedPosts;
+  uint32_t skippedMissing;   // Photos deleted before they could be uploaded
+  uint32_t lastBatchMs;
+  uint32_t lastBatchBytes;
+  uint32_t retryDelayMs;
+};
+
+class PhotoUploader {
+private:
+  Preferences preferences;
+  UploaderConfig config;                   // Guarded by configLock
+  mutable portMUX_TYPE configLock;
+  UploaderStats stats;
+  SemaphoreHandle_t sdMutex;
+  TaskHandle_t taskHandle;
+  std::atomic<uint32_t> latestCommitted;   // Written by the capture task
+  std::atomic<uint32_t> cursor;            // Last photo number the collector acknowledged
+  std::atomic<uint32_t> rewindTo;          // Cursor reset asked for by the capture task
+  std::atomic<bool> paused;                // Temporary hold (memory pressure), not persisted
+  uint8_t* chunkBuffer;
+  uint8_t consecutiveFailures;
+
+public:
+  PhotoUploader();
+  bool begin(SemaphoreHandle_t sdMutexHandle);
+
+  // Called from the capture task - never blocks
+  void notifyCommitted(uint32_t photoNumber);
+
+  bool setCollectorUrl(const String& url);
+  void setBatchSize(long batchSize);
+  void setEnabled(bool enabled);
+  void setPaused(bool pause);
+
+  uint32_t getBacklog() const;
+  bool isEnabled() const { return getConfig().enabled; }
+  UploaderConfig getConfig() const;
+  uint32_t getCursor() const { return cursor.load(); }
+  UploaderStats getStats() const;
+  void writeStatusJson(Print& out) const;
+
+private:
+  static void uploaderTask(void* parameter);
+  void run();
+  bool networkAvailable() const;
+  void applyRewind();
+  bool uploadBatch(const UploaderConfig& target);
+  bool postPhoto(WiFiClient& client, const UploaderConfig& target, uint32_t photoNumber, bool& keepAlive,
+                 bool& missing);
+  bool readResponse(WiFiClient& client, bool& keepAlive);
+  bool readLine(WiFiClient& client, String& line);
+  bool writeAll(WiFiClient& client, const uint8_t* data, size_t len);
+  bool loadCursor();
+  bool saveCursor();
+  void loadConfig();
+  void saveConfig(const UploaderConfig& saved);
+};
+
+extern PhotoUploader photoUploader;
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PHOTO_WRITER_H
+#define PHOTO_WRITER_H
+
+#include <Arduino.h>
+
+#define PHOTO_PATH_LEN 40              // "/photos/photo_000123.jpg" plus room for the mount point
+#define PHOTO_STAGING_SIZE 8192        // DMA-capable bounce buffer, a whole number of sectors
+#define PHOTO_MOUNT_POINT "/sdcard"    // SD_MMC default mount point
+
+// One piece of a gathered write
+struct PhotoWritePart {
+  const uint8_t* data;
+  size_t len;
+};
+
+// Writes complete photo files with no heap traffic: the path is built in a fixed
+// buffer, the file goes through POSIX open/write/close instead of a File object,
+// and PSRAM frames are copied through one staging buffer allocated at begin() so
+// the SDMMC driver never has to allocate its own per-sector bounce buffer. Frames
+// in internal RAM are written in place, sector by sector; only their unaligned
+// edges go through the staging buffer.
+// Not thread-safe - callers hold sdMutex.
+class PhotoWriter {
+private:
+  uint8_t* staging;
+  size_t stagingSize;
+  char vfsPath[PHOTO_PATH_LEN + 16];
+  uint64_t directBytes;                // Written straight from the caller's buffers
+
+public:
+  PhotoWriter();
+  bool begin(size_t stagingBytes = PHOTO_STAGING_SIZE);
+
+  // path is relative to the card root (e.g. /photos/photo_000001.jpg).
+  // Returns bytes written, or -1 when the file could not be created.
+  int write(const char* path, const uint8_t* data, size_t len);
+
+  // Same, with the file content gathered from several buffers in order (a header
+  // segment plus the untouched frame). DMA-capable parts are written in place
+  // from the first sector boundary on; the rest is packed into the staging
+  // buffer back to back, so the card still sees whole-sector writes.
+  int writeParts(const char* path, const PhotoWritePart* parts, size_t count);
+
+  uint64_t getDirectBytes() const { return directBytes; }
+
+  // Numbered photo path into a caller-owned buffer (PHOTO_PATH_LEN bytes)
+  static void formatPhotoPath(char* out, size_t size, unsigned long number);
+
+  // Replaces a stored photo by background jobs without ever leaving it missing:
+  // the new content goes to photo_N.tmp (with the old modification time, which
+  // the index reads as the capture time), then photo_N.jpg becomes photo_N.bak
+  // and the .tmp takes its name. Changes nothing when the current file is not
+  // expectedSize bytes (deleted or renumbered meanwhile). The .bak is left for
+  // removeBackup() once no reader can still have the old file open.
+  bool replacePhoto(uint32_t number, const uint8_t* data, size_t len, uint32_t expectedSize);
+  bool replacePhoto(uint32_t number, const PhotoWritePart* parts, size_t count, uint32_t expectedSize);
+  static bool removeBackup(uint32_t number);
+
+  // Rolls an interrupted replacePhoto() forward or back, e.g. after a power loss
+  static void recoverReplace(uint32_t number);
+
+private:
+  bool stage(int fd, const uint8_t* source, size_t len, size_t& staged, size_t& written);
+  bool flushStaging(int fd, size_t& staged, size_t& written);
+};
+
+extern PhotoWriter photoWriter;
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "freertos/FreeRTOS.h"
+
+// Per-request scratch memory (PSRAM when fitted)
+#define REQUEST_ARENA_SLOTS 4
+#define REQUEST_ARENA_SIZE 16384
+#define REQUEST_PRINTF_STACK 192   // printfTo() text formatted without the heap
+
+// Bump allocator for one request. Response text grows up from the bottom through
+// Print, scratch allocations come down from the top, and nothing is freed until
+// the whole arena is handed back after the response has been sent.
+class RequestArena : public Print {
+  friend class RequestArenaPool;
+
+private:
+  uint8_t* base;
+  size_t capacity;
+  size_t textLength;
+  size_t scratchTop;         // Scratch region is [scratchTop, capacity)
+  bool overflowed;
+  AsyncWebServerRequest* owner;
+
+public:
+  RequestArena();
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* data, size_t len) override;
+  using Print::write;
+
+  // printf straight into the response text (no temporary String)
+  size_t appendf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  // Scratch memory that lives until the arena is released
+  void* alloc(size_t size);
+  const char* formatf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  const char* text() const { return (const char*)base; }
+  size_t length() const { return textLength; }
+  size_t used() const { return textLength + (capacity - scratchTop); }
+  bool hasOverflowed() const { return overflowed; }
+
+private:
+  void reset();
+};
+
+struct RequestArenaStats {
+  uint32_t acquired;
+  uint32_t exhausted;     // Requests that found every arena busy
+  uint32_t overflowed;    // Responses that did not fit
+  uint32_t peakBytes;     // Largest text + scratch seen in one request
+  uint8_t inUse;
+};
+
+class RequestArenaPool {
+private:
+  RequestArena arenas[REQUEST_ARENA_SLOTS];
+  uint8_t* memory;
+  RequestArenaStats stats;
+  portMUX_TYPE lock;
+
+public:
+  RequestArenaPool();
+  bool begin();
+
+  // Returns nullptr when every arena is busy (the caller should answer 503)
+  RequestArena* acquire(AsyncWebServerRequest* request);
+
+  // Called by the request profiler when the connection finishes
+  void releaseFor(AsyncWebServerRequest* request);
+
+  // Sends the arena text without copying it; the arena stays owned until disconnect
+  void send(AsyncWebServerRequest* request, RequestArena* arena, int code, const char* contentType);
+
+  // acquire() failure response shared by every arena-backed handler
+  static void sendBusy(AsyncWebServerRequest* request);
+
+  RequestArenaStats getStats();
+  void writeStatusJson(Print& out);
+};
+
+extern RequestArenaPool requestArenas;
+
+// For writers that take any Print (status JSON, page fragments): Print::printf
+// mallocs once the text passes 64 bytes, this formats on the stack first
+size_t printfTo(Print& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Quoted and escaped JSON string
+void printJsonString(Print& out, const char* text);
+
+#endif
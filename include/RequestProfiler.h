@@ -0,0 +1,73 @@
+#ifndef REQUEST_PROFILER_H
+#define REQUEST_PROFILER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "freertos/FreeRTOS.h"
+#include "Metrics.h"
+
+// Profiler capacity
+#define PROFILER_MAX_ROUTES 40
+#define PROFILER_SLOW_LOG_SIZE 16
+#define PROFILER_PARAMS_LEN 96
+#define PROFILER_DEFAULT_SLOW_MS 250
+
+// Latency histograms for one registered route
+struct RouteTiming {
+  const char* route;
+  MetricHistogram ttfb;       // Handler entry until the response was handed to the server
+  MetricHistogram total;      // Handler entry until the connection finished sending
+  MetricCounter requests;
+  std::atomic<uint32_t> inFlight;
+  std::atomic<uint32_t> maxTotalMs;
+};
+
+// One entry of the slow-request ring
+struct SlowRequest {
+  const char* route;
+  char method[8];
+  char params[PROFILER_PARAMS_LEN];
+  uint32_t ttfbMs;
+  uint32_t totalMs;
+  uint32_t finishedAt;   // millis() when the request completed
+  uint32_t freeHeap;
+};
+
+class RequestProfiler {
+private:
+  RouteTiming routes[PROFILER_MAX_ROUTES];
+  uint8_t routeCount;
+  SlowRequest slowLog[PROFILER_SLOW_LOG_SIZE];
+  uint8_t slowHead;
+  uint8_t slowCount;
+  uint32_t slowThresholdMs;
+  uint32_t slowTotal;
+  std::atomic<uint32_t> inFlightTotal;   // Requests whose response is still being sent
+  portMUX_TYPE lock;
+
+public:
+  RequestProfiler();
+
+  // Wraps a handler so every call is timed; call once per route at registration
+  ArRequestHandlerFunction wrap(const char* route, ArRequestHandlerFunction handler);
+
+  uint32_t getInFlight() const { return inFlightTotal.load(std::memory_order_relaxed); }
+
+  void setSlowThreshold(uint32_t thresholdMs);
+  uint32_t getSlowThreshold() const;
+
+  String getRoutesJson();
+  String getSlowRequestsJson();
+
+private:
+  RouteTiming* registerRoute(const char* route);
+  void finish(RouteTiming* timing, AsyncWebServerRequest* request,
+              uint32_t startUs, uint32_t ttfbUs);
+  void recordSlow(RouteTiming* timing, AsyncWebServerRequest* request,
+                  uint32_t ttfbMs, uint32_t totalMs);
+  static void appendHistogramJson(String& json, const MetricHistogram& histogram);
+};
+
+extern RequestProfiler requestProfiler;
+
+#endif
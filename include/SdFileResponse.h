@@ -0,0 +1,40 @@
+#ifndef SD_FILE_RESPONSE_H
+#define SD_FILE_RESPONSE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "SdReadAhead.h"
+
+// File response over POSIX I/O on the card. Unlike the library's File-based
+// response it can start at any offset, so a byte range is served by seeking
+// straight to it instead of reading and discarding the prefix. The body is
+// handed to sdReadAhead by prefetch(), or on the first fill at the latest; when
+// every read-ahead stream is busy the response reads the card directly.
+class SdFileResponse : public AsyncAbstractResponse {
+private:
+  int fd;                  // -1 once sdReadAhead owns the file
+  ReadAheadStream* stream;
+  uint32_t fileSize;
+  uint32_t start;          // First byte of the selected range
+  uint32_t remaining;      // Bytes of the selected range still to send
+  bool started;            // Range fixed; the body is being read
+  bool filled;             // _fillBuffer has run
+
+public:
+  // path is relative to the card root (e.g. /photos/photo_000001.jpg)
+  SdFileResponse(const char* path, const char* contentType);
+  ~SdFileResponse();
+
+  bool _sourceValid() const override { return fd >= 0 || (stream && !stream->failed.load()); }
+  size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+  uint32_t getFileSize() const { return fileSize; }
+
+  // Sends [start, start + length) as 206 Partial Content
+  void setRange(uint32_t start, uint32_t length);
+
+  // Once the range is set: starts reading ahead before the response is queued
+  void prefetch();
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SD_READ_AHEAD_H
+#define SD_READ_AHEAD_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define READAHEAD_STREAMS 4              // Responses that can read ahead at once
+#define READAHEAD_CHUNK 32768            // Per buffer; matches the common 32 KB FAT cluster
+#define READAHEAD_STAGING 8192           // DMA-capable bounce buffer for the SDMMC driver
+#define READAHEAD_TASK_STACK 4096
+
+// Buffer states
+#define READAHEAD_EMPTY 0
+#define READAHEAD_READY 1
+
+// Stream states
+#define READAHEAD_STREAM_FREE 0
+#define READAHEAD_STREAM_ACTIVE 1
+#define READAHEAD_STREAM_CLOSING 2      // Response gone; the task closes the file and frees it
+
+struct ReadAheadBuffer {
+  uint8_t* data;
+  uint32_t length;
+  std::atomic<uint8_t> state;
+};
+
+// One response's view of the helper task. The task owns fd and the fill side,
+// the response only drains READY buffers and hands them back.
+struct ReadAheadStream {
+  int fd;
+  std::atomic<uint32_t> nextOffset;      // File offset of the next read; moves once its chunk is READY
+  uint32_t endOffset;                    // One past the last byte to read
+  bool seekPending;
+  uint8_t fillIndex;                     // Task side: buffer to fill next
+  uint8_t readIndex;                     // Response side: buffer being drained
+  uint32_t readPos;
+  ReadAheadBuffer buffers[2];
+  std::atomic<uint8_t> use;              // Stream state
+  std::atomic<bool> failed;
+};
+
+struct ReadAheadStats {
+  uint32_t streams;
+  uint32_t fallbacks;                    // Responses that found every stream busy
+  uint32_t chunks;
+  uint64_t bytes;
+  uint32_t stalls;                       // _fillBuffer calls that found no data ready
+  uint32_t firstStalls;                  // ... of which were a response's first fill
+  uint32_t readErrors;
+  uint32_t readUsMax;                    // Slowest chunk read
+};
+
+// Card read-ahead for file responses. A helper task reads each open response in
+// cluster-aligned chunks into a pair of PSRAM buffers, bouncing through a small
+// DMA-capable staging buffer so the SDMMC driver does whole multi-sector reads,
+// while the web server task only copies out of RAM. A response whose next buffer
+// is not ready yet answers RESPONSE_TRY_AGAIN instead of blocking on the card or
+// sleeping; the server polls it again. Responses open their stream as soon as
+// they are created, so the first chunk is usually read while headers go out.
+class SdReadAhead {
+private:
+  ReadAheadStream streams[READAHEAD_STREAMS];
+  uint8_t* memory;
+  uint8_t* staging;
+  TaskHandle_t taskHandle;
+  ReadAheadStats stats;
+
+public:
+  SdReadAhead();
+  bool begin();
+
+  // Hands [start, end) of an open file to the task, which then owns fd. Returns
+  // nullptr when every stream is busy; the caller keeps fd and reads directly.
+  ReadAheadStream* open(int fd, uint32_t start, uint32_t end);
+
+  // Web server side: copies up to maxLen ready bytes; RESPONSE_TRY_AGAIN when none
+  // are ready yet, 0 at the end or after a read error. Never waits.
+  size_t read(ReadAheadStream* stream, uint8_t* out, size_t maxLen, bool firstCall);
+
+  // Called when the response is destroyed; the task closes the file
+  void close(ReadAheadStream* stream);
+
+  ReadAheadStats getStats() const { return stats; }
+  void writeStatusJson(Print& out) const;
+
+private:
+  static void readAheadTask(void* parameter);
+  void fillStreams();
+  bool fillBuffer(ReadAheadStream& stream, ReadAheadBuffer& buffer);
+};
+
+extern SdReadAhead sdReadAhead;
+
+#endif
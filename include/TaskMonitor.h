@@ -0,0 +1,72 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Sampler settings
+#define TASK_MONITOR_MAX_TASKS 32
+#define TASK_MONITOR_HISTORY 12         // Samples kept (one minute at the default period)
+#define TASK_MONITOR_PERIOD_MS 5000
+#define TASK_MONITOR_STACK 3072
+
+// Per-task figures for one sample
+struct TaskSample {
+  uint16_t taskNumber;      // FreeRTOS xTaskNumber, key into the name table
+  uint16_t cpuPermille;     // Share of one core over the sample period (0-1000)
+  uint16_t stackFreeBytes;  // Stack high-water mark (bytes never used)
+  int8_t core;              // Pinned core, -1 when the task may run on either
+  uint8_t state;            // eTaskState
+};
+
+// One history entry
+struct TaskMonitorSample {
+  uint32_t timestampMs;
+  uint32_t periodUs;
+  uint16_t idlePermille[portNUM_PROCESSORS];   // Idle share of each core
+  uint8_t taskCount;
+  TaskSample tasks[TASK_MONITOR_MAX_TASKS];
+};
+
+class TaskMonitor {
+private:
+  struct TaskName {
+    uint16_t taskNumber;
+    char name[configMAX_TASK_NAME_LEN];
+  };
+
+  TaskStatus_t* statusBuffer;
+  TaskMonitorSample* history;
+  uint32_t sampleCount;                        // Total samples ever taken
+  TaskName names[TASK_MONITOR_MAX_TASKS * 2];  // Includes tasks that have since exited
+  uint8_t nameCount;
+  uint32_t previousRuntime[TASK_MONITOR_MAX_TASKS];
+  uint16_t previousNumbers[TASK_MONITOR_MAX_TASKS];
+  uint8_t previousCount;
+  uint32_t previousSampleUs;
+  uint32_t periodMs;
+  SemaphoreHandle_t historyMutex;
+  TaskHandle_t taskHandle;
+
+public:
+  TaskMonitor();
+  bool begin(uint32_t samplePeriodMs = TASK_MONITOR_PERIOD_MS);
+
+  // True when FreeRTOS keeps per-task run time (needed for CPU percentages)
+  static bool hasRuntimeStats();
+
+  void writeJson(Print& out);            // Latest sample plus per-core idle history
+  void writeTaskTableHtml(Print& out);   // Latest sample for the diagnostics page
+
+private:
+  static void monitorTask(void* parameter);
+  void takeSample();
+  const char* lookupName(uint16_t taskNumber) const;
+  void rememberName(uint16_t taskNumber, const char* name);
+};
+
+extern TaskMonitor taskMonitor;
+
+#endif
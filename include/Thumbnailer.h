@@ -0,0 +1,89 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "PhotoIndex.h"
+
+#define THUMB_DIR "/thumbs"
+#define THUMB_MAX_WIDTH 160              // Decoder scales by 1/2, 1/4 or 1/8 to get under this
+#define THUMB_QUALITY 60                 // fmt2jpg quality (1-100)
+#define THUMB_MAX_SOURCE (512 * 1024)    // Larger photos are not thumbnailed
+#define THUMB_QUEUE_LEN 12               // A full gallery page
+#define THUMB_FAILED_SLOTS 16            // Recent failures, served the photo instead
+#define THUMB_RETRY_AFTER "1"            // Seconds, while a thumbnail is being made
+// fmt2jpg keeps its ~13 KB jpge encoder on the caller's stack (see PhotoAging.h)
+#define THUMB_TASK_STACK (20 * 1024)
+
+enum ThumbState {
+  THUMB_READY,                           // Cached on the card
+  THUMB_PENDING,                         // Queued or being made - try again shortly
+  THUMB_UNAVAILABLE                      // Too large, unreadable or failed
+};
+
+struct ThumbnailStats {
+  uint32_t generated;
+  uint32_t failed;
+  uint32_t lastMs;
+  uint32_t maxMs;
+  uint32_t deferred;                     // Requests answered with 503 while pending
+};
+
+// Makes small JPEG previews for the photo list and caches them next to the photos
+// (/thumbs/thumb_000123.jpg). The photo is read under sdMutex, decoded at reduced
+// scale and re-encoded without the lock, then written back under the lock, so the
+// capture task only ever waits for the two file operations.
+//
+// Thumbnails are made on a worker task, never on the web server's task: a request
+// for a missing one queues it and is told to come back, so a gallery page full of
+// new photos does not hold up every other route behind decodes and sdMutex waits.
+// The task and its stack are created on the first request.
+class Thumbnailer {
+private:
+  SemaphoreHandle_t sdMutex;
+  QueueHandle_t queue;
+  TaskHandle_t taskHandle;
+  ThumbnailStats stats;
+  portMUX_TYPE lock;                     // Guards pending and failed
+  uint32_t pending[THUMB_QUEUE_LEN];     // Queued or in progress, 0 = free
+  uint32_t failed[THUMB_FAILED_SLOTS];   // Ring of photo numbers
+  uint8_t failedNext;
+  bool stackLogged;
+
+public:
+  Thumbnailer();
+
+  // After the card is mounted, and again after a format
+  void begin(SemaphoreHandle_t sdMutexHandle);
+
+  // Web server task: queues the thumbnail if it is missing. path receives the
+  // thumbnail's card path when it is THUMB_READY.
+  ThumbState request(const PhotoEntry& photo, char* path, size_t pathSize);
+
+  static void formatThumbPath(char* out, size_t size, uint32_t number);
+
+  // Drop cached thumbnails whose photos are gone (caller holds sdMutex)
+  static void remove(uint32_t number);
+  static uint32_t removeAll();
+
+  // Frame size from the SOF header of a JPEG (or its first few hundred bytes)
+  static bool readDimensions(const uint8_t* jpeg, size_t len, uint16_t& width, uint16_t& height);
+
+  void writeStatusJson(Print& out);
+
+private:
+  bool createTask();
+  static void thumbTask(void* parameter);
+  void run();
+  bool generate(const PhotoEntry& photo);
+  bool readPhoto(uint32_t number, uint8_t* buffer, size_t size);
+  bool isPending(uint32_t number);         // Caller holds lock
+  bool hasFailed(uint32_t number);         // Caller holds lock
+};
+
+extern Thumbnailer thumbnailer;
+
+#endif
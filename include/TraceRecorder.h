@@ -0,0 +1,84 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+// Flight-recorder size (power of two, 32 bytes per span, kept in PSRAM)
+#define TRACE_RING_SIZE 2048
+
+// One completed span on the esp_timer timeline, which every core shares (the
+// CCOUNT cycle counter is per core and wraps after ~18 s at 240 MHz)
+struct TraceSpan {
+  std::atomic<uint32_t> sequence;   // 0 while being written, ticket + 1 once complete
+  uint32_t durationUs;
+  uint32_t endUs;
+  const char* name;                 // String literals only
+  const char* category;
+  uint32_t arg;
+  uint8_t core;
+};
+
+class TraceRecorder {
+private:
+  TraceSpan* ring;
+  std::atomic<uint32_t> nextTicket;
+  std::atomic<bool> enabled;
+
+public:
+  TraceRecorder();
+  bool begin();
+
+  // Low 32 bits of esp_timer microseconds; differences stay exact for spans
+  // under 71 minutes, whichever core or task took the two readings
+  static inline uint32_t now() { return (uint32_t)esp_timer_get_time(); }
+
+  // Records a finished span that started at beginUs (a now() value)
+  void record(const char* name, const char* category, uint32_t beginUs, uint32_t arg = 0);
+
+  void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+  bool isEnabled() const { return ring && enabled.load(std::memory_order_relaxed); }
+  void clear();
+  uint32_t getRecorded() const { return nextTicket.load(std::memory_order_relaxed); }
+
+  // Streams the ring as Chrome Trace Event JSON without buffering it in RAM
+  AsyncWebServerResponse* beginTraceResponse(AsyncWebServerRequest* request);
+
+private:
+  size_t writeEvent(char* buffer, size_t size, const TraceSpan& span, uint64_t nowUs, bool first);
+};
+
+extern TraceRecorder traceRecorder;
+
+// Scoped span: records from construction to destruction
+class TraceScope {
+private:
+  const char* name;
+  const char* category;
+  uint32_t beginUs;
+
+public:
+  uint32_t arg;
+
+  TraceScope(const char* spanName, const char* spanCategory, uint32_t spanArg = 0)
+    : name(spanName), category(spanCategory), beginUs(TraceRecorder::now()), arg(spanArg) {}
+  ~TraceScope() { traceRecorder.record(name, category, beginUs, arg); }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name, category) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, category)
+
+// xSemaphoreTake with the wait recorded as a span (arg = 1 when the lock was obtained)
+inline BaseType_t traceSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout, const char* name) {
+  uint32_t begin = TraceRecorder::now();
+  BaseType_t taken = xSemaphoreTake(semaphore, timeout);
+  traceRecorder.record(name, "lock", begin, taken == pdTRUE ? 1 : 0);
+  return taken;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// One file from web/, minified and gzipped at build time by tools/embed_web.py
+struct WebAsset {
+  const char* route;         // Path it is served at
+  const char* url;           // Route plus ?v=<hash> for stylesheets and scripts
+  const char* contentType;
+  const char* etag;
+  const uint8_t* data;       // Gzip stream in flash
+  size_t length;
+  bool versioned;            // Linked by hashed URL, so cacheable forever
+};
+
+// Static UI pages, stylesheet and script served straight from flash with
+// Content-Encoding: gzip - no heap copy and no per-request formatting. Pages are
+// shells; their dynamic values come from /api/status and /events.
+class WebAssets {
+public:
+  static const WebAsset* find(const char* route);
+
+  // Versioned URL to link from generated pages (the route itself if unknown)
+  static const char* url(const char* route);
+
+  // Sends the asset or a 304; false when there is no asset at route
+  static bool send(AsyncWebServerRequest* request, const char* route);
+
+  static void writeStatusJson(Print& out);
+};
+
+#endif
@@ -4,34 +4,98 @@
 #include <WiFi.h>
 #include <Preferences.h>
 #include <ESPmDNS.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/timers.h"
 #include "config.h"
 
+// Reconnect backoff (doubles after every failed attempt)
+#define WIFI_BACKOFF_MIN_MS 500
+#define WIFI_BACKOFF_MAX_MS 60000
+
+// Link state driven by WiFi driver events
+enum WiFiLinkState {
+  WIFI_LINK_IDLE,        // No station connection wanted
+  WIFI_LINK_CONNECTING,  // Association / DHCP in progress
+  WIFI_LINK_CONNECTED,   // Got an IP address
+  WIFI_LINK_BACKOFF      // Waiting for the reconnect timer
+};
+
+// Last successful association, persisted so reconnects can skip the scan and DHCP
+struct WiFiFastConnectCache {
+  bool valid;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// Association timing and outage counters
+struct WiFiLinkStats {
+  uint32_t connects;           // Successful connections (got IP)
+  uint32_t fastConnects;       // ... of which used the cached BSSID/channel/lease
+  uint32_t failedAttempts;
+  uint32_t outages;            // Link drops after a successful connection
+  uint32_t lastAssociationMs;  // WiFi.begin() to associated
+  uint32_t lastConnectMs;      // WiFi.begin() to IP address
+  uint32_t lastOutageMs;
+  uint32_t totalOutageMs;
+  uint32_t currentBackoffMs;
+};
+
 class WiFiManager {
 private:
   Preferences preferences;
   WiFiConfig currentConfig;
+  WiFiFastConnectCache cache;
+  WiFiLinkStats stats;
+  volatile WiFiLinkState linkState;
+  bool reconnectEnabled;
+  bool attemptIsFast;
+  unsigned long attemptStart;
+  unsigned long outageStart;
+  uint8_t failedInRow;
+  EventGroupHandle_t linkBits;
+  TimerHandle_t reconnectTimer;
+  std::atomic<bool> reconnectDue;   // Set by the timer, consumed by loop()
 
 public:
   WiFiManager();
   void begin();
   bool connectToSavedWiFi();
   bool connectToWiFi(const WiFiConfig& config);
+  bool startConnect(const WiFiConfig& config);   // Non-blocking, reconnects automatically
+  void loop();                                   // Runs reconnect attempts the timer scheduled
+  void disconnect();
   void saveConfig(const WiFiConfig& config);
   void clearConfig();
   WiFiConfig getCurrentConfig() const;
-  
+
   // mDNS functions
   bool setupMDNS();
-  
+
   // Status functions
   String getSSID() const;
   String getIPAddress() const;
   String getMACAddress() const;
   int getSignalStrength() const;
   bool isConnected() const;
+  WiFiLinkState getLinkState() const;
+  WiFiLinkStats getStats() const;
+  void writeStatusJson(Print& out) const;
 
 private:
   WiFiConfig loadConfig();
+  void loadFastConnectCache();
+  void saveFastConnectCache();
+  void clearFastConnectCache();
+  void attemptConnect();
+  void scheduleReconnect();
+  void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info);
+  static void reconnectTimerCallback(TimerHandle_t timer);
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -56,6 +56,12 @@
 extern const char* AP_SSID;
 extern const char* AP_PASSWORD;
 
+// Upper bound for a station connection attempt (returns early on success)
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+
+// Wall-clock time for photo timestamps (UTC, synced once the station has an IP)
+#define NTP_SERVER "pool.ntp.org"
+
 // Web Server Configuration
 #define HTTP_PORT 80
 #define DNS_PORT 53
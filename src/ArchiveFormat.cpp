@@ -0,0 +1,160 @@
+#include "ArchiveFormat.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+#endif
+
+#define ZIP_VERSION 20                      // 2.0: needed for data descriptors
+#define ZIP_MADE_BY_UNIX 0x0314             // Unix, spec 2.0 - keeps the file mode below
+#define ZIP_FLAG_DESCRIPTOR 0x0008
+
+uint32_t ArchiveFormat::crc32(uint32_t crc, const uint8_t* data, size_t len) {
+#ifdef ESP_PLATFORM
+  return esp_rom_crc32_le(crc, data, len);   // ROM table, no flash or RAM cost
+#else
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+#endif
+}
+
+size_t ArchiveFormat::tarHeader(uint8_t* out, const char* name, uint32_t size, uint32_t mtime) {
+  memset(out, 0, ARCHIVE_TAR_BLOCK);
+  char* h = (char*)out;
+  strncpy(h, name, 99);
+  memcpy(h + 100, "0000644", 7);
+  memcpy(h + 108, "0000000", 7);
+  memcpy(h + 116, "0000000", 7);
+  snprintf(h + 124, 12, "%011lo", (unsigned long)size);
+  snprintf(h + 136, 12, "%011lo", (unsigned long)mtime);
+  h[156] = '0';
+  memcpy(h + 257, "ustar", 6);
+  memcpy(h + 263, "00", 2);
+
+  // Checksum is taken with its own field as spaces
+  memset(h + 148, ' ', 8);
+  uint32_t sum = 0;
+  for (size_t i = 0; i < ARCHIVE_TAR_BLOCK; i++) {
+    sum += out[i];
+  }
+  // Six octal digits, NUL, space
+  snprintf(h + 148, 7, "%06o", (unsigned)(sum & 0777777));
+  h[155] = ' ';
+  return ARCHIVE_TAR_BLOCK;
+}
+
+uint32_t ArchiveFormat::tarPadding(uint32_t size) {
+  return (ARCHIVE_TAR_BLOCK - size % ARCHIVE_TAR_BLOCK) % ARCHIVE_TAR_BLOCK;
+}
+
+uint64_t ArchiveFormat::tarEntryBytes(uint32_t size) {
+  return ARCHIVE_TAR_BLOCK + (uint64_t)size + tarPadding(size);
+}
+
+size_t ArchiveFormat::zipLocalHeader(uint8_t* out, const char* name, uint32_t size, uint32_t mtime) {
+  uint16_t date, time;
+  dosDateTime(mtime, date, time);
+  size_t nameLen = strlen(name);
+  put32(out, 0x04034b50);
+  put16(out + 4, ZIP_VERSION);
+  put16(out + 6, ZIP_FLAG_DESCRIPTOR);
+  put16(out + 8, 0);                        // Stored
+  put16(out + 10, time);
+  put16(out + 12, date);
+  // CRC follows in the descriptor. Sizes are known, and stored entries need them
+  // for readers that walk local headers instead of the central directory.
+  put32(out + 14, 0);
+  put32(out + 18, size);
+  put32(out + 22, size);
+  put16(out + 26, nameLen);
+  put16(out + 28, 0);
+  memcpy(out + ARCHIVE_ZIP_LOCAL_HEADER, name, nameLen);
+  return ARCHIVE_ZIP_LOCAL_HEADER + nameLen;
+}
+
+size_t ArchiveFormat::zipDescriptor(uint8_t* out, uint32_t crc, uint32_t size) {
+  put32(out, 0x08074b50);
+  put32(out + 4, crc);
+  put32(out + 8, size);
+  put32(out + 12, size);
+  return ARCHIVE_ZIP_DESCRIPTOR;
+}
+
+size_t ArchiveFormat::zipCentralHeader(uint8_t* out, const char* name, uint32_t size, uint32_t crc,
+                                       uint32_t mtime, uint32_t localOffset) {
+  uint16_t date, time;
+  dosDateTime(mtime, date, time);
+  size_t nameLen = strlen(name);
+  put32(out, 0x02014b50);
+  put16(out + 4, ZIP_MADE_BY_UNIX);
+  put16(out + 6, ZIP_VERSION);
+  put16(out + 8, ZIP_FLAG_DESCRIPTOR);
+  put16(out + 10, 0);
+  put16(out + 12, time);
+  put16(out + 14, date);
+  put32(out + 16, crc);
+  put32(out + 20, size);
+  put32(out + 24, size);
+  put16(out + 28, nameLen);
+  put16(out + 30, 0);                       // Extra
+  put16(out + 32, 0);                       // Comment
+  put16(out + 34, 0);                       // Disk
+  put16(out + 36, 0);                       // Internal attributes
+  put32(out + 38, 0100644UL << 16);         // Regular file, rw-r--r--
+  put32(out + 42, localOffset);
+  memcpy(out + ARCHIVE_ZIP_CENTRAL_HEADER, name, nameLen);
+  return ARCHIVE_ZIP_CENTRAL_HEADER + nameLen;
+}
+
+size_t ArchiveFormat::zipEnd(uint8_t* out, uint16_t entries, uint32_t centralSize, uint32_t centralOffset) {
+  put32(out, 0x06054b50);
+  put16(out + 4, 0);
+  put16(out + 6, 0);
+  put16(out + 8, entries);
+  put16(out + 10, entries);
+  put32(out + 12, centralSize);
+  put32(out + 16, centralOffset);
+  put16(out + 20, 0);
+  return ARCHIVE_ZIP_END;
+}
+
+uint64_t ArchiveFormat::zipEntryBytes(size_t nameLen, uint32_t size) {
+  return ARCHIVE_ZIP_LOCAL_HEADER + nameLen + (uint64_t)size + ARCHIVE_ZIP_DESCRIPTOR;
+}
+
+uint64_t ArchiveFormat::zipCentralBytes(size_t nameLen) {
+  return ARCHIVE_ZIP_CENTRAL_HEADER + nameLen;
+}
+
+void ArchiveFormat::dosDateTime(uint32_t unixTime, uint16_t& date, uint16_t& time) {
+  // DOS dates start in 1980; anything earlier (clock never set) becomes 1980-01-01
+  if (unixTime < 315532800UL) {
+    date = (1 << 5) | 1;
+    time = 0;
+    return;
+  }
+  time_t t = unixTime;
+  struct tm parts;
+  gmtime_r(&t, &parts);
+  date = ((parts.tm_year - 80) << 9) | ((parts.tm_mon + 1) << 5) | parts.tm_mday;
+  time = (parts.tm_hour << 11) | (parts.tm_min << 5) | (parts.tm_sec / 2);
+}
+
+void ArchiveFormat::put16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+void ArchiveFormat::put32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
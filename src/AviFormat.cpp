@@ -0,0 +1,103 @@
+#include "AviFormat.h"
+#include <string.h>
+
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+size_t AviFormat::header(uint8_t* out, const AviStreamInfo& info) {
+  memset(out, 0, AVI_HEADER_BYTES);
+  uint32_t usPerFrame = info.fps ? 1000000UL / info.fps : 1000000UL;
+
+  putFourcc(out, "RIFF");
+  put32(out + 4, (uint32_t)(fileBytes(info) - 8));
+  putFourcc(out + 8, "AVI ");
+
+  putFourcc(out + 12, "LIST");
+  put32(out + 16, 192);
+  putFourcc(out + 20, "hdrl");
+
+  // Main header
+  putFourcc(out + 24, "avih");
+  put32(out + 28, 56);
+  put32(out + 32, usPerFrame);
+  put32(out + 36, info.maxFrameBytes * info.fps);
+  put32(out + 44, AVIF_HASINDEX);
+  put32(out + 48, info.frames);
+  put32(out + 56, 1);                       // Streams
+  put32(out + 60, info.maxFrameBytes);
+  put32(out + 64, info.width);
+  put32(out + 68, info.height);
+
+  putFourcc(out + 88, "LIST");
+  put32(out + 92, 116);
+  putFourcc(out + 96, "strl");
+
+  // Video stream header
+  putFourcc(out + 100, "strh");
+  put32(out + 104, 56);
+  putFourcc(out + 108, "vids");
+  putFourcc(out + 112, "MJPG");
+  put32(out + 128, 1);                      // Scale
+  put32(out + 132, info.fps);               // Rate: fps = rate / scale
+  put32(out + 140, info.frames);
+  put32(out + 144, info.maxFrameBytes);
+  put32(out + 148, 0xFFFFFFFF);             // Default quality
+  put16(out + 160, info.width);
+  put16(out + 162, info.height);
+
+  // BITMAPINFOHEADER
+  putFourcc(out + 164, "strf");
+  put32(out + 168, 40);
+  put32(out + 172, 40);
+  put32(out + 176, info.width);
+  put32(out + 180, info.height);
+  put16(out + 184, 1);                      // Planes
+  put16(out + 186, 24);                     // Bits per pixel once decoded
+  putFourcc(out + 188, "MJPG");
+  put32(out + 192, (uint32_t)info.width * info.height * 3);
+
+  putFourcc(out + AVI_MOVI_OFFSET, "LIST");
+  put32(out + AVI_MOVI_OFFSET + 4, 4 + info.moviBytes);
+  putFourcc(out + AVI_MOVI_OFFSET + 8, "movi");
+  return AVI_HEADER_BYTES;
+}
+
+size_t AviFormat::frameHeader(uint8_t* out, uint32_t size) {
+  putFourcc(out, "00dc");
+  put32(out + 4, size);
+  return AVI_CHUNK_HEADER;
+}
+
+size_t AviFormat::indexHeader(uint8_t* out, uint32_t frames) {
+  putFourcc(out, "idx1");
+  put32(out + 4, frames * AVI_INDEX_ENTRY);
+  return AVI_CHUNK_HEADER;
+}
+
+size_t AviFormat::indexEntry(uint8_t* out, uint32_t offset, uint32_t size) {
+  putFourcc(out, "00dc");
+  put32(out + 4, AVIIF_KEYFRAME);           // Every MJPEG frame stands alone
+  put32(out + 8, offset);
+  put32(out + 12, size);
+  return AVI_INDEX_ENTRY;
+}
+
+uint64_t AviFormat::fileBytes(const AviStreamInfo& info) {
+  return AVI_HEADER_BYTES + (uint64_t)info.moviBytes + AVI_CHUNK_HEADER + (uint64_t)info.frames * AVI_INDEX_ENTRY;
+}
+
+void AviFormat::put16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+void AviFormat::put32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = v >> 24;
+}
+
+void AviFormat::putFourcc(uint8_t* p, const char* fourcc) {
+  memcpy(p, fourcc, 4);
+}
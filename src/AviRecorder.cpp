@@ -0,0 +1,408 @@
+#include "AviRecorder.h"
+#include "RequestArena.h"
+#include "EventBroadcaster.h"
+#include "PhotoWriter.h"
+#include "TraceRecorder.h"
+#include "esp_heap_caps.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+AviRecorder aviRecorder;
+
+#define RECORDER_INDEX_BATCH 32              // idx1 entries written per call
+
+// Positioned I/O on the segment; the VFS keeps one file position per descriptor
+static bool readAt(int fd, uint32_t offset, uint8_t* data, size_t len) {
+  return ::lseek(fd, offset, SEEK_SET) == (off_t)offset && ::read(fd, data, len) == (ssize_t)len;
+}
+
+static bool writeAt(int fd, uint32_t offset, const uint8_t* data, size_t len) {
+  return ::lseek(fd, offset, SEEK_SET) == (off_t)offset && ::write(fd, data, len) == (ssize_t)len;
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+AviRecorder::AviRecorder()
+  : sdMutex(NULL), recording(false), fd(-1), nextSegment(1), segmentStartMs(0), frameSizes(nullptr),
+    staging(nullptr), stagingLen(0), stagingOffset(0), lastSyncMs(0) {
+  memset(&config, 0, sizeof(config));
+  memset(&stats, 0, sizeof(stats));
+  memset(&info, 0, sizeof(info));
+  path[0] = '\0';
+}
+
+bool AviRecorder::begin(SemaphoreHandle_t sdMutexHandle) {
+  if (!sdMutex) {
+    preferences.begin("recorder", false);
+    loadConfig();
+  }
+  sdMutex = sdMutexHandle;
+  fd = -1;
+  mkdir(PHOTO_MOUNT_POINT RECORDER_DIR, 0755);
+
+  // Number new segments after the newest one, repairing any left open on the way
+  uint32_t newest = 0;
+  DIR* dir = opendir(PHOTO_MOUNT_POINT RECORDER_DIR);
+  if (dir) {
+    char segmentPath[RECORDER_PATH_LEN + 16];
+    struct dirent* item;
+    while ((item = readdir(dir)) != nullptr) {
+      uint32_t number;
+      if (!parseSegmentNumber(item->d_name, number)) {
+        continue;
+      }
+      if (number > newest) {
+        newest = number;
+      }
+      snprintf(segmentPath, sizeof(segmentPath), PHOTO_MOUNT_POINT RECORDER_DIR "/%s", item->d_name);
+      recoverSegment(segmentPath);
+    }
+    closedir(dir);
+  }
+  nextSegment = newest + 1;
+  recording.store(config.enabled, std::memory_order_relaxed);
+
+  Serial.printf("✅ AVI recorder: %s, %u min / %u MB segments at %u fps, next rec_%06lu.avi\n",
+                config.enabled ? "recording" : "off", config.segmentMinutes, config.segmentMB, config.fps,
+                (unsigned long)nextSegment);
+  return true;
+}
+
+bool AviRecorder::append(const uint8_t* jpeg, size_t len, uint16_t width, uint16_t height) {
+  if (fd >= 0) {
+    uint64_t segmentBytes = AviFormat::fileBytes(info) + AviFormat::frameBytes(len) + AVI_INDEX_ENTRY;
+    if (millis() - segmentStartMs >= config.segmentMinutes * 60000UL ||
+        segmentBytes > config.segmentMB * 1048576ULL || info.frames >= RECORDER_MAX_FRAMES) {
+      closeSegment();
+    }
+  }
+  if (fd < 0 && !openSegment(width, height)) {
+    return false;
+  }
+
+  uint32_t appendStart = TraceRecorder::now();
+  uint8_t chunk[AVI_CHUNK_HEADER];
+  static const uint8_t pad = 0;
+  AviFormat::frameHeader(chunk, len);
+  if (!stage(chunk, sizeof(chunk)) || !stage(jpeg, len) ||
+      (AviFormat::framePadding(len) && !stage(&pad, 1))) {
+    // Card trouble: leave the segment for recovery rather than write more into it
+    stats.writeErrors++;
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  traceRecorder.record("avi.append", "sd", appendStart, len);
+
+  frameSizes[info.frames++] = len;
+  info.moviBytes += AviFormat::frameBytes(len);
+  if (len > info.maxFrameBytes) {
+    info.maxFrameBytes = len;
+  }
+  stats.frames++;
+  stats.bytes += len;
+
+  if (millis() - lastSyncMs >= RECORDER_SYNC_MS) {
+    syncSegment();
+  }
+  return true;
+}
+
+void AviRecorder::closeSegment() {
+  if (fd < 0) {
+    return;
+  }
+  bool ok = flushStaging(true) && info.frames > 0 && finalize(fd, info, frameSizes);
+  ::close(fd);
+  fd = -1;
+  if (info.frames == 0) {
+    ::unlink(path);
+    return;
+  }
+  if (!ok) {
+    stats.writeErrors++;
+    return;
+  }
+  stats.segments++;
+  const char* name = strrchr(path, '/') + 1;
+  Serial.printf("🎞️ Recording segment %s closed: %lu frames, %lu bytes\n", name,
+                (unsigned long)info.frames, (unsigned long)AviFormat::fileBytes(info));
+  eventBroadcaster.publish(EVENT_JOB, "{\"job\":\"record\",\"segment\":\"%s\",\"frames\":%lu}", name,
+                           (unsigned long)info.frames);
+}
+
+bool AviRecorder::setEnabled(bool enabled) {
+  if (!sdMutex || xSemaphoreTake(sdMutex, pdMS_TO_TICKS(RECORDER_SD_LOCK_MS)) != pdTRUE) {
+    return false;
+  }
+  if (!enabled) {
+    closeSegment();
+  }
+  config.enabled = enabled;
+  saveConfig();
+  recording.store(enabled, std::memory_order_relaxed);
+  xSemaphoreGive(sdMutex);
+  Serial.printf("🎞️ Recording %s\n", enabled ? "started" : "stopped");
+  return true;
+}
+
+void AviRecorder::setLimits(uint16_t minutes, uint16_t megabytes, uint8_t fps) {
+  if (sdMutex && xSemaphoreTake(sdMutex, pdMS_TO_TICKS(RECORDER_SD_LOCK_MS)) != pdTRUE) {
+    return;
+  }
+  // AVI 1.0 players cope best below 1 GB
+  config.segmentMinutes = constrain(minutes, 1, 1440);
+  config.segmentMB = constrain(megabytes, 1, 1024);
+  config.fps = constrain(fps, 1, 60);
+  saveConfig();
+  if (sdMutex) {
+    xSemaphoreGive(sdMutex);
+  }
+}
+
+uint32_t AviRecorder::removeAll() {
+  uint32_t removed = 0;
+  DIR* dir = opendir(PHOTO_MOUNT_POINT RECORDER_DIR);
+  if (!dir) {
+    return 0;
+  }
+  char segmentPath[RECORDER_PATH_LEN + 16];
+  struct dirent* item;
+  while ((item = readdir(dir)) != nullptr) {
+    uint32_t number;
+    if (!parseSegmentNumber(item->d_name, number)) {
+      continue;
+    }
+    snprintf(segmentPath, sizeof(segmentPath), PHOTO_MOUNT_POINT RECORDER_DIR "/%s", item->d_name);
+    if (::unlink(segmentPath) == 0) {
+      removed++;
+    }
+  }
+  closedir(dir);
+  return removed;
+}
+
+bool AviRecorder::openSegment(uint16_t width, uint16_t height) {
+  if (!frameSizes) {
+    uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+    frameSizes = (uint32_t*)heap_caps_malloc(RECORDER_MAX_FRAMES * sizeof(uint32_t), caps);
+  }
+  if (!staging) {
+    staging = (uint8_t*)heap_caps_malloc(RECORDER_STAGING, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  }
+  if (!frameSizes || !staging) {
+    stats.writeErrors++;
+    return false;
+  }
+
+  snprintf(path, sizeof(path), PHOTO_MOUNT_POINT RECORDER_DIR "/rec_%06lu.avi", (unsigned long)nextSegment);
+  fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    stats.writeErrors++;
+    return false;
+  }
+  nextSegment++;
+
+  memset(&info, 0, sizeof(info));
+  info.width = width;
+  info.height = height;
+  info.fps = config.fps;
+  // RIFF size 0 marks the segment as open until finalize() rewrites the header
+  AviFormat::header(staging, info);
+  memset(staging + 4, 0, 4);
+  stagingLen = AVI_HEADER_BYTES;
+  stagingOffset = 0;
+  segmentStartMs = millis();
+  lastSyncMs = segmentStartMs;
+  return true;
+}
+
+bool AviRecorder::finalize(int segmentFd, const AviStreamInfo& segmentInfo, const uint32_t* sizes) {
+  // idx1 straight after the last frame; sizes == nullptr reads them back from the chunks
+  uint8_t batch[AVI_INDEX_ENTRY * RECORDER_INDEX_BATCH];
+  uint32_t indexOffset = AVI_HEADER_BYTES + segmentInfo.moviBytes;
+  uint32_t writeOffset = indexOffset;
+  size_t batchLen = AviFormat::indexHeader(batch, segmentInfo.frames);
+  uint32_t frameOffset = 4;
+  for (uint32_t i = 0; i < segmentInfo.frames; i++) {
+    uint32_t size;
+    if (sizes) {
+      size = sizes[i];
+    } else {
+      uint8_t chunk[AVI_CHUNK_HEADER];
+      if (!readAt(segmentFd, AVI_MOVI_OFFSET + 8 + frameOffset, chunk, sizeof(chunk))) {
+        return false;
+      }
+      size = get32(chunk + 4);
+    }
+    batchLen += AviFormat::indexEntry(batch + batchLen, frameOffset, size);
+    frameOffset += AviFormat::frameBytes(size);
+    if (batchLen + AVI_INDEX_ENTRY > sizeof(batch)) {
+      if (!writeAt(segmentFd, writeOffset, batch, batchLen)) {
+        return false;
+      }
+      writeOffset += batchLen;
+      batchLen = 0;
+    }
+  }
+  if (batchLen && !writeAt(segmentFd, writeOffset, batch, batchLen)) {
+    return false;
+  }
+
+  // Drop anything past the index (a partial frame after a power loss)
+  uint32_t fileBytes = (uint32_t)AviFormat::fileBytes(segmentInfo);
+  if (ftruncate(segmentFd, fileBytes) != 0) {
+    return false;
+  }
+  uint8_t header[AVI_HEADER_BYTES];
+  AviFormat::header(header, segmentInfo);
+  return writeAt(segmentFd, 0, header, sizeof(header)) && fsync(segmentFd) == 0;
+}
+
+bool AviRecorder::stage(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t n = RECORDER_STAGING - stagingLen;
+    if (n > len) n = len;
+    memcpy(staging + stagingLen, data, n);
+    stagingLen += n;
+    data += n;
+    len -= n;
+    if (stagingLen == RECORDER_STAGING && !flushStaging(false)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AviRecorder::flushStaging(bool partial) {
+  if (stagingLen == 0) {
+    return true;
+  }
+  // Every write starts on a staging boundary, so full buffers stay sector-aligned and
+  // take FATFS's multi-sector path. A partial flush (sync or close) keeps its bytes:
+  // the next full flush rewrites the same region with the rest of the buffer.
+  if (!writeAt(fd, stagingOffset, staging, stagingLen)) {
+    return false;
+  }
+  if (!partial) {
+    stagingOffset += stagingLen;
+    stagingLen = 0;
+  }
+  return true;
+}
+
+void AviRecorder::syncSegment() {
+  uint32_t syncStart = millis();
+  // fsync commits the directory entry's length, which is what survives a power cut
+  if (!flushStaging(true) || fsync(fd) != 0) {
+    stats.writeErrors++;
+  }
+  uint32_t elapsed = millis() - syncStart;
+  if (elapsed > stats.maxSyncMs) {
+    stats.maxSyncMs = elapsed;
+  }
+  stats.syncs++;
+  lastSyncMs = millis();
+}
+
+bool AviRecorder::recoverSegment(const char* segmentPath) {
+  int segmentFd = ::open(segmentPath, O_RDWR);
+  if (segmentFd < 0) {
+    return false;
+  }
+  struct stat fileInfo;
+  uint8_t header[AVI_HEADER_BYTES];
+  if (fstat(segmentFd, &fileInfo) != 0 || fileInfo.st_size < AVI_HEADER_BYTES ||
+      !readAt(segmentFd, 0, header, sizeof(header)) || memcmp(header, "RIFF", 4) != 0 ||
+      memcmp(header + AVI_MOVI_OFFSET + 8, "movi", 4) != 0) {
+    // Never synced past its header: nothing to save
+    ::close(segmentFd);
+    ::unlink(segmentPath);
+    return false;
+  }
+  if (get32(header + 4) != 0) {
+    ::close(segmentFd);      // Finalized
+    return true;
+  }
+
+  // Walk the frame chunks up to the first one that did not make it to the card
+  AviStreamInfo recovered;
+  memset(&recovered, 0, sizeof(recovered));
+  recovered.width = get32(header + 64);
+  recovered.height = get32(header + 68);
+  recovered.fps = get32(header + 132);
+  uint32_t fileSize = fileInfo.st_size;
+  uint32_t offset = AVI_HEADER_BYTES;
+  uint8_t chunk[AVI_CHUNK_HEADER];
+  while (offset + AVI_CHUNK_HEADER <= fileSize && recovered.frames < RECORDER_MAX_FRAMES &&
+         readAt(segmentFd, offset, chunk, sizeof(chunk)) && memcmp(chunk, "00dc", 4) == 0) {
+    uint32_t size = get32(chunk + 4);
+    if (size == 0 || offset + AviFormat::frameBytes(size) > fileSize) {
+      break;
+    }
+    recovered.frames++;
+    recovered.moviBytes += AviFormat::frameBytes(size);
+    if (size > recovered.maxFrameBytes) {
+      recovered.maxFrameBytes = size;
+    }
+    offset += AviFormat::frameBytes(size);
+  }
+
+  bool ok = recovered.frames > 0 && finalize(segmentFd, recovered, nullptr);
+  ::close(segmentFd);
+  if (recovered.frames == 0) {
+    ::unlink(segmentPath);
+    return false;
+  }
+  if (ok) {
+    stats.recovered++;
+    stats.recoveredFrames += recovered.frames;
+  }
+  Serial.printf("%s Recording %s: recovered %lu frames after power loss\n", ok ? "🩹" : "❌",
+                strrchr(segmentPath, '/') + 1, (unsigned long)recovered.frames);
+  return ok;
+}
+
+void AviRecorder::loadConfig() {
+  config.enabled = preferences.getBool("enabled", false);
+  config.segmentMinutes = preferences.getUShort("minutes", RECORDER_DEFAULT_MINUTES);
+  config.segmentMB = preferences.getUShort("mb", RECORDER_DEFAULT_MB);
+  config.fps = preferences.getUChar("fps", RECORDER_DEFAULT_FPS);
+}
+
+void AviRecorder::saveConfig() {
+  preferences.putBool("enabled", config.enabled);
+  preferences.putUShort("minutes", config.segmentMinutes);
+  preferences.putUShort("mb", config.segmentMB);
+  preferences.putUChar("fps", config.fps);
+}
+
+bool AviRecorder::parseSegmentNumber(const char* name, uint32_t& number) {
+  unsigned long value;
+  char tail[8];
+  if (sscanf(name, "rec_%lu.%7s", &value, tail) != 2 || strcmp(tail, "avi") != 0) {
+    return false;
+  }
+  number = value;
+  return true;
+}
+
+void AviRecorder::writeStatusJson(Print& out) {
+  printfTo(out, "{\"enabled\":%s,\"segment_minutes\":%u,\"segment_mb\":%u,\"fps\":%u", config.enabled ? "true" : "false",
+           (unsigned)config.segmentMinutes, (unsigned)config.segmentMB, (unsigned)config.fps);
+  if (fd >= 0) {
+    printfTo(out, ",\"segment\":\"%s\",\"segment_frames\":%lu,\"segment_seconds\":%lu", strrchr(path, '/') + 1,
+             (unsigned long)info.frames, (unsigned long)((millis() - segmentStartMs) / 1000));
+  } else {
+    out.print(",\"segment\":null");
+  }
+  printfTo(out, ",\"segments\":%lu,\"frames\":%lu,\"bytes\":%llu", (unsigned long)stats.segments,
+           (unsigned long)stats.frames, (unsigned long long)stats.bytes);
+  printfTo(out, ",\"recovered\":%lu,\"recovered_frames\":%lu,\"syncs\":%lu,\"max_sync_ms\":%lu,\"write_errors\":%lu}",
+           (unsigned long)stats.recovered, (unsigned long)stats.recoveredFrames, (unsigned long)stats.syncs,
+           (unsigned long)stats.maxSyncMs, (unsigned long)stats.writeErrors);
+}
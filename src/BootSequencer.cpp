@@ -0,0 +1,198 @@
+#include "BootSequencer.h"
+#include "RequestArena.h"
+#include "esp_timer.h"
+
+// Parameter handed to each step task
+struct BootStepTaskParam {
+  BootSequencer* sequencer;
+  int stepId;
+};
+
+static BootStepTaskParam stepParams[BOOT_MAX_STEPS];
+
+BootSequencer::BootSequencer() : stepCount(0), milestoneCount(0), doneBits(NULL), startedUs(0) {
+  memset(steps, 0, sizeof(steps));
+  memset(milestones, 0, sizeof(milestones));
+}
+
+int BootSequencer::addStep(const char* name, BootStepFunction function, uint32_t dependsOn,
+                           BaseType_t core, uint32_t stackSize) {
+  if (stepCount >= BOOT_MAX_STEPS) {
+    Serial.printf("❌ Boot sequencer full - cannot add step '%s'\n", name);
+    return -1;
+  }
+
+  BootStep& step = steps[stepCount];
+  step.name = name;
+  step.function = function;
+  step.dependsOn = dependsOn;
+  step.core = core;
+  step.stackSize = stackSize;
+  step.ranOnCore = -1;
+  return stepCount++;
+}
+
+void BootSequencer::runAfter(int stepId, uint32_t stepMask) {
+  if (stepId >= 0 && stepId < stepCount) {
+    steps[stepId].runsAfter |= stepMask;
+  }
+}
+
+void BootSequencer::addMilestone(const char* name) {
+  if (milestoneCount < BOOT_MAX_MILESTONES) {
+    milestones[milestoneCount].name = name;
+    milestones[milestoneCount].timeUs = 0;
+    milestoneCount++;
+  }
+}
+
+bool BootSequencer::start() {
+  doneBits = xEventGroupCreate();
+  if (doneBits == NULL) {
+    Serial.println("❌ Failed to create boot event group");
+    return false;
+  }
+
+  startedUs = esp_timer_get_time();
+  Serial.printf("🚀 Boot sequencer: launching %d steps\n", stepCount);
+
+  for (int i = 0; i < stepCount; i++) {
+    stepParams[i].sequencer = this;
+    stepParams[i].stepId = i;
+
+    BaseType_t created = xTaskCreatePinnedToCore(
+      stepTask, steps[i].name, steps[i].stackSize, &stepParams[i], 3, NULL, steps[i].core);
+
+    if (created != pdPASS) {
+      // Fall back to running inline so the system still comes up
+      Serial.printf("⚠️ Could not create task for boot step '%s' - running inline\n", steps[i].name);
+      runStep(i);
+    }
+  }
+  return true;
+}
+
+void BootSequencer::stepTask(void* parameter) {
+  BootStepTaskParam* param = (BootStepTaskParam*)parameter;
+  param->sequencer->runStep(param->stepId);
+  vTaskDelete(NULL);
+}
+
+void BootSequencer::runStep(int stepId) {
+  BootStep& step = steps[stepId];
+
+  // Wait until every dependency has finished
+  uint32_t waitBits = step.dependsOn | step.runsAfter;
+  if (waitBits != 0) {
+    xEventGroupWaitBits(doneBits, waitBits, pdFALSE, pdTRUE, portMAX_DELAY);
+  }
+
+  for (int i = 0; i < stepCount; i++) {
+    if ((step.dependsOn & BOOT_DEP(i)) && !steps[i].succeeded) {
+      step.skipped = true;
+    }
+  }
+
+  step.startUs = esp_timer_get_time();
+  step.ranOnCore = xPortGetCoreID();
+
+  if (step.skipped) {
+    Serial.printf("⏭️ Boot step '%s' skipped - dependency failed\n", step.name);
+  } else {
+    step.succeeded = step.function();
+  }
+
+  step.endUs = esp_timer_get_time();
+  Serial.printf("⏱️ Boot step '%s' %s in %lu ms (core %d)\n", step.name,
+                step.succeeded ? "done" : "failed",
+                (unsigned long)((step.endUs - step.startUs) / 1000), (int)step.ranOnCore);
+
+  xEventGroupSetBits(doneBits, BOOT_DEP(stepId));
+}
+
+bool BootSequencer::waitFor(int stepId, TickType_t timeout) {
+  if (doneBits == NULL || stepId < 0 || stepId >= stepCount) {
+    return false;
+  }
+  EventBits_t bits = xEventGroupWaitBits(doneBits, BOOT_DEP(stepId), pdFALSE, pdTRUE, timeout);
+  return (bits & BOOT_DEP(stepId)) != 0;
+}
+
+bool BootSequencer::waitForAll(TickType_t timeout) {
+  if (doneBits == NULL) {
+    return false;
+  }
+  EventBits_t all = BOOT_DEP(stepCount) - 1;
+  EventBits_t bits = xEventGroupWaitBits(doneBits, all, pdFALSE, pdTRUE, timeout);
+  return (bits & all) == all;
+}
+
+bool BootSequencer::isDone(int stepId) const {
+  if (doneBits == NULL || stepId < 0 || stepId >= stepCount) {
+    return false;
+  }
+  return (xEventGroupGetBits(doneBits) & BOOT_DEP(stepId)) != 0;
+}
+
+bool BootSequencer::succeeded(int stepId) const {
+  return isDone(stepId) && steps[stepId].succeeded;
+}
+
+void BootSequencer::mark(const char* name) {
+  for (int i = 0; i < milestoneCount; i++) {
+    if (strcmp(milestones[i].name, name) == 0) {
+      if (milestones[i].timeUs == 0) {
+        milestones[i].timeUs = esp_timer_get_time();
+        Serial.printf("⏱️ Boot milestone '%s' at %lu ms\n", name,
+                      (unsigned long)(milestones[i].timeUs / 1000));
+      }
+      return;
+    }
+  }
+}
+
+void BootSequencer::writeProfileJson(Print& out) const {
+  printfTo(out, "{\"sequencer_start_us\":%ld,\"steps\":[", (long)startedUs);
+
+  for (int i = 0; i < stepCount; i++) {
+    const BootStep& step = steps[i];
+    bool done = isDone(i);
+    if (i > 0) out.print(",");
+    printfTo(out, "{\"name\":\"%s\"", step.name);
+
+    out.print(",\"depends_on\":[");
+    bool first = true;
+    for (int d = 0; d < stepCount; d++) {
+      if (step.dependsOn & BOOT_DEP(d)) {
+        printfTo(out, "%s\"%s\"", first ? "" : ",", steps[d].name);
+        first = false;
+      }
+    }
+    out.print("],\"runs_after\":[");
+    first = true;
+    for (int d = 0; d < stepCount; d++) {
+      if (step.runsAfter & BOOT_DEP(d)) {
+        printfTo(out, "%s\"%s\"", first ? "" : ",", steps[d].name);
+        first = false;
+      }
+    }
+    out.print("]");
+
+    printfTo(out, ",\"core\":%d,\"start_us\":%ld,\"end_us\":%ld,\"duration_us\":%ld,\"state\":\"%s\"}",
+             (int)step.ranOnCore, (long)step.startUs, done ? (long)step.endUs : 0L,
+             done ? (long)(step.endUs - step.startUs) : 0L,
+             !done ? "running" : step.skipped ? "skipped" : step.succeeded ? "ok" : "failed");
+  }
+  out.print("]");
+
+  out.print(",\"milestones\":{");
+  for (int i = 0; i < milestoneCount; i++) {
+    if (i > 0) out.print(",");
+    if (milestones[i].timeUs != 0) {
+      printfTo(out, "\"%s\":%ld", milestones[i].name, (long)milestones[i].timeUs);
+    } else {
+      printfTo(out, "\"%s\":null", milestones[i].name);
+    }
+  }
+  out.print("}}");
+}
@@ -1,8 +1,12 @@
 #include "CameraManager.h"
 #include "FS.h"
 #include "SD_MMC.h"
+#include "DeferredLog.h"
+#include "TraceRecorder.h"
 
-CameraManager::CameraManager() : cameraInitialized(false), lastCaptureTime(0), lastPhotoFilename("") {
+CameraManager::CameraManager()
+  : cameraInitialized(false), lastCaptureTime(0), lastPhotoNumber(0), lastPhotoSize(0) {
+  lastPhotoFilename[0] = '\0';
 }
 
 bool CameraManager::begin() {
@@ -22,7 +26,12 @@ bool CameraManager::begin() {
     Serial.println("⏳ This may take a few seconds...");
     Serial.flush(); // Ensure all debug messages are sent before potential hang
     
-    esp_err_t err = esp_camera_init(&camera_config);
+    esp_err_t err;
+    if (tuner.isCalibrationRequested()) {
+      err = tuner.runCalibration(camera_config) ? ESP_OK : ESP_FAIL;
+    } else {
+      err = esp_camera_init(&camera_config);
+    }
     if (err != ESP_OK) {
       Serial.printf("✗ Camera init failed with error 0x%x\n", err);
       Serial.println("💡 Possible causes:");
@@ -97,6 +106,7 @@ bool CameraManager::begin() {
     } else {
       Serial.printf("✓ Photos directory already exists: %s\n", PHOTOS_DIR);
     }
+    photoWriter.begin();
     
     // Test SD card write
     Serial.println("📋 Step 6: Testing SD card write capability...");
@@ -174,7 +184,7 @@ void CameraManager::initCameraConfig() {
     // Optimize for 8MB PSRAM - use maximum quality settings
     camera_config.frame_size = FRAMESIZE_UXGA;  // 1600x1200 - maximum resolution
     camera_config.jpeg_quality = 8;  // High quality (lower number = better quality)
-    camera_config.fb_count = 2;  // Double buffering for smooth capture
+    camera_config.fb_count = 2;  // Default until CameraTuner has measured this board
     camera_config.grab_mode = CAMERA_GRAB_LATEST;
     camera_config.fb_location = CAMERA_FB_IN_PSRAM;
     
@@ -191,6 +201,14 @@ void CameraManager::initCameraConfig() {
     camera_config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
     camera_config.fb_location = CAMERA_FB_IN_DRAM;
   }
+  
+  // Measured settings from a previous calibration override the defaults above
+  tuner.begin();
+  if (tuner.hasTuning()) {
+    tuner.applyTo(camera_config);
+    Serial.printf("📐 Using calibrated driver settings - XCLK: %d MHz, fb_count: %d\n",
+                  camera_config.xclk_freq_hz / 1000000, camera_config.fb_count);
+  }
 }
 
 bool CameraManager::isCameraReady() const {
@@ -209,28 +227,33 @@ void CameraManager::handleLoop() {
 
 bool CameraManager::capturePhoto() {
   if (!cameraInitialized) {
-    Serial.println("⚠ Cannot capture photo - camera not initialized");
+    DLOGW("⚠ Cannot capture photo - camera not initialized");
     return false;
   }
   
   static int photoCounter = 0;
   photoCounter++;
   
-  Serial.printf("📸 Capturing photo #%d...\n", photoCounter);
+  DLOGD("📸 Capturing photo #%d...", photoCounter);
   
   // Take picture with camera
-  camera_fb_t* fb = esp_camera_fb_get();
+  camera_fb_t* fb;
+  {
+    TRACE_SCOPE("esp_camera_fb_get", "camera");
+    fb = esp_camera_fb_get();
+  }
   if (!fb) {
-    Serial.println("✗ Camera capture failed - no frame buffer");
+    DLOGE("✗ Camera capture failed - no frame buffer");
     return false;
   }
   
-  Serial.printf("✓ Frame captured - Size: %d bytes, Format: %s\n", 
-                fb->len, (fb->format == PIXFORMAT_JPEG) ? "JPEG" : "RAW");
+  DLOGD("✓ Frame captured - Size: %zu bytes, Format: %s",
+        fb->len, (fb->format == PIXFORMAT_JPEG) ? "JPEG" : "RAW");
   
   // Generate filename
-  String filename = generatePhotoFilename();
-  Serial.printf("💾 Saving as: %s\n", filename.c_str());
+  char filename[PHOTO_PATH_LEN];
+  unsigned long number = generatePhotoFilename(filename, sizeof(filename));
+  size_t photoSize = fb->len;
   
   // Save to SD card
   bool saved = savePhotoToSD(fb, filename);
@@ -239,40 +262,41 @@ bool CameraManager::capturePhoto() {
   esp_camera_fb_return(fb);
   
   if (saved) {
-    lastPhotoFilename = filename;
+    strncpy(lastPhotoFilename, filename, sizeof(lastPhotoFilename));
+    lastPhotoNumber = number;
+    lastPhotoSize = photoSize;
     lastCaptureTime = millis();
-    Serial.printf("✅ Photo #%d saved successfully: %s\n", photoCounter, filename.c_str());
+    DLOGI("✅ Photo #%d saved successfully", photoCounter);
     return true;
   } else {
-    Serial.printf("❌ Failed to save photo #%d\n", photoCounter);
+    DLOGE("❌ Failed to save photo #%d", photoCounter);
   }
   
   return false;
 }
 
-String CameraManager::generatePhotoFilename() {
-  static int photoNumber = 1;
-  return String(PHOTOS_DIR) + "/photo_" + String(photoNumber++) + ".jpg";
+unsigned long CameraManager::generatePhotoFilename(char* out, size_t size) {
+  static unsigned long photoNumber = 1;
+  PhotoWriter::formatPhotoPath(out, size, photoNumber);
+  return photoNumber++;
 }
 
-bool CameraManager::savePhotoToSD(camera_fb_t* fb, const String& filename) {
-  File file = SD_MMC.open(filename.c_str(), FILE_WRITE);
-  if (!file) {
-    Serial.println("Failed to open file for writing");
+bool CameraManager::savePhotoToSD(camera_fb_t* fb, const char* filename) {
+  // Fixed path buffer plus preallocated staging, so saving never touches the heap
+  int written = photoWriter.write(filename, fb->buf, fb->len);
+  if (written < 0) {
+    DLOGE("Failed to open file for writing");
     return false;
   }
   
-  size_t written = file.write(fb->buf, fb->len);
-  file.close();
-  
-  if (written != fb->len) {
-    Serial.println("Failed to write complete image data");
+  if ((size_t)written != fb->len) {
+    DLOGE("Failed to write complete image data");
     return false;
   }
   
   return true;
 }
 
-String CameraManager::getLastPhotoFilename() const {
+const char* CameraManager::getLastPhotoFilename() const {
   return lastPhotoFilename;
 }
\ No newline at end of file
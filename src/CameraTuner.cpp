@@ -0,0 +1,310 @@
+#include "CameraTuner.h"
+#include "RequestArena.h"
+#include "esp_timer.h"
+#include "esp_task_wdt.h"
+
+// Candidate values benchmarked during calibration
+static const int XCLK_CANDIDATES[] = { 10000000, 16000000, 20000000 };
+static const uint8_t FB_COUNT_CANDIDATES[] = { 1, 2, 3 };
+static const camera_grab_mode_t GRAB_MODE_CANDIDATES[] = { CAMERA_GRAB_WHEN_EMPTY, CAMERA_GRAB_LATEST };
+static const camera_fb_location_t FB_LOCATION_CANDIDATES[] = { CAMERA_FB_IN_DRAM, CAMERA_FB_IN_PSRAM };
+
+static const char* grabModeName(camera_grab_mode_t mode) {
+  return mode == CAMERA_GRAB_LATEST ? "latest" : "when_empty";
+}
+
+static const char* fbLocationName(camera_fb_location_t location) {
+  return location == CAMERA_FB_IN_PSRAM ? "psram" : "dram";
+}
+
+CameraTuner::CameraTuner() : resultCount(0), bestIndex(-1) {
+}
+
+void CameraTuner::begin() {
+  preferences.begin("cam-tuning", false);
+  tuning = loadTuning();
+
+  if (tuning.valid) {
+    Serial.printf("✓ Camera tuning loaded - XCLK: %d MHz, fb_count: %d, grab: %s, fb: %s\n",
+                  tuning.xclkFreqHz / 1000000, tuning.fbCount,
+                  grabModeName(tuning.grabMode), fbLocationName(tuning.fbLocation));
+  } else {
+    Serial.println("ℹ No camera tuning stored - using default driver settings");
+  }
+}
+
+bool CameraTuner::hasTuning() const {
+  return tuning.valid;
+}
+
+CameraTuning CameraTuner::getTuning() const {
+  return tuning;
+}
+
+void CameraTuner::applyTo(camera_config_t& config) const {
+  if (!tuning.valid) {
+    return;
+  }
+
+  // Tuning measured with PSRAM buffers is useless on a board without PSRAM
+  if (tuning.fbLocation == CAMERA_FB_IN_PSRAM && !psramFound()) {
+    return;
+  }
+
+  config.xclk_freq_hz = tuning.xclkFreqHz;
+  config.fb_count = tuning.fbCount;
+  config.grab_mode = tuning.grabMode;
+  config.fb_location = tuning.fbLocation;
+}
+
+void CameraTuner::clearTuning() {
+  preferences.remove("xclk");
+  preferences.remove("fb_count");
+  preferences.remove("grab");
+  preferences.remove("fb_loc");
+  tuning = CameraTuning();
+  Serial.println("Camera tuning cleared from memory");
+}
+
+void CameraTuner::requestCalibration() {
+  preferences.putBool("calibrate", true);
+  Serial.println("📐 Camera calibration requested for next boot");
+}
+
+bool CameraTuner::isCalibrationRequested() {
+  return preferences.getBool("calibrate", false);
+}
+
+bool CameraTuner::runCalibration(const camera_config_t& baseConfig) {
+  Serial.println("📐 Starting camera calibration...");
+
+  // Consume the request up front so a crash during calibration cannot boot-loop
+  preferences.putBool("calibrate", false);
+
+  resultCount = 0;
+  bestIndex = -1;
+  bool psramAvailable = psramFound();
+  unsigned long startTime = millis();
+
+  for (int xclk : XCLK_CANDIDATES) {
+    for (uint8_t fbCount : FB_COUNT_CANDIDATES) {
+      for (camera_grab_mode_t grabMode : GRAB_MODE_CANDIDATES) {
+        for (camera_fb_location_t fbLocation : FB_LOCATION_CANDIDATES) {
+          if (fbLocation == CAMERA_FB_IN_PSRAM && !psramAvailable) {
+            continue;
+          }
+          if (resultCount >= CALIBRATION_MAX_RESULTS) {
+            break;
+          }
+
+          camera_config_t config = baseConfig;
+          config.xclk_freq_hz = xclk;
+          config.fb_count = fbCount;
+          config.grab_mode = grabMode;
+          config.fb_location = fbLocation;
+
+          CameraTuningResult& result = results[resultCount];
+          benchmark(config, result);
+
+          if (result.initOk) {
+            Serial.printf("📐 XCLK %2d MHz, fb %d, %-10s, %-5s: %5.1f fps, avg %6lu us, max %6lu us, errors %d/%d, heap %ld, psram %ld\n",
+                          xclk / 1000000, fbCount, grabModeName(grabMode), fbLocationName(fbLocation),
+                          result.fps, (unsigned long)result.avgLatencyUs, (unsigned long)result.maxLatencyUs,
+                          result.errors, result.frames, (long)result.heapCost, (long)result.psramCost);
+          } else {
+            Serial.printf("📐 XCLK %2d MHz, fb %d, %-10s, %-5s: init failed\n",
+                          xclk / 1000000, fbCount, grabModeName(grabMode), fbLocationName(fbLocation));
+          }
+
+          if (isBetter(result, bestIndex >= 0 ? results[bestIndex] : result)) {
+            bestIndex = resultCount;
+          }
+          resultCount++;
+          esp_task_wdt_reset();
+        }
+      }
+    }
+  }
+
+  Serial.printf("📐 Calibration finished: %d configurations in %lu ms\n",
+                resultCount, millis() - startTime);
+
+  if (bestIndex < 0) {
+    Serial.println("❌ No usable camera configuration found - keeping previous tuning");
+    camera_config_t config = baseConfig;
+    applyTo(config);
+    return esp_camera_init(&config) == ESP_OK;
+  }
+
+  const CameraTuningResult& best = results[bestIndex];
+  CameraTuning newTuning;
+  newTuning.valid = true;
+  newTuning.xclkFreqHz = best.xclkFreqHz;
+  newTuning.fbCount = best.fbCount;
+  newTuning.grabMode = best.grabMode;
+  newTuning.fbLocation = best.fbLocation;
+  saveTuning(newTuning);
+
+  Serial.printf("✅ Best configuration: XCLK %d MHz, fb %d, %s, %s (%.1f fps)\n",
+                best.xclkFreqHz / 1000000, best.fbCount,
+                grabModeName(best.grabMode), fbLocationName(best.fbLocation), best.fps);
+
+  // Leave the camera running with the winning configuration
+  camera_config_t config = baseConfig;
+  applyTo(config);
+  return esp_camera_init(&config) == ESP_OK;
+}
+
+bool CameraTuner::benchmark(const camera_config_t& config, CameraTuningResult& result) {
+  memset(&result, 0, sizeof(result));
+  result.xclkFreqHz = config.xclk_freq_hz;
+  result.fbCount = config.fb_count;
+  result.grabMode = config.grab_mode;
+  result.fbLocation = config.fb_location;
+
+  int32_t heapBefore = ESP.getFreeHeap();
+  int32_t psramBefore = ESP.getFreePsram();
+
+  if (esp_camera_init(&config) != ESP_OK) {
+    esp_camera_deinit();
+    return false;
+  }
+  result.initOk = true;
+  result.heapCost = heapBefore - (int32_t)ESP.getFreeHeap();
+  result.psramCost = psramBefore - (int32_t)ESP.getFreePsram();
+
+  // Let auto exposure settle before measuring
+  for (int i = 0; i < CALIBRATION_WARMUP_FRAMES; i++) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (fb) {
+      esp_camera_fb_return(fb);
+    }
+  }
+
+  uint64_t totalLatency = 0;
+  int64_t runStart = esp_timer_get_time();
+
+  for (int i = 0; i < CALIBRATION_FRAMES; i++) {
+    int64_t frameStart = esp_timer_get_time();
+    camera_fb_t* fb = esp_camera_fb_get();
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - frameStart);
+
+    result.frames++;
+    totalLatency += latency;
+    if (latency > result.maxLatencyUs) {
+      result.maxLatencyUs = latency;
+    }
+
+    if (!isValidFrame(fb)) {
+      result.errors++;
+    }
+    if (fb) {
+      esp_camera_fb_return(fb);
+    }
+  }
+
+  int64_t elapsed = esp_timer_get_time() - runStart;
+  result.avgLatencyUs = (uint32_t)(totalLatency / result.frames);
+  result.fps = elapsed > 0 ? (result.frames - result.errors) * 1000000.0f / elapsed : 0;
+
+  esp_camera_deinit();
+  return true;
+}
+
+bool CameraTuner::isBetter(const CameraTuningResult& candidate, const CameraTuningResult& best) const {
+  if (!candidate.initOk || candidate.frames == 0) {
+    return false;
+  }
+  if (candidate.errors * 100 > candidate.frames * CALIBRATION_MAX_ERROR_PCT) {
+    return false;
+  }
+  if (&candidate == &best) {
+    return true;  // First usable result
+  }
+
+  // Within 5% FPS the cheaper configuration wins - internal heap is the scarce resource
+  if (candidate.fps > best.fps * 1.05f) {
+    return true;
+  }
+  if (candidate.fps < best.fps * 0.95f) {
+    return false;
+  }
+  if (candidate.heapCost != best.heapCost) {
+    return candidate.heapCost < best.heapCost;
+  }
+  return candidate.avgLatencyUs < best.avgLatencyUs;
+}
+
+bool CameraTuner::isValidFrame(const camera_fb_t* fb) const {
+  if (!fb || fb->len < 4) {
+    return false;
+  }
+  if (fb->format != PIXFORMAT_JPEG) {
+    return true;
+  }
+
+  // JPEG must start with SOI and carry an EOI near the end (the driver may pad)
+  if (fb->buf[0] != 0xFF || fb->buf[1] != 0xD8) {
+    return false;
+  }
+  size_t searchFrom = fb->len > 32 ? fb->len - 32 : 1;
+  for (size_t i = fb->len - 1; i >= searchFrom; i--) {
+    if (fb->buf[i - 1] == 0xFF && fb->buf[i] == 0xD9) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t CameraTuner::getResultCount() const {
+  return resultCount;
+}
+
+const CameraTuningResult& CameraTuner::getResult(size_t index) const {
+  return results[index];
+}
+
+void CameraTuner::writeStatusJson(Print& out) const {
+  out.print("{\"tuning\":");
+  if (tuning.valid) {
+    printfTo(out, "{\"xclk_hz\":%ld,\"fb_count\":%d,\"grab_mode\":\"%s\",\"fb_location\":\"%s\"}",
+             (long)tuning.xclkFreqHz, (int)tuning.fbCount, grabModeName(tuning.grabMode),
+             fbLocationName(tuning.fbLocation));
+  } else {
+    out.print("null");
+  }
+
+  out.print(",\"results\":[");
+  for (size_t i = 0; i < resultCount; i++) {
+    const CameraTuningResult& r = results[i];
+    if (i > 0) out.print(",");
+    printfTo(out, "{\"xclk_hz\":%ld,\"fb_count\":%d,\"grab_mode\":\"%s\",\"fb_location\":\"%s\",\"init_ok\":%s",
+             (long)r.xclkFreqHz, (int)r.fbCount, grabModeName(r.grabMode), fbLocationName(r.fbLocation),
+             r.initOk ? "true" : "false");
+    printfTo(out, ",\"fps\":%.2f,\"avg_latency_us\":%lu,\"max_latency_us\":%lu,\"frames\":%lu,\"errors\":%lu",
+             r.fps, (unsigned long)r.avgLatencyUs, (unsigned long)r.maxLatencyUs, (unsigned long)r.frames,
+             (unsigned long)r.errors);
+    printfTo(out, ",\"heap_cost\":%ld,\"psram_cost\":%ld,\"best\":%s}", (long)r.heapCost, (long)r.psramCost,
+             (int)i == bestIndex ? "true" : "false");
+  }
+  out.print("]}");
+}
+
+void CameraTuner::saveTuning(const CameraTuning& newTuning) {
+  preferences.putInt("xclk", newTuning.xclkFreqHz);
+  preferences.putUChar("fb_count", newTuning.fbCount);
+  preferences.putUChar("grab", (uint8_t)newTuning.grabMode);
+  preferences.putUChar("fb_loc", (uint8_t)newTuning.fbLocation);
+  tuning = newTuning;
+  Serial.println("Camera tuning saved to memory");
+}
+
+CameraTuning CameraTuner::loadTuning() {
+  CameraTuning loaded;
+  loaded.xclkFreqHz = preferences.getInt("xclk", 0);
+  loaded.fbCount = preferences.getUChar("fb_count", 0);
+  loaded.grabMode = (camera_grab_mode_t)preferences.getUChar("grab", CAMERA_GRAB_WHEN_EMPTY);
+  loaded.fbLocation = (camera_fb_location_t)preferences.getUChar("fb_loc", CAMERA_FB_IN_DRAM);
+  loaded.valid = loaded.xclkFreqHz > 0 && loaded.fbCount > 0;
+  return loaded;
+}
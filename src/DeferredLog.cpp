@@ -0,0 +1,213 @@
+#include "DeferredLog.h"
+#include "esp_heap_caps.h"
+#include <new>
+
+DeferredLog deferredLog;
+
+static const char DLOG_LEVEL_CHARS[] = { '-', 'E', 'W', 'I', 'D' };
+
+DeferredLog::DeferredLog()
+  : history(nullptr), historyCount(0), historyMutex(NULL), taskHandle(NULL),
+    written(0), dropped(0), started(false) {
+  for (auto& ring : rings) {
+    ring.slots = nullptr;
+    ring.head.store(0);
+    ring.tail.store(0);
+  }
+}
+
+bool DeferredLog::begin() {
+  if (started) {
+    return true;
+  }
+
+  // Rings and history live in PSRAM when available - internal RAM is reserved for DMA/WiFi
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  for (auto& ring : rings) {
+    ring.slots = (Slot*)heap_caps_calloc(DLOG_RING_SIZE, sizeof(Slot), caps);
+    if (!ring.slots) {
+      Serial.println("❌ Deferred log: ring allocation failed - logging stays synchronous");
+      return false;
+    }
+    for (int i = 0; i < DLOG_RING_SIZE; i++) {
+      new (&ring.slots[i].sequence) std::atomic<uint32_t>(0);
+    }
+  }
+
+  history = (DeferredLogRecord*)heap_caps_calloc(DLOG_HISTORY_SIZE, sizeof(DeferredLogRecord), caps);
+  historyMutex = xSemaphoreCreateMutex();
+  if (!history || !historyMutex) {
+    Serial.println("❌ Deferred log: history allocation failed - logging stays synchronous");
+    return false;
+  }
+
+  // Lowest useful priority: formatting and UART output only run when capture is idle
+  xTaskCreatePinnedToCore(logTask, "DeferredLog", DLOG_TASK_STACK, this, 1, &taskHandle, 0);
+  if (!taskHandle) {
+    Serial.println("❌ Deferred log: failed to create log task");
+    return false;
+  }
+
+  started = true;
+  Serial.printf("✅ Deferred log ready (%d records/core, level %d)\n", DLOG_RING_SIZE, DLOG_LEVEL);
+  return true;
+}
+
+void DeferredLog::push(uint8_t level, const char* format, const uint32_t* args, uint8_t argCount) {
+  if (!started) {
+    // Before begin() (or if it failed) fall back to printing in place
+    DeferredLogRecord record;
+    record.timestampMs = millis();
+    record.format = format;
+    record.level = level;
+    record.core = xPortGetCoreID();
+    record.argCount = argCount;
+    memcpy(record.args, args, argCount * sizeof(uint32_t));
+    char line[192];
+    formatRecord(record, line, sizeof(line));
+    Serial.print(line);
+    return;
+  }
+
+  Ring& ring = rings[xPortGetCoreID()];
+
+  // Reserve a ticket; a full ring drops the record instead of waiting
+  uint32_t ticket = ring.head.load(std::memory_order_relaxed);
+  do {
+    if (ticket - ring.tail.load(std::memory_order_acquire) >= DLOG_RING_SIZE) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  } while (!ring.head.compare_exchange_weak(ticket, ticket + 1,
+                                            std::memory_order_acq_rel, std::memory_order_relaxed));
+
+  Slot& slot = ring.slots[ticket & (DLOG_RING_SIZE - 1)];
+  slot.record.timestampMs = millis();
+  slot.record.format = format;
+  slot.record.level = level;
+  slot.record.core = xPortGetCoreID();
+  slot.record.argCount = argCount;
+  memcpy(slot.record.args, args, argCount * sizeof(uint32_t));
+  slot.sequence.store(ticket + 1, std::memory_order_release);
+
+  written.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool DeferredLog::peek(uint8_t core, DeferredLogRecord*& record) {
+  Ring& ring = rings[core];
+  uint32_t ticket = ring.tail.load(std::memory_order_relaxed);
+  Slot& slot = ring.slots[ticket & (DLOG_RING_SIZE - 1)];
+  if (slot.sequence.load(std::memory_order_acquire) != ticket + 1) {
+    return false;   // Empty, or the producer has not finished writing this slot yet
+  }
+  record = &slot.record;
+  return true;
+}
+
+bool DeferredLog::popOldest(DeferredLogRecord& record) {
+  // Merge the per-core rings by timestamp
+  int oldestCore = -1;
+  DeferredLogRecord* oldest = nullptr;
+  for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+    DeferredLogRecord* candidate;
+    if (peek(core, candidate) &&
+        (!oldest || (int32_t)(candidate->timestampMs - oldest->timestampMs) < 0)) {
+      oldest = candidate;
+      oldestCore = core;
+    }
+  }
+  if (!oldest) {
+    return false;
+  }
+
+  record = *oldest;
+  Ring& ring = rings[oldestCore];
+  ring.tail.store(ring.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  return true;
+}
+
+size_t DeferredLog::formatRecord(const DeferredLogRecord& record, char* buffer, size_t size) {
+  int used = snprintf(buffer, size, "[%6lu.%03lu] %c/C%u ",
+                      (unsigned long)(record.timestampMs / 1000), (unsigned long)(record.timestampMs % 1000),
+                      DLOG_LEVEL_CHARS[record.level <= DLOG_LEVEL_DEBUG ? record.level : 0], record.core);
+  if (used < 0 || (size_t)used >= size) {
+    return size - 1;
+  }
+
+  // Unused trailing arguments are ignored by the formatter
+  const uint32_t* a = record.args;
+  int body = snprintf(buffer + used, size - used, record.format, a[0], a[1], a[2], a[3], a[4], a[5]);
+  if (body < 0) {
+    return used;
+  }
+  used += body;
+  if ((size_t)used >= size) {
+    used = size - 1;
+  }
+
+  // Every emitted line ends with exactly one newline
+  if (used == 0 || buffer[used - 1] != '\n') {
+    if ((size_t)used + 1 < size) {
+      buffer[used++] = '\n';
+      buffer[used] = '\0';
+    } else {
+      buffer[size - 2] = '\n';
+    }
+  }
+  return used;
+}
+
+void DeferredLog::drain() {
+  DeferredLogRecord record;
+  char line[192];
+  while (popOldest(record)) {
+    formatRecord(record, line, sizeof(line));
+    Serial.print(line);
+
+    if (xSemaphoreTake(historyMutex, portMAX_DELAY) == pdTRUE) {
+      history[historyCount & (DLOG_HISTORY_SIZE - 1)] = record;
+      historyCount++;
+      xSemaphoreGive(historyMutex);
+    }
+  }
+}
+
+void DeferredLog::logTask(void* parameter) {
+  DeferredLog* self = static_cast<DeferredLog*>(parameter);
+  uint32_t reportedDrops = 0;
+
+  while (true) {
+    self->drain();
+
+    uint32_t drops = self->getDropped();
+    if (drops != reportedDrops) {
+      Serial.printf("⚠️ Deferred log: %lu records dropped (ring full)\n", (unsigned long)(drops - reportedDrops));
+      reportedDrops = drops;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(DLOG_FLUSH_MS));
+  }
+}
+
+void DeferredLog::writeHistory(Print& out, uint8_t maxLevel) {
+  out.printf("# deferred log: %lu written, %lu dropped, level %d\n",
+             (unsigned long)getWritten(), (unsigned long)getDropped(), DLOG_LEVEL);
+  if (!started) {
+    return;
+  }
+
+  char line[192];
+  if (xSemaphoreTake(historyMutex, pdMS_TO_TICKS(500)) != pdTRUE) {
+    out.print("# history busy\n");
+    return;
+  }
+  uint32_t count = historyCount < DLOG_HISTORY_SIZE ? historyCount : DLOG_HISTORY_SIZE;
+  for (uint32_t i = historyCount - count; i != historyCount; i++) {
+    const DeferredLogRecord& record = history[i & (DLOG_HISTORY_SIZE - 1)];
+    if (record.level <= maxLevel) {
+      formatRecord(record, line, sizeof(line));
+      out.print(line);
+    }
+  }
+  xSemaphoreGive(historyMutex);
+}
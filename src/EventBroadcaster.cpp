@@ -0,0 +1,175 @@
+#include "EventBroadcaster.h"
+#include "RequestArena.h"
+#include "esp_heap_caps.h"
+#include <stdarg.h>
+#include <memory>
+#include <new>
+
+EventBroadcaster eventBroadcaster;
+
+static const char* const EVENT_NAMES[EVENT_TYPE_COUNT] = { "photo", "job", "sd", "memory" };
+
+EventBroadcaster::EventBroadcaster() : ring(nullptr), nextTicket(0), clients(0) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool EventBroadcaster::begin() {
+  if (ring) {
+    return true;
+  }
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  ring = (BroadcastEvent*)heap_caps_calloc(EVENT_RING_SIZE, sizeof(BroadcastEvent), caps);
+  if (!ring) {
+    Serial.println("❌ Event broadcaster: ring allocation failed - /events disabled");
+    return false;
+  }
+  for (int i = 0; i < EVENT_RING_SIZE; i++) {
+    new (&ring[i].sequence) std::atomic<uint32_t>(0);
+  }
+  Serial.printf("✅ Event broadcaster ready (%d events, %d clients)\n", EVENT_RING_SIZE, EVENT_MAX_CLIENTS);
+  return true;
+}
+
+const char* EventBroadcaster::typeName(EventType type) {
+  return type < EVENT_TYPE_COUNT ? EVENT_NAMES[type] : "unknown";
+}
+
+void EventBroadcaster::publish(EventType type, const char* format, ...) {
+  if (!ring) {
+    return;
+  }
+  // Same slot protocol as the trace ring: readers skip slots whose sequence moved
+  uint32_t ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+  BroadcastEvent& event = ring[ticket & (EVENT_RING_SIZE - 1)];
+  event.sequence.store(0, std::memory_order_release);
+  event.type = type;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(event.data, sizeof(event.data), format, args);
+  va_end(args);
+  event.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+void EventBroadcaster::handleRequest(AsyncWebServerRequest* request) {
+  if (!ring) {
+    request->send(503, "text/plain", "Events unavailable");
+    return;
+  }
+  // Claim a client slot without a lock
+  uint8_t current = clients.load(std::memory_order_relaxed);
+  do {
+    if (current >= EVENT_MAX_CLIENTS) {
+      stats.rejected++;
+      AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Too many event clients");
+      response->addHeader("Retry-After", "10");
+      request->send(response);
+      return;
+    }
+  } while (!clients.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+  stats.connects++;
+
+  // Per-client stream state; freed with the response when the browser goes away
+  struct ClientState {
+    uint32_t cursor;          // Next ticket to send
+    uint32_t lastSendMs;
+    bool resync;              // Tell the client it missed events
+    bool greeted;
+    char pending[EVENT_DATA_LEN + 64];
+    size_t pendingLen;
+    size_t pendingPos;
+  };
+
+  std::shared_ptr<ClientState> state = std::make_shared<ClientState>();
+  uint32_t end = nextTicket.load(std::memory_order_acquire);
+  state->cursor = end;
+  state->resync = false;
+  // A reconnecting browser sends the last id it saw; replay from there if it is still in the ring
+  if (request->hasHeader("Last-Event-ID")) {
+    uint32_t lastId = strtoul(request->getHeader("Last-Event-ID")->value().c_str(), nullptr, 10);
+    if (end - (lastId + 1) <= EVENT_CLIENT_BACKLOG) {
+      state->cursor = lastId + 1;
+    } else {
+      state->resync = true;
+    }
+  }
+  state->lastSendMs = millis();
+  state->greeted = false;
+  state->pendingLen = 0;
+  state->pendingPos = 0;
+
+  request->onDisconnect([this]() {
+    clients.fetch_sub(1, std::memory_order_relaxed);
+  });
+
+  AsyncWebServerResponse* response = request->beginChunkedResponse("text/event-stream",
+    [this, state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      size_t used = 0;
+      while (used < maxLen) {
+        // Flush whatever did not fit into the previous chunk
+        if (state->pendingPos < state->pendingLen) {
+          size_t n = state->pendingLen - state->pendingPos;
+          if (n > maxLen - used) n = maxLen - used;
+          memcpy(buffer + used, state->pending + state->pendingPos, n);
+          state->pendingPos += n;
+          used += n;
+          continue;
+        }
+
+        state->pendingLen = 0;
+        state->pendingPos = 0;
+        uint32_t end = nextTicket.load(std::memory_order_acquire);
+        if (!state->greeted) {
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending), "retry: %d\n: connected\n\n", EVENT_RETRY_MS);
+          state->greeted = true;
+        } else if (state->resync || end - state->cursor > EVENT_CLIENT_BACKLOG) {
+          // Too far behind - drop the backlog rather than let the queue grow
+          if (end - state->cursor > EVENT_CLIENT_BACKLOG) {
+            stats.skipped += end - state->cursor - EVENT_CLIENT_BACKLOG;
+            state->cursor = end - EVENT_CLIENT_BACKLOG;
+          }
+          state->resync = false;
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending), "event: resync\ndata: {}\n\n");
+        } else if (state->cursor != end) {
+          uint32_t ticket = state->cursor;
+          const BroadcastEvent& slot = ring[ticket & (EVENT_RING_SIZE - 1)];
+          uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+          if (sequence == 0 || (int32_t)(sequence - (ticket + 1)) < 0) {
+            break;    // Claimed but still being written - pick it up on the next poll
+          }
+          state->cursor++;
+          if (sequence != ticket + 1) {
+            stats.skipped++;    // Already overwritten by a later lap
+            continue;
+          }
+          int written = snprintf(state->pending, sizeof(state->pending), "id: %lu\nevent: %s\ndata: %s\n\n",
+                                 (unsigned long)ticket, typeName((EventType)slot.type), slot.data);
+          if (slot.sequence.load(std::memory_order_acquire) != ticket + 1) {
+            stats.skipped++;
+            continue;
+          }
+          state->pendingLen = written < (int)sizeof(state->pending) ? written : sizeof(state->pending) - 1;
+          stats.delivered++;
+        } else if (used == 0 && millis() - state->lastSendMs > EVENT_KEEPALIVE_MS) {
+          // Comment line keeps proxies from timing out and exposes dead connections
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending), ": ping\n\n");
+        } else {
+          break;
+        }
+      }
+      if (used == 0) {
+        return RESPONSE_TRY_AGAIN;    // Caught up - the server polls us again shortly
+      }
+      state->lastSendMs = millis();
+      return used;
+    });
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+void EventBroadcaster::writeStatusJson(Print& out) {
+  printfTo(out, "{\"clients\":%u,\"max_clients\":%d,\"published\":%lu", (unsigned)getClientCount(), EVENT_MAX_CLIENTS,
+           (unsigned long)nextTicket.load(std::memory_order_relaxed));
+  printfTo(out, ",\"delivered\":%lu,\"skipped\":%lu,\"connects\":%lu,\"rejected\":%lu}",
+           (unsigned long)stats.delivered, (unsigned long)stats.skipped, (unsigned long)stats.connects,
+           (unsigned long)stats.rejected);
+}
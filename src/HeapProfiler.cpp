@@ -0,0 +1,392 @@
+#include "HeapProfiler.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef ARDUINO
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#else
+#include <atomic>
+#endif
+
+HeapProfiler heapProfiler;
+
+// Platform glue: the lock has to be usable from inside malloc, so it never allocates
+#ifdef ARDUINO
+static portMUX_TYPE profilerLock = portMUX_INITIALIZER_UNLOCKED;
+#define PROFILER_LOCK() portENTER_CRITICAL_SAFE(&profilerLock)
+#define PROFILER_UNLOCK() portEXIT_CRITICAL_SAFE(&profilerLock)
+
+static inline const void* currentTask() {
+  return xTaskGetCurrentTaskHandle();
+}
+
+static inline const char* currentTaskName() {
+  return xTaskGetCurrentTaskHandle() ? pcTaskGetName(NULL) : "startup";
+}
+#else
+static std::atomic_flag profilerLock = ATOMIC_FLAG_INIT;
+#define PROFILER_LOCK() while (profilerLock.test_and_set(std::memory_order_acquire)) {}
+#define PROFILER_UNLOCK() profilerLock.clear(std::memory_order_release)
+
+static inline const void* currentTask() {
+  static thread_local char marker;
+  return &marker;
+}
+
+static inline const char* currentTaskName() {
+  return "host";
+}
+#endif
+
+static const uint8_t OVERFLOW_TAG = HEAP_PROFILER_MAX_TAGS - 1;
+
+bool HeapProfiler::begin() {
+#if HEAP_PROFILER
+  if (live) {
+    return true;
+  }
+  size_t bytes = HEAP_PROFILER_MAX_LIVE * sizeof(LiveEntry) + 2 * HEAP_PROFILER_MAX_TAGS * sizeof(HeapTagStats);
+#ifdef ARDUINO
+  // heap_caps_* is not wrapped, so the tables themselves never show up in the profile
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  uint8_t* block = (uint8_t*)heap_caps_calloc(1, bytes, caps);
+#else
+  uint8_t* block = (uint8_t*)calloc(1, bytes);
+#endif
+  if (!block) {
+    return false;
+  }
+  PROFILER_LOCK();
+  liveCount = 0;
+  tagCount = 0;
+  tags = (HeapTagStats*)(block + HEAP_PROFILER_MAX_LIVE * sizeof(LiveEntry));
+  report = tags + HEAP_PROFILER_MAX_TAGS;
+  memset(contexts, 0, sizeof(contexts));
+  memset(&totals, 0, sizeof(totals));
+  strncpy(tags[OVERFLOW_TAG].taskName, "(other)", HEAP_PROFILER_NAME_LEN - 1);
+  live = (LiveEntry*)block;   // Published last: the hooks start recording from here
+  PROFILER_UNLOCK();
+#ifdef ARDUINO
+  Serial.printf("✅ Heap profiler tracking up to %d live allocations\n", HEAP_PROFILER_MAX_LIVE);
+#endif
+  return true;
+#else
+  return false;
+#endif
+}
+
+uint32_t HeapProfiler::slotFor(uintptr_t ptr) {
+  // Heap blocks are at least 4-byte aligned; Fibonacci hashing spreads the rest
+  return ((uint32_t)(ptr >> 2) * 2654435761u) & (HEAP_PROFILER_MAX_LIVE - 1);
+}
+
+bool HeapProfiler::insertLive(uintptr_t ptr, uint32_t size, uint8_t tag) {
+  // Keep the table below 7/8 full so probe chains stay short
+  if (liveCount >= HEAP_PROFILER_MAX_LIVE - HEAP_PROFILER_MAX_LIVE / 8) {
+    return false;
+  }
+  uint32_t slot = slotFor(ptr);
+  while (live[slot].ptr != 0) {
+    slot = (slot + 1) & (HEAP_PROFILER_MAX_LIVE - 1);
+  }
+  live[slot].ptr = ptr;
+  live[slot].size = size;
+  live[slot].tag = tag;
+  liveCount++;
+  return true;
+}
+
+bool HeapProfiler::removeLive(uintptr_t ptr, uint32_t& size, uint8_t& tag) {
+  const uint32_t mask = HEAP_PROFILER_MAX_LIVE - 1;
+  uint32_t slot = slotFor(ptr);
+  while (live[slot].ptr != ptr) {
+    if (live[slot].ptr == 0) {
+      return false;   // Allocated before begin() or not tracked
+    }
+    slot = (slot + 1) & mask;
+  }
+  size = live[slot].size;
+  tag = live[slot].tag;
+
+  // Backward-shift deletion keeps linear probing correct without tombstones
+  uint32_t hole = slot;
+  uint32_t next = slot;
+  while (true) {
+    next = (next + 1) & mask;
+    if (live[next].ptr == 0) {
+      break;
+    }
+    uint32_t home = slotFor(live[next].ptr);
+    bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+    if (movable) {
+      live[hole] = live[next];
+      hole = next;
+    }
+  }
+  live[hole].ptr = 0;
+  liveCount--;
+  return true;
+}
+
+const char* HeapProfiler::currentContext(const void* task) const {
+  for (uint8_t i = 0; i < HEAP_PROFILER_MAX_CONTEXTS; i++) {
+    if (contexts[i].task == task) {
+      return contexts[i].context;
+    }
+  }
+  return nullptr;
+}
+
+uint8_t HeapProfiler::findTag(const void* task, const char* context, const char* taskName) {
+  for (uint8_t i = 0; i < tagCount; i++) {
+    if (tags[i].task == task && tags[i].context == context) {
+      return i;
+    }
+  }
+  if (tagCount >= OVERFLOW_TAG) {
+    return OVERFLOW_TAG;
+  }
+  HeapTagStats& tag = tags[tagCount];
+  tag.task = task;
+  tag.context = context;
+  strncpy(tag.taskName, taskName, HEAP_PROFILER_NAME_LEN - 1);
+  tag.taskName[HEAP_PROFILER_NAME_LEN - 1] = '\0';
+  return tagCount++;
+}
+
+void HeapProfiler::recordAlloc(void* ptr, size_t size) {
+  if (!live || !ptr) {
+    return;
+  }
+  const void* task = currentTask();
+  const char* taskName = currentTaskName();
+
+  PROFILER_LOCK();
+  uint8_t index = findTag(task, currentContext(task), taskName);
+  HeapTagStats& tag = tags[index];
+  tag.allocs++;
+  tag.bytes += size;
+  tag.liveBytes += size;
+  if (tag.liveBytes > tag.peakLiveBytes) tag.peakLiveBytes = tag.liveBytes;
+  if (size > tag.largest) tag.largest = size;
+
+  totals.allocs++;
+  if (insertLive((uintptr_t)ptr, size, index)) {
+    totals.liveBytes += size;
+    totals.liveBlocks++;
+    if (totals.liveBytes > totals.peakLiveBytes) totals.peakLiveBytes = totals.liveBytes;
+  } else {
+    totals.untracked++;
+    tag.liveBytes -= size;   // Its free will not be matched either
+  }
+  PROFILER_UNLOCK();
+}
+
+void HeapProfiler::recordFree(void* ptr) {
+  if (!live || !ptr) {
+    return;
+  }
+  PROFILER_LOCK();
+  uint32_t size;
+  uint8_t index;
+  if (removeLive((uintptr_t)ptr, size, index)) {
+    // Charged to the tag that allocated it, whoever frees it
+    HeapTagStats& tag = tags[index];
+    tag.frees++;
+    tag.liveBytes -= size;
+    totals.frees++;
+    totals.liveBytes -= size;
+    totals.liveBlocks--;
+  }
+  PROFILER_UNLOCK();
+}
+
+const char* HeapProfiler::enterContext(const char* context) {
+  const void* task = currentTask();
+  const char* previous = nullptr;
+  PROFILER_LOCK();
+  int8_t freeSlot = -1;
+  for (uint8_t i = 0; i < HEAP_PROFILER_MAX_CONTEXTS; i++) {
+    if (contexts[i].task == task) {
+      previous = contexts[i].context;
+      contexts[i].context = context;
+      freeSlot = -2;
+      break;
+    }
+    if (freeSlot == -1 && contexts[i].task == nullptr) {
+      freeSlot = i;
+    }
+  }
+  if (freeSlot >= 0) {
+    contexts[freeSlot].task = task;
+    contexts[freeSlot].context = context;
+  }
+  PROFILER_UNLOCK();
+  return previous;
+}
+
+void HeapProfiler::leaveContext(const char* previous) {
+  const void* task = currentTask();
+  PROFILER_LOCK();
+  for (uint8_t i = 0; i < HEAP_PROFILER_MAX_CONTEXTS; i++) {
+    if (contexts[i].task == task) {
+      contexts[i].context = previous;
+      if (!previous) {
+        contexts[i].task = nullptr;
+      }
+      break;
+    }
+  }
+  PROFILER_UNLOCK();
+}
+
+void HeapProfiler::reset() {
+  if (!live) {
+    return;
+  }
+  PROFILER_LOCK();
+  // Live bytes and peaks restart from what is currently outstanding
+  for (uint8_t i = 0; i < HEAP_PROFILER_MAX_TAGS; i++) {
+    tags[i].allocs = 0;
+    tags[i].frees = 0;
+    tags[i].bytes = 0;
+    tags[i].largest = 0;
+    tags[i].peakLiveBytes = tags[i].liveBytes;
+  }
+  totals.allocs = 0;
+  totals.frees = 0;
+  totals.untracked = 0;
+  totals.peakLiveBytes = totals.liveBytes;
+  PROFILER_UNLOCK();
+}
+
+HeapProfilerTotals HeapProfiler::getTotals() {
+  if (!live) {
+    HeapProfilerTotals empty = { 0, 0, 0, 0, 0, 0 };
+    return empty;
+  }
+  PROFILER_LOCK();
+  HeapProfilerTotals copy = totals;
+  PROFILER_UNLOCK();
+  return copy;
+}
+
+uint32_t HeapProfiler::getTaskAllocs(const void* task) {
+  uint32_t allocs = 0;
+  PROFILER_LOCK();
+  for (uint8_t i = 0; i < tagCount; i++) {
+    if (tags[i].task == task) {
+      allocs += tags[i].allocs;
+    }
+  }
+  PROFILER_UNLOCK();
+  return allocs;
+}
+
+static uint32_t sortKey(const HeapTagStats& tag, HeapProfileSort sort) {
+  switch (sort) {
+    case HEAP_SORT_BYTES: return tag.bytes;
+    case HEAP_SORT_COUNT: return tag.allocs;
+    default: return tag.peakLiveBytes;
+  }
+}
+
+uint8_t HeapProfiler::getTopTags(HeapTagStats* out, uint8_t max, HeapProfileSort sort) {
+  if (!live) {
+    return 0;
+  }
+  uint8_t count = 0;
+  PROFILER_LOCK();
+  for (uint8_t i = 0; i < HEAP_PROFILER_MAX_TAGS && count < HEAP_PROFILER_MAX_TAGS; i++) {
+    if (i < tagCount || (i == OVERFLOW_TAG && tags[i].allocs > 0)) {
+      report[count++] = tags[i];
+    }
+  }
+  PROFILER_UNLOCK();
+
+  // Insertion sort, largest first (at most HEAP_PROFILER_MAX_TAGS entries)
+  for (uint8_t i = 1; i < count; i++) {
+    HeapTagStats entry = report[i];
+    uint32_t key = sortKey(entry, sort);
+    int j = i - 1;
+    while (j >= 0 && sortKey(report[j], sort) < key) {
+      report[j + 1] = report[j];
+      j--;
+    }
+    report[j + 1] = entry;
+  }
+
+  if (count > max) {
+    count = max;
+  }
+  if (out != report) {
+    memcpy(out, report, count * sizeof(HeapTagStats));
+  }
+  return count;
+}
+
+#ifdef ARDUINO
+void HeapProfiler::writeReportJson(Print& out, uint8_t top, HeapProfileSort sort) {
+  out.printf("{\"enabled\":%s", isActive() ? "true" : "false");
+  if (!isActive()) {
+    out.print(",\"hint\":\"flash the esp32-s3-devkitc-1-heapprof environment\"}");
+    return;
+  }
+
+  HeapProfilerTotals t = getTotals();
+  out.printf(",\"allocs\":%lu,\"frees\":%lu,\"live_bytes\":%lu,\"live_blocks\":%lu,\"peak_live_bytes\":%lu,\"untracked\":%lu",
+             (unsigned long)t.allocs, (unsigned long)t.frees, (unsigned long)t.liveBytes,
+             (unsigned long)t.liveBlocks, (unsigned long)t.peakLiveBytes, (unsigned long)t.untracked);
+  out.printf(",\"sort\":\"%s\",\"tags\":[",
+             sort == HEAP_SORT_BYTES ? "bytes" : sort == HEAP_SORT_COUNT ? "count" : "peak");
+
+  uint8_t count = getTopTags(report, top, sort);
+  for (uint8_t i = 0; i < count; i++) {
+    const HeapTagStats& tag = report[i];
+    out.printf("%s{\"task\":\"%s\",\"context\":\"%s\",\"allocs\":%lu,\"frees\":%lu,\"bytes\":%lu,"
+               "\"live_bytes\":%lu,\"peak_live_bytes\":%lu,\"largest\":%lu}",
+               i > 0 ? "," : "", tag.taskName, tag.context ? tag.context : "",
+               (unsigned long)tag.allocs, (unsigned long)tag.frees, (unsigned long)tag.bytes,
+               (unsigned long)tag.liveBytes, (unsigned long)tag.peakLiveBytes, (unsigned long)tag.largest);
+  }
+  out.print("]}");
+}
+#endif
+
+// Linker-level hooks (-Wl,--wrap=...). realloc is booked as a free plus a new allocation.
+#if HEAP_PROFILER
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  heapProfiler.recordAlloc(ptr, size);
+  return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* ptr = __real_calloc(count, size);
+  heapProfiler.recordAlloc(ptr, count * size);
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  void* moved = __real_realloc(ptr, size);
+  if (moved || size == 0) {
+    heapProfiler.recordFree(ptr);
+    heapProfiler.recordAlloc(moved, size);
+  }
+  return moved;
+}
+
+void __wrap_free(void* ptr) {
+  heapProfiler.recordFree(ptr);
+  __real_free(ptr);
+}
+}
+#endif
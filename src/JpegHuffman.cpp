@@ -0,0 +1,672 @@
+#include "JpegHuffman.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+struct DecodeTable {
+  bool defined;
+  uint8_t bits[17];                         // Codes of each length
+  uint8_t values[256];
+  int32_t maxCode[18];                      // Largest code of each length, -1 = none
+  int32_t valuePointer[17];
+  int32_t minCode[17];
+  uint8_t lookupLen[256];                   // 8-bit lookahead, 0 = longer code
+  uint8_t lookupValue[256];
+};
+
+struct EncodeTable {
+  uint8_t bits[17];
+  uint8_t values[256];
+  uint16_t count;
+  uint16_t code[256];
+  uint8_t size[256];
+};
+
+struct ScanComponent {
+  uint8_t blocksPerMcu;
+  uint8_t dcSlot;
+  uint8_t acSlot;
+};
+
+// Working arrays of the table builders; ~3.8 KB that would not fit a task stack
+struct TableScratch {
+  uint32_t freq[257];
+  int codeSize[257];
+  int others[257];
+  uint16_t codes[256];
+  uint8_t sizes[256];
+};
+
+struct Work {
+  DecodeTable decode[JPEG_HUFF_SLOTS];
+  EncodeTable encode[JPEG_HUFF_SLOTS];
+  uint32_t freq[JPEG_HUFF_SLOTS][256];
+  bool used[JPEG_HUFF_SLOTS];
+  TableScratch scratch;
+};
+
+class BitReader {
+public:
+  const uint8_t* data;
+  size_t len;
+  size_t pos;
+  uint32_t acc;                             // Valid bits left-aligned
+  int bits;
+  int fakeBits;                             // Zero bits appended at a marker or the end
+  bool atMarker;
+  bool overrun;
+
+  void begin(const uint8_t* scan, size_t scanLen) {
+    data = scan;
+    len = scanLen;
+    pos = 0;
+    acc = 0;
+    bits = 0;
+    fakeBits = 0;
+    atMarker = false;
+    overrun = false;
+  }
+
+  void fill() {
+    while (bits <= 24) {
+      uint32_t byte = 0;
+      if (atMarker || pos >= len) {
+        fakeBits += 8;
+      } else if (data[pos] != 0xFF) {
+        byte = data[pos++];
+      } else if (pos + 1 < len && data[pos + 1] == 0x00) {
+        byte = 0xFF;                        // Stuffed
+        pos += 2;
+      } else {
+        atMarker = true;                    // pos stays on the marker
+        fakeBits += 8;
+      }
+      acc |= byte << (24 - bits);
+      bits += 8;
+    }
+  }
+
+  uint32_t peek(int n) const { return acc >> (32 - n); }
+
+  void consume(int n) {
+    acc <<= n;
+    bits -= n;
+    if (bits < fakeBits) {
+      overrun = true;
+    }
+  }
+
+  uint32_t receive(int n) {
+    if (n == 0) {
+      return 0;
+    }
+    fill();
+    uint32_t value = peek(n);
+    consume(n);
+    return value;
+  }
+
+  // Real bits left over must only be the padding of the last byte
+  bool finishSegment() {
+    return !overrun && bits - fakeBits < 8;
+  }
+
+  bool restart(uint8_t expected) {
+    if (!finishSegment()) {
+      return false;
+    }
+    acc = 0;
+    bits = 0;
+    fakeBits = 0;
+    atMarker = false;
+    while (pos + 1 < len && data[pos] == 0xFF && data[pos + 1] == 0xFF) {
+      pos++;                                // Fill bytes before a marker
+    }
+    if (pos + 1 >= len || data[pos] != 0xFF || data[pos + 1] != 0xD0 + (expected & 7)) {
+      return false;
+    }
+    pos += 2;
+    return true;
+  }
+};
+
+class BitWriter {
+public:
+  uint8_t* out;
+  size_t size;
+  size_t pos;
+  uint32_t acc;
+  int bits;
+  bool full;
+
+  void begin(uint8_t* buffer, size_t bufferSize, size_t start) {
+    out = buffer;
+    size = bufferSize;
+    pos = start;
+    acc = 0;
+    bits = 0;
+    full = false;
+  }
+
+  void emit(uint8_t byte) {
+    if (pos >= size) {
+      full = true;
+      return;
+    }
+    out[pos++] = byte;
+  }
+
+  void put(uint32_t value, int n) {
+    acc = (acc << n) | (value & ((1UL << n) - 1));
+    bits += n;
+    while (bits >= 8) {
+      uint8_t byte = (acc >> (bits - 8)) & 0xFF;
+      emit(byte);
+      if (byte == 0xFF) {
+        emit(0x00);
+      }
+      bits -= 8;
+    }
+  }
+
+  void flush() {
+    if (bits > 0) {
+      put(0x7F, 8 - bits);                  // Pad with one bits
+    }
+    acc = 0;
+  }
+
+  void marker(uint8_t code) {
+    flush();
+    emit(0xFF);
+    emit(code);
+  }
+};
+
+uint16_t get16(const uint8_t* p) {
+  return (p[0] << 8) | p[1];
+}
+
+bool buildDecodeTable(DecodeTable& table, TableScratch& scratch) {
+  uint16_t* codes = scratch.codes;
+  uint8_t* sizes = scratch.sizes;
+  int count = 0;
+  uint32_t code = 0;
+  for (int length = 1; length <= 16; length++) {
+    table.valuePointer[length] = count;
+    table.minCode[length] = code;
+    for (int i = 0; i < table.bits[length]; i++) {
+      if (count >= 256) {
+        return false;
+      }
+      codes[count] = code;
+      sizes[count] = length;
+      count++;
+      code++;
+    }
+    if (code > (1UL << length)) {
+      return false;                         // Over-subscribed
+    }
+    table.maxCode[length] = table.bits[length] ? (int32_t)code - 1 : -1;
+    code <<= 1;
+  }
+  table.maxCode[17] = 0x7FFFFFFF;
+  memset(table.lookupLen, 0, sizeof(table.lookupLen));
+  for (int i = 0; i < count; i++) {
+    if (sizes[i] > 8) {
+      break;
+    }
+    int shift = 8 - sizes[i];
+    for (int fillBits = 0; fillBits < (1 << shift); fillBits++) {
+      int index = (codes[i] << shift) | fillBits;
+      table.lookupLen[index] = sizes[i];
+      table.lookupValue[index] = table.values[i];
+    }
+  }
+  table.defined = true;
+  return true;
+}
+
+int decodeSymbol(BitReader& reader, const DecodeTable& table) {
+  reader.fill();
+  uint32_t look = reader.peek(8);
+  if (table.lookupLen[look]) {
+    reader.consume(table.lookupLen[look]);
+    return table.lookupValue[look];
+  }
+  int length = 9;
+  uint32_t code = reader.peek(length);
+  while (length <= 16 && (int32_t)code > table.maxCode[length]) {
+    length++;
+    code = reader.peek(length);
+  }
+  if (length > 16) {
+    return -1;
+  }
+  reader.consume(length);
+  return table.values[table.valuePointer[length] + code - table.minCode[length]];
+}
+
+// Annex K.2 code lengths, K.3 limit to 16 bits, one code point reserved so no
+// code is all ones
+bool buildOptimalTable(const uint32_t* counts, EncodeTable& table, TableScratch& scratch) {
+  uint32_t* freq = scratch.freq;
+  int* codeSize = scratch.codeSize;
+  int* others = scratch.others;
+  memcpy(freq, counts, 256 * sizeof(uint32_t));
+  freq[256] = 1;
+  for (int i = 0; i < 257; i++) {
+    codeSize[i] = 0;
+    others[i] = -1;
+  }
+
+  while (true) {
+    // Least frequent, then second least; ties go to the larger symbol
+    int c1 = -1, c2 = -1;
+    uint32_t v1 = 0xFFFFFFFF, v2 = 0xFFFFFFFF;
+    for (int i = 0; i < 257; i++) {
+      if (freq[i] && freq[i] <= v1) {
+        v1 = freq[i];
+        c1 = i;
+      }
+    }
+    for (int i = 0; i < 257; i++) {
+      if (freq[i] && freq[i] <= v2 && i != c1) {
+        v2 = freq[i];
+        c2 = i;
+      }
+    }
+    if (c2 < 0) {
+      break;
+    }
+    freq[c1] += freq[c2];
+    freq[c2] = 0;
+    codeSize[c1]++;
+    while (others[c1] >= 0) {
+      c1 = others[c1];
+      codeSize[c1]++;
+    }
+    others[c1] = c2;
+    codeSize[c2]++;
+    while (others[c2] >= 0) {
+      c2 = others[c2];
+      codeSize[c2]++;
+    }
+  }
+
+  uint16_t bits[33] = {0};
+  for (int i = 0; i < 257; i++) {
+    if (codeSize[i]) {
+      if (codeSize[i] > 32) {
+        return false;
+      }
+      bits[codeSize[i]]++;
+    }
+  }
+  for (int i = 32; i > 16; i--) {
+    while (bits[i] > 0) {
+      int j = i - 2;
+      while (bits[j] == 0) {
+        j--;
+      }
+      bits[i] -= 2;
+      bits[i - 1]++;
+      bits[j + 1] += 2;
+      bits[j]--;
+    }
+  }
+  int longest = 16;
+  while (bits[longest] == 0) {
+    longest--;
+  }
+  bits[longest]--;                          // Drop the reserved code point
+
+  table.bits[0] = 0;
+  for (int i = 1; i <= 16; i++) {
+    table.bits[i] = bits[i];
+  }
+  table.count = 0;
+  for (int size = 1; size <= 32; size++) {
+    for (int symbol = 0; symbol < 256; symbol++) {
+      if (codeSize[symbol] == size) {
+        table.values[table.count++] = symbol;
+      }
+    }
+  }
+
+  // Annex C canonical codes
+  memset(table.size, 0, sizeof(table.size));
+  uint32_t code = 0;
+  int k = 0;
+  for (int length = 1; length <= 16; length++) {
+    for (int i = 0; i < table.bits[length]; i++) {
+      uint8_t symbol = table.values[k++];
+      table.code[symbol] = code++;
+      table.size[symbol] = length;
+    }
+    code <<= 1;
+  }
+  return true;
+}
+
+// One pass over the entropy-coded data: counts symbols when writer is null,
+// otherwise writes them with the new tables
+JpegOptimizeResult runScan(Work& work, BitReader& reader, BitWriter* writer, const ScanComponent* components,
+                           int componentCount, uint32_t mcuCount, uint32_t restartInterval) {
+  uint8_t nextRestart = 0;
+  for (uint32_t mcu = 0; mcu < mcuCount; mcu++) {
+    if (restartInterval && mcu > 0 && mcu % restartInterval == 0) {
+      if (!reader.restart(nextRestart)) {
+        return JPEG_OPT_CORRUPT;
+      }
+      if (writer) {
+        writer->marker(0xD0 + (nextRestart & 7));
+      }
+      nextRestart++;
+    }
+    for (int c = 0; c < componentCount; c++) {
+      const ScanComponent& component = components[c];
+      const DecodeTable& dcTable = work.decode[component.dcSlot];
+      const DecodeTable& acTable = work.decode[component.acSlot];
+      for (int block = 0; block < component.blocksPerMcu; block++) {
+        int dc = decodeSymbol(reader, dcTable);
+        if (dc < 0 || dc > 11) {
+          return JPEG_OPT_CORRUPT;
+        }
+        uint32_t extra = reader.receive(dc);
+        if (writer) {
+          const EncodeTable& table = work.encode[component.dcSlot];
+          writer->put(table.code[dc], table.size[dc]);
+          if (dc) writer->put(extra, dc);
+        } else {
+          work.freq[component.dcSlot][dc]++;
+        }
+
+        for (int k = 1; k < 64; k++) {
+          int rs = decodeSymbol(reader, acTable);
+          if (rs < 0) {
+            return JPEG_OPT_CORRUPT;
+          }
+          int run = rs >> 4;
+          int size = rs & 15;
+          if (size > 10 || (size == 0 && run != 15 && run != 0)) {
+            return JPEG_OPT_CORRUPT;
+          }
+          extra = reader.receive(size);
+          if (writer) {
+            const EncodeTable& table = work.encode[component.acSlot];
+            writer->put(table.code[rs], table.size[rs]);
+            if (size) writer->put(extra, size);
+          } else {
+            work.freq[component.acSlot][rs]++;
+          }
+          if (rs == 0x00) {
+            break;                          // EOB
+          }
+          k += run;
+          if (k > 63) {
+            return JPEG_OPT_CORRUPT;
+          }
+        }
+        if (reader.overrun) {
+          return JPEG_OPT_CORRUPT;
+        }
+      }
+    }
+  }
+  return reader.finishSegment() ? JPEG_OPT_OK : JPEG_OPT_CORRUPT;
+}
+
+bool copyBytes(uint8_t* out, size_t outSize, size_t& outPos, const uint8_t* data, size_t len) {
+  if (outPos + len > outSize) {
+    return false;
+  }
+  memcpy(out + outPos, data, len);
+  outPos += len;
+  return true;
+}
+
+JpegOptimizeResult optimizeWith(Work& work, const uint8_t* in, size_t len, uint8_t* out, size_t outSize,
+                                size_t* outLen) {
+  if (len < 4 || in[0] != 0xFF || in[1] != 0xD8) {
+    return JPEG_OPT_CORRUPT;
+  }
+  size_t outPos = 0;
+  if (!copyBytes(out, outSize, outPos, in, 2)) {
+    return JPEG_OPT_NOT_SMALLER;
+  }
+
+  // Frame and scan parameters from the marker segments ahead of the scan
+  uint8_t frameIds[JPEG_MAX_COMPONENTS];
+  uint8_t frameH[JPEG_MAX_COMPONENTS];
+  uint8_t frameV[JPEG_MAX_COMPONENTS];
+  int frameComponents = 0;
+  uint16_t width = 0, height = 0;
+  uint32_t restartInterval = 0;
+  const uint8_t* sos = nullptr;
+  size_t pos = 2;
+  while (!sos) {
+    while (pos + 1 < len && in[pos] == 0xFF && in[pos + 1] == 0xFF) {
+      pos++;
+    }
+    if (pos + 4 > len || in[pos] != 0xFF) {
+      return JPEG_OPT_CORRUPT;
+    }
+    uint8_t marker = in[pos + 1];
+    size_t segmentLen = get16(in + pos + 2);
+    if (segmentLen < 2 || pos + 2 + segmentLen > len) {
+      return JPEG_OPT_CORRUPT;
+    }
+    const uint8_t* body = in + pos + 4;
+    size_t bodyLen = segmentLen - 2;
+
+    if (marker == 0xC0 || marker == 0xC1) {
+      if (bodyLen < 6 || body[0] != 8) {
+        return JPEG_OPT_UNSUPPORTED;
+      }
+      height = get16(body + 1);
+      width = get16(body + 3);
+      frameComponents = body[5];
+      if (height == 0 || width == 0 || frameComponents < 1 || frameComponents > JPEG_MAX_COMPONENTS ||
+          bodyLen < 6 + 3 * (size_t)frameComponents) {
+        return JPEG_OPT_UNSUPPORTED;
+      }
+      for (int i = 0; i < frameComponents; i++) {
+        frameIds[i] = body[6 + 3 * i];
+        frameH[i] = body[7 + 3 * i] >> 4;
+        frameV[i] = body[7 + 3 * i] & 15;
+        if (frameH[i] < 1 || frameH[i] > 4 || frameV[i] < 1 || frameV[i] > 4) {
+          return JPEG_OPT_CORRUPT;
+        }
+      }
+    } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      return JPEG_OPT_UNSUPPORTED;          // Progressive, lossless or hierarchical
+    } else if (marker == 0xCC || marker == 0xD9 || marker == 0xDC) {
+      return JPEG_OPT_UNSUPPORTED;          // Arithmetic coding, no scan, DNL
+    }
+
+    if (marker == 0xC4) {
+      // Tables are dropped from the output and rebuilt before the scan
+      size_t p = 0;
+      while (p < bodyLen) {
+        if (p + 17 > bodyLen) {
+          return JPEG_OPT_CORRUPT;
+        }
+        uint8_t tableClass = body[p] >> 4;
+        uint8_t tableId = body[p] & 15;
+        if (tableClass > 1 || tableId > 3) {
+          return JPEG_OPT_CORRUPT;
+        }
+        DecodeTable& table = work.decode[tableClass * 4 + tableId];
+        size_t total = 0;
+        table.bits[0] = 0;
+        for (int i = 1; i <= 16; i++) {
+          table.bits[i] = body[p + i];
+          total += body[p + i];
+        }
+        if (total > 256 || p + 17 + total > bodyLen) {
+          return JPEG_OPT_CORRUPT;
+        }
+        memcpy(table.values, body + p + 17, total);
+        if (!buildDecodeTable(table, work.scratch)) {
+          return JPEG_OPT_CORRUPT;
+        }
+        p += 17 + total;
+      }
+    } else if (marker == 0xDA) {
+      sos = in + pos;
+    } else {
+      if (marker == 0xDD && bodyLen >= 2) {
+        restartInterval = get16(body);
+      }
+      if (!copyBytes(out, outSize, outPos, in + pos, 2 + segmentLen)) {
+        return JPEG_OPT_NOT_SMALLER;
+      }
+    }
+    pos += 2 + segmentLen;
+  }
+  if (frameComponents == 0) {
+    return JPEG_OPT_UNSUPPORTED;
+  }
+
+  // Scan header: components in MCU order with their table slots
+  size_t sosLen = 2 + get16(sos + 2);
+  int scanComponentCount = sos[4];
+  if (scanComponentCount < 1 || scanComponentCount > frameComponents ||
+      sosLen != 2 + 6 + 2 * (size_t)scanComponentCount) {
+    return JPEG_OPT_CORRUPT;
+  }
+  const uint8_t* spectral = sos + 5 + 2 * scanComponentCount;
+  if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0) {
+    return JPEG_OPT_UNSUPPORTED;
+  }
+  uint8_t maxH = 1, maxV = 1;
+  for (int i = 0; i < frameComponents; i++) {
+    if (frameH[i] > maxH) maxH = frameH[i];
+    if (frameV[i] > maxV) maxV = frameV[i];
+  }
+  ScanComponent components[JPEG_MAX_COMPONENTS];
+  uint32_t mcuCount = 0;
+  for (int c = 0; c < scanComponentCount; c++) {
+    uint8_t id = sos[5 + 2 * c];
+    uint8_t selectors = sos[6 + 2 * c];
+    int index = -1;
+    for (int i = 0; i < frameComponents; i++) {
+      if (frameIds[i] == id) index = i;
+    }
+    if (index < 0 || (selectors >> 4) > 3 || (selectors & 15) > 3) {
+      return JPEG_OPT_CORRUPT;
+    }
+    components[c].dcSlot = selectors >> 4;
+    components[c].acSlot = 4 + (selectors & 15);
+    if (!work.decode[components[c].dcSlot].defined || !work.decode[components[c].acSlot].defined) {
+      return JPEG_OPT_CORRUPT;
+    }
+    components[c].blocksPerMcu = scanComponentCount > 1 ? frameH[index] * frameV[index] : 1;
+    if (scanComponentCount == 1) {
+      // Non-interleaved: one block per MCU over the component's own size
+      uint32_t blocksAcross = ((width * frameH[index] + maxH - 1) / maxH + 7) / 8;
+      uint32_t blocksDown = ((height * frameV[index] + maxV - 1) / maxV + 7) / 8;
+      mcuCount = blocksAcross * blocksDown;
+    }
+    work.used[components[c].dcSlot] = true;
+    work.used[components[c].acSlot] = true;
+  }
+  if (scanComponentCount > 1) {
+    mcuCount = ((width + 8 * maxH - 1) / (8 * maxH)) * ((height + 8 * maxV - 1) / (8 * maxV));
+  }
+
+  // Pass 1: symbol statistics
+  const uint8_t* scan = sos + sosLen;
+  size_t scanLen = len - (scan - in);
+  BitReader reader;
+  reader.begin(scan, scanLen);
+  JpegOptimizeResult result = runScan(work, reader, nullptr, components, scanComponentCount, mcuCount,
+                                      restartInterval);
+  if (result != JPEG_OPT_OK) {
+    return result;
+  }
+  // Only one scan per file: what follows must be EOI (and whatever trails it)
+  size_t tail = reader.pos;
+  while (tail + 1 < scanLen && scan[tail] == 0xFF && scan[tail + 1] == 0xFF) {
+    tail++;
+  }
+  if (tail + 1 >= scanLen || scan[tail] != 0xFF || scan[tail + 1] != 0xD9) {
+    return JPEG_OPT_UNSUPPORTED;
+  }
+
+  // New tables in one DHT segment, DC classes first
+  size_t dhtLen = 2;
+  for (int slot = 0; slot < JPEG_HUFF_SLOTS; slot++) {
+    if (work.used[slot]) {
+      if (!buildOptimalTable(work.freq[slot], work.encode[slot], work.scratch)) {
+        return JPEG_OPT_CORRUPT;
+      }
+      dhtLen += 17 + work.encode[slot].count;
+    }
+  }
+  if (outPos + 2 + dhtLen + sosLen > outSize) {
+    return JPEG_OPT_NOT_SMALLER;
+  }
+  out[outPos++] = 0xFF;
+  out[outPos++] = 0xC4;
+  out[outPos++] = dhtLen >> 8;
+  out[outPos++] = dhtLen & 0xFF;
+  for (int slot = 0; slot < JPEG_HUFF_SLOTS; slot++) {
+    if (work.used[slot]) {
+      const EncodeTable& table = work.encode[slot];
+      out[outPos++] = ((slot / 4) << 4) | (slot % 4);
+      memcpy(out + outPos, table.bits + 1, 16);
+      outPos += 16;
+      memcpy(out + outPos, table.values, table.count);
+      outPos += table.count;
+    }
+  }
+  memcpy(out + outPos, sos, sosLen);
+  outPos += sosLen;
+
+  // Pass 2: same symbols, new codes
+  BitWriter writer;
+  writer.begin(out, outSize, outPos);
+  reader.begin(scan, scanLen);
+  result = runScan(work, reader, &writer, components, scanComponentCount, mcuCount, restartInterval);
+  if (result != JPEG_OPT_OK) {
+    return result;
+  }
+  writer.flush();
+  if (writer.full) {
+    return JPEG_OPT_NOT_SMALLER;
+  }
+  outPos = writer.pos;
+  if (!copyBytes(out, outSize, outPos, scan + tail, scanLen - tail) || outPos >= len) {
+    return JPEG_OPT_NOT_SMALLER;
+  }
+  *outLen = outPos;
+  return JPEG_OPT_OK;
+}
+
+}  // namespace
+
+JpegOptimizeResult JpegHuffman::optimize(const uint8_t* in, size_t len, uint8_t* out, size_t outSize,
+                                         size_t* outLen) {
+  // ~20 KB of tables and counters; heap rather than a task stack
+  Work* work = (Work*)calloc(1, sizeof(Work));
+  if (!work) {
+    return JPEG_OPT_NO_MEMORY;
+  }
+  JpegOptimizeResult result = optimizeWith(*work, in, len, out, outSize, outLen);
+  free(work);
+  return result;
+}
+
+const char* JpegHuffman::resultName(JpegOptimizeResult result) {
+  switch (result) {
+    case JPEG_OPT_OK: return "ok";
+    case JPEG_OPT_NOT_SMALLER: return "not smaller";
+    case JPEG_OPT_UNSUPPORTED: return "unsupported";
+    case JPEG_OPT_CORRUPT: return "corrupt";
+    case JPEG_OPT_NO_MEMORY: return "no memory";
+  }
+  return "?";
+}
@@ -0,0 +1,163 @@
+#include "LatestFrame.h"
+#include "RequestArena.h"
+#include "esp_heap_caps.h"
+#include <time.h>
+
+FrameCache frameCache;
+LatestFrame latestFrame;
+
+FrameCache::FrameCache() : nextGeneration(1), lastSlot(0), enabled(true) {
+  for (auto& slot : slots) {
+    slot.data = nullptr;
+    slot.size = 0;
+    slot.generation.store(0);
+    slot.refs.store(0);
+  }
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool FrameCache::begin() {
+  if (slots[0].data) {
+    return true;
+  }
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  for (auto& slot : slots) {
+    slot.data = (uint8_t*)heap_caps_malloc(FRAME_CACHE_SLOT_SIZE, caps);
+    if (!slot.data) {
+      Serial.println("❌ Frame cache: allocation failed - caching disabled");
+      enabled.store(false);
+      return false;
+    }
+  }
+  Serial.printf("✅ Frame cache: %d x %d KB\n", FRAME_CACHE_SLOTS, FRAME_CACHE_SLOT_SIZE / 1024);
+  return true;
+}
+
+FrameCacheHandle FrameCache::store(const uint8_t* data, size_t len) {
+  PhotoWritePart part = {data, len};
+  return store(&part, 1);
+}
+
+FrameCacheHandle FrameCache::store(const PhotoWritePart* parts, size_t count) {
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += parts[i].len;
+  }
+  if (!isEnabled() || !slots[0].data || len > FRAME_CACHE_SLOT_SIZE) {
+    stats.skipped++;
+    return 0;
+  }
+
+  // Oldest slot first; the current latest is only reused when everything else is pinned
+  for (uint8_t i = 1; i <= FRAME_CACHE_SLOTS; i++) {
+    uint8_t index = (lastSlot + i) % FRAME_CACHE_SLOTS;
+    Slot& slot = slots[index];
+    if (slot.refs.load() != 0) {
+      continue;
+    }
+    // Invalidate first, then re-check: a reader that pinned in between sees
+    // generation 0 and backs off, one that pinned before keeps the slot
+    slot.generation.store(0);
+    if (slot.refs.load() != 0) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+      memcpy(slot.data + offset, parts[i].data, parts[i].len);
+      offset += parts[i].len;
+    }
+    slot.size = len;
+    uint32_t generation = nextGeneration++ & 0x0FFFFFFF;
+    if (generation == 0) {
+      generation = nextGeneration++ & 0x0FFFFFFF;
+    }
+    slot.generation.store(generation, std::memory_order_release);
+    lastSlot = index;
+    stats.stored++;
+    return (generation << 4) | index;
+  }
+
+  stats.skipped++;
+  return 0;
+}
+
+bool FrameCache::pin(FrameCacheHandle handle, const uint8_t** data, size_t* len) {
+  uint8_t index = handle & 0x0F;
+  uint32_t generation = handle >> 4;
+  if (handle == 0 || index >= FRAME_CACHE_SLOTS) {
+    return false;
+  }
+  Slot& slot = slots[index];
+  slot.refs.fetch_add(1);
+  if (slot.generation.load(std::memory_order_acquire) != generation) {
+    slot.refs.fetch_sub(1);
+    stats.misses++;
+    return false;
+  }
+  *data = slot.data;
+  *len = slot.size;
+  stats.hits++;
+  return true;
+}
+
+void FrameCache::unpin(FrameCacheHandle handle) {
+  uint8_t index = handle & 0x0F;
+  if (handle != 0 && index < FRAME_CACHE_SLOTS) {
+    slots[index].refs.fetch_sub(1);
+  }
+}
+
+void FrameCache::writeStatusJson(Print& out) const {
+  printfTo(out, "{\"enabled\":%s,\"slots\":%d,\"slot_bytes\":%d", isEnabled() ? "true" : "false", FRAME_CACHE_SLOTS,
+           FRAME_CACHE_SLOT_SIZE);
+  printfTo(out, ",\"stored\":%lu,\"skipped\":%lu,\"hits\":%lu,\"misses\":%lu,\"pinned\":[",
+           (unsigned long)stats.stored, (unsigned long)stats.skipped, (unsigned long)stats.hits,
+           (unsigned long)stats.misses);
+  for (uint8_t i = 0; i < FRAME_CACHE_SLOTS; i++) {
+    if (i > 0) out.print(",");
+    out.print((unsigned long)slots[i].refs.load(std::memory_order_relaxed));
+  }
+  out.print("]}");
+}
+
+LatestFrame::LatestFrame() : published(0), begun(0), retries(0) {
+  memset(buffers, 0, sizeof(buffers));
+}
+
+void LatestFrame::publish(const LatestFrameInfo& info) {
+  uint32_t next = published.load(std::memory_order_relaxed) + 1;
+
+  // Announce which buffer is about to change before touching it
+  begun.store(next, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  buffers[next & 1] = info;
+
+  // The flip: readers switch to the new buffer with this one store
+  published.store(next, std::memory_order_release);
+}
+
+void LatestFrame::publishStored(uint32_t number) {
+  LatestFrameInfo info;
+  memset(&info, 0, sizeof(info));
+  info.number = number;
+  if (number > 0) {
+    info.storage = FRAME_STORED_SD;
+    PhotoWriter::formatPhotoPath(info.path, sizeof(info.path), number);
+  }
+  publish(info);
+}
+
+LatestFrameInfo LatestFrame::read() const {
+  while (true) {
+    uint32_t index = published.load(std::memory_order_acquire);
+    LatestFrameInfo copy = buffers[index & 1];
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    // Safe unless the writer has since started on this same buffer (two publishes later)
+    if (begun.load(std::memory_order_relaxed) - index < 2) {
+      return copy;
+    }
+    retries.fetch_add(1, std::memory_order_relaxed);
+  }
+}
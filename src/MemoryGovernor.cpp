@@ -0,0 +1,306 @@
+#include "MemoryGovernor.h"
+#include "RequestArena.h"
+#include "EventBroadcaster.h"
+#include "esp_heap_caps.h"
+
+MemoryGovernor memoryGovernor;
+
+static const char* const REGION_NAMES[MEMORY_REGION_COUNT] = { "internal", "dma", "psram" };
+static const uint32_t REGION_CAPS[MEMORY_REGION_COUNT] = {
+  MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+  MALLOC_CAP_DMA,
+  MALLOC_CAP_SPIRAM
+};
+
+MemoryGovernor::MemoryGovernor() : handlerCount(0), level(MEMORY_NORMAL), thresholdsChanged(false),
+                                     lastUpdate(0) {
+  defaultThresholds(thresholds);
+  memset(&stats, 0, sizeof(stats));
+  memset(regions, 0, sizeof(regions));
+  memset(handlers, 0, sizeof(handlers));
+}
+
+void MemoryGovernor::defaultThresholds(MemoryThresholds& out) {
+  // ELEVATED, HIGH, CRITICAL, EMERGENCY
+  static const uint32_t FREE[MEMORY_REGION_COUNT][MEMORY_LEVEL_COUNT - 1] = {
+    { 60000, 40000, 30000, 20000 },             // Internal: WiFi/lwIP and AsyncTCP live here
+    { 32768, 24576, 16384, 8192 },              // DMA-capable: SD and camera transfers
+    { 1048576, 524288, 262144, 131072 }         // PSRAM: frame buffers and caches
+  };
+  static const uint32_t LARGEST[MEMORY_REGION_COUNT][MEMORY_LEVEL_COUNT - 1] = {
+    { 16384, 12288, 8192, 4096 },
+    { 12288, 8192, 6144, 4096 },
+    { 524288, 262144, 131072, 65536 }
+  };
+  memcpy(out.freeBytes, FREE, sizeof(out.freeBytes));
+  memcpy(out.largestBlock, LARGEST, sizeof(out.largestBlock));
+  out.recoveryPercent = 20;
+  out.maxClientsUnderPressure = 2;
+}
+
+void MemoryGovernor::begin() {
+  loadThresholds();
+  update(true);
+  Serial.printf("✅ Memory governor started (level %s)\n", levelName(getLevel()));
+}
+
+void MemoryGovernor::addReliefHandler(const char* name, MemoryPressure atLevel, MemoryReliefHandler handler) {
+  if (handlerCount >= MEMORY_GOVERNOR_MAX_HANDLERS) {
+    Serial.printf("⚠️ Memory governor: no room for relief handler %s\n", name);
+    return;
+  }
+  handlers[handlerCount++] = { name, atLevel, handler, false };
+
+  // A handler registered while already under pressure applies immediately
+  if (getLevel() >= atLevel) {
+    handlers[handlerCount - 1].active = true;
+    handler(true);
+  }
+}
+
+void MemoryGovernor::sample() {
+  for (uint8_t r = 0; r < MEMORY_REGION_COUNT; r++) {
+    regions[r].freeBytes = heap_caps_get_free_size(REGION_CAPS[r]);
+    regions[r].largestBlock = heap_caps_get_largest_free_block(REGION_CAPS[r]);
+    regions[r].minFree = heap_caps_get_minimum_free_size(REGION_CAPS[r]);
+    regions[r].totalBytes = heap_caps_get_total_size(REGION_CAPS[r]);
+  }
+}
+
+MemoryPressure MemoryGovernor::classify(uint8_t headroomPercent) const {
+  for (int l = MEMORY_LEVEL_COUNT - 2; l >= 0; l--) {
+    for (uint8_t r = 0; r < MEMORY_REGION_COUNT; r++) {
+      if (regions[r].totalBytes == 0) {
+        continue;   // Region not present (e.g. no PSRAM fitted)
+      }
+      uint32_t freeLimit = (uint64_t)thresholds.freeBytes[r][l] * (100 + headroomPercent) / 100;
+      uint32_t blockLimit = (uint64_t)thresholds.largestBlock[r][l] * (100 + headroomPercent) / 100;
+      if (regions[r].freeBytes < freeLimit || regions[r].largestBlock < blockLimit) {
+        return (MemoryPressure)(l + 1);
+      }
+    }
+  }
+  return MEMORY_NORMAL;
+}
+
+MemoryPressure MemoryGovernor::update(bool force) {
+  bool changed = thresholdsChanged.exchange(false);
+  if (!force && !changed && millis() - lastUpdate < MEMORY_GOVERNOR_PERIOD_MS) {
+    return getLevel();
+  }
+  lastUpdate = millis();
+  sample();
+
+  MemoryPressure current = getLevel();
+  MemoryPressure target = classify(0);
+  if (target < current) {
+    // Only step down once there is real headroom above the thresholds
+    MemoryPressure recovered = classify(thresholds.recoveryPercent);
+    target = recovered < current ? recovered : current;
+  }
+
+  if (target != current) {
+    transition(current, target);
+  }
+  return target;
+}
+
+void MemoryGovernor::transition(MemoryPressure from, MemoryPressure to) {
+  level.store(to, std::memory_order_relaxed);
+  stats.transitions++;
+  stats.entered[to]++;
+  stats.lastTransitionMs = millis();
+
+  const MemoryRegionSample& internal = regions[MEMORY_REGION_INTERNAL];
+  Serial.printf("%s Memory pressure %s → %s (internal %lu free / %lu largest, PSRAM %lu free)\n",
+                to > from ? "🧠" : "🌿", levelName(from), levelName(to),
+                (unsigned long)internal.freeBytes, (unsigned long)internal.largestBlock,
+                (unsigned long)regions[MEMORY_REGION_PSRAM].freeBytes);
+  eventBroadcaster.publish(EVENT_MEMORY, "{\"level\":\"%s\",\"from\":\"%s\",\"internal_free\":%lu}",
+                           levelName(to), levelName(from), (unsigned long)internal.freeBytes);
+
+  // Release handlers in reverse order so actions unwind the way they were applied
+  if (to < from) {
+    for (int i = handlerCount - 1; i >= 0; i--) {
+      ReliefHandler& h = handlers[i];
+      if (h.active && to < h.level) {
+        h.active = false;
+        Serial.printf("   ↩️ %s released\n", h.name);
+        h.handler(false);
+      }
+    }
+  } else {
+    for (uint8_t i = 0; i < handlerCount; i++) {
+      ReliefHandler& h = handlers[i];
+      if (!h.active && to >= h.level) {
+        h.active = true;
+        Serial.printf("   ▶️ %s applied\n", h.name);
+        h.handler(true);
+      }
+    }
+  }
+
+  if (to >= MEMORY_HIGH && from < MEMORY_HIGH) {
+    Serial.printf("   ▶️ HTTP clients capped at %d\n", thresholds.maxClientsUnderPressure);
+  }
+  if (to >= MEMORY_EMERGENCY) {
+    Serial.println("   🛑 Photo capture paused");
+  } else if (from >= MEMORY_EMERGENCY) {
+    Serial.println("   📸 Photo capture resumed");
+  }
+}
+
+bool MemoryGovernor::allowCapture() {
+  if (isCapturePaused()) {
+    stats.skippedCaptures++;
+    return false;
+  }
+  return true;
+}
+
+bool MemoryGovernor::admitRequest(uint32_t inFlight) {
+  if (getLevel() >= MEMORY_HIGH && inFlight >= thresholds.maxClientsUnderPressure) {
+    stats.rejectedRequests++;
+    return false;
+  }
+  return true;
+}
+
+bool MemoryGovernor::setThreshold(const String& region, const String& kind, const String& csvValues) {
+  int r = -1;
+  for (uint8_t i = 0; i < MEMORY_REGION_COUNT; i++) {
+    if (region == REGION_NAMES[i]) {
+      r = i;
+    }
+  }
+  if (r < 0 || (kind != "free" && kind != "largest")) {
+    return false;
+  }
+
+  // Expect one value per level (ELEVATED..EMERGENCY), each lower than the one before
+  uint32_t values[MEMORY_LEVEL_COUNT - 1];
+  int start = 0;
+  for (uint8_t l = 0; l < MEMORY_LEVEL_COUNT - 1; l++) {
+    int comma = csvValues.indexOf(',', start);
+    String part = comma < 0 ? csvValues.substring(start) : csvValues.substring(start, comma);
+    if (part.length() == 0) {
+      return false;
+    }
+    long value = part.toInt();
+    if (value < 0) {
+      return false;
+    }
+    values[l] = (uint32_t)value;
+    if (l > 0 && values[l] > values[l - 1]) {
+      return false;
+    }
+    start = comma + 1;
+    if (comma < 0 && l < MEMORY_LEVEL_COUNT - 2) {
+      return false;
+    }
+  }
+
+  memcpy(kind == "free" ? thresholds.freeBytes[r] : thresholds.largestBlock[r], values, sizeof(values));
+  saveThresholds();
+  thresholdsChanged.store(true);
+  return true;
+}
+
+bool MemoryGovernor::setRecoveryPercent(long percent) {
+  if (percent < 0 || percent > 100) {
+    return false;
+  }
+  thresholds.recoveryPercent = (uint8_t)percent;
+  saveThresholds();
+  thresholdsChanged.store(true);
+  return true;
+}
+
+bool MemoryGovernor::setMaxClients(long clients) {
+  if (clients < 1 || clients > 255) {
+    return false;
+  }
+  thresholds.maxClientsUnderPressure = (uint8_t)clients;
+  saveThresholds();
+  return true;
+}
+
+void MemoryGovernor::resetThresholds() {
+  defaultThresholds(thresholds);
+  preferences.begin("mem-gov", false);
+  preferences.clear();
+  preferences.end();
+  thresholdsChanged.store(true);
+}
+
+void MemoryGovernor::loadThresholds() {
+  preferences.begin("mem-gov", true);
+  MemoryThresholds saved;
+  size_t len = preferences.getBytes("thresholds", &saved, sizeof(saved));
+  preferences.end();
+  if (len == sizeof(saved)) {
+    thresholds = saved;
+    Serial.println("📋 Memory governor: using saved thresholds");
+  }
+}
+
+void MemoryGovernor::saveThresholds() {
+  preferences.begin("mem-gov", false);
+  preferences.putBytes("thresholds", &thresholds, sizeof(thresholds));
+  preferences.end();
+}
+
+const char* MemoryGovernor::levelName(MemoryPressure pressure) {
+  switch (pressure) {
+    case MEMORY_NORMAL: return "NORMAL";
+    case MEMORY_ELEVATED: return "ELEVATED";
+    case MEMORY_HIGH: return "HIGH";
+    case MEMORY_CRITICAL: return "CRITICAL";
+    case MEMORY_EMERGENCY: return "EMERGENCY";
+    default: return "UNKNOWN";
+  }
+}
+
+void MemoryGovernor::writeStatusJson(Print& out) const {
+  printfTo(out, "{\"level\":\"%s\",\"capture_paused\":%s", levelName(getLevel()),
+           isCapturePaused() ? "true" : "false");
+
+  out.print(",\"regions\":{");
+  for (uint8_t r = 0; r < MEMORY_REGION_COUNT; r++) {
+    if (r > 0) out.print(",");
+    printfTo(out, "\"%s\":{\"free\":%lu,\"largest_block\":%lu,\"min_free\":%lu,\"total\":%lu", REGION_NAMES[r],
+             (unsigned long)regions[r].freeBytes, (unsigned long)regions[r].largestBlock,
+             (unsigned long)regions[r].minFree, (unsigned long)regions[r].totalBytes);
+    out.print(",\"free_thresholds\":[");
+    for (uint8_t l = 0; l < MEMORY_LEVEL_COUNT - 1; l++) {
+      if (l > 0) out.print(",");
+      out.print((unsigned long)thresholds.freeBytes[r][l]);
+    }
+    out.print("],\"largest_thresholds\":[");
+    for (uint8_t l = 0; l < MEMORY_LEVEL_COUNT - 1; l++) {
+      if (l > 0) out.print(",");
+      out.print((unsigned long)thresholds.largestBlock[r][l]);
+    }
+    out.print("]}");
+  }
+  out.print("}");
+
+  printfTo(out, ",\"recovery_percent\":%u,\"max_clients_under_pressure\":%u,\"transitions\":%lu",
+           (unsigned)thresholds.recoveryPercent, (unsigned)thresholds.maxClientsUnderPressure,
+           (unsigned long)stats.transitions);
+  out.print(",\"entered\":{");
+  for (uint8_t l = 0; l < MEMORY_LEVEL_COUNT; l++) {
+    printfTo(out, "%s\"%s\":%lu", l > 0 ? "," : "", levelName((MemoryPressure)l), (unsigned long)stats.entered[l]);
+  }
+  out.print("}");
+  printfTo(out, ",\"rejected_requests\":%lu,\"skipped_captures\":%lu,\"last_transition_ms\":%lu",
+           (unsigned long)stats.rejectedRequests, (unsigned long)stats.skippedCaptures,
+           (unsigned long)stats.lastTransitionMs);
+
+  out.print(",\"relief\":[");
+  for (uint8_t i = 0; i < handlerCount; i++) {
+    printfTo(out, "%s{\"name\":\"%s\",\"level\":\"%s\",\"active\":%s}", i > 0 ? "," : "", handlers[i].name,
+             levelName(handlers[i].level), handlers[i].active ? "true" : "false");
+  }
+  out.print("]}");
+}
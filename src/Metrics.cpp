@@ -0,0 +1,107 @@
+#include "Metrics.h"
+
+MetricsRegistry metrics;
+
+MetricsRegistry::MetricsRegistry()
+  : counterCount(0), gaugeCount(0), histogramCount(0), collectorCount(0) {
+  registrationLock = portMUX_INITIALIZER_UNLOCKED;
+  memset(counterEntries, 0, sizeof(counterEntries));
+  memset(gaugeEntries, 0, sizeof(gaugeEntries));
+  memset(histogramEntries, 0, sizeof(histogramEntries));
+  memset(collectors, 0, sizeof(collectors));
+}
+
+MetricCounter* MetricsRegistry::counter(const char* name, const char* help, const char* labels) {
+  MetricCounter* result = &overflowCounter;
+  portENTER_CRITICAL(&registrationLock);
+  if (counterCount < METRICS_MAX_COUNTERS) {
+    counterEntries[counterCount] = { name, help, labels };
+    result = &counters[counterCount++];
+  }
+  portEXIT_CRITICAL(&registrationLock);
+  return result;
+}
+
+MetricGauge* MetricsRegistry::gauge(const char* name, const char* help, const char* labels) {
+  MetricGauge* result = &overflowGauge;
+  portENTER_CRITICAL(&registrationLock);
+  if (gaugeCount < METRICS_MAX_GAUGES) {
+    gaugeEntries[gaugeCount] = { name, help, labels };
+    result = &gauges[gaugeCount++];
+  }
+  portEXIT_CRITICAL(&registrationLock);
+  return result;
+}
+
+MetricHistogram* MetricsRegistry::histogram(const char* name, const char* help,
+                                            const uint32_t* upperBounds, uint8_t boundCount) {
+  MetricHistogram* result = &overflowHistogram;
+  portENTER_CRITICAL(&registrationLock);
+  if (histogramCount < METRICS_MAX_HISTOGRAMS) {
+    histogramEntries[histogramCount] = { name, help, nullptr };
+    result = &histograms[histogramCount++];
+  }
+  portEXIT_CRITICAL(&registrationLock);
+  result->setBounds(upperBounds, boundCount);
+  return result;
+}
+
+void MetricsRegistry::addCollector(MetricsCollector collector) {
+  portENTER_CRITICAL(&registrationLock);
+  if (collectorCount < METRICS_MAX_COLLECTORS) {
+    collectors[collectorCount++] = collector;
+  }
+  portEXIT_CRITICAL(&registrationLock);
+}
+
+void MetricsRegistry::writeHeader(Print& out, const Entry& entry, const char* type, const Entry* previous) {
+  // Labelled series of one family share a single HELP/TYPE header
+  if (previous && strcmp(previous->name, entry.name) == 0) {
+    return;
+  }
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", entry.name, entry.help, entry.name, type);
+}
+
+void MetricsRegistry::writePrometheus(Print& out) {
+  // Refresh sampled gauges (heap, RSSI, queue depth...) - readers only, never blocks writers
+  for (uint8_t i = 0; i < collectorCount; i++) {
+    collectors[i]();
+  }
+
+  for (uint8_t i = 0; i < counterCount; i++) {
+    const Entry& entry = counterEntries[i];
+    writeHeader(out, entry, "counter", i > 0 ? &counterEntries[i - 1] : nullptr);
+    if (entry.labels) {
+      out.printf("%s{%s} %llu\n", entry.name, entry.labels, (unsigned long long)counters[i].value());
+    } else {
+      out.printf("%s %llu\n", entry.name, (unsigned long long)counters[i].value());
+    }
+  }
+
+  for (uint8_t i = 0; i < gaugeCount; i++) {
+    const Entry& entry = gaugeEntries[i];
+    writeHeader(out, entry, "gauge", i > 0 ? &gaugeEntries[i - 1] : nullptr);
+    if (entry.labels) {
+      out.printf("%s{%s} %ld\n", entry.name, entry.labels, (long)gauges[i].value());
+    } else {
+      out.printf("%s %ld\n", entry.name, (long)gauges[i].value());
+    }
+  }
+
+  for (uint8_t i = 0; i < histogramCount; i++) {
+    const Entry& entry = histogramEntries[i];
+    const MetricHistogram& histogram = histograms[i];
+    writeHeader(out, entry, "histogram", nullptr);
+
+    uint64_t cumulative = 0;
+    for (uint8_t b = 0; b < histogram.getBucketCount(); b++) {
+      cumulative += histogram.getBucket(b);
+      out.printf("%s_bucket{le=\"%lu\"} %llu\n", entry.name,
+                 (unsigned long)histogram.getBound(b), (unsigned long long)cumulative);
+    }
+    cumulative += histogram.getBucket(histogram.getBucketCount());
+    out.printf("%s_bucket{le=\"+Inf\"} %llu\n", entry.name, (unsigned long long)cumulative);
+    out.printf("%s_sum %llu\n", entry.name, (unsigned long long)histogram.getSum());
+    out.printf("%s_count %llu\n", entry.name, (unsigned long long)cumulative);
+  }
+}
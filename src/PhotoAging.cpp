@@ -0,0 +1,343 @@
+#include "PhotoAging.h"
+#include "RequestArena.h"
+#include "JpegHuffman.h"
+#include "PhotoMetadata.h"
+#include "PhotoWriter.h"
+#include "Thumbnailer.h"
+#include "TraceRecorder.h"
+#include "DeferredLog.h"
+#include "img_converters.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+PhotoAging photoAging;
+
+PhotoAging::PhotoAging()
+  : halfThrough(0), eighthThrough(0),
+    job("PhotoAging", PHOTO_MOUNT_POINT AGING_STATE_FILE, AGING_TASK_STACK, &halfThrough, &eighthThrough),
+    budgetBytes(0), budgetRefillMs(0), startable(false) {
+  config.halfAfterHours = AGING_HALF_AFTER_HOURS;
+  config.eighthAfterHours = AGING_EIGHTH_AFTER_HOURS;
+  config.budgetKBps = AGING_BUDGET_KBPS;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void PhotoAging::begin(SemaphoreHandle_t sdMutexHandle) {
+  preferences.begin("aging", false);
+  config.halfAfterHours = preferences.getUShort("half_h", AGING_HALF_AFTER_HOURS);
+  config.eighthAfterHours = preferences.getUShort("eighth_h", AGING_EIGHTH_AFTER_HOURS);
+  config.budgetKBps = preferences.getUShort("budget", AGING_BUDGET_KBPS);
+  // Lossy, so never on until asked for
+  job.begin(sdMutexHandle, preferences.getBool("enabled", false));
+}
+
+bool PhotoAging::start() {
+  photoIndex.applyTiers(halfThrough, eighthThrough);
+  // A source photo, its decoded pixels and two encodes per pass
+  if (!psramFound()) {
+    Serial.println("ℹ Photo aging off - needs PSRAM");
+    return false;
+  }
+  startable = true;
+  if (job.isEnabled() && !createTask()) {
+    return false;
+  }
+  Serial.printf("✅ Photo aging: %s, half after %uh (through #%lu), 1/8 after %uh (through #%lu), %u KB/s\n",
+                job.isEnabled() ? "on" : "off", config.halfAfterHours, (unsigned long)halfThrough,
+                config.eighthAfterHours, (unsigned long)eighthThrough, config.budgetKBps);
+  return true;
+}
+
+bool PhotoAging::createTask() {
+  budgetRefillMs = millis();
+  return job.startTask(agingTask, this);
+}
+
+void PhotoAging::setEnabled(bool on) {
+  job.setEnabled(on);
+  preferences.putBool("enabled", on);
+  if (on && startable && !job.isRunning()) {
+    createTask();
+  }
+}
+
+void PhotoAging::setConfig(const AgingConfig& newConfig) {
+  config = newConfig;
+  if (config.budgetKBps == 0) {
+    config.budgetKBps = 1;                     // The budget is what keeps captures unaffected
+  }
+  preferences.putUShort("half_h", config.halfAfterHours);
+  preferences.putUShort("eighth_h", config.eighthAfterHours);
+  preferences.putUShort("budget", config.budgetKBps);
+}
+
+void PhotoAging::agingTask(void* parameter) {
+  static_cast<PhotoAging*>(parameter)->run();
+}
+
+void PhotoAging::run() {
+  while (true) {
+    PhotoEntry photo;
+    uint8_t tier = PHOTO_TIER_FULL;
+    bool wait = false;
+    if (!job.ready() || !findNext(photo, tier, wait)) {
+      if (wait) {
+        job.defer();
+      }
+      job.sleep();
+      continue;
+    }
+    uint32_t waitMs = 0;
+    if (!takeBudget(waitMs)) {
+      stats.budgetWaits++;
+      vTaskDelay(pdMS_TO_TICKS(waitMs) + 1);
+      continue;
+    }
+    if (!job.idle()) {
+      job.defer();
+      job.sleep();
+      continue;
+    }
+    age(photo, tier);
+    job.logStack();
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+uint32_t PhotoAging::agedThrough(uint16_t hours, time_t now) {
+  if (hours == 0 || (uint32_t)now < PHOTO_TIME_VALID + (uint32_t)hours * 3600) {
+    return 0;
+  }
+  // Photos without a clock time sit before the first one with it, so they are
+  // at least as old as any timed photo that qualifies
+  uint32_t minNumber, maxNumber;
+  if (photoIndex.resolveTimeRange(PHOTO_TIME_VALID, (uint32_t)now - (uint32_t)hours * 3600,
+                                  minNumber, maxNumber) == 0) {
+    return 0;
+  }
+  return maxNumber;
+}
+
+bool PhotoAging::findNext(PhotoEntry& photo, uint8_t& tier, bool& wait) {
+  photo.number = 0;
+  time_t now = time(nullptr);
+  if ((uint32_t)now < PHOTO_TIME_VALID) {
+    return false;                              // No ages until the clock is set
+  }
+  uint32_t last = photoIndex.getLastNumber();
+  if (halfThrough > last || eighthThrough > last) {
+    halfThrough = 0;                           // Numbering restarted after a clear
+    eighthThrough = 0;
+  }
+
+  // The oldest tier first, so a photo due for both is only re-encoded once
+  uint32_t through = agedThrough(config.eighthAfterHours, now);
+  if (through > eighthThrough &&
+      photoIndex.copyPage(eighthThrough, true, eighthThrough + 1, through, &photo, 1) == 1) {
+    tier = PHOTO_TIER_EIGHTH;
+  } else {
+    uint32_t from = max(halfThrough, eighthThrough);
+    through = agedThrough(config.halfAfterHours, now);
+    if (through <= from || photoIndex.copyPage(from, true, from + 1, through, &photo, 1) != 1) {
+      return false;                            // Caught up
+    }
+    tier = PHOTO_TIER_HALF;
+  }
+  if (!job.uploaded(photo.number)) {
+    wait = true;
+    return false;
+  }
+  return true;
+}
+
+bool PhotoAging::takeBudget(uint32_t& waitMs) {
+  uint32_t now = millis();
+  int64_t rate = (int64_t)config.budgetKBps * 1024;   // Bytes per second
+  budgetBytes += (int64_t)(now - budgetRefillMs) * rate / 1000;
+  budgetRefillMs = now;
+  // Saved-up budget allows one photo's worth of burst at most
+  if (budgetBytes > AGING_MAX_SOURCE) {
+    budgetBytes = AGING_MAX_SOURCE;
+  }
+  if (budgetBytes >= 0) {
+    return true;
+  }
+  // Photos are charged after the fact; wait off the debt
+  waitMs = (uint32_t)(-budgetBytes * 1000 / rate);
+  return false;
+}
+
+void PhotoAging::age(const PhotoEntry& photo, uint8_t tier) {
+  uint32_t start = millis();
+  uint8_t current = photoTier(photo);
+  if (current >= tier || photo.size == 0 || photo.size > AGING_MAX_SOURCE) {
+    if (current < tier) {
+      stats.failed++;
+    }
+    markAged(photo.number, tier);
+    photoIndex.setTier(photo.number, photo.size, max(current, tier), photo.flags & PHOTO_FLAG_OPTIMIZED);
+    job.saveProgress();
+    return;
+  }
+  uint8_t* source = (uint8_t*)ps_malloc(photo.size);
+  if (!source) {
+    job.defer();
+    return;                                    // Retried on the next pass
+  }
+  bool busy = false;
+  bool readOk = readPhoto(photo.number, source, photo.size, busy);
+  if (busy) {
+    free(source);
+    job.defer();
+    return;
+  }
+  budgetBytes -= photo.size;
+
+  // Decode at the reduced scale and encode again. A half-scale photo going to
+  // 1/8 is decoded at 1/4.
+  uint8_t shift = tier == PHOTO_TIER_EIGHTH ? (current == PHOTO_TIER_HALF ? 2 : 3) : 1;
+  uint8_t quality = tier == PHOTO_TIER_EIGHTH ? AGING_EIGHTH_QUALITY : AGING_HALF_QUALITY;
+  uint8_t* jpg = nullptr;
+  size_t jpgLen = 0;
+  uint16_t width = 0, height = 0;
+  if (readOk && Thumbnailer::readDimensions(source, photo.size, width, height)) {
+    uint16_t scaledWidth = (width + (1 << shift) - 1) >> shift;
+    uint16_t scaledHeight = (height + (1 << shift) - 1) >> shift;
+    size_t pixelsLen = (size_t)scaledWidth * scaledHeight * 2;
+    uint8_t* pixels = (uint8_t*)ps_malloc(pixelsLen);
+    uint32_t convertStart = TraceRecorder::now();
+    if (!pixels || !jpg2rgb565(source, photo.size, pixels, (jpg_scale_t)shift) ||
+        !fmt2jpg(pixels, pixelsLen, scaledWidth, scaledHeight, PIXFORMAT_RGB565, quality, &jpg, &jpgLen)) {
+      free(jpg);
+      jpg = nullptr;
+      jpgLen = 0;
+    }
+    traceRecorder.record("aging.convert", "sd", convertStart, jpgLen);
+    free(pixels);
+  }
+
+  // The fresh encode uses the generic tables again
+  const uint8_t* encoded = jpg;
+  size_t encodedLen = jpgLen;
+  bool optimized = false;
+  uint8_t* smaller = jpg ? (uint8_t*)ps_malloc(jpgLen) : nullptr;
+  size_t smallerLen = 0;
+  if (smaller && JpegHuffman::optimize(jpg, jpgLen, smaller, jpgLen, &smallerLen) == JPEG_OPT_OK) {
+    encoded = smaller;
+    encodedLen = smallerLen;
+    optimized = true;
+  }
+
+  // Carry the capture metadata over to the same place in the new file
+  size_t segmentOffset = 0;
+  size_t segmentLen = jpg ? PhotoMetadataFormat::findSegment(source, photo.size, segmentOffset) : 0;
+  size_t insertAt = segmentLen ? PhotoMetadataFormat::insertionOffset(encoded, encodedLen) : 0;
+  PhotoWritePart parts[3] = {{encoded, encodedLen}, {nullptr, 0}, {nullptr, 0}};
+  size_t partCount = 1;
+  if (insertAt) {
+    parts[0].len = insertAt;
+    parts[1] = {source + segmentOffset, segmentLen};
+    parts[2] = {encoded + insertAt, encodedLen - insertAt};
+    partCount = 3;
+  }
+  size_t resultLen = encodedLen + (insertAt ? segmentLen : 0);
+
+  bool replaced = false;
+  bool retry = false;
+  if (jpg && resultLen < photo.size) {
+    // A request that started meanwhile goes first; the work is simply redone
+    retry = !job.idle() || !job.lockCard();
+    if (!retry) {
+      replaced = job.replace(photo.number, parts, partCount, photo.size);
+      markAged(photo.number, tier);
+      job.saveState();
+      job.unlockCard();
+      budgetBytes -= resultLen;
+    }
+  }
+  free(smaller);
+  free(jpg);
+  free(source);
+  if (retry) {
+    job.defer();
+    return;
+  }
+
+  if (replaced) {
+    photoIndex.setTier(photo.number, resultLen, tier, optimized);
+    if (tier == PHOTO_TIER_EIGHTH) {
+      stats.eighthed++;
+    } else {
+      stats.halved++;
+    }
+    job.replaced(photo.size - resultLen, start);
+    DLOGD("🗂️ Photo #%lu aged to 1/%u scale: %lu -> %lu bytes", (unsigned long)photo.number, 1u << shift,
+          (unsigned long)photo.size, (unsigned long)resultLen);
+    return;
+  }
+  if (jpg && resultLen >= photo.size) {
+    stats.kept++;                              // Already small, e.g. a low quality setting
+  } else {
+    stats.failed++;
+  }
+  markAged(photo.number, tier);
+  photoIndex.setTier(photo.number, photo.size, tier, photo.flags & PHOTO_FLAG_OPTIMIZED);
+  job.saveProgress();
+}
+
+bool PhotoAging::readPhoto(uint32_t number, uint8_t* buffer, size_t size, bool& busy) {
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  PhotoWriter::formatPhotoPath(path + strlen(path), sizeof(path) - strlen(path), number);
+  busy = false;
+  int fd = -1;
+  size_t total = 0;
+  bool failed = false;
+  // One chunk per lock hold. Once the file is open the job waits its turn
+  // rather than give up halfway; a replace by someone else in between changes
+  // the size, which replacePhoto() checks.
+  while (!failed && total < size) {
+    if (!job.lockCard(fd < 0 ? pdMS_TO_TICKS(PHOTO_JOB_SD_LOCK_MS) : portMAX_DELAY)) {
+      busy = true;
+      return false;
+    }
+    if (fd < 0 && (fd = ::open(path, O_RDONLY)) < 0) {
+      failed = true;
+    }
+    size_t end = min(size, total + AGING_READ_CHUNK);
+    while (!failed && total < end) {
+      ssize_t n = ::read(fd, buffer + total, end - total);
+      if (n <= 0) {
+        failed = true;
+      } else {
+        total += n;
+      }
+    }
+    if (fd >= 0 && (failed || total == size)) {
+      ::close(fd);
+    }
+    job.unlockCard();
+  }
+  return !failed;
+}
+
+void PhotoAging::markAged(uint32_t number, uint8_t tier) {
+  if (tier == PHOTO_TIER_EIGHTH) {
+    eighthThrough = number;
+  }
+  if (number > halfThrough) {
+    halfThrough = number;
+  }
+}
+
+void PhotoAging::writeStatusJson(Print& out) {
+  job.writeStatusHead(out);
+  printfTo(out, ",\"half_after_hours\":%u,\"eighth_after_hours\":%u,\"budget_kbps\":%u",
+           (unsigned)config.halfAfterHours, (unsigned)config.eighthAfterHours, (unsigned)config.budgetKBps);
+  printfTo(out, ",\"half_through\":%lu,\"eighth_through\":%lu", (unsigned long)halfThrough,
+           (unsigned long)eighthThrough);
+  printfTo(out, ",\"halved\":%lu,\"eighthed\":%lu,\"kept\":%lu,\"failed\":%lu,\"budget_waits\":%lu",
+           (unsigned long)stats.halved, (unsigned long)stats.eighthed, (unsigned long)stats.kept,
+           (unsigned long)stats.failed, (unsigned long)stats.budgetWaits);
+  job.writeStatusTail(out);
+}
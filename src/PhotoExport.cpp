@@ -0,0 +1,597 @@
+#include "PhotoExport.h"
+#include "RequestArena.h"
+#include "ArchiveFormat.h"
+#include "PhotoIndex.h"
+#include "PhotoHttp.h"
+#include "AviFormat.h"
+#include "PhotoSequenceReader.h"
+#include "PhotoWriter.h"
+#include "Thumbnailer.h"
+#include "esp_heap_caps.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+PhotoExport photoExport;
+
+// Name of a photo inside the archive; returns its length
+static size_t formatEntryName(char* out, size_t size, uint32_t number) {
+  return snprintf(out, size, "photos/photo_%06lu.jpg", (unsigned long)number);
+}
+
+enum ExportStage : uint8_t {
+  EXPORT_STAGE_HEADER,      // Next entry's header, or on to the directory/trailer
+  EXPORT_STAGE_DATA,
+  EXPORT_STAGE_CENTRAL,     // ZIP central directory, one record per entry, then the end record
+  EXPORT_STAGE_TRAILER,     // TAR end-of-archive blocks
+  EXPORT_STAGE_DONE,
+  EXPORT_STAGE_FAILED
+};
+
+// Archive body for one export. The web server task pulls bytes through
+// _fillBuffer; everything it sends is either a record built into `record` or
+// photo data copied out of a read-ahead buffer.
+class ExportResponse : public AsyncAbstractResponse {
+private:
+  ExportEntry* entries;     // PSRAM snapshot, freed with the response
+  uint32_t count;
+  bool zip;
+  ExportStage stage;
+  uint32_t index;
+  uint8_t record[ARCHIVE_HEADER_MAX];
+  size_t recordLen;
+  size_t recordPos;
+  uint8_t trailerBlocks;
+
+  PhotoSequenceReader reader;
+  uint32_t crc;
+
+  uint32_t centralStart;    // ZIP: archive offset of the central directory
+  uint32_t centralBytes;
+  uint32_t entryOffset;     // ZIP: local header offset of the entry being listed
+  uint64_t sent;
+
+public:
+  ExportResponse(ExportEntry* entries, uint32_t count, bool zip, uint32_t localBytes,
+                 uint32_t centralBytes, uint32_t totalBytes);
+  ~ExportResponse();
+
+  bool _sourceValid() const override { return stage != EXPORT_STAGE_FAILED; }
+  size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+  bool startEntry();
+  void finishEntry();
+  size_t fail();
+};
+
+ExportResponse::ExportResponse(ExportEntry* entries, uint32_t count, bool zip, uint32_t localBytes,
+                               uint32_t centralBytes, uint32_t totalBytes)
+  : AsyncAbstractResponse(), entries(entries), count(count), zip(zip), stage(EXPORT_STAGE_HEADER),
+    index(0), recordLen(0), recordPos(0), trailerBlocks(0), crc(0), centralStart(localBytes),
+    centralBytes(centralBytes), entryOffset(0), sent(0) {
+  _code = 200;
+  _contentType = zip ? "application/zip" : "application/x-tar";
+  _contentLength = totalBytes;
+}
+
+ExportResponse::~ExportResponse() {
+  reader.close(true);
+  heap_caps_free(entries);
+  photoExport.finished(stage == EXPORT_STAGE_DONE, sent);
+}
+
+bool ExportResponse::startEntry() {
+  const ExportEntry& entry = entries[index];
+  bool hasNext = index + 1 < count;
+  if (!reader.begin(entry.number, entry.size, hasNext ? entries[index + 1].number : 0,
+                    hasNext ? entries[index + 1].size : 0)) {
+    return false;
+  }
+  crc = 0;
+
+  char name[EXPORT_NAME_LEN];
+  formatEntryName(name, sizeof(name), entries[index].number);
+  if (zip) {
+    recordLen = ArchiveFormat::zipLocalHeader(record, name, entries[index].size, entries[index].timestamp);
+  } else {
+    recordLen = ArchiveFormat::tarHeader(record, name, entries[index].size, entries[index].timestamp);
+  }
+  recordPos = 0;
+  return true;
+}
+
+void ExportResponse::finishEntry() {
+  reader.close();
+  ExportEntry& entry = entries[index];
+  if (zip) {
+    entry.crc = crc;
+    recordLen = ArchiveFormat::zipDescriptor(record, crc, entry.size);
+  } else {
+    recordLen = ArchiveFormat::tarPadding(entry.size);
+    memset(record, 0, recordLen);
+  }
+  recordPos = 0;
+}
+
+size_t ExportResponse::fail() {
+  // Nothing after this can be a valid archive; closing tells the client it is truncated
+  reader.close(true);
+  stage = EXPORT_STAGE_FAILED;
+  return 0;
+}
+
+size_t ExportResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+  size_t written = 0;
+  while (written < maxLen) {
+    if (recordPos < recordLen) {
+      size_t n = recordLen - recordPos;
+      if (n > maxLen - written) n = maxLen - written;
+      memcpy(buf + written, record + recordPos, n);
+      recordPos += n;
+      written += n;
+      continue;
+    }
+
+    if (stage == EXPORT_STAGE_HEADER) {
+      if (index < count) {
+        if (!startEntry()) {
+          return fail();
+        }
+        stage = EXPORT_STAGE_DATA;
+      } else {
+        stage = zip ? EXPORT_STAGE_CENTRAL : EXPORT_STAGE_TRAILER;
+        index = 0;
+      }
+    } else if (stage == EXPORT_STAGE_DATA) {
+      if (reader.getRemaining() == 0) {
+        finishEntry();
+        index++;
+        stage = EXPORT_STAGE_HEADER;
+        continue;
+      }
+      size_t n = reader.read(buf + written, maxLen - written);
+      if (n == RESPONSE_TRY_AGAIN) {
+        // Card is behind the link: send what we have, or get polled again
+        break;
+      }
+      if (n == 0) {
+        return fail();
+      }
+      crc = ArchiveFormat::crc32(crc, buf + written, n);
+      written += n;
+    } else if (stage == EXPORT_STAGE_CENTRAL) {
+      if (index < count) {
+        char name[EXPORT_NAME_LEN];
+        size_t nameLen = formatEntryName(name, sizeof(name), entries[index].number);
+        recordLen = ArchiveFormat::zipCentralHeader(record, name, entries[index].size, entries[index].crc,
+                                                    entries[index].timestamp, entryOffset);
+        entryOffset += ArchiveFormat::zipEntryBytes(nameLen, entries[index].size);
+        index++;
+      } else {
+        recordLen = ArchiveFormat::zipEnd(record, count, centralBytes, centralStart);
+        stage = EXPORT_STAGE_DONE;
+      }
+      recordPos = 0;
+    } else if (stage == EXPORT_STAGE_TRAILER) {
+      memset(record, 0, ARCHIVE_TAR_BLOCK);
+      recordLen = ARCHIVE_TAR_BLOCK;
+      recordPos = 0;
+      if (++trailerBlocks == ARCHIVE_TAR_TRAILER / ARCHIVE_TAR_BLOCK) {
+        stage = EXPORT_STAGE_DONE;
+      }
+    } else {
+      break;
+    }
+  }
+
+  if (written == 0 && stage != EXPORT_STAGE_DONE) {
+    return RESPONSE_TRY_AGAIN;
+  }
+  sent += written;
+  return written;
+}
+
+enum TimelapseStage : uint8_t {
+  TIMELAPSE_STAGE_FRAME,    // Next frame's chunk header, or on to the index
+  TIMELAPSE_STAGE_DATA,
+  TIMELAPSE_STAGE_INDEX,
+  TIMELAPSE_STAGE_DONE,
+  TIMELAPSE_STAGE_FAILED
+};
+
+// MJPEG AVI body: the header, one '00dc' chunk per photo straight from the card,
+// then idx1 built TIMELAPSE_INDEX_BATCH entries at a time. For a range request
+// the response starts at the chunk holding the first byte, and skip drops the
+// bytes before it as records are generated.
+class TimelapseResponse : public AsyncAbstractResponse {
+private:
+  ExportEntry* entries;
+  AviStreamInfo info;
+  TimelapseStage stage;
+  uint32_t index;
+  uint8_t record[AVI_INDEX_ENTRY * TIMELAPSE_INDEX_BATCH];
+  size_t recordLen;
+  size_t recordPos;
+  PhotoSequenceReader reader;
+  uint32_t skip;            // Bytes still to drop before the range starts
+  uint32_t remaining;       // Of the response body
+  uint64_t sent;
+
+public:
+  TimelapseResponse(ExportEntry* entries, const AviStreamInfo& info, uint32_t start, uint32_t length);
+  ~TimelapseResponse();
+
+  bool _sourceValid() const override { return stage != TIMELAPSE_STAGE_FAILED; }
+  size_t _fillBuffer(uint8_t* buf, size_t maxLen) override;
+
+private:
+  void seek(uint32_t start);
+  size_t fail();
+};
+
+TimelapseResponse::TimelapseResponse(ExportEntry* entries, const AviStreamInfo& info, uint32_t start,
+                                     uint32_t length)
+  : AsyncAbstractResponse(), entries(entries), info(info), stage(TIMELAPSE_STAGE_FRAME), index(0),
+    recordLen(0), recordPos(0), skip(0), remaining(length), sent(0) {
+  _code = 200;
+  _contentType = "video/x-msvideo";
+  _contentLength = length;
+  recordLen = AviFormat::header(record, info);
+  seek(start);
+}
+
+TimelapseResponse::~TimelapseResponse() {
+  reader.close(true);
+  heap_caps_free(entries);
+  photoExport.finished(remaining == 0, sent);
+}
+
+void TimelapseResponse::seek(uint32_t start) {
+  if (start < AVI_HEADER_BYTES) {
+    recordPos = start;
+    return;
+  }
+  recordLen = 0;
+  uint32_t moviPos = start - AVI_HEADER_BYTES + 4;
+  if (moviPos >= 4 + info.moviBytes) {
+    index = info.frames;                    // In idx1
+    skip = moviPos - 4 - info.moviBytes;
+    return;
+  }
+  // Last frame whose chunk starts at or before moviPos
+  uint32_t low = 0, high = info.frames - 1;
+  while (low < high) {
+    uint32_t mid = low + (high - low + 1) / 2;
+    if (entries[mid].offset <= moviPos) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  index = low;
+  skip = moviPos - entries[low].offset;
+}
+
+size_t TimelapseResponse::fail() {
+  reader.close(true);
+  stage = TIMELAPSE_STAGE_FAILED;
+  return 0;
+}
+
+size_t TimelapseResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+  if (maxLen > remaining) {
+    maxLen = remaining;
+  }
+  size_t written = 0;
+  while (written < maxLen) {
+    if (recordPos < recordLen) {
+      size_t n = recordLen - recordPos;
+      if (skip > 0) {
+        if (n > skip) n = skip;
+        recordPos += n;
+        skip -= n;
+        continue;
+      }
+      if (n > maxLen - written) n = maxLen - written;
+      memcpy(buf + written, record + recordPos, n);
+      recordPos += n;
+      written += n;
+      continue;
+    }
+
+    if (stage == TIMELAPSE_STAGE_FRAME) {
+      recordPos = 0;
+      if (index < info.frames) {
+        const ExportEntry& frame = entries[index];
+        if (skip >= AVI_CHUNK_HEADER + frame.size) {
+          // Range starts in the pad byte
+          recordLen = AviFormat::framePadding(frame.size);
+          record[0] = 0;
+          recordPos = skip - AVI_CHUNK_HEADER - frame.size;
+          skip = 0;
+          index++;
+          continue;
+        }
+        uint32_t offset = skip > AVI_CHUNK_HEADER ? skip - AVI_CHUNK_HEADER : 0;
+        skip -= offset;
+        bool hasNext = index + 1 < info.frames;
+        if (!reader.begin(frame.number, frame.size, hasNext ? entries[index + 1].number : 0,
+                          hasNext ? entries[index + 1].size : 0, offset)) {
+          return fail();
+        }
+        recordLen = AviFormat::frameHeader(record, frame.size);
+        stage = TIMELAPSE_STAGE_DATA;
+      } else {
+        recordLen = AviFormat::indexHeader(record, info.frames);
+        stage = TIMELAPSE_STAGE_INDEX;
+        index = 0;
+      }
+    } else if (stage == TIMELAPSE_STAGE_DATA) {
+      if (reader.getRemaining() == 0) {
+        reader.close();
+        recordLen = AviFormat::framePadding(entries[index].size);
+        record[0] = 0;
+        recordPos = 0;
+        index++;
+        stage = TIMELAPSE_STAGE_FRAME;
+        continue;
+      }
+      size_t n = reader.read(buf + written, maxLen - written);
+      if (n == RESPONSE_TRY_AGAIN) {
+        break;
+      }
+      if (n == 0) {
+        return fail();
+      }
+      written += n;
+    } else if (stage == TIMELAPSE_STAGE_INDEX) {
+      // Whole entries before the range are never built
+      index += skip / AVI_INDEX_ENTRY;
+      skip %= AVI_INDEX_ENTRY;
+      recordLen = 0;
+      recordPos = 0;
+      while (index < info.frames && recordLen < sizeof(record)) {
+        recordLen += AviFormat::indexEntry(record + recordLen, entries[index].offset, entries[index].size);
+        index++;
+      }
+      if (index == info.frames) {
+        stage = TIMELAPSE_STAGE_DONE;
+      }
+    } else {
+      break;
+    }
+  }
+
+  if (written == 0 && remaining > 0 && stage != TIMELAPSE_STAGE_DONE) {
+    return RESPONSE_TRY_AGAIN;
+  }
+  remaining -= written;
+  sent += written;
+  return written;
+}
+
+PhotoExport::PhotoExport() : active(0) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+ExportEntry* PhotoExport::beginExport(AsyncWebServerRequest* request, uint32_t stride, uint32_t maxEntries,
+                                      uint32_t& count) {
+  uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+  uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : 0;
+  uint32_t minNumber, maxNumber;
+  uint32_t matched = photoIndex.resolveTimeRange(from, to, minNumber, maxNumber);
+  uint32_t wanted = (matched + stride - 1) / stride;
+  if (wanted == 0) {
+    request->send(404, "text/plain", "No photos in range");
+    return nullptr;
+  }
+  if (wanted > maxEntries) {
+    request->send(413, "text/plain", "Too many photos for one export - narrow from/to");
+    return nullptr;
+  }
+
+  uint8_t current = active.load(std::memory_order_relaxed);
+  do {
+    if (current >= EXPORT_MAX_ACTIVE) {
+      stats.rejected++;
+      AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Export already running");
+      response->addHeader("Retry-After", "30");
+      request->send(response);
+      return nullptr;
+    }
+  } while (!active.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  ExportEntry* entries = (ExportEntry*)heap_caps_malloc(wanted * sizeof(ExportEntry), caps);
+  if (!entries) {
+    active.fetch_sub(1, std::memory_order_relaxed);
+    request->send(503, "text/plain", "Not enough memory for the export list");
+    return nullptr;
+  }
+
+  // Snapshot the range, keeping every stride-th photo; the open end may have grown
+  // since it was resolved
+  PhotoEntry batch[PHOTO_INDEX_BATCH];
+  uint32_t seen = 0;
+  uint32_t cursor = 0;
+  count = 0;
+  while (count < wanted) {
+    uint32_t got = photoIndex.copyPage(cursor, true, minNumber, maxNumber, batch, PHOTO_INDEX_BATCH);
+    if (got == 0) {
+      break;
+    }
+    for (uint32_t i = 0; i < got && count < wanted; i++, seen++) {
+      if (seen % stride != 0) {
+        continue;
+      }
+      ExportEntry& entry = entries[count++];
+      entry.number = batch[i].number;
+      entry.size = batch[i].size;
+      entry.timestamp = batch[i].timestamp;
+      entry.crc = 0;
+    }
+    cursor = batch[got - 1].number;
+  }
+  if (count == 0) {
+    cancelExport(entries);
+    request->send(404, "text/plain", "No photos in range");
+    return nullptr;
+  }
+  return entries;
+}
+
+void PhotoExport::cancelExport(ExportEntry* entries) {
+  heap_caps_free(entries);
+  active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PhotoExport::handleRequest(AsyncWebServerRequest* request) {
+  bool zip = false;
+  if (request->hasParam("format")) {
+    const String& format = request->getParam("format")->value();
+    if (format == "zip") {
+      zip = true;
+    } else if (format != "tar") {
+      request->send(400, "text/plain", "format must be tar or zip");
+      return;
+    }
+  }
+
+  uint32_t count;
+  ExportEntry* entries = beginExport(request, 1, zip ? ARCHIVE_ZIP_MAX_ENTRIES : PHOTO_INDEX_CAPACITY, count);
+  if (!entries) {
+    return;
+  }
+  uint64_t localBytes = 0;
+  uint64_t centralBytes = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (zip) {
+      size_t nameLen = formatEntryName(nullptr, 0, entries[i].number);
+      localBytes += ArchiveFormat::zipEntryBytes(nameLen, entries[i].size);
+      centralBytes += ArchiveFormat::zipCentralBytes(nameLen);
+    } else {
+      localBytes += ArchiveFormat::tarEntryBytes(entries[i].size);
+    }
+  }
+  uint64_t totalBytes = localBytes + centralBytes + (zip ? ARCHIVE_ZIP_END : ARCHIVE_TAR_TRAILER);
+  if (totalBytes > UINT32_MAX) {
+    cancelExport(entries);
+    request->send(413, "text/plain", "Export over 4 GB - narrow from/to");
+    return;
+  }
+
+  stats.started++;
+  ExportResponse* response = new ExportResponse(entries, count, zip, (uint32_t)localBytes,
+                                                (uint32_t)centralBytes, (uint32_t)totalBytes);
+  char disposition[64];
+  snprintf(disposition, sizeof(disposition), "attachment; filename=\"photos-%lu-%lu.%s\"",
+           (unsigned long)entries[0].number, (unsigned long)entries[count - 1].number, zip ? "zip" : "tar");
+  response->addHeader("Content-Disposition", disposition);
+  request->send(response);
+  Serial.printf("📦 Export: %lu photos as %s, %lu bytes\n", (unsigned long)count, zip ? "ZIP" : "TAR",
+                (unsigned long)totalBytes);
+}
+
+void PhotoExport::handleTimelapse(AsyncWebServerRequest* request) {
+  uint32_t fps = request->hasParam("fps") ? request->getParam("fps")->value().toInt() : TIMELAPSE_DEFAULT_FPS;
+  uint32_t stride = request->hasParam("stride") ? request->getParam("stride")->value().toInt() : 1;
+  if (fps < 1) fps = 1;
+  if (fps > TIMELAPSE_MAX_FPS) fps = TIMELAPSE_MAX_FPS;
+  if (stride < 1) stride = 1;
+
+  uint32_t count;
+  ExportEntry* entries = beginExport(request, stride, PHOTO_INDEX_CAPACITY, count);
+  if (!entries) {
+    return;
+  }
+  AviStreamInfo info;
+  memset(&info, 0, sizeof(info));
+  info.fps = fps;
+  info.frames = count;
+  uint64_t moviBytes = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    entries[i].offset = (uint32_t)(4 + moviBytes);   // Only read once the total fits 32 bits
+    moviBytes += AviFormat::frameBytes(entries[i].size);
+    if (entries[i].size > info.maxFrameBytes) {
+      info.maxFrameBytes = entries[i].size;
+    }
+  }
+  if (AVI_HEADER_BYTES + moviBytes + AVI_CHUNK_HEADER + (uint64_t)count * AVI_INDEX_ENTRY > UINT32_MAX) {
+    cancelExport(entries);
+    request->send(413, "text/plain", "Time-lapse over 4 GB - narrow from/to or raise stride");
+    return;
+  }
+  info.moviBytes = (uint32_t)moviBytes;
+  uint32_t fileBytes = (uint32_t)AviFormat::fileBytes(info);
+
+  // The file follows from the photos picked, which never change once written, and
+  // the frame rate; it is the same again as long as those are
+  char etag[64];
+  snprintf(etag, sizeof(etag), "\"v%lu-%lu-%lu-%lu-%lu\"", (unsigned long)entries[0].number,
+           (unsigned long)entries[count - 1].number, (unsigned long)count, (unsigned long)fps,
+           (unsigned long)fileBytes);
+  uint32_t start = 0, length = fileBytes;
+  HttpRangeResult range = PhotoHttp::parseRange(request, fileBytes, etag, start, length);
+  if (range == HTTP_RANGE_UNSATISFIABLE) {
+    cancelExport(entries);
+    PhotoHttp::sendRangeNotSatisfiable(request, fileBytes);
+    return;
+  }
+  readFrameSize(entries[0].number, info.width, info.height);
+
+  stats.started++;
+  TimelapseResponse* response = new TimelapseResponse(entries, info, start, length);
+  if (range == HTTP_RANGE_PARTIAL) {
+    char contentRange[48];
+    snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu", (unsigned long)start,
+             (unsigned long)(start + length - 1), (unsigned long)fileBytes);
+    response->setCode(206);
+    response->addHeader("Content-Range", contentRange);
+  }
+  char disposition[64];
+  snprintf(disposition, sizeof(disposition), "attachment; filename=\"timelapse-%lu-%lu.avi\"",
+           (unsigned long)entries[0].number, (unsigned long)entries[count - 1].number);
+  response->addHeader("Content-Disposition", disposition);
+  response->addHeader("Accept-Ranges", "bytes");
+  response->addHeader("ETag", etag);
+  request->send(response);
+  Serial.printf("🎞️ Time-lapse: %lu frames at %lu fps, %lu of %lu bytes from %lu\n", (unsigned long)count,
+                (unsigned long)fps, (unsigned long)length, (unsigned long)fileBytes, (unsigned long)start);
+}
+
+void PhotoExport::readFrameSize(uint32_t number, uint16_t& width, uint16_t& height) {
+  // Players take the size from each JPEG; the header copy is informational, so a
+  // failed read just leaves it at 0x0
+  width = 0;
+  height = 0;
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  PhotoWriter::formatPhotoPath(path + strlen(path), sizeof(path) - strlen(path), number);
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  uint8_t head[TIMELAPSE_PROBE_BYTES];
+  ssize_t n = ::read(fd, head, sizeof(head));
+  ::close(fd);
+  if (n > 0) {
+    Thumbnailer::readDimensions(head, n, width, height);
+  }
+}
+
+void PhotoExport::finished(bool complete, uint64_t bytes) {
+  if (complete) {
+    stats.completed++;
+  } else {
+    stats.aborted++;
+  }
+  stats.bytes += bytes;
+  active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PhotoExport::writeStatusJson(Print& out) {
+  printfTo(out, "{\"active\":%u,\"started\":%lu,\"completed\":%lu", (unsigned)active.load(),
+           (unsigned long)stats.started, (unsigned long)stats.completed);
+  printfTo(out, ",\"aborted\":%lu,\"rejected\":%lu,\"bytes\":%llu}", (unsigned long)stats.aborted,
+           (unsigned long)stats.rejected, (unsigned long long)stats.bytes);
+}
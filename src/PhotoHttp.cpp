@@ -0,0 +1,210 @@
+#include "PhotoHttp.h"
+#include "PhotoIndex.h"
+#include "SdFileResponse.h"
+#include <memory>
+#include <time.h>
+
+void PhotoHttp::formatETag(char* out, size_t size, char kind, uint32_t number, uint32_t bytes) {
+  snprintf(out, size, "\"%c%lu-%lu\"", kind, (unsigned long)number, (unsigned long)bytes);
+}
+
+void PhotoHttp::formatHttpDate(char* out, size_t size, uint32_t unixTime) {
+  time_t seconds = unixTime;
+  struct tm utc;
+  gmtime_r(&seconds, &utc);
+  strftime(out, size, "%a, %d %b %Y %H:%M:%S GMT", &utc);
+}
+
+void PhotoHttp::formatPhotoUrl(char* out, size_t size, uint32_t number, uint32_t bytes) {
+  snprintf(out, size, "/photos/photo_%06lu.jpg?v=%lu", (unsigned long)number, (unsigned long)bytes);
+}
+
+uint32_t PhotoHttp::parsePhotoPath(const char* path) {
+  static const char prefix[] = "/photos/photo_";
+  if (strncmp(path, prefix, sizeof(prefix) - 1) != 0) {
+    return 0;
+  }
+  char* end = nullptr;
+  unsigned long number = strtoul(path + sizeof(prefix) - 1, &end, 10);
+  if (end == path + sizeof(prefix) - 1 || strcmp(end, ".jpg") != 0) {
+    return 0;
+  }
+  return (uint32_t)number;
+}
+
+bool PhotoHttp::sendNotModified(AsyncWebServerRequest* request, const char* etag, const char* cacheControl) {
+  if (!request->hasHeader("If-None-Match")) {
+    return false;
+  }
+  // May be a list, and W/ prefixes still compare by the quoted value
+  const String& tags = request->getHeader("If-None-Match")->value();
+  if (tags != "*" && strstr(tags.c_str(), etag) == nullptr) {
+    return false;
+  }
+  AsyncWebServerResponse* response = request->beginResponse(304);
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", cacheControl);
+  request->send(response);
+  return true;
+}
+
+void PhotoHttp::addValidators(AsyncWebServerResponse* response, const char* etag, uint32_t unixTime,
+                              const char* cacheControl) {
+  if (etag) {
+    response->addHeader("ETag", etag);
+  }
+  if (unixTime >= PHOTO_TIME_VALID) {
+    char date[40];
+    formatHttpDate(date, sizeof(date), unixTime);
+    response->addHeader("Last-Modified", date);
+  }
+  response->addHeader("Cache-Control", cacheControl);
+}
+
+HttpRangeResult PhotoHttp::parseRange(AsyncWebServerRequest* request, uint32_t size, const char* etag,
+                                      uint32_t& start, uint32_t& length) {
+  if (!request->hasHeader("Range")) {
+    return HTTP_RANGE_NONE;
+  }
+  // If-Range: only resume when the client still has this exact version
+  if (request->hasHeader("If-Range") && (!etag || request->getHeader("If-Range")->value() != etag)) {
+    return HTTP_RANGE_NONE;
+  }
+  const char* spec = request->getHeader("Range")->value().c_str();
+  if (strncmp(spec, "bytes=", 6) != 0 || strchr(spec, ',') != nullptr) {
+    return HTTP_RANGE_NONE;
+  }
+  spec += 6;
+
+  char* end = nullptr;
+  if (*spec == '-') {
+    // Suffix range: the last N bytes
+    unsigned long suffix = strtoul(spec + 1, &end, 10);
+    if (end == spec + 1 || suffix == 0 || size == 0) {
+      return HTTP_RANGE_UNSATISFIABLE;
+    }
+    length = suffix < size ? suffix : size;
+    start = size - length;
+    return HTTP_RANGE_PARTIAL;
+  }
+
+  unsigned long first = strtoul(spec, &end, 10);
+  if (end == spec || *end != '-') {
+    return HTTP_RANGE_NONE;
+  }
+  if (first >= size) {
+    return HTTP_RANGE_UNSATISFIABLE;
+  }
+  const char* lastSpec = end + 1;
+  unsigned long last = size - 1;
+  if (*lastSpec != '\0') {
+    last = strtoul(lastSpec, &end, 10);
+    if (end == lastSpec || last < first) {
+      return HTTP_RANGE_NONE;
+    }
+    if (last >= size) {
+      last = size - 1;
+    }
+  }
+  start = first;
+  length = last - first + 1;
+  return HTTP_RANGE_PARTIAL;
+}
+
+void PhotoHttp::sendRangeNotSatisfiable(AsyncWebServerRequest* request, uint32_t size) {
+  char contentRange[32];
+  snprintf(contentRange, sizeof(contentRange), "bytes */%lu", (unsigned long)size);
+  AsyncWebServerResponse* response = request->beginResponse(416);
+  response->addHeader("Content-Range", contentRange);
+  request->send(response);
+}
+
+const char* PhotoHttp::contentTypeFor(const char* path) {
+  const char* dot = strrchr(path, '.');
+  if (!dot) return "application/octet-stream";
+  if (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0) return "image/jpeg";
+  if (strcasecmp(dot, ".avi") == 0) return "video/x-msvideo";
+  if (strcasecmp(dot, ".json") == 0) return "application/json";
+  if (strcasecmp(dot, ".txt") == 0 || strcasecmp(dot, ".log") == 0) return "text/plain";
+  if (strcasecmp(dot, ".html") == 0) return "text/html";
+  return "application/octet-stream";
+}
+
+void PhotoHttp::sendFile(AsyncWebServerRequest* request, const char* path, const char* contentType,
+                         const char* etag, uint32_t unixTime, const char* cacheControl) {
+  SdFileResponse* response = new SdFileResponse(path, contentType[0] ? contentType : contentTypeFor(path));
+  if (!response->_sourceValid()) {
+    delete response;
+    request->send(404, "text/plain", "File not found");
+    return;
+  }
+
+  uint32_t start = 0, length = 0;
+  switch (parseRange(request, response->getFileSize(), etag, start, length)) {
+    case HTTP_RANGE_UNSATISFIABLE:
+      sendRangeNotSatisfiable(request, response->getFileSize());
+      delete response;
+      return;
+    case HTTP_RANGE_PARTIAL:
+      response->setRange(start, length);
+      break;
+    case HTTP_RANGE_NONE:
+      break;
+  }
+  response->addHeader("Accept-Ranges", "bytes");
+  addValidators(response, etag, unixTime, cacheControl);
+  response->prefetch();
+  request->send(response);
+}
+
+bool PhotoHttp::sendCached(AsyncWebServerRequest* request, FrameCacheHandle handle, const char* contentType,
+                           const char* etag, uint32_t unixTime, const char* cacheControl) {
+  // The slot stays pinned for as long as the response holds this
+  struct CachePin {
+    FrameCacheHandle handle;
+    const uint8_t* data;
+    size_t len;
+    ~CachePin() {
+      if (handle) {
+        frameCache.unpin(handle);
+      }
+    }
+  };
+
+  std::shared_ptr<CachePin> pin = std::make_shared<CachePin>();
+  pin->handle = 0;
+  if (!handle || !frameCache.pin(handle, &pin->data, &pin->len)) {
+    return false;
+  }
+  pin->handle = handle;
+
+  uint32_t start = 0, length = pin->len;
+  HttpRangeResult range = parseRange(request, pin->len, etag, start, length);
+  if (range == HTTP_RANGE_UNSATISFIABLE) {
+    sendRangeNotSatisfiable(request, pin->len);
+    return true;
+  }
+
+  AsyncWebServerResponse* response = request->beginResponse(contentType, length,
+    [pin, start, length](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      size_t n = length - index;
+      if (n > maxLen) n = maxLen;
+      memcpy(buffer, pin->data + start + index, n);
+      return n;
+    });
+  if (range == HTTP_RANGE_PARTIAL) {
+    char contentRange[48];
+    snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu", (unsigned long)start,
+             (unsigned long)(start + length - 1), (unsigned long)pin->len);
+    response->setCode(206);
+    response->addHeader("Content-Range", contentRange);
+  }
+  response->addHeader("Accept-Ranges", "bytes");
+  addValidators(response, etag, unixTime, cacheControl);
+  request->send(response);
+  return true;
+}
+
+bool PrefixRequestHandler::canHandle(AsyncWebServerRequest* request) {
+  return request->method() == HTTP_GET && request->url().startsWith(prefix);
+}
@@ -0,0 +1,517 @@
+#include "PhotoIndex.h"
+#include "RequestArena.h"
+#include "PhotoWriter.h"
+#include "Thumbnailer.h"
+#include "esp_heap_caps.h"
+#include "ff.h"
+#include <dirent.h>
+#include <time.h>
+#include <memory>
+
+PhotoIndex photoIndex;
+
+PhotoIndex::PhotoIndex() : entries(nullptr), count(0), capacity(0), dropped(0), mutex(NULL) {
+}
+
+bool PhotoIndex::begin(uint32_t maxEntries) {
+  if (entries) {
+    return true;
+  }
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  entries = (PhotoEntry*)heap_caps_malloc(maxEntries * sizeof(PhotoEntry), caps);
+  mutex = xSemaphoreCreateMutex();
+  if (!entries || !mutex) {
+    Serial.println("❌ Photo index: allocation failed");
+    return false;
+  }
+  capacity = maxEntries;
+  Serial.printf("✅ Photo index: room for %lu photos in %s\n", (unsigned long)capacity,
+                psramFound() ? "PSRAM" : "internal RAM");
+  return true;
+}
+
+bool PhotoIndex::parseNumber(const char* name, const char* prefix, uint32_t& number) {
+  size_t prefixLen = strlen(prefix);
+  if (strncmp(name, prefix, prefixLen) != 0) {
+    return false;
+  }
+  char* end = nullptr;
+  unsigned long value = strtoul(name + prefixLen, &end, 10);
+  if (end == name + prefixLen || strcmp(end, ".jpg") != 0 || value == 0) {
+    return false;
+  }
+  number = (uint32_t)value;
+  return true;
+}
+
+static int compareByNumber(const void* a, const void* b) {
+  uint32_t left = ((const PhotoEntry*)a)->number;
+  uint32_t right = ((const PhotoEntry*)b)->number;
+  return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+static int compareNumbers(const void* a, const void* b) {
+  uint32_t left = *(const uint32_t*)a;
+  uint32_t right = *(const uint32_t*)b;
+  return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+// FAT date and time fields as the VFS stat() reports them: local time
+static uint32_t fatTimestamp(uint16_t fdate, uint16_t ftime) {
+  struct tm tm = {};
+  tm.tm_mday = fdate & 0x1f;
+  tm.tm_mon = ((fdate >> 5) & 0x0f) - 1;
+  tm.tm_year = (fdate >> 9) + 80;
+  tm.tm_sec = (ftime & 0x1f) * 2;
+  tm.tm_min = (ftime >> 5) & 0x3f;
+  tm.tm_hour = (ftime >> 11) & 0x1f;
+  tm.tm_isdst = -1;
+  return (uint32_t)mktime(&tm);
+}
+
+uint32_t PhotoIndex::rebuild() {
+  if (!entries) {
+    return 0;
+  }
+  unsigned long start = millis();
+  // FatFs directly: the VFS dirent carries no size, and stat() or open() per
+  // entry looks the name up from the start of the directory again, which made
+  // the scan quadratic in the photo count. f_readdir returns size and date with
+  // each entry in one pass.
+  FF_DIR dir;
+  if (f_opendir(&dir, PHOTO_FATFS_DRIVE "/photos") != FR_OK) {
+    Serial.println("⚠️ Photo index: /photos not readable");
+    return 0;
+  }
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  count = 0;
+  dropped = 0;
+  FILINFO info;
+  while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != '\0') {
+    uint32_t number;
+    if ((info.fattrib & AM_DIR) || !parseNumber(info.fname, "photo_", number)) {
+      continue;
+    }
+    if (count >= capacity) {
+      dropped++;
+      continue;
+    }
+    PhotoEntry& entry = entries[count++];
+    entry.number = number;
+    entry.size = (uint32_t)info.fsize;
+    entry.timestamp = fatTimestamp(info.fdate, info.ftime);
+    entry.flags = 0;
+  }
+  f_closedir(&dir);
+
+  // Directory order is creation order only until files get deleted
+  qsort(entries, count, sizeof(PhotoEntry), compareByNumber);
+
+  // FAT keeps 2 s resolution and an unset clock writes 1980 - clamp so time stays sorted
+  uint32_t previous = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (entries[i].timestamp < PHOTO_TIME_VALID || entries[i].timestamp < previous) {
+      entries[i].timestamp = previous;
+      entries[i].flags |= PHOTO_FLAG_TIME_ESTIMATED;
+    }
+    previous = entries[i].timestamp;
+  }
+  uint32_t total = count;
+  xSemaphoreGive(mutex);
+
+  scanThumbnails();
+
+  Serial.printf("✅ Photo index: %lu photos (last #%lu) in %lu ms\n", (unsigned long)total,
+                (unsigned long)getLastNumber(), millis() - start);
+  if (dropped > 0) {
+    Serial.printf("⚠️ Photo index full - %lu older photos not listed\n", (unsigned long)dropped);
+  }
+  return total;
+}
+
+void PhotoIndex::scanThumbnails() {
+  DIR* dir = opendir(PHOTO_MOUNT_POINT THUMB_DIR);
+  if (!dir) {
+    return;
+  }
+  struct dirent* item;
+  while ((item = readdir(dir)) != nullptr) {
+    uint32_t number;
+    if (parseNumber(item->d_name, "thumb_", number)) {
+      setFlags(number, PHOTO_FLAG_THUMB);
+    }
+  }
+  closedir(dir);
+}
+
+uint32_t PhotoIndex::lowerBoundNumber(uint32_t number) const {
+  uint32_t low = 0, high = count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (entries[mid].number < number) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+uint32_t PhotoIndex::lowerBoundTime(uint32_t timestamp) const {
+  uint32_t low = 0, high = count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (entries[mid].timestamp < timestamp) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+uint32_t PhotoIndex::upperBoundTime(uint32_t timestamp) const {
+  uint32_t low = 0, high = count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (entries[mid].timestamp <= timestamp) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+void PhotoIndex::append(uint32_t number, uint32_t size, uint32_t unixTime) {
+  if (!entries) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  PhotoEntry entry;
+  entry.number = number;
+  entry.size = size;
+  entry.timestamp = unixTime;
+  entry.flags = 0;
+  uint32_t previous = count > 0 ? entries[count - 1].timestamp : 0;
+  if (entry.timestamp < PHOTO_TIME_VALID || entry.timestamp < previous) {
+    entry.timestamp = previous;
+    entry.flags |= PHOTO_FLAG_TIME_ESTIMATED;
+  }
+
+  if (count > 0 && entries[count - 1].number >= number) {
+    // Numbering went backwards (files are being rewritten) - drop what it supersedes
+    uint32_t pos = lowerBoundNumber(number);
+    count = pos;
+    if (pos > 0 && entries[pos - 1].timestamp > entry.timestamp) {
+      entry.timestamp = entries[pos - 1].timestamp;
+    }
+  }
+  if (count >= capacity) {
+    // Full: forget the oldest so the newest photos stay listed
+    memmove(entries, entries + 1, (count - 1) * sizeof(PhotoEntry));
+    count--;
+    dropped++;
+  }
+  entries[count++] = entry;
+  xSemaphoreGive(mutex);
+}
+
+void PhotoIndex::setFlags(uint32_t number, uint32_t flags) {
+  if (!entries) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t pos = lowerBoundNumber(number);
+  if (pos < count && entries[pos].number == number) {
+    entries[pos].flags |= flags;
+  }
+  xSemaphoreGive(mutex);
+}
+
+void PhotoIndex::setSize(uint32_t number, uint32_t size, uint32_t flags) {
+  if (!entries) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t pos = lowerBoundNumber(number);
+  if (pos < count && entries[pos].number == number) {
+    entries[pos].size = size;
+    entries[pos].flags |= flags;
+  }
+  xSemaphoreGive(mutex);
+}
+
+void PhotoIndex::setTier(uint32_t number, uint32_t size, uint8_t tier, bool optimized) {
+  if (!entries) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t pos = lowerBoundNumber(number);
+  if (pos < count && entries[pos].number == number) {
+    entries[pos].size = size;
+    entries[pos].flags &= ~(PHOTO_TIER_MASK | PHOTO_FLAG_OPTIMIZED);
+    entries[pos].flags |= ((uint32_t)tier << PHOTO_TIER_SHIFT) & PHOTO_TIER_MASK;
+    if (optimized) {
+      entries[pos].flags |= PHOTO_FLAG_OPTIMIZED;
+    }
+  }
+  xSemaphoreGive(mutex);
+}
+
+void PhotoIndex::applyTiers(uint32_t halfThrough, uint32_t eighthThrough) {
+  if (!entries) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t end = lowerBoundNumber(max(halfThrough, eighthThrough) + 1);
+  for (uint32_t i = 0; i < end; i++) {
+    uint32_t tier = entries[i].number <= eighthThrough ? PHOTO_TIER_EIGHTH : PHOTO_TIER_HALF;
+    entries[i].flags = (entries[i].flags & ~PHOTO_TIER_MASK) | (tier << PHOTO_TIER_SHIFT);
+  }
+  xSemaphoreGive(mutex);
+}
+
+uint32_t PhotoIndex::removeBatch(uint32_t* numbers, uint32_t n) {
+  if (!entries || n == 0) {
+    return 0;
+  }
+  qsort(numbers, n, sizeof(uint32_t), compareNumbers);
+
+  // One compaction pass however many photos went
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t write = lowerBoundNumber(numbers[0]);
+  uint32_t next = 0;
+  uint32_t removed = 0;
+  for (uint32_t read = write; read < count; read++) {
+    while (next < n && numbers[next] < entries[read].number) {
+      next++;
+    }
+    if (next < n && numbers[next] == entries[read].number) {
+      removed++;
+      continue;
+    }
+    entries[write++] = entries[read];
+  }
+  count = write;
+  xSemaphoreGive(mutex);
+  return removed;
+}
+
+void PhotoIndex::clear() {
+  if (!entries) {
+    return;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  count = 0;
+  dropped = 0;
+  xSemaphoreGive(mutex);
+}
+
+uint32_t PhotoIndex::getCount() {
+  if (!entries) {
+    return 0;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t total = count;
+  xSemaphoreGive(mutex);
+  return total;
+}
+
+uint32_t PhotoIndex::getLastNumber() {
+  if (!entries) {
+    return 0;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t last = count > 0 ? entries[count - 1].number : 0;
+  xSemaphoreGive(mutex);
+  return last;
+}
+
+bool PhotoIndex::find(uint32_t number, PhotoEntry& out) {
+  if (!entries) {
+    return false;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t pos = lowerBoundNumber(number);
+  bool found = pos < count && entries[pos].number == number;
+  if (found) {
+    out = entries[pos];
+  }
+  xSemaphoreGive(mutex);
+  return found;
+}
+
+uint32_t PhotoIndex::copyNewest(uint32_t skip, PhotoEntry* out, uint32_t max) {
+  if (!entries) {
+    return 0;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t copied = 0;
+  while (copied < max && skip + copied < count) {
+    out[copied] = entries[count - 1 - skip - copied];
+    copied++;
+  }
+  xSemaphoreGive(mutex);
+  return copied;
+}
+
+uint32_t PhotoIndex::copyPage(uint32_t cursor, bool ascending, uint32_t minNumber, uint32_t maxNumber,
+                              PhotoEntry* out, uint32_t max) {
+  if (!entries) {
+    return 0;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  // Positions move under clears, so every call re-finds its place by number
+  uint32_t copied = 0;
+  if (ascending) {
+    uint32_t first = cursor >= minNumber ? cursor + 1 : minNumber;
+    for (uint32_t pos = lowerBoundNumber(first); pos < count && copied < max; pos++) {
+      if (entries[pos].number > maxNumber) {
+        break;
+      }
+      out[copied++] = entries[pos];
+    }
+  } else {
+    uint32_t limit = (cursor == 0 || cursor > maxNumber) ? maxNumber : cursor - 1;
+    uint32_t pos = limit == UINT32_MAX ? count : lowerBoundNumber(limit + 1);
+    while (pos > 0 && copied < max) {
+      pos--;
+      if (entries[pos].number < minNumber) {
+        break;
+      }
+      out[copied++] = entries[pos];
+    }
+  }
+  xSemaphoreGive(mutex);
+  return copied;
+}
+
+uint32_t PhotoIndex::resolveTimeRange(uint32_t from, uint32_t to, uint32_t& minNumber, uint32_t& maxNumber) {
+  minNumber = 1;
+  maxNumber = UINT32_MAX;
+  if (!entries) {
+    return 0;
+  }
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  uint32_t first = from ? lowerBoundTime(from) : 0;
+  uint32_t last = to ? upperBoundTime(to) : count;   // One past the end
+  uint32_t matched = 0;
+  if (first < last) {
+    matched = last - first;
+    minNumber = entries[first].number;
+    // An open upper bound keeps following new captures
+    if (to) {
+      maxNumber = entries[last - 1].number;
+    }
+  } else {
+    minNumber = UINT32_MAX;
+    maxNumber = 0;
+  }
+  xSemaphoreGive(mutex);
+  return matched;
+}
+
+AsyncWebServerResponse* PhotoIndex::beginListResponse(AsyncWebServerRequest* request, const PhotoListQuery& query) {
+  // List state shared with the chunk filler; freed with the response
+  struct ListState {
+    PhotoListQuery query;
+    uint32_t minNumber;
+    uint32_t maxNumber;
+    uint32_t total;
+    uint32_t emitted;
+    uint32_t lastNumber;
+    bool more;
+    uint8_t stage;        // 0 = header, 1 = photos, 2 = footer, 3 = done
+    PhotoEntry batch[PHOTO_INDEX_BATCH];
+    uint32_t batchLen;
+    uint32_t batchPos;
+    char pending[192];
+    size_t pendingLen;
+    size_t pendingPos;
+  };
+
+  std::shared_ptr<ListState> state = std::make_shared<ListState>();
+  state->query = query;
+  state->total = resolveTimeRange(query.from, query.to, state->minNumber, state->maxNumber);
+  state->emitted = 0;
+  state->lastNumber = query.cursor;
+  state->more = false;
+  state->stage = 0;
+  state->batchLen = 0;
+  state->batchPos = 0;
+  state->pendingLen = 0;
+  state->pendingPos = 0;
+
+  return request->beginChunkedResponse("application/json",
+    [this, state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      size_t used = 0;
+      while (used < maxLen) {
+        // Flush whatever did not fit into the previous chunk
+        if (state->pendingPos < state->pendingLen) {
+          size_t n = state->pendingLen - state->pendingPos;
+          if (n > maxLen - used) n = maxLen - used;
+          memcpy(buffer + used, state->pending + state->pendingPos, n);
+          state->pendingPos += n;
+          used += n;
+          continue;
+        }
+
+        state->pendingLen = 0;
+        state->pendingPos = 0;
+        if (state->stage == 0) {
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending),
+            "{\"total\":%lu,\"limit\":%lu,\"order\":\"%s\",\"photos\":[",
+            (unsigned long)state->total, (unsigned long)state->query.limit,
+            state->query.ascending ? "asc" : "desc");
+          state->stage = 1;
+        } else if (state->stage == 1) {
+          if (state->batchPos == state->batchLen) {
+            uint32_t wanted = state->query.limit - state->emitted;
+            if (wanted > PHOTO_INDEX_BATCH) wanted = PHOTO_INDEX_BATCH;
+            state->batchLen = wanted == 0 ? 0 :
+              copyPage(state->lastNumber, state->query.ascending, state->minNumber, state->maxNumber,
+                       state->batch, wanted);
+            state->batchPos = 0;
+            if (state->batchLen == 0) {
+              // Page full: one more lookup tells the client whether to come back
+              PhotoEntry probe;
+              state->more = state->emitted == state->query.limit &&
+                copyPage(state->lastNumber, state->query.ascending, state->minNumber, state->maxNumber,
+                         &probe, 1) == 1;
+              state->stage = 2;
+              continue;
+            }
+          }
+          const PhotoEntry& photo = state->batch[state->batchPos++];
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending),
+            "%s{\"n\":%lu,\"size\":%lu,\"ts\":%lu,\"url\":\"/photos/photo_%06lu.jpg?v=%lu\","
+            "\"thumb\":\"/thumb?n=%lu&v=%lu\",\"flags\":%lu,\"tier\":%u}",
+            state->emitted ? "," : "", (unsigned long)photo.number, (unsigned long)photo.size,
+            (unsigned long)photo.timestamp, (unsigned long)photo.number, (unsigned long)photo.size,
+            (unsigned long)photo.number, (unsigned long)photo.size, (unsigned long)photo.flags,
+            (unsigned)photoTier(photo));
+          state->lastNumber = photo.number;
+          state->emitted++;
+        } else if (state->stage == 2) {
+          if (state->more) {
+            state->pendingLen = snprintf(state->pending, sizeof(state->pending),
+              "],\"count\":%lu,\"next_cursor\":%lu}\n", (unsigned long)state->emitted, (unsigned long)state->lastNumber);
+          } else {
+            state->pendingLen = snprintf(state->pending, sizeof(state->pending),
+              "],\"count\":%lu,\"next_cursor\":null}\n", (unsigned long)state->emitted);
+          }
+          state->stage = 3;
+        } else {
+          break;
+        }
+      }
+      return used;
+    });
+}
+
+void PhotoIndex::writeStatusJson(Print& out) {
+  printfTo(out, "{\"photos\":%lu,\"capacity\":%lu,\"last_number\":%lu,\"dropped\":%lu}", (unsigned long)getCount(),
+           (unsigned long)capacity, (unsigned long)getLastNumber(), (unsigned long)dropped);
+}
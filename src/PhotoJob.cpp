@@ -0,0 +1,166 @@
+#include "PhotoJob.h"
+#include "RequestArena.h"
+#include "PhotoUploader.h"
+#include "RequestProfiler.h"
+#include "TraceRecorder.h"
+#include "DeferredLog.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+PhotoJob::PhotoJob(const char* taskName, const char* stateFileName, uint32_t taskStack, uint32_t* cursor,
+                   uint32_t* secondCursor)
+  : name(taskName), stateFile(stateFileName), cursorCount(secondCursor ? 2 : 1), stackSize(taskStack),
+    sdMutex(NULL), taskHandle(NULL), enabled(false), paused(false), resetRequested(false), stackLogged(false),
+    pending(0), deferred(0), bytesReclaimed(0), lastMs(0), maxMs(0) {
+  cursors[0] = cursor;
+  cursors[1] = secondCursor;
+}
+
+void PhotoJob::begin(SemaphoreHandle_t sdMutexHandle, bool on) {
+  sdMutex = sdMutexHandle;
+  enabled.store(on);
+  if (lockCard()) {
+    loadState();
+    if (pending) {
+      PhotoWriter::recoverReplace(pending);
+      pending = 0;
+      saveState();
+    }
+    xSemaphoreGive(sdMutex);
+  }
+}
+
+bool PhotoJob::startTask(TaskFunction_t task, void* owner) {
+  xTaskCreatePinnedToCore(task, name, stackSize, owner, tskIDLE_PRIORITY, &taskHandle, 1);
+  if (taskHandle == NULL) {
+    Serial.printf("❌ Failed to create %s task\n", name);
+    return false;
+  }
+  return true;
+}
+
+bool PhotoJob::ready() {
+  if (resetRequested.exchange(false)) {
+    // The card was formatted: the state file and any .bak went with it
+    for (uint8_t i = 0; i < cursorCount; i++) {
+      *cursors[i] = 0;
+    }
+    pending = 0;
+    bytesReclaimed = 0;
+  }
+
+  // The old file stays until no response that may have opened it is left
+  if (pending && idle() && lockCard()) {
+    PhotoWriter::removeBackup(pending);
+    pending = 0;
+    saveState();
+    xSemaphoreGive(sdMutex);
+  }
+  return enabled.load() && !paused.load() && !pending;
+}
+
+bool PhotoJob::idle() const {
+  return requestProfiler.getInFlight() == 0;
+}
+
+bool PhotoJob::uploaded(uint32_t number) const {
+  return !photoUploader.isEnabled() || number <= photoUploader.getCursor();
+}
+
+bool PhotoJob::lockCard(TickType_t wait) {
+  return sdMutex && traceSemaphoreTake(sdMutex, wait, "sdMutex") == pdTRUE;
+}
+
+bool PhotoJob::replace(uint32_t number, const PhotoWritePart* parts, size_t count, uint32_t expectedSize) {
+  pending = number;
+  saveState();
+  bool done = photoWriter.replacePhoto(number, parts, count, expectedSize);
+  if (!done) {
+    pending = 0;
+  }
+  return done;
+}
+
+void PhotoJob::saveProgress() {
+  if (lockCard()) {
+    saveState();
+    xSemaphoreGive(sdMutex);
+  }
+}
+
+void PhotoJob::replaced(uint32_t bytesSaved, uint32_t startMs) {
+  bytesReclaimed += bytesSaved;
+  lastMs = millis() - startMs;
+  if (lastMs > maxMs) {
+    maxMs = lastMs;
+  }
+}
+
+void PhotoJob::logStack() {
+  if (!stackLogged) {
+    stackLogged = true;
+    DLOGI("📏 %s stack: %u of %u bytes never used", name, (unsigned)uxTaskGetStackHighWaterMark(NULL),
+          (unsigned)stackSize);
+  }
+}
+
+void PhotoJob::loadState() {
+  char text[PHOTO_JOB_STATE_LEN] = {0};
+  int fd = ::open(stateFile, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  ssize_t n = ::read(fd, text, sizeof(text) - 1);
+  ::close(fd);
+  if (n <= 0) {
+    return;
+  }
+  // The cursors and the bytes reclaimed are required, pending is not
+  uint32_t saved[PHOTO_JOB_MAX_CURSORS];
+  char* p = text;
+  char* end;
+  for (uint8_t i = 0; i < cursorCount; i++) {
+    saved[i] = strtoul(p, &end, 10);
+    if (end == p) {
+      return;
+    }
+    p = end;
+  }
+  unsigned long long reclaimed = strtoull(p, &end, 10);
+  if (end == p) {
+    return;
+  }
+  p = end;
+  unsigned long savedPending = strtoul(p, &end, 10);
+  for (uint8_t i = 0; i < cursorCount; i++) {
+    *cursors[i] = saved[i];
+  }
+  bytesReclaimed = reclaimed;
+  pending = end == p ? 0 : savedPending;
+}
+
+void PhotoJob::saveState() {
+  char text[PHOTO_JOB_STATE_LEN];
+  int len = 0;
+  for (uint8_t i = 0; i < cursorCount; i++) {
+    len += snprintf(text + len, sizeof(text) - len, "%lu ", (unsigned long)*cursors[i]);
+  }
+  len += snprintf(text + len, sizeof(text) - len, "%llu %lu", (unsigned long long)bytesReclaimed,
+                  (unsigned long)pending);
+  int fd = ::open(stateFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    ::write(fd, text, len);
+    ::close(fd);
+  }
+}
+
+void PhotoJob::writeStatusHead(Print& out) {
+  printfTo(out, "{\"enabled\":%s,\"running\":%s,\"paused\":%s", enabled.load() ? "true" : "false",
+           taskHandle ? "true" : "false", paused.load() ? "true" : "false");
+}
+
+void PhotoJob::writeStatusTail(Print& out) {
+  printfTo(out, ",\"deferred\":%lu,\"bytes_reclaimed\":%llu,\"last_ms\":%lu,\"max_ms\":%lu,\"stack_free\":%u}",
+           (unsigned long)deferred, (unsigned long long)bytesReclaimed, (unsigned long)lastMs, (unsigned long)maxMs,
+           taskHandle ? (unsigned)uxTaskGetStackHighWaterMark(taskHandle) : 0);
+}
@@ -0,0 +1,109 @@
+#include "PhotoMetadata.h"
+#include "PhotoWriter.h"
+#include "esp_camera.h"
+#include <WiFi.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void PhotoMetadataFormat::capture(PhotoMetadata& meta, uint32_t number, uint32_t unixTime) {
+  memset(&meta, 0, sizeof(meta));
+  meta.number = number;
+  meta.unixTime = unixTime;
+  meta.uptimeMs = millis();
+  // The configured values: OV2640 does not report what auto exposure picked
+  sensor_t* sensor = esp_camera_sensor_get();
+  if (sensor) {
+    meta.exposure = sensor->status.aec_value;
+    meta.gain = sensor->status.agc_gain;
+    meta.aec = sensor->status.aec;
+    meta.aec2 = sensor->status.aec2;
+    meta.aeLevel = sensor->status.ae_level;
+    meta.agc = sensor->status.agc;
+    meta.quality = sensor->status.quality;
+    meta.framesize = sensor->status.framesize;
+  }
+  meta.rssi = WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0;
+}
+
+size_t PhotoMetadataFormat::buildSegment(uint8_t* out, size_t size, const PhotoMetadata& meta) {
+  const size_t prefix = 4 + PHOTO_META_ID_LEN;
+  if (size <= prefix) {
+    return 0;
+  }
+  int n = snprintf((char*)out + prefix, size - prefix,
+                   "{\"n\":%lu,\"ts\":%lu,\"uptime_ms\":%lu,\"exposure\":%u,\"gain\":%u,\"aec\":%u,\"aec2\":%u,"
+                   "\"ae_level\":%d,\"agc\":%u,\"quality\":%u,\"framesize\":%u,\"rssi\":%d,\"build\":\"%s\"}",
+                   (unsigned long)meta.number, (unsigned long)meta.unixTime, (unsigned long)meta.uptimeMs,
+                   meta.exposure, meta.gain, meta.aec, meta.aec2, meta.aeLevel, meta.agc, meta.quality,
+                   meta.framesize, meta.rssi, PHOTO_META_BUILD);
+  if (n < 0 || prefix + n >= size) {
+    return 0;
+  }
+  // Segment length counts itself but not the marker
+  size_t segmentLen = 2 + PHOTO_META_ID_LEN + n;
+  out[0] = 0xFF;
+  out[1] = PHOTO_META_MARKER;
+  out[2] = segmentLen >> 8;
+  out[3] = segmentLen & 0xFF;
+  memcpy(out + 4, PHOTO_META_ID, PHOTO_META_ID_LEN);
+  return 2 + segmentLen;
+}
+
+size_t PhotoMetadataFormat::insertionOffset(const uint8_t* jpeg, size_t len) {
+  if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+    return 0;
+  }
+  // JFIF wants APP0 straight after SOI
+  if (len > 11 && jpeg[2] == 0xFF && jpeg[3] == 0xE0 && memcmp(jpeg + 6, "JFIF", 5) == 0) {
+    size_t app0End = 4 + ((jpeg[4] << 8) | jpeg[5]);
+    return app0End < len ? app0End : 0;
+  }
+  return 2;
+}
+
+size_t PhotoMetadataFormat::findSegment(const uint8_t* jpeg, size_t len, size_t& offset) {
+  if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+    return 0;
+  }
+  // Walk the APPn segments ahead of the tables
+  size_t pos = 2;
+  while (pos + 4 <= len && jpeg[pos] == 0xFF && jpeg[pos + 1] >= 0xE0 && jpeg[pos + 1] <= 0xEF) {
+    size_t segmentLen = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+    if (jpeg[pos + 1] == PHOTO_META_MARKER && segmentLen > 2 + PHOTO_META_ID_LEN &&
+        pos + 2 + segmentLen <= len && memcmp(jpeg + pos + 4, PHOTO_META_ID, PHOTO_META_ID_LEN) == 0) {
+      offset = pos;
+      return 2 + segmentLen;
+    }
+    pos += 2 + segmentLen;
+  }
+  return 0;
+}
+
+bool PhotoMetadataFormat::parse(const uint8_t* head, size_t len, char* json, size_t size) {
+  size_t offset = 0;
+  size_t segmentLen = findSegment(head, len, offset);
+  if (segmentLen == 0) {
+    return false;
+  }
+  size_t payloadLen = segmentLen - 4 - PHOTO_META_ID_LEN;
+  if (payloadLen >= size) {
+    return false;
+  }
+  memcpy(json, head + offset + 4 + PHOTO_META_ID_LEN, payloadLen);
+  json[payloadLen] = '\0';
+  return true;
+}
+
+bool PhotoMetadataFormat::readFromFile(uint32_t number, char* json, size_t size) {
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  PhotoWriter::formatPhotoPath(path + strlen(path), sizeof(path) - strlen(path), number);
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  uint8_t head[PHOTO_META_PROBE];
+  ssize_t n = ::read(fd, head, sizeof(head));
+  ::close(fd);
+  return n > 0 && parse(head, n, json, size);
+}
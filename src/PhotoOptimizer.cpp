@@ -0,0 +1,184 @@
+#include "PhotoOptimizer.h"
+#include "RequestArena.h"
+#include "JpegHuffman.h"
+#include "PhotoWriter.h"
+#include "TraceRecorder.h"
+#include "DeferredLog.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+PhotoOptimizer photoOptimizer;
+
+PhotoOptimizer::PhotoOptimizer()
+  : done(0), job("PhotoOptimizer", PHOTO_MOUNT_POINT OPTIMIZER_STATE_FILE, OPTIMIZER_TASK_STACK, &done) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+void PhotoOptimizer::begin(SemaphoreHandle_t sdMutexHandle) {
+  preferences.begin("optimizer", false);
+  job.begin(sdMutexHandle, preferences.getBool("enabled", true));
+}
+
+bool PhotoOptimizer::start() {
+  // Two photo-sized buffers per pass; internal RAM cannot spare that
+  if (!psramFound()) {
+    Serial.println("ℹ Photo optimizer off - needs PSRAM");
+    return false;
+  }
+  if (!job.startTask(optimizerTask, this)) {
+    return false;
+  }
+  Serial.printf("✅ Photo optimizer: %s, after photo #%lu, %llu bytes reclaimed so far\n",
+                job.isEnabled() ? "on" : "off", (unsigned long)done, (unsigned long long)job.getBytesReclaimed());
+  return true;
+}
+
+void PhotoOptimizer::setEnabled(bool on) {
+  job.setEnabled(on);
+  preferences.putBool("enabled", on);
+}
+
+void PhotoOptimizer::optimizerTask(void* parameter) {
+  static_cast<PhotoOptimizer*>(parameter)->run();
+}
+
+void PhotoOptimizer::run() {
+  while (true) {
+    PhotoEntry photo;
+    bool wait = false;
+    if (!job.ready() || !findNext(photo, wait)) {
+      if (wait) {
+        job.defer();
+      }
+      job.sleep();
+      continue;
+    }
+    if (!job.idle()) {
+      job.defer();
+      job.sleep();
+      continue;
+    }
+    optimize(photo);
+    job.logStack();
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+bool PhotoOptimizer::findNext(PhotoEntry& photo, bool& wait) {
+  photo.number = 0;
+  uint32_t last = photoIndex.getLastNumber();
+  if (done > last) {
+    done = 0;                                  // Numbering restarted after a clear
+  }
+  while (photoIndex.copyPage(done, true, done + 1, UINT32_MAX, &photo, 1) == 1 &&
+         (photo.flags & PHOTO_FLAG_OPTIMIZED)) {
+    done = photo.number;
+  }
+  if (photo.number <= done) {
+    return false;                              // Caught up
+  }
+  // Old enough that nobody is still looking at it
+  if (photo.number + OPTIMIZER_SKIP_NEWEST > last) {
+    return false;
+  }
+  time_t now = time(nullptr);
+  if (!(photo.flags & PHOTO_FLAG_TIME_ESTIMATED) && now > PHOTO_TIME_VALID &&
+      (uint32_t)now - photo.timestamp < OPTIMIZER_MIN_AGE_S) {
+    return false;
+  }
+  if (!job.uploaded(photo.number)) {
+    wait = true;
+    return false;
+  }
+  return true;
+}
+
+void PhotoOptimizer::optimize(const PhotoEntry& photo) {
+  uint32_t start = millis();
+  if (photo.size == 0 || photo.size > OPTIMIZER_MAX_SOURCE) {
+    stats.unchanged++;
+    done = photo.number;
+    return;
+  }
+  uint8_t* source = (uint8_t*)ps_malloc(photo.size);
+  uint8_t* result = (uint8_t*)ps_malloc(photo.size);
+  if (!source || !result) {
+    free(source);
+    free(result);
+    job.defer();
+    return;                                    // Retried on the next pass
+  }
+
+  bool replaced = false;
+  bool retry = !job.lockCard();
+  size_t resultLen = 0;
+  JpegOptimizeResult outcome = JPEG_OPT_CORRUPT;
+  if (!retry && readPhoto(photo.number, source, photo.size)) {
+    uint32_t encodeStart = TraceRecorder::now();
+    outcome = JpegHuffman::optimize(source, photo.size, result, photo.size, &resultLen);
+    traceRecorder.record("optimizer.huffman", "sd", encodeStart, photo.size);
+    if (outcome == JPEG_OPT_NO_MEMORY) {
+      retry = true;
+    } else if (outcome == JPEG_OPT_OK) {
+      // A request that started meanwhile goes first; the work is simply redone
+      retry = !job.idle() || !job.lockCard();
+      if (!retry) {
+        PhotoWritePart part = {result, resultLen};
+        replaced = job.replace(photo.number, &part, 1, photo.size);
+        done = photo.number;
+        job.saveState();
+        job.unlockCard();
+      }
+    }
+  }
+  free(source);
+  free(result);
+  if (retry) {
+    job.defer();
+    return;
+  }
+
+  if (replaced) {
+    photoIndex.setSize(photo.number, resultLen, PHOTO_FLAG_OPTIMIZED);
+    stats.optimized++;
+    job.replaced(photo.size - resultLen, start);
+    DLOGD("🗜️ Photo #%lu: %lu -> %lu bytes", (unsigned long)photo.number, (unsigned long)photo.size,
+          (unsigned long)resultLen);
+    return;
+  }
+  if (outcome == JPEG_OPT_OK || outcome == JPEG_OPT_CORRUPT) {
+    stats.failed++;                            // Unreadable, or replaced by something else
+  } else {
+    stats.unchanged++;
+  }
+  done = photo.number;
+  job.saveProgress();
+}
+
+bool PhotoOptimizer::readPhoto(uint32_t number, uint8_t* buffer, size_t size) {
+  // Called with sdMutex held; releases it
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  PhotoWriter::formatPhotoPath(path + strlen(path), sizeof(path) - strlen(path), number);
+  size_t total = 0;
+  int fd = ::open(path, O_RDONLY);
+  if (fd >= 0) {
+    while (total < size) {
+      ssize_t n = ::read(fd, buffer + total, size - total);
+      if (n <= 0) {
+        break;
+      }
+      total += n;
+    }
+    ::close(fd);
+  }
+  job.unlockCard();
+  return total == size;
+}
+
+void PhotoOptimizer::writeStatusJson(Print& out) {
+  job.writeStatusHead(out);
+  printfTo(out, ",\"done_through\":%lu,\"optimized\":%lu,\"unchanged\":%lu,\"failed\":%lu", (unsigned long)done,
+           (unsigned long)stats.optimized, (unsigned long)stats.unchanged, (unsigned long)stats.failed);
+  job.writeStatusTail(out);
+}
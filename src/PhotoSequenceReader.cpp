@@ -0,0 +1,101 @@
+#include "PhotoSequenceReader.h"
+#include "PhotoWriter.h"
+#include <ESPAsyncWebServer.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+PhotoSequenceReader::PhotoSequenceReader()
+  : fd(-1), stream(nullptr), nextFd(-1), nextStream(nullptr), nextNumber(0), remaining(0) {
+}
+
+PhotoSequenceReader::~PhotoSequenceReader() {
+  close(true);
+}
+
+bool PhotoSequenceReader::begin(uint32_t number, uint32_t size, uint32_t next, uint32_t nextSize,
+                                uint32_t offset) {
+  closePhoto(fd, stream);
+  if (nextNumber == number && offset == 0) {
+    fd = nextFd;
+    stream = nextStream;
+    nextFd = -1;
+    nextStream = nullptr;
+    nextNumber = 0;
+  } else {
+    closePhoto(nextFd, nextStream);
+    nextNumber = 0;
+    if (!openPhoto(number, size, offset, fd, stream)) {
+      return false;
+    }
+  }
+  // A photo that fails here is retried, and reported, when its turn comes
+  if (next && openPhoto(next, nextSize, 0, nextFd, nextStream)) {
+    nextNumber = next;
+  }
+  remaining = size - offset;
+  return true;
+}
+
+size_t PhotoSequenceReader::read(uint8_t* out, size_t maxLen) {
+  if (maxLen > remaining) {
+    maxLen = remaining;
+  }
+  if (maxLen == 0) {
+    return 0;
+  }
+  size_t n;
+  if (stream) {
+    n = sdReadAhead.read(stream, out, maxLen, false);
+    if (n == RESPONSE_TRY_AGAIN) {
+      return n;
+    }
+  } else {
+    ssize_t r = fd >= 0 ? ::read(fd, out, maxLen) : -1;
+    n = r > 0 ? r : 0;
+  }
+  remaining -= n;
+  return n;
+}
+
+void PhotoSequenceReader::close(bool all) {
+  closePhoto(fd, stream);
+  remaining = 0;
+  if (all) {
+    closePhoto(nextFd, nextStream);
+    nextNumber = 0;
+  }
+}
+
+bool PhotoSequenceReader::openPhoto(uint32_t number, uint32_t size, uint32_t offset, int& outFd,
+                                    ReadAheadStream*& outStream) {
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  PhotoWriter::formatPhotoPath(path + strlen(path), sizeof(path) - strlen(path), number);
+  int photoFd = ::open(path, O_RDONLY);
+  struct stat info;
+  if (photoFd < 0 || fstat(photoFd, &info) != 0 || (uint32_t)info.st_size != size) {
+    if (photoFd >= 0) {
+      ::close(photoFd);
+    }
+    return false;
+  }
+  outStream = sdReadAhead.open(photoFd, offset, size);
+  if (!outStream && offset > 0 && ::lseek(photoFd, offset, SEEK_SET) != (off_t)offset) {
+    ::close(photoFd);
+    return false;
+  }
+  outFd = outStream ? -1 : photoFd;
+  return true;
+}
+
+void PhotoSequenceReader::closePhoto(int& photoFd, ReadAheadStream*& photoStream) {
+  if (photoStream) {
+    sdReadAhead.close(photoStream);
+    photoStream = nullptr;
+  }
+  if (photoFd >= 0) {
+    ::close(photoFd);
+    photoFd = -1;
+  }
+}
@@ -0,0 +1,455 @@
+#include "PhotoUploader.h"
+#include "RequestArena.h"
+#include "FS.h"
+#include "SD_MMC.h"
+#include "TraceRecorder.h"
+#include "EventBroadcaster.h"
+#include "PhotoIndex.h"
+
+PhotoUploader::PhotoUploader()
+  : sdMutex(NULL), taskHandle(NULL), latestCommitted(0), cursor(0),
+    rewindTo(UPLOADER_NO_REWIND), paused(false),
+    chunkBuffer(nullptr), consecutiveFailures(0) {
+  memset(&stats, 0, sizeof(stats));
+  configLock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+bool PhotoUploader::begin(SemaphoreHandle_t sdMutexHandle) {
+  Serial.println("📤 Starting photo uploader...");
+  sdMutex = sdMutexHandle;
+
+  preferences.begin("uploader", false);
+  loadConfig();
+  loadCursor();
+  // Photos left waiting before the reboot are a backlog right away, not after the next capture
+  uint32_t last = photoIndex.getLastNumber();
+  latestCommitted.store(last);
+  if (cursor.load() > last) {
+    cursor.store(last);                    // Card cleared or swapped while off
+  }
+
+  // Chunk buffer lives in PSRAM when available to spare internal heap
+  chunkBuffer = (uint8_t*)(psramFound() ? ps_malloc(UPLOADER_CHUNK_SIZE) : malloc(UPLOADER_CHUNK_SIZE));
+  if (!chunkBuffer) {
+    Serial.println("❌ Failed to allocate uploader buffer");
+    return false;
+  }
+
+  // Low priority on core 0 next to the web server - capture on core 1 is never delayed
+  xTaskCreatePinnedToCore(uploaderTask, "PhotoUploader", UPLOADER_TASK_STACK, this, 1, &taskHandle, 0);
+  if (taskHandle == NULL) {
+    Serial.println("❌ Failed to create uploader task");
+    return false;
+  }
+
+  if (config.enabled) {
+    Serial.printf("✓ Uploading to http://%s:%d%s (batch %d, cursor %lu)\n",
+                  config.host, config.port, config.path,
+                  config.batchSize, (unsigned long)cursor.load());
+  } else {
+    Serial.println("ℹ Uploader idle - no collector configured (see /uploader)");
+  }
+  return true;
+}
+
+void PhotoUploader::notifyCommitted(uint32_t photoNumber) {
+  // Photo numbering restarted (e.g. after a format) - rewind so new photos are not skipped.
+  // The uploader task owns the cursor, so it applies the rewind itself.
+  if (photoNumber <= cursor.load()) {
+    rewindTo.store(photoNumber - 1);
+  }
+  latestCommitted.store(photoNumber);
+  if (taskHandle) {
+    xTaskNotifyGive(taskHandle);
+  }
+}
+
+bool PhotoUploader::setCollectorUrl(const String& url) {
+  // Accepts http://host[:port][/path]
+  if (!url.startsWith("http://")) {
+    return false;
+  }
+  String rest = url.substring(7);
+  int slash = rest.indexOf('/');
+  String hostPort = slash >= 0 ? rest.substring(0, slash) : rest;
+  String path = slash >= 0 ? rest.substring(slash) : String("/");
+
+  int colon = hostPort.indexOf(':');
+  String host = colon >= 0 ? hostPort.substring(0, colon) : hostPort;
+  long port = colon >= 0 ? hostPort.substring(colon + 1).toInt() : 80;
+  if (host.length() == 0 || host.length() >= UPLOADER_HOST_LEN || path.length() >= UPLOADER_PATH_LEN ||
+      port <= 0 || port > 65535) {
+    return false;
+  }
+
+  portENTER_CRITICAL(&configLock);
+  strcpy(config.host, host.c_str());
+  config.port = (uint16_t)port;
+  strcpy(config.path, path.c_str());
+  config.enabled = true;
+  UploaderConfig saved = config;
+  portEXIT_CRITICAL(&configLock);
+  saveConfig(saved);
+  Serial.printf("📤 Collector set to http://%s:%d%s\n", saved.host, saved.port, saved.path);
+
+  if (taskHandle) {
+    xTaskNotifyGive(taskHandle);
+  }
+  return true;
+}
+
+void PhotoUploader::setBatchSize(long batchSize) {
+  portENTER_CRITICAL(&configLock);
+  config.batchSize = (uint8_t)constrain(batchSize, 1L, (long)UPLOADER_MAX_BATCH);
+  UploaderConfig saved = config;
+  portEXIT_CRITICAL(&configLock);
+  saveConfig(saved);
+}
+
+void PhotoUploader::setEnabled(bool enabled) {
+  portENTER_CRITICAL(&configLock);
+  config.enabled = enabled && config.host[0] != '\0';
+  UploaderConfig saved = config;
+  portEXIT_CRITICAL(&configLock);
+  saveConfig(saved);
+}
+
+UploaderConfig PhotoUploader::getConfig() const {
+  portENTER_CRITICAL(&configLock);
+  UploaderConfig copy = config;
+  portEXIT_CRITICAL(&configLock);
+  return copy;
+}
+
+void PhotoUploader::setPaused(bool pause) {
+  paused.store(pause);
+  if (!pause && taskHandle) {
+    xTaskNotifyGive(taskHandle);
+  }
+}
+
+uint32_t PhotoUploader::getBacklog() const {
+  uint32_t latest = latestCommitted.load();
+  uint32_t done = cursor.load();
+  return latest > done ? latest - done : 0;
+}
+
+UploaderStats PhotoUploader::getStats() const {
+  return stats;
+}
+
+void PhotoUploader::uploaderTask(void* parameter) {
+  ((PhotoUploader*)parameter)->run();
+}
+
+void PhotoUploader::run() {
+  while (true) {
+    // Sleep until a photo is committed, the config changes, or a periodic re-check
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5000));
+    applyRewind();
+
+    while (!paused.load() && getBacklog() > 0 && networkAvailable()) {
+      // A collector change applies from the next batch
+      UploaderConfig target = getConfig();
+      if (!target.enabled) {
+        break;
+      }
+      if (uploadBatch(target)) {
+        consecutiveFailures = 0;
+        stats.retryDelayMs = 0;
+        continue;
+      }
+
+      // Collector unreachable - back off exponentially; the outbox keeps growing safely on SD
+      if (consecutiveFailures < 16) {
+        consecutiveFailures++;
+      }
+      stats.retryDelayMs = min((uint32_t)UPLOADER_RETRY_MAX_MS, (uint32_t)1000 << min((int)consecutiveFailures, 6));
+      vTaskDelay(pdMS_TO_TICKS(stats.retryDelayMs));
+    }
+  }
+}
+
+void PhotoUploader::applyRewind() {
+  uint32_t target = rewindTo.exchange(UPLOADER_NO_REWIND);
+  if (target != UPLOADER_NO_REWIND && target < cursor.load()) {
+    cursor.store(target);
+    saveCursor();
+  }
+}
+
+bool PhotoUploader::networkAvailable() const {
+  // Collector may sit on the station network or on a laptop joined to our AP
+  return WiFi.status() == WL_CONNECTED || WiFi.softAPgetStationNum() > 0;
+}
+
+bool PhotoUploader::uploadBatch(const UploaderConfig& target) {
+  WiFiClient client;
+  if (!client.connect(target.host, target.port)) {
+    Serial.printf("⚠️ Uploader: cannot reach collector %s:%d\n", target.host, target.port);
+    stats.failedPosts++;
+    return false;
+  }
+  client.setNoDelay(true);
+  stats.connections++;
+
+  unsigned long batchStart = millis();
+  uint64_t bytesBefore = stats.bytesUploaded;
+  uint32_t startCursor = cursor.load();
+  bool ok = true;
+
+  for (uint8_t i = 0; i < target.batchSize && getBacklog() > 0; i++) {
+    applyRewind();
+    uint32_t photoNumber = cursor.load() + 1;
+    bool keepAlive = true;
+    bool missing = false;
+
+    if (!postPhoto(client, target, photoNumber, keepAlive, missing)) {
+      if (missing) {
+        // Deleted before upload (e.g. /clear-photos) - nothing to send, move on
+        stats.skippedMissing++;
+        cursor.store(photoNumber);
+        continue;
+      }
+      stats.failedPosts++;
+      ok = false;
+      break;
+    }
+
+    cursor.store(photoNumber);
+    stats.photosUploaded++;
+    eventBroadcaster.publish(EVENT_JOB, "{\"job\":\"upload\",\"done\":%lu,\"total\":%lu}",
+                             (unsigned long)photoNumber, (unsigned long)latestCommitted.load());
+
+    if (!keepAlive) {
+      break;  // Collector closed the connection; the next batch reconnects
+    }
+  }
+  client.stop();
+
+  // Persist progress once per batch; at worst a batch is re-sent after a reboot
+  if (cursor.load() != startCursor) {
+    saveCursor();
+    stats.batches++;
+    stats.lastBatchMs = millis() - batchStart;
+    stats.lastBatchBytes = (uint32_t)(stats.bytesUploaded - bytesBefore);
+  }
+  return ok;
+}
+
+bool PhotoUploader::postPhoto(WiFiClient& client, const UploaderConfig& target, uint32_t photoNumber,
+                              bool& keepAlive, bool& missing) {
+  char filename[50];
+  snprintf(filename, sizeof(filename), "/photos/photo_%06lu.jpg", (unsigned long)photoNumber);
+
+  if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(UPLOADER_SD_LOCK_MS), "sdMutex") != pdTRUE) {
+    return false;
+  }
+  File file = SD_MMC.open(filename, FILE_READ);
+  size_t fileSize = file ? file.size() : 0;
+  xSemaphoreGive(sdMutex);
+
+  if (!file) {
+    missing = true;
+    return false;
+  }
+
+  char header[256];
+  int headerLen = snprintf(header, sizeof(header),
+                           "POST %s HTTP/1.1\r\n"
+                           "Host: %s:%d\r\n"
+                           "Content-Type: image/jpeg\r\n"
+                           "Transfer-Encoding: chunked\r\n"
+                           "Connection: keep-alive\r\n"
+                           "X-Photo-Number: %lu\r\n"
+                           "X-Photo-Name: %s\r\n"
+                           "\r\n",
+                           target.path, target.host, target.port,
+                           (unsigned long)photoNumber, filename + 8);
+  bool ok = writeAll(client, (const uint8_t*)header, headerLen);
+
+  size_t sent = 0;
+  while (ok && sent < fileSize) {
+    // Hold the SD mutex for one chunk at a time so capture can always get in
+    if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(UPLOADER_SD_LOCK_MS), "sdMutex") != pdTRUE) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    size_t readLen = file.read(chunkBuffer, UPLOADER_CHUNK_SIZE);
+    xSemaphoreGive(sdMutex);
+
+    if (readLen == 0) {
+      ok = false;
+      break;
+    }
+
+    char chunkHeader[12];
+    int chunkHeaderLen = snprintf(chunkHeader, sizeof(chunkHeader), "%X\r\n", (unsigned)readLen);
+    ok = writeAll(client, (const uint8_t*)chunkHeader, chunkHeaderLen) &&
+         writeAll(client, chunkBuffer, readLen) &&
+         writeAll(client, (const uint8_t*)"\r\n", 2);
+    sent += readLen;
+  }
+
+  if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(UPLOADER_TIMEOUT_MS), "sdMutex") == pdTRUE) {
+    file.close();
+    xSemaphoreGive(sdMutex);
+  }
+
+  if (!ok || !writeAll(client, (const uint8_t*)"0\r\n\r\n", 5)) {
+    return false;
+  }
+  stats.bytesUploaded += sent;
+  return readResponse(client, keepAlive);
+}
+
+bool PhotoUploader::readResponse(WiFiClient& client, bool& keepAlive) {
+  String line;
+  if (!readLine(client, line) || !line.startsWith("HTTP/1.")) {
+    return false;
+  }
+  int status = line.substring(9, 12).toInt();
+  keepAlive = !line.startsWith("HTTP/1.0");
+
+  // Headers - only Connection and Content-Length matter to us
+  long contentLength = 0;
+  while (readLine(client, line) && line.length() > 0) {
+    line.toLowerCase();
+    if (line.startsWith("content-length:")) {
+      contentLength = line.substring(15).toInt();
+    } else if (line.startsWith("connection:")) {
+      keepAlive = line.indexOf("close") < 0;
+    }
+  }
+
+  // Drain the body so the next request on this connection starts clean
+  unsigned long start = millis();
+  while (contentLength > 0 && millis() - start < UPLOADER_TIMEOUT_MS) {
+    if (client.available()) {
+      client.read();
+      contentLength--;
+    } else if (!client.connected()) {
+      break;
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(1));
+    }
+  }
+
+  if (status < 200 || status >= 300) {
+    Serial.printf("⚠️ Uploader: collector answered %d\n", status);
+    return false;
+  }
+  return true;
+}
+
+bool PhotoUploader::readLine(WiFiClient& client, String& line) {
+  line = "";
+  unsigned long start = millis();
+  while (millis() - start < UPLOADER_TIMEOUT_MS) {
+    if (!client.available()) {
+      if (!client.connected()) {
+        return false;
+      }
+      vTaskDelay(pdMS_TO_TICKS(1));
+      continue;
+    }
+    char c = client.read();
+    if (c == '\n') {
+      line.trim();
+      return true;
+    }
+    if (line.length() < 256) {
+      line += c;
+    }
+  }
+  return false;
+}
+
+bool PhotoUploader::writeAll(WiFiClient& client, const uint8_t* data, size_t len) {
+  unsigned long start = millis();
+  while (len > 0) {
+    size_t written = client.write(data, len);
+    if (written == 0) {
+      if (!client.connected() || millis() - start > UPLOADER_TIMEOUT_MS) {
+        return false;
+      }
+      vTaskDelay(pdMS_TO_TICKS(1));
+      continue;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+bool PhotoUploader::loadCursor() {
+  if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(UPLOADER_TIMEOUT_MS), "sdMutex") != pdTRUE) {
+    return false;
+  }
+  File file = SD_MMC.open(UPLOADER_CURSOR_FILE, FILE_READ);
+  bool found = file;
+  if (found) {
+    cursor.store((uint32_t)file.readString().toInt());
+    file.close();
+  }
+  xSemaphoreGive(sdMutex);
+  return found;
+}
+
+bool PhotoUploader::saveCursor() {
+  if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(UPLOADER_TIMEOUT_MS), "sdMutex") != pdTRUE) {
+    return false;
+  }
+  File file = SD_MMC.open(UPLOADER_CURSOR_FILE, FILE_WRITE);
+  bool saved = file;
+  if (saved) {
+    file.print((unsigned long)cursor.load());
+    file.close();
+  }
+  xSemaphoreGive(sdMutex);
+  return saved;
+}
+
+// Before the task starts, so no lock is needed
+void PhotoUploader::loadConfig() {
+  config.enabled = preferences.getBool("enabled", false);
+  if (preferences.getString("host", config.host, sizeof(config.host)) == 0) {
+    config.host[0] = '\0';
+  }
+  config.port = preferences.getUShort("port", 80);
+  if (preferences.getString("path", config.path, sizeof(config.path)) == 0) {
+    strcpy(config.path, "/");
+  }
+  config.batchSize = preferences.getUChar("batch", UPLOADER_DEFAULT_BATCH);
+  if (config.host[0] == '\0') {
+    config.enabled = false;
+  }
+}
+
+void PhotoUploader::saveConfig(const UploaderConfig& saved) {
+  preferences.putBool("enabled", saved.enabled);
+  preferences.putString("host", saved.host);
+  preferences.putUShort("port", saved.port);
+  preferences.putString("path", saved.path);
+  preferences.putUChar("batch", saved.batchSize);
+}
+
+void PhotoUploader::writeStatusJson(Print& out) const {
+  float throughputKBps = stats.lastBatchMs > 0 ? stats.lastBatchBytes / (float)stats.lastBatchMs : 0;
+
+  UploaderConfig current = getConfig();
+  printfTo(out, "{\"enabled\":%s,\"paused\":%s", current.enabled ? "true" : "false",
+           paused.load() ? "true" : "false");
+  printfTo(out, ",\"collector\":\"http://%s:%u", current.host, (unsigned)current.port);
+  out.print(current.path);
+  printfTo(out, "\",\"batch_size\":%u", (unsigned)current.batchSize);
+  printfTo(out, ",\"cursor\":%lu,\"latest_committed\":%lu,\"backlog\":%lu", (unsigned long)cursor.load(),
+           (unsigned long)latestCommitted.load(), (unsigned long)getBacklog());
+  printfTo(out, ",\"photos_uploaded\":%lu,\"bytes_uploaded\":%llu,\"batches\":%lu,\"connections\":%lu",
+           (unsigned long)stats.photosUploaded, (unsigned long long)stats.bytesUploaded,
+           (unsigned long)stats.batches, (unsigned long)stats.connections);
+  printfTo(out, ",\"failed_posts\":%lu,\"skipped_missing\":%lu,\"last_batch_ms\":%lu", (unsigned long)stats.failedPosts,
+           (unsigned long)stats.skippedMissing, (unsigned long)stats.lastBatchMs);
+  printfTo(out, ",\"throughput_kbytes_per_s\":%.1f,\"retry_delay_ms\":%lu}", throughputKBps,
+           (unsigned long)stats.retryDelayMs);
+}
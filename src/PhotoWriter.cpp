@@ -0,0 +1,207 @@
+#include "PhotoWriter.h"
+#include "TraceRecorder.h"
+#include "esp_heap_caps.h"
+#include "soc/soc_memory_layout.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+PhotoWriter photoWriter;
+
+PhotoWriter::PhotoWriter() : staging(nullptr), stagingSize(0), directBytes(0) {
+  vfsPath[0] = '\0';
+}
+
+bool PhotoWriter::begin(size_t stagingBytes) {
+  if (staging) {
+    return true;
+  }
+  staging = (uint8_t*)heap_caps_malloc(stagingBytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!staging) {
+    Serial.println("❌ Photo writer: staging buffer allocation failed");
+    return false;
+  }
+  stagingSize = stagingBytes;
+  Serial.printf("✅ Photo writer: %u byte DMA staging buffer\n", (unsigned)stagingSize);
+  return true;
+}
+
+void PhotoWriter::formatPhotoPath(char* out, size_t size, unsigned long number) {
+  snprintf(out, size, "/photos/photo_%06lu.jpg", number);
+}
+
+// Card paths of a photo and its replacement files
+static void formatReplacePath(char* out, size_t size, uint32_t number, const char* extension) {
+  snprintf(out, size, PHOTO_MOUNT_POINT "/photos/photo_%06lu.%s", (unsigned long)number, extension);
+}
+
+bool PhotoWriter::replacePhoto(uint32_t number, const uint8_t* data, size_t len, uint32_t expectedSize) {
+  PhotoWritePart part = {data, len};
+  return replacePhoto(number, &part, 1, expectedSize);
+}
+
+bool PhotoWriter::replacePhoto(uint32_t number, const PhotoWritePart* parts, size_t count, uint32_t expectedSize) {
+  char photoPath[PHOTO_PATH_LEN + 16];
+  char tmpPath[PHOTO_PATH_LEN + 16];
+  char bakPath[PHOTO_PATH_LEN + 16];
+  formatReplacePath(photoPath, sizeof(photoPath), number, "jpg");
+  formatReplacePath(tmpPath, sizeof(tmpPath), number, "tmp");
+  formatReplacePath(bakPath, sizeof(bakPath), number, "bak");
+
+  struct stat current;
+  if (stat(photoPath, &current) != 0 || (uint32_t)current.st_size != expectedSize) {
+    return false;
+  }
+  char tmpRelative[PHOTO_PATH_LEN];
+  snprintf(tmpRelative, sizeof(tmpRelative), "/photos/photo_%06lu.tmp", (unsigned long)number);
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += parts[i].len;
+  }
+  if (writeParts(tmpRelative, parts, count) != (int)len) {
+    ::unlink(tmpPath);
+    return false;
+  }
+  struct utimbuf times = {current.st_mtime, current.st_mtime};
+  utime(tmpPath, &times);
+
+  // FATFS rename will not overwrite, so the old file steps aside first
+  ::unlink(bakPath);
+  if (::rename(photoPath, bakPath) != 0) {
+    ::unlink(tmpPath);
+    return false;
+  }
+  if (::rename(tmpPath, photoPath) != 0) {
+    ::rename(bakPath, photoPath);
+    ::unlink(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+bool PhotoWriter::removeBackup(uint32_t number) {
+  char bakPath[PHOTO_PATH_LEN + 16];
+  formatReplacePath(bakPath, sizeof(bakPath), number, "bak");
+  return ::unlink(bakPath) == 0;
+}
+
+void PhotoWriter::recoverReplace(uint32_t number) {
+  char photoPath[PHOTO_PATH_LEN + 16];
+  char tmpPath[PHOTO_PATH_LEN + 16];
+  char bakPath[PHOTO_PATH_LEN + 16];
+  formatReplacePath(photoPath, sizeof(photoPath), number, "jpg");
+  formatReplacePath(tmpPath, sizeof(tmpPath), number, "tmp");
+  formatReplacePath(bakPath, sizeof(bakPath), number, "bak");
+
+  // A .tmp never replaced anything yet; a lone .bak is the only copy left
+  ::unlink(tmpPath);
+  struct stat info;
+  if (stat(bakPath, &info) == 0) {
+    if (stat(photoPath, &info) == 0) {
+      ::unlink(bakPath);
+    } else {
+      ::rename(bakPath, photoPath);
+      Serial.printf("🩹 Restored photo #%lu from its backup\n", (unsigned long)number);
+    }
+  }
+}
+
+int PhotoWriter::write(const char* path, const uint8_t* data, size_t len) {
+  PhotoWritePart part = {data, len};
+  return writeParts(path, &part, 1);
+}
+
+// FATFS hands whole sectors to the SDMMC driver straight from the caller's
+// buffer, and the driver can DMA from it only when it is internal RAM and
+// word-aligned (otherwise it allocates a bounce buffer per sector)
+#define PHOTO_SECTOR 512
+
+bool PhotoWriter::flushStaging(int fd, size_t& staged, size_t& written) {
+  if (staged == 0) {
+    return true;
+  }
+  ssize_t result = ::write(fd, staging, staged);
+  written += result > 0 ? result : 0;
+  bool ok = result == (ssize_t)staged;
+  staged = 0;
+  return ok;
+}
+
+bool PhotoWriter::stage(int fd, const uint8_t* source, size_t len, size_t& staged, size_t& written) {
+  while (len > 0) {
+    // Whole staging buffers keep FATFS on its multi-sector direct path
+    size_t chunk = stagingSize - staged;
+    if (chunk > len) {
+      chunk = len;
+    }
+    memcpy(staging + staged, source, chunk);
+    staged += chunk;
+    source += chunk;
+    len -= chunk;
+    if (staged == stagingSize && !flushStaging(fd, staged, written)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int PhotoWriter::writeParts(const char* path, const PhotoWritePart* parts, size_t count) {
+  snprintf(vfsPath, sizeof(vfsPath), PHOTO_MOUNT_POINT "%s", path);
+
+  uint32_t openStart = TraceRecorder::now();
+  int fd = ::open(vfsPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  traceRecorder.record("vfs.open", "sd", openStart);
+  if (fd < 0) {
+    return -1;
+  }
+
+  // Every ::write below starts on a sector boundary of the file, so the sectors
+  // FATFS passes through come from an aligned address in the source buffer
+  uint32_t writeStart = TraceRecorder::now();
+  size_t written = 0;
+  size_t staged = 0;
+  bool ok = true;
+  for (size_t i = 0; i < count && ok; i++) {
+    const uint8_t* source = parts[i].data;
+    size_t len = parts[i].len;
+    if (!staging) {
+      ssize_t result = len > 0 ? ::write(fd, source, len) : 0;
+      written += result > 0 ? result : 0;
+      ok = result == (ssize_t)len;
+      continue;
+    }
+
+    // A DMA-capable part goes to the card in place once the staged bytes before
+    // it have filled up to a sector boundary; PSRAM parts and short or
+    // misaligned pieces are staged
+    size_t head = (PHOTO_SECTOR - (written + staged) % PHOTO_SECTOR) % PHOTO_SECTOR;
+    size_t direct = 0;
+    if (head < len && esp_ptr_dma_capable(source + head) && ((uintptr_t)(source + head) & 3) == 0) {
+      direct = (len - head) / PHOTO_SECTOR * PHOTO_SECTOR;
+    }
+    if (direct == 0) {
+      ok = stage(fd, source, len, staged, written);
+      continue;
+    }
+    ok = stage(fd, source, head, staged, written) && flushStaging(fd, staged, written);
+    if (ok) {
+      ssize_t result = ::write(fd, source + head, direct);
+      written += result > 0 ? result : 0;
+      ok = result == (ssize_t)direct;
+    }
+    if (ok) {
+      directBytes += direct;
+      ok = stage(fd, source + head + direct, len - head - direct, staged, written);
+    }
+  }
+  if (ok) {
+    flushStaging(fd, staged, written);
+  }
+  traceRecorder.record("vfs.write", "sd", writeStart, written);
+
+  uint32_t closeStart = TraceRecorder::now();
+  ::close(fd);
+  traceRecorder.record("vfs.close", "sd", closeStart);
+  return (int)written;
+}
@@ -0,0 +1,225 @@
+#include "RequestArena.h"
+#include "esp_heap_caps.h"
+#include <stdarg.h>
+
+RequestArenaPool requestArenas;
+
+RequestArena::RequestArena()
+  : base(nullptr), capacity(0), textLength(0), scratchTop(0), overflowed(false), owner(nullptr) {
+}
+
+void RequestArena::reset() {
+  textLength = 0;
+  scratchTop = capacity;
+  overflowed = false;
+  if (base) {
+    base[0] = '\0';
+  }
+}
+
+size_t RequestArena::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t RequestArena::write(const uint8_t* data, size_t len) {
+  // Keep one byte for the terminator so text() is always a C string
+  if (overflowed || textLength + len + 1 > scratchTop) {
+    overflowed = true;
+    return 0;
+  }
+  memcpy(base + textLength, data, len);
+  textLength += len;
+  base[textLength] = '\0';
+  return len;
+}
+
+size_t RequestArena::appendf(const char* format, ...) {
+  if (overflowed) {
+    return 0;
+  }
+  size_t room = scratchTop - textLength;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf((char*)base + textLength, room, format, args);
+  va_end(args);
+
+  if (written < 0 || (size_t)written >= room) {
+    overflowed = true;
+    base[textLength] = '\0';
+    return 0;
+  }
+  textLength += written;
+  return written;
+}
+
+void* RequestArena::alloc(size_t size) {
+  size = (size + 3) & ~(size_t)3;
+  if (size + textLength + 1 > scratchTop) {
+    overflowed = true;
+    return nullptr;
+  }
+  scratchTop -= size;
+  return base + scratchTop;
+}
+
+const char* RequestArena::formatf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int needed = vsnprintf(nullptr, 0, format, args);
+  va_end(args);
+  if (needed < 0) {
+    return "";
+  }
+
+  char* out = (char*)alloc(needed + 1);
+  if (!out) {
+    return "";
+  }
+  va_start(args, format);
+  vsnprintf(out, needed + 1, format, args);
+  va_end(args);
+  return out;
+}
+
+RequestArenaPool::RequestArenaPool() : memory(nullptr) {
+  lock = portMUX_INITIALIZER_UNLOCKED;
+  memset(&stats, 0, sizeof(stats));
+}
+
+bool RequestArenaPool::begin() {
+  if (memory) {
+    return true;
+  }
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  memory = (uint8_t*)heap_caps_malloc(REQUEST_ARENA_SLOTS * REQUEST_ARENA_SIZE, caps);
+  if (!memory) {
+    Serial.println("❌ Request arenas: allocation failed");
+    return false;
+  }
+  for (uint8_t i = 0; i < REQUEST_ARENA_SLOTS; i++) {
+    arenas[i].base = memory + i * REQUEST_ARENA_SIZE;
+    arenas[i].capacity = REQUEST_ARENA_SIZE;
+    arenas[i].reset();
+  }
+  Serial.printf("✅ Request arenas: %d x %d bytes in %s\n", REQUEST_ARENA_SLOTS, REQUEST_ARENA_SIZE,
+                psramFound() ? "PSRAM" : "internal RAM");
+  return true;
+}
+
+RequestArena* RequestArenaPool::acquire(AsyncWebServerRequest* request) {
+  RequestArena* arena = nullptr;
+  portENTER_CRITICAL(&lock);
+  if (memory) {
+    for (uint8_t i = 0; i < REQUEST_ARENA_SLOTS; i++) {
+      if (!arenas[i].owner) {
+        arena = &arenas[i];
+        arena->owner = request;
+        stats.acquired++;
+        stats.inUse++;
+        break;
+      }
+    }
+  }
+  if (!arena) {
+    stats.exhausted++;
+  }
+  portEXIT_CRITICAL(&lock);
+  return arena;
+}
+
+void RequestArenaPool::releaseFor(AsyncWebServerRequest* request) {
+  portENTER_CRITICAL(&lock);
+  for (uint8_t i = 0; i < REQUEST_ARENA_SLOTS; i++) {
+    RequestArena& arena = arenas[i];
+    if (arena.owner == request) {
+      if (arena.used() > stats.peakBytes) {
+        stats.peakBytes = arena.used();
+      }
+      if (arena.overflowed) {
+        stats.overflowed++;
+      }
+      arena.reset();
+      arena.owner = nullptr;
+      stats.inUse--;
+    }
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+void RequestArenaPool::send(AsyncWebServerRequest* request, RequestArena* arena, int code, const char* contentType) {
+  if (arena->hasOverflowed()) {
+    Serial.printf("⚠️ Request arena overflow on %s (%u bytes)\n", request->url().c_str(), (unsigned)arena->used());
+    request->send(500, "text/plain", "Response too large");
+    return;
+  }
+  // The _P variant streams straight from our buffer instead of copying into a String
+  request->send(request->beginResponse_P(code, contentType, (const uint8_t*)arena->text(), arena->length()));
+}
+
+void RequestArenaPool::sendBusy(AsyncWebServerRequest* request) {
+  AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Busy - try again");
+  response->addHeader("Retry-After", "2");
+  request->send(response);
+}
+
+RequestArenaStats RequestArenaPool::getStats() {
+  portENTER_CRITICAL(&lock);
+  RequestArenaStats copy = stats;
+  portEXIT_CRITICAL(&lock);
+  return copy;
+}
+
+void RequestArenaPool::writeStatusJson(Print& out) {
+  RequestArenaStats s = getStats();
+  printfTo(out, "{\"slots\":%d,\"slot_bytes\":%d,\"in_use\":%u,\"acquired\":%lu", REQUEST_ARENA_SLOTS,
+           REQUEST_ARENA_SIZE, (unsigned)s.inUse, (unsigned long)s.acquired);
+  printfTo(out, ",\"exhausted\":%lu,\"overflowed\":%lu,\"peak_bytes\":%lu}", (unsigned long)s.exhausted,
+           (unsigned long)s.overflowed, (unsigned long)s.peakBytes);
+}
+
+size_t printfTo(Print& out, const char* format, ...) {
+  char buffer[REQUEST_PRINTF_STACK];
+  va_list args;
+  va_start(args, format);
+  int needed = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (needed < 0) {
+    return 0;
+  }
+  if ((size_t)needed < sizeof(buffer)) {
+    return out.write((const uint8_t*)buffer, needed);
+  }
+
+  // Longer than the stack buffer: rare enough to take the heap
+  char* text = (char*)malloc(needed + 1);
+  if (!text) {
+    return 0;
+  }
+  va_start(args, format);
+  vsnprintf(text, needed + 1, format, args);
+  va_end(args);
+  size_t written = out.write((const uint8_t*)text, needed);
+  free(text);
+  return written;
+}
+
+void printJsonString(Print& out, const char* text) {
+  out.write('"');
+  const char* run = text;
+  for (const char* p = text; *p; p++) {
+    uint8_t c = (uint8_t)*p;
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    out.write((const uint8_t*)run, p - run);
+    if (c == '"' || c == '\\') {
+      out.write('\\');
+      out.write(c);
+    } else {
+      printfTo(out, "\\u%04x", (unsigned)c);
+    }
+    run = p + 1;
+  }
+  out.print(run);
+  out.write('"');
+}
@@ -0,0 +1,255 @@
+#include "RequestProfiler.h"
+#include "esp_timer.h"
+#include "TraceRecorder.h"
+#include "RequestArena.h"
+#include "HeapProfiler.h"
+
+RequestProfiler requestProfiler;
+
+// Latency buckets in milliseconds (gallery waits up to 2 s on the SD mutex, format-sd up to 15 s)
+static const uint32_t ROUTE_LATENCY_BUCKETS_MS[] = { 1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 15000 };
+static const uint8_t ROUTE_LATENCY_BUCKET_COUNT = sizeof(ROUTE_LATENCY_BUCKETS_MS) / sizeof(ROUTE_LATENCY_BUCKETS_MS[0]);
+
+// Parameter names whose values never leave the device (Wi-Fi credentials, upload tokens)
+static const char* const SENSITIVE_PARAMS[] = { "pass", "psk", "token", "secret", "auth" };
+
+static bool isSensitiveParam(const String& name) {
+  String lower = name;
+  lower.toLowerCase();
+  for (const char* sensitive : SENSITIVE_PARAMS) {
+    if (lower.indexOf(sensitive) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+RequestProfiler::RequestProfiler()
+  : routeCount(0), slowHead(0), slowCount(0),
+    slowThresholdMs(PROFILER_DEFAULT_SLOW_MS), slowTotal(0), inFlightTotal(0) {
+  lock = portMUX_INITIALIZER_UNLOCKED;
+  memset(slowLog, 0, sizeof(slowLog));
+  for (auto& timing : routes) {
+    timing.route = nullptr;
+    timing.ttfb.setBounds(ROUTE_LATENCY_BUCKETS_MS, ROUTE_LATENCY_BUCKET_COUNT);
+    timing.total.setBounds(ROUTE_LATENCY_BUCKETS_MS, ROUTE_LATENCY_BUCKET_COUNT);
+    timing.inFlight.store(0);
+    timing.maxTotalMs.store(0);
+  }
+}
+
+RouteTiming* RequestProfiler::registerRoute(const char* route) {
+  RouteTiming* timing = nullptr;
+  portENTER_CRITICAL(&lock);
+  for (uint8_t i = 0; i < routeCount; i++) {
+    if (strcmp(routes[i].route, route) == 0) {
+      timing = &routes[i];   // Same path registered by another server instance
+      break;
+    }
+  }
+  if (!timing && routeCount < PROFILER_MAX_ROUTES) {
+    timing = &routes[routeCount];
+    timing->route = route;
+    routeCount++;
+  }
+  portEXIT_CRITICAL(&lock);
+  return timing;
+}
+
+ArRequestHandlerFunction RequestProfiler::wrap(const char* route, ArRequestHandlerFunction handler) {
+  RouteTiming* timing = registerRoute(route);
+  if (!timing) {
+    Serial.printf("⚠️ Request profiler full - %s is not timed\n", route);
+    return [handler](AsyncWebServerRequest *request) {
+      handler(request);
+      request->onDisconnect([request]() { requestArenas.releaseFor(request); });
+    };
+  }
+
+  return [this, timing, handler](AsyncWebServerRequest *request) {
+    uint32_t startUs = (uint32_t)esp_timer_get_time();
+    timing->inFlight.fetch_add(1, std::memory_order_relaxed);
+    inFlightTotal.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t spanStart = TraceRecorder::now();
+    {
+      HEAP_PROFILE_SCOPE(timing->route);   // Tags the handler's allocations (heapprof builds)
+      handler(request);
+    }
+    traceRecorder.record(timing->route, "http", spanStart);
+
+    // Handlers send synchronously, so the response headers are queued by the time we return
+    uint32_t ttfbUs = (uint32_t)esp_timer_get_time() - startUs;
+
+    // The request object is destroyed once the response has been fully sent,
+    // which is also when any arena the handler built its response in is free again
+    request->onDisconnect([this, timing, request, startUs, ttfbUs]() {
+      finish(timing, request, startUs, ttfbUs);
+      requestArenas.releaseFor(request);
+    });
+  };
+}
+
+void RequestProfiler::finish(RouteTiming* timing, AsyncWebServerRequest* request,
+                             uint32_t startUs, uint32_t ttfbUs) {
+  uint32_t ttfbMs = ttfbUs / 1000;
+  uint32_t totalMs = ((uint32_t)esp_timer_get_time() - startUs) / 1000;
+
+  timing->inFlight.fetch_sub(1, std::memory_order_relaxed);
+  inFlightTotal.fetch_sub(1, std::memory_order_relaxed);
+  timing->requests.inc();
+  timing->ttfb.observe(ttfbMs);
+  timing->total.observe(totalMs);
+
+  uint32_t previousMax = timing->maxTotalMs.load(std::memory_order_relaxed);
+  while (totalMs > previousMax &&
+         !timing->maxTotalMs.compare_exchange_weak(previousMax, totalMs, std::memory_order_relaxed)) {
+  }
+
+  if (totalMs >= slowThresholdMs) {
+    recordSlow(timing, request, ttfbMs, totalMs);
+  }
+}
+
+void RequestProfiler::recordSlow(RouteTiming* timing, AsyncWebServerRequest* request,
+                                 uint32_t ttfbMs, uint32_t totalMs) {
+  SlowRequest entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.route = timing->route;
+  entry.ttfbMs = ttfbMs;
+  entry.totalMs = totalMs;
+  entry.finishedAt = millis();
+  entry.freeHeap = ESP.getFreeHeap();
+  strncpy(entry.method, request->methodToString(), sizeof(entry.method) - 1);
+
+  // Query/form parameters as a=1&b=2, truncated to the fixed slot size. The log
+  // is printed and served over HTTP, so credentials are masked.
+  size_t used = 0;
+  int count = request->params();
+  for (int i = 0; i < count && used < sizeof(entry.params) - 1; i++) {
+    AsyncWebParameter* param = request->getParam(i);
+    int written = snprintf(entry.params + used, sizeof(entry.params) - used, "%s%s=%s",
+                           i > 0 ? "&" : "", param->name().c_str(),
+                           isSensitiveParam(param->name()) ? "***" : param->value().c_str());
+    if (written < 0) {
+      break;
+    }
+    used += written;
+  }
+  if (used >= sizeof(entry.params)) {
+    entry.params[sizeof(entry.params) - 1] = '\0';
+  }
+
+  portENTER_CRITICAL(&lock);
+  slowLog[slowHead] = entry;
+  slowHead = (slowHead + 1) % PROFILER_SLOW_LOG_SIZE;
+  if (slowCount < PROFILER_SLOW_LOG_SIZE) {
+    slowCount++;
+  }
+  slowTotal++;
+  portEXIT_CRITICAL(&lock);
+
+  Serial.printf("🐢 Slow request: %s %s took %lu ms (first byte %lu ms)\n",
+                entry.method, entry.route, (unsigned long)totalMs, (unsigned long)ttfbMs);
+}
+
+void RequestProfiler::setSlowThreshold(uint32_t thresholdMs) {
+  slowThresholdMs = thresholdMs;
+}
+
+uint32_t RequestProfiler::getSlowThreshold() const {
+  return slowThresholdMs;
+}
+
+void RequestProfiler::appendHistogramJson(String& json, const MetricHistogram& histogram) {
+  uint32_t counts[METRICS_MAX_BUCKETS + 1];
+  uint32_t total = 0;
+  uint8_t bucketCount = histogram.getBucketCount();
+  for (uint8_t b = 0; b <= bucketCount; b++) {
+    counts[b] = histogram.getBucket(b);
+    total += counts[b];
+  }
+
+  // Percentiles reported as the upper bound of the bucket they fall in
+  auto percentile = [&](uint32_t permille) -> long {
+    if (total == 0) {
+      return 0;
+    }
+    uint32_t rank = (total * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < bucketCount; b++) {
+      seen += counts[b];
+      if (seen >= rank) {
+        return (long)histogram.getBound(b);
+      }
+    }
+    return -1;   // Above the largest bound
+  };
+
+  json += "{\"count\":" + String(total);
+  json += ",\"sum_ms\":" + String((unsigned long)histogram.getSum());
+  json += ",\"p50_ms\":" + String(percentile(500));
+  json += ",\"p95_ms\":" + String(percentile(950));
+  json += ",\"p99_ms\":" + String(percentile(990));
+  json += ",\"buckets\":[";
+  for (uint8_t b = 0; b <= bucketCount; b++) {
+    if (b > 0) json += ",";
+    json += "{\"le\":";
+    json += b < bucketCount ? String(histogram.getBound(b)) : String("\"+Inf\"");
+    json += ",\"count\":" + String(counts[b]) + "}";
+  }
+  json += "]}";
+}
+
+String RequestProfiler::getRoutesJson() {
+  String json = "{\"routes\":[";
+  for (uint8_t i = 0; i < routeCount; i++) {
+    const RouteTiming& timing = routes[i];
+    if (i > 0) json += ",";
+    json += "{\"route\":\"" + String(timing.route) + "\"";
+    json += ",\"requests\":" + String((unsigned long)timing.requests.value());
+    json += ",\"in_flight\":" + String(timing.inFlight.load());
+    json += ",\"max_ms\":" + String(timing.maxTotalMs.load());
+    json += ",\"ttfb\":";
+    appendHistogramJson(json, timing.ttfb);
+    json += ",\"total\":";
+    appendHistogramJson(json, timing.total);
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
+
+String RequestProfiler::getSlowRequestsJson() {
+  SlowRequest snapshot[PROFILER_SLOW_LOG_SIZE];
+  uint8_t count, head;
+  uint32_t total;
+  portENTER_CRITICAL(&lock);
+  memcpy(snapshot, slowLog, sizeof(snapshot));
+  count = slowCount;
+  head = slowHead;
+  total = slowTotal;
+  portEXIT_CRITICAL(&lock);
+
+  String json = "{\"threshold_ms\":" + String(slowThresholdMs);
+  json += ",\"total_slow\":" + String(total);
+  json += ",\"now\":" + String(millis());
+  json += ",\"requests\":[";
+  // Newest first
+  for (uint8_t i = 0; i < count; i++) {
+    const SlowRequest& entry = snapshot[(head + PROFILER_SLOW_LOG_SIZE - 1 - i) % PROFILER_SLOW_LOG_SIZE];
+    if (i > 0) json += ",";
+    String params = String(entry.params);
+    params.replace("\\", "\\\\");
+    params.replace("\"", "\\\"");
+    json += "{\"route\":\"" + String(entry.route) + "\"";
+    json += ",\"method\":\"" + String(entry.method) + "\"";
+    json += ",\"params\":\"" + params + "\"";
+    json += ",\"ttfb_ms\":" + String(entry.ttfbMs);
+    json += ",\"total_ms\":" + String(entry.totalMs);
+    json += ",\"finished_at\":" + String(entry.finishedAt);
+    json += ",\"free_heap\":" + String(entry.freeHeap) + "}";
+  }
+  json += "]}";
+  return json;
+}
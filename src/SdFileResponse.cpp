@@ -0,0 +1,99 @@
+#include "SdFileResponse.h"
+#include "PhotoWriter.h"
+#include "TraceRecorder.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+SdFileResponse::SdFileResponse(const char* path, const char* contentType)
+  : AsyncAbstractResponse(), fd(-1), stream(nullptr), fileSize(0), start(0), remaining(0), started(false), filled(false) {
+  char vfsPath[PHOTO_PATH_LEN + 16];
+  snprintf(vfsPath, sizeof(vfsPath), PHOTO_MOUNT_POINT "%s", path);
+
+  uint32_t openStart = TraceRecorder::now();
+  fd = ::open(vfsPath, O_RDONLY);
+  traceRecorder.record("vfs.open", "sd", openStart);
+  struct stat info;
+  if (fd >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    fileSize = (uint32_t)info.st_size;
+  } else if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+
+  _code = 200;
+  _contentType = contentType;
+  _contentLength = fileSize;
+  remaining = fileSize;
+}
+
+SdFileResponse::~SdFileResponse() {
+  if (stream) {
+    sdReadAhead.close(stream);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+void SdFileResponse::setRange(uint32_t start, uint32_t length) {
+  if (fd < 0 || started) {
+    return;
+  }
+  this->start = start;
+  char contentRange[48];
+  snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu", (unsigned long)start,
+           (unsigned long)(start + length - 1), (unsigned long)fileSize);
+  addHeader("Content-Range", contentRange);
+  _code = 206;
+  _contentLength = length;
+  remaining = length;
+}
+
+void SdFileResponse::prefetch() {
+  if (started || fd < 0) {
+    return;
+  }
+  started = true;
+  stream = sdReadAhead.open(fd, start, start + remaining);
+  if (stream) {
+    fd = -1;
+  } else if (start > 0 && ::lseek(fd, start, SEEK_SET) != (off_t)start) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+size_t SdFileResponse::_fillBuffer(uint8_t* buf, size_t maxLen) {
+  if (remaining == 0) {
+    return 0;
+  }
+  if (maxLen > remaining) {
+    maxLen = remaining;
+  }
+  bool firstCall = !filled;
+  filled = true;
+  prefetch();
+  if (stream) {
+    size_t n = sdReadAhead.read(stream, buf, maxLen, firstCall);
+    if (n != RESPONSE_TRY_AGAIN) {
+      remaining -= n;
+    }
+    return n;
+  }
+  if (fd < 0) {
+    return 0;
+  }
+
+  uint32_t readStart = TraceRecorder::now();
+  ssize_t n = ::read(fd, buf, maxLen);
+  traceRecorder.record("vfs.read", "sd", readStart, n > 0 ? n : 0);
+  if (n <= 0) {
+    // Card gone or file truncated - close so the server drops the connection
+    ::close(fd);
+    fd = -1;
+    return 0;
+  }
+  remaining -= n;
+  return n;
+}
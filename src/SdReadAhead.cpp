@@ -0,0 +1,231 @@
+#include "SdReadAhead.h"
+#include "RequestArena.h"
+#include "TraceRecorder.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <ESPAsyncWebServer.h>
+#include <unistd.h>
+
+SdReadAhead sdReadAhead;
+
+SdReadAhead::SdReadAhead() : memory(nullptr), staging(nullptr), taskHandle(NULL) {
+  memset(&stats, 0, sizeof(stats));
+  for (uint8_t i = 0; i < READAHEAD_STREAMS; i++) {
+    streams[i].fd = -1;
+    streams[i].use.store(READAHEAD_STREAM_FREE);
+    streams[i].failed.store(false);
+    streams[i].buffers[0].data = nullptr;
+    streams[i].buffers[1].data = nullptr;
+  }
+}
+
+bool SdReadAhead::begin() {
+  if (memory) {
+    return true;
+  }
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  memory = (uint8_t*)heap_caps_malloc(READAHEAD_STREAMS * 2 * READAHEAD_CHUNK, caps);
+  staging = (uint8_t*)heap_caps_malloc(READAHEAD_STAGING, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+  if (!memory || !staging) {
+    Serial.println("❌ SD read-ahead: allocation failed - file responses read directly");
+    heap_caps_free(memory);
+    heap_caps_free(staging);
+    memory = nullptr;
+    staging = nullptr;
+    return false;
+  }
+  for (uint8_t i = 0; i < READAHEAD_STREAMS; i++) {
+    streams[i].buffers[0].data = memory + (i * 2) * READAHEAD_CHUNK;
+    streams[i].buffers[1].data = memory + (i * 2 + 1) * READAHEAD_CHUNK;
+  }
+
+  // Same priority and core as the web server so a refill is never starved by it
+  xTaskCreatePinnedToCore(readAheadTask, "SdReadAhead", READAHEAD_TASK_STACK, this, 3, &taskHandle, 0);
+  if (taskHandle == NULL) {
+    Serial.println("❌ SD read-ahead: task creation failed");
+    heap_caps_free(memory);
+    memory = nullptr;
+    return false;
+  }
+  Serial.printf("✅ SD read-ahead: %d streams x 2 x %d KB in %s\n", READAHEAD_STREAMS, READAHEAD_CHUNK / 1024,
+                psramFound() ? "PSRAM" : "internal RAM");
+  return true;
+}
+
+ReadAheadStream* SdReadAhead::open(int fd, uint32_t start, uint32_t end) {
+  if (!taskHandle) {
+    return nullptr;
+  }
+  for (uint8_t i = 0; i < READAHEAD_STREAMS; i++) {
+    ReadAheadStream& stream = streams[i];
+    // Only the web server task opens streams and the task ignores FREE ones, so
+    // the fields can be set before the release store publishes them
+    if (stream.use.load(std::memory_order_acquire) != READAHEAD_STREAM_FREE) {
+      continue;
+    }
+    stream.fd = fd;
+    stream.nextOffset.store(start, std::memory_order_relaxed);
+    stream.endOffset = end;
+    stream.seekPending = true;
+    stream.fillIndex = 0;
+    stream.readIndex = 0;
+    stream.readPos = 0;
+    stream.buffers[0].state.store(READAHEAD_EMPTY);
+    stream.buffers[1].state.store(READAHEAD_EMPTY);
+    stream.failed.store(false);
+    stream.use.store(READAHEAD_STREAM_ACTIVE, std::memory_order_release);
+    stats.streams++;
+    xTaskNotifyGive(taskHandle);
+    return &stream;
+  }
+  stats.fallbacks++;
+  return nullptr;
+}
+
+size_t SdReadAhead::read(ReadAheadStream* stream, uint8_t* out, size_t maxLen, bool firstCall) {
+  ReadAheadBuffer* buffer;
+  size_t copied = 0;
+  while (copied < maxLen) {
+    buffer = &stream->buffers[stream->readIndex];
+    if (buffer->state.load(std::memory_order_acquire) != READAHEAD_READY) {
+      break;
+    }
+    size_t n = buffer->length - stream->readPos;
+    if (n > maxLen - copied) n = maxLen - copied;
+    memcpy(out + copied, buffer->data + stream->readPos, n);
+    copied += n;
+    stream->readPos += n;
+    if (stream->readPos == buffer->length) {
+      // Drained: hand it back for the next chunk
+      stream->readPos = 0;
+      stream->readIndex ^= 1;
+      buffer->state.store(READAHEAD_EMPTY, std::memory_order_release);
+      xTaskNotifyGive(taskHandle);
+    }
+  }
+
+  if (copied == 0) {
+    if (stream->failed.load()) {
+      return 0;
+    }
+    // The task publishes a chunk before moving nextOffset past it, so once the end
+    // is seen a last chunk that was not READY above is visible now
+    if (stream->nextOffset.load(std::memory_order_acquire) >= stream->endOffset &&
+        stream->buffers[stream->readIndex].state.load(std::memory_order_acquire) != READAHEAD_READY) {
+      return 0;
+    }
+    stats.stalls++;
+    if (firstCall) {
+      stats.firstStalls++;
+    }
+    return RESPONSE_TRY_AGAIN;
+  }
+  return copied;
+}
+
+void SdReadAhead::close(ReadAheadStream* stream) {
+  stream->use.store(READAHEAD_STREAM_CLOSING, std::memory_order_release);
+  xTaskNotifyGive(taskHandle);
+}
+
+void SdReadAhead::readAheadTask(void* parameter) {
+  SdReadAhead* self = (SdReadAhead*)parameter;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+    self->fillStreams();
+  }
+}
+
+void SdReadAhead::fillStreams() {
+  // Round-robin one chunk per stream per pass so a large download cannot starve a small one
+  bool progressed = true;
+  while (progressed) {
+    progressed = false;
+    for (uint8_t i = 0; i < READAHEAD_STREAMS; i++) {
+      ReadAheadStream& stream = streams[i];
+      uint8_t use = stream.use.load(std::memory_order_acquire);
+      if (use == READAHEAD_STREAM_CLOSING) {
+        if (stream.fd >= 0) {
+          ::close(stream.fd);
+          stream.fd = -1;
+        }
+        stream.use.store(READAHEAD_STREAM_FREE, std::memory_order_release);
+        continue;
+      }
+      if (use != READAHEAD_STREAM_ACTIVE || stream.failed.load() ||
+          stream.nextOffset.load(std::memory_order_relaxed) >= stream.endOffset) {
+        continue;
+      }
+      ReadAheadBuffer& buffer = stream.buffers[stream.fillIndex];
+      if (buffer.state.load(std::memory_order_acquire) != READAHEAD_EMPTY) {
+        continue;
+      }
+      if (fillBuffer(stream, buffer)) {
+        buffer.state.store(READAHEAD_READY, std::memory_order_release);
+        stream.nextOffset.store(stream.nextOffset.load(std::memory_order_relaxed) + buffer.length,
+                                std::memory_order_release);
+        stream.fillIndex ^= 1;
+        progressed = true;
+      } else {
+        stream.failed.store(true);
+        stats.readErrors++;
+      }
+    }
+  }
+}
+
+bool SdReadAhead::fillBuffer(ReadAheadStream& stream, ReadAheadBuffer& buffer) {
+  // Only this task moves nextOffset; the caller advances it once the buffer is READY
+  uint32_t offset = stream.nextOffset.load(std::memory_order_relaxed);
+  if (stream.seekPending) {
+    if (::lseek(stream.fd, offset, SEEK_SET) != (off_t)offset) {
+      return false;
+    }
+    stream.seekPending = false;
+  }
+
+  // End on a chunk boundary of the file so later reads stay cluster-aligned
+  uint32_t length = READAHEAD_CHUNK - (offset % READAHEAD_CHUNK);
+  if (length > stream.endOffset - offset) {
+    length = stream.endOffset - offset;
+  }
+
+  uint32_t readStart = TraceRecorder::now();
+  uint64_t startUs = esp_timer_get_time();
+  uint32_t done = 0;
+  while (done < length) {
+    uint32_t part = length - done;
+    if (part > READAHEAD_STAGING) part = READAHEAD_STAGING;
+    ssize_t n = ::read(stream.fd, staging, part);
+    if (n <= 0) {
+      return false;
+    }
+    memcpy(buffer.data + done, staging, n);
+    done += n;
+  }
+  traceRecorder.record("readahead.fill", "sd", readStart, length);
+
+  uint32_t elapsedUs = (uint32_t)(esp_timer_get_time() - startUs);
+  if (elapsedUs > stats.readUsMax) {
+    stats.readUsMax = elapsedUs;
+  }
+  buffer.length = length;
+  stats.chunks++;
+  stats.bytes += length;
+  return true;
+}
+
+void SdReadAhead::writeStatusJson(Print& out) const {
+  uint8_t active = 0;
+  for (uint8_t i = 0; i < READAHEAD_STREAMS; i++) {
+    if (streams[i].use.load() == READAHEAD_STREAM_ACTIVE) {
+      active++;
+    }
+  }
+  printfTo(out, "{\"enabled\":%s,\"active\":%u,\"streams\":%lu,\"fallbacks\":%lu,\"chunks\":%lu,\"bytes\":%llu",
+           taskHandle ? "true" : "false", (unsigned)active, (unsigned long)stats.streams,
+           (unsigned long)stats.fallbacks, (unsigned long)stats.chunks, (unsigned long long)stats.bytes);
+  printfTo(out, ",\"stalls\":%lu,\"first_stalls\":%lu,\"slowest_chunk_us\":%lu,\"read_errors\":%lu}",
+           (unsigned long)stats.stalls, (unsigned long)stats.firstStalls, (unsigned long)stats.readUsMax,
+           (unsigned long)stats.readErrors);
+}
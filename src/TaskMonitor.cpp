@@ -0,0 +1,231 @@
+#include "TaskMonitor.h"
+#include "RequestArena.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+TaskMonitor taskMonitor;
+
+static const char* const TASK_STATE_NAMES[] = { "running", "ready", "blocked", "suspended", "deleted", "invalid" };
+
+TaskMonitor::TaskMonitor()
+  : statusBuffer(nullptr), history(nullptr), sampleCount(0), nameCount(0),
+    previousCount(0), previousSampleUs(0), periodMs(TASK_MONITOR_PERIOD_MS),
+    historyMutex(NULL), taskHandle(NULL) {
+  memset(names, 0, sizeof(names));
+  memset(previousRuntime, 0, sizeof(previousRuntime));
+  memset(previousNumbers, 0, sizeof(previousNumbers));
+}
+
+bool TaskMonitor::hasRuntimeStats() {
+#if configGENERATE_RUN_TIME_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool TaskMonitor::begin(uint32_t samplePeriodMs) {
+  if (taskHandle) {
+    return true;
+  }
+  periodMs = samplePeriodMs;
+
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  statusBuffer = (TaskStatus_t*)heap_caps_calloc(TASK_MONITOR_MAX_TASKS, sizeof(TaskStatus_t), caps);
+  history = (TaskMonitorSample*)heap_caps_calloc(TASK_MONITOR_HISTORY, sizeof(TaskMonitorSample), caps);
+  historyMutex = xSemaphoreCreateMutex();
+  if (!statusBuffer || !history || !historyMutex) {
+    Serial.println("❌ Task monitor: allocation failed");
+    return false;
+  }
+
+  xTaskCreatePinnedToCore(monitorTask, "TaskMonitor", TASK_MONITOR_STACK, this, 1, &taskHandle, 0);
+  if (!taskHandle) {
+    Serial.println("❌ Task monitor: failed to create sampler task");
+    return false;
+  }
+
+  Serial.printf("✅ Task monitor sampling every %lu ms (runtime stats: %s)\n",
+                (unsigned long)periodMs, hasRuntimeStats() ? "yes" : "no - CPU %% unavailable");
+  return true;
+}
+
+void TaskMonitor::monitorTask(void* parameter) {
+  TaskMonitor* self = static_cast<TaskMonitor*>(parameter);
+  TickType_t lastWake = xTaskGetTickCount();
+  while (true) {
+    self->takeSample();
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(self->periodMs));
+  }
+}
+
+void TaskMonitor::rememberName(uint16_t taskNumber, const char* name) {
+  for (uint8_t i = 0; i < nameCount; i++) {
+    if (names[i].taskNumber == taskNumber) {
+      return;
+    }
+  }
+  // Oldest names are recycled once the table is full
+  uint8_t slot = nameCount < TASK_MONITOR_MAX_TASKS * 2 ? nameCount++ : taskNumber % (TASK_MONITOR_MAX_TASKS * 2);
+  names[slot].taskNumber = taskNumber;
+  strncpy(names[slot].name, name, sizeof(names[slot].name) - 1);
+  names[slot].name[sizeof(names[slot].name) - 1] = '\0';
+}
+
+const char* TaskMonitor::lookupName(uint16_t taskNumber) const {
+  for (uint8_t i = 0; i < nameCount; i++) {
+    if (names[i].taskNumber == taskNumber) {
+      return names[i].name;
+    }
+  }
+  return "?";
+}
+
+void TaskMonitor::takeSample() {
+  uint32_t totalRuntime = 0;
+  UBaseType_t count = uxTaskGetSystemState(statusBuffer, TASK_MONITOR_MAX_TASKS, &totalRuntime);
+  uint32_t nowUs = (uint32_t)esp_timer_get_time();
+  uint32_t periodUs = previousSampleUs ? nowUs - previousSampleUs : 0;
+
+  // Names and history are read by the web handlers
+  if (xSemaphoreTake(historyMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    return;
+  }
+
+  TaskMonitorSample sample;
+  memset(&sample, 0, sizeof(sample));
+  sample.timestampMs = millis();
+  sample.periodUs = periodUs;
+  sample.taskCount = count;
+
+  uint32_t currentRuntime[TASK_MONITOR_MAX_TASKS];
+  uint16_t currentNumbers[TASK_MONITOR_MAX_TASKS];
+
+  for (UBaseType_t i = 0; i < count; i++) {
+    const TaskStatus_t& status = statusBuffer[i];
+    TaskSample& task = sample.tasks[i];
+    task.taskNumber = status.xTaskNumber;
+    task.state = status.eCurrentState <= eInvalid ? status.eCurrentState : eInvalid;
+    task.stackFreeBytes = status.usStackHighWaterMark > 0xFFFF ? 0xFFFF : status.usStackHighWaterMark;
+    BaseType_t affinity = xTaskGetAffinity(status.xHandle);
+    task.core = affinity == tskNO_AFFINITY ? -1 : (int8_t)affinity;
+    rememberName(status.xTaskNumber, status.pcTaskName);
+
+    currentRuntime[i] = status.ulRunTimeCounter;
+    currentNumbers[i] = status.xTaskNumber;
+
+    // CPU share = runtime delta over the wall-clock period (per core, so 1000 = one full core)
+    if (hasRuntimeStats() && periodUs > 0) {
+      for (uint8_t p = 0; p < previousCount; p++) {
+        if (previousNumbers[p] == status.xTaskNumber) {
+          uint32_t delta = status.ulRunTimeCounter - previousRuntime[p];
+          uint64_t permille = (uint64_t)delta * 1000 / periodUs;
+          task.cpuPermille = permille > 1000 ? 1000 : permille;
+          break;
+        }
+      }
+    }
+
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+      if (status.xHandle == xTaskGetIdleTaskHandleForCPU(core)) {
+        sample.idlePermille[core] = task.cpuPermille;
+      }
+    }
+  }
+
+  memcpy(previousRuntime, currentRuntime, count * sizeof(uint32_t));
+  memcpy(previousNumbers, currentNumbers, count * sizeof(uint16_t));
+  previousCount = count;
+  previousSampleUs = nowUs;
+
+  // The first pass only primes the runtime baseline
+  if (periodUs > 0) {
+    history[sampleCount % TASK_MONITOR_HISTORY] = sample;
+    sampleCount++;
+  }
+  xSemaphoreGive(historyMutex);
+}
+
+void TaskMonitor::writeJson(Print& out) {
+  printfTo(out, "{\"runtime_stats\":%s,\"period_ms\":%lu,\"samples\":%lu", hasRuntimeStats() ? "true" : "false",
+           (unsigned long)periodMs, (unsigned long)sampleCount);
+
+  if (!history || sampleCount == 0 || xSemaphoreTake(historyMutex, pdMS_TO_TICKS(200)) != pdTRUE) {
+    out.print(",\"cores\":[],\"tasks\":[]}");
+    return;
+  }
+
+  uint32_t kept = sampleCount < TASK_MONITOR_HISTORY ? sampleCount : TASK_MONITOR_HISTORY;
+  const TaskMonitorSample& latest = history[(sampleCount - 1) % TASK_MONITOR_HISTORY];
+
+  // Per-core idle, oldest sample first
+  out.print(",\"cores\":[");
+  for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+    printfTo(out, "%s{\"core\":%u,\"idle_pct\":%.1f,\"idle_history\":[", core > 0 ? "," : "", (unsigned)core,
+             latest.idlePermille[core] / 10.0f);
+    for (uint32_t s = sampleCount - kept; s < sampleCount; s++) {
+      printfTo(out, "%s%.1f", s != sampleCount - kept ? "," : "",
+               history[s % TASK_MONITOR_HISTORY].idlePermille[core] / 10.0f);
+    }
+    out.print("]}");
+  }
+  out.print("]");
+
+  // Latest per-task figures plus the worst stack headroom seen across the history
+  out.print(",\"tasks\":[");
+  for (uint8_t i = 0; i < latest.taskCount; i++) {
+    const TaskSample& task = latest.tasks[i];
+    uint16_t minStackFree = task.stackFreeBytes;
+    uint32_t peakPermille = task.cpuPermille;
+    for (uint32_t s = sampleCount - kept; s < sampleCount; s++) {
+      const TaskMonitorSample& older = history[s % TASK_MONITOR_HISTORY];
+      for (uint8_t t = 0; t < older.taskCount; t++) {
+        if (older.tasks[t].taskNumber == task.taskNumber) {
+          if (older.tasks[t].stackFreeBytes < minStackFree) minStackFree = older.tasks[t].stackFreeBytes;
+          if (older.tasks[t].cpuPermille > peakPermille) peakPermille = older.tasks[t].cpuPermille;
+          break;
+        }
+      }
+    }
+
+    if (i > 0) out.print(",");
+    printfTo(out, "{\"name\":\"%s\",\"core\":%d,\"state\":\"%s\"", lookupName(task.taskNumber), (int)task.core,
+             TASK_STATE_NAMES[task.state]);
+    printfTo(out, ",\"cpu_pct\":%.1f,\"peak_cpu_pct\":%.1f,\"stack_free\":%u,\"min_stack_free\":%u}",
+             task.cpuPermille / 10.0f, peakPermille / 10.0f, (unsigned)task.stackFreeBytes, (unsigned)minStackFree);
+  }
+  out.print("]}");
+
+  xSemaphoreGive(historyMutex);
+}
+
+void TaskMonitor::writeTaskTableHtml(Print& out) {
+  if (!history || sampleCount == 0 || xSemaphoreTake(historyMutex, pdMS_TO_TICKS(200)) != pdTRUE) {
+    out.print("<p>Task sampler not running yet</p>");
+    return;
+  }
+  const TaskMonitorSample* latest = &history[(sampleCount - 1) % TASK_MONITOR_HISTORY];
+
+  out.print("<p><strong>Core Idle:</strong> ");
+  for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+    printfTo(out, "Core %u %.1f%% ", (unsigned)core, latest->idlePermille[core] / 10.0f);
+  }
+  out.print("</p><table border='1' cellpadding='3'><tr><th>Task</th><th>Core</th><th>CPU %</th><th>Stack free</th></tr>");
+  for (uint8_t i = 0; i < latest->taskCount; i++) {
+    const TaskSample& task = latest->tasks[i];
+    printfTo(out, "<tr><td>%s</td>", lookupName(task.taskNumber));
+    if (task.core < 0) {
+      out.print("<td>any</td>");
+    } else {
+      printfTo(out, "<td>%d</td>", (int)task.core);
+    }
+    if (hasRuntimeStats()) {
+      printfTo(out, "<td>%.1f</td>", task.cpuPermille / 10.0f);
+    } else {
+      out.print("<td>n/a</td>");
+    }
+    printfTo(out, "<td>%u B</td></tr>", (unsigned)task.stackFreeBytes);
+  }
+  out.print("</table>");
+  xSemaphoreGive(historyMutex);
+}
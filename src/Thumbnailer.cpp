@@ -0,0 +1,278 @@
+#include "Thumbnailer.h"
+#include "RequestArena.h"
+#include "PhotoWriter.h"
+#include "TraceRecorder.h"
+#include "DeferredLog.h"
+#include "esp_heap_caps.h"
+#include "img_converters.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#define THUMB_SD_LOCK_MS 2000
+
+Thumbnailer thumbnailer;
+
+Thumbnailer::Thumbnailer() : sdMutex(NULL), queue(NULL), taskHandle(NULL), failedNext(0), stackLogged(false) {
+  memset(&stats, 0, sizeof(stats));
+  memset(pending, 0, sizeof(pending));
+  memset(failed, 0, sizeof(failed));
+  lock = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void Thumbnailer::begin(SemaphoreHandle_t sdMutexHandle) {
+  sdMutex = sdMutexHandle;
+  mkdir(PHOTO_MOUNT_POINT THUMB_DIR, 0755);
+  if (!queue) {
+    queue = xQueueCreate(THUMB_QUEUE_LEN, sizeof(PhotoEntry));
+  }
+  // Photo numbers start over after a format
+  portENTER_CRITICAL(&lock);
+  memset(failed, 0, sizeof(failed));
+  portEXIT_CRITICAL(&lock);
+}
+
+bool Thumbnailer::createTask() {
+  // Low priority on core 0 next to the web server - capture on core 1 is never delayed
+  xTaskCreatePinnedToCore(thumbTask, "Thumbnailer", THUMB_TASK_STACK, this, 1, &taskHandle, 0);
+  if (taskHandle == NULL) {
+    Serial.println("❌ Failed to create thumbnail task");
+    return false;
+  }
+  return true;
+}
+
+void Thumbnailer::thumbTask(void* parameter) {
+  static_cast<Thumbnailer*>(parameter)->run();
+}
+
+void Thumbnailer::run() {
+  PhotoEntry photo;
+  while (true) {
+    if (xQueueReceive(queue, &photo, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    // Deleted meanwhile, or made by an earlier request for the same photo
+    bool ok = true;
+    PhotoEntry current;
+    if (photoIndex.find(photo.number, current) && !(current.flags & PHOTO_FLAG_THUMB)) {
+      ok = generate(current);
+    }
+
+    portENTER_CRITICAL(&lock);
+    if (!ok) {
+      failed[failedNext] = photo.number;
+      failedNext = (failedNext + 1) % THUMB_FAILED_SLOTS;
+    }
+    for (uint8_t i = 0; i < THUMB_QUEUE_LEN; i++) {
+      if (pending[i] == photo.number) {
+        pending[i] = 0;
+      }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (!stackLogged) {
+      stackLogged = true;
+      DLOGI("📏 Thumbnail stack: %u of %u bytes never used", (unsigned)uxTaskGetStackHighWaterMark(NULL),
+            (unsigned)THUMB_TASK_STACK);
+    }
+  }
+}
+
+bool Thumbnailer::isPending(uint32_t number) {
+  for (uint8_t i = 0; i < THUMB_QUEUE_LEN; i++) {
+    if (pending[i] == number) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Thumbnailer::hasFailed(uint32_t number) {
+  for (uint8_t i = 0; i < THUMB_FAILED_SLOTS; i++) {
+    if (failed[i] == number) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ThumbState Thumbnailer::request(const PhotoEntry& photo, char* path, size_t pathSize) {
+  formatThumbPath(path, pathSize, photo.number);
+  if (photo.flags & PHOTO_FLAG_THUMB) {
+    return THUMB_READY;
+  }
+  if (!sdMutex || !queue || photo.size == 0 || photo.size > THUMB_MAX_SOURCE) {
+    return THUMB_UNAVAILABLE;
+  }
+  if (taskHandle == NULL && !createTask()) {
+    return THUMB_UNAVAILABLE;
+  }
+
+  ThumbState state = THUMB_PENDING;
+  int8_t slot = -1;
+  portENTER_CRITICAL(&lock);
+  if (hasFailed(photo.number)) {
+    state = THUMB_UNAVAILABLE;
+  } else if (!isPending(photo.number)) {
+    // All slots taken: the client comes back once the worker has caught up
+    for (uint8_t i = 0; i < THUMB_QUEUE_LEN && slot < 0; i++) {
+      if (pending[i] == 0) {
+        pending[i] = photo.number;
+        slot = i;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (slot >= 0 && xQueueSend(queue, &photo, 0) != pdTRUE) {
+    portENTER_CRITICAL(&lock);
+    pending[slot] = 0;
+    portEXIT_CRITICAL(&lock);
+  }
+  if (state == THUMB_PENDING) {
+    stats.deferred++;
+  }
+  return state;
+}
+
+void Thumbnailer::formatThumbPath(char* out, size_t size, uint32_t number) {
+  snprintf(out, size, THUMB_DIR "/thumb_%06lu.jpg", (unsigned long)number);
+}
+
+void Thumbnailer::remove(uint32_t number) {
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  formatThumbPath(path + strlen(path), sizeof(path) - strlen(path), number);
+  ::unlink(path);
+}
+
+uint32_t Thumbnailer::removeAll() {
+  DIR* dir = opendir(PHOTO_MOUNT_POINT THUMB_DIR);
+  if (!dir) {
+    return 0;
+  }
+  uint32_t removed = 0;
+  char path[PHOTO_PATH_LEN + 16];
+  struct dirent* item;
+  while ((item = readdir(dir)) != nullptr) {
+    if (snprintf(path, sizeof(path), PHOTO_MOUNT_POINT THUMB_DIR "/%s", item->d_name) < (int)sizeof(path) &&
+        ::unlink(path) == 0) {
+      removed++;
+    }
+  }
+  closedir(dir);
+  return removed;
+}
+
+bool Thumbnailer::readDimensions(const uint8_t* jpeg, size_t len, uint16_t& width, uint16_t& height) {
+  // Walk the marker segments up to the frame header (SOF0-SOF2)
+  size_t pos = 2;
+  while (pos + 9 < len) {
+    if (jpeg[pos] != 0xFF) {
+      return false;
+    }
+    uint8_t marker = jpeg[pos + 1];
+    uint16_t segmentLen = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+    if (marker >= 0xC0 && marker <= 0xC2) {
+      height = (jpeg[pos + 5] << 8) | jpeg[pos + 6];
+      width = (jpeg[pos + 7] << 8) | jpeg[pos + 8];
+      return width > 0 && height > 0;
+    }
+    pos += 2 + segmentLen;
+  }
+  return false;
+}
+
+bool Thumbnailer::readPhoto(uint32_t number, uint8_t* buffer, size_t size) {
+  char path[PHOTO_PATH_LEN + 16];
+  strcpy(path, PHOTO_MOUNT_POINT);
+  PhotoWriter::formatPhotoPath(path + strlen(path), sizeof(path) - strlen(path), number);
+
+  if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(THUMB_SD_LOCK_MS), "sdMutex") != pdTRUE) {
+    return false;
+  }
+  bool ok = false;
+  int fd = ::open(path, O_RDONLY);
+  if (fd >= 0) {
+    size_t done = 0;
+    while (done < size) {
+      ssize_t n = ::read(fd, buffer + done, size - done);
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    ::close(fd);
+    ok = done == size;
+  }
+  xSemaphoreGive(sdMutex);
+  return ok;
+}
+
+bool Thumbnailer::generate(const PhotoEntry& photo) {
+  if (photo.size == 0 || photo.size > THUMB_MAX_SOURCE) {
+    stats.failed++;
+    return false;
+  }
+
+  char path[PHOTO_PATH_LEN];
+  formatThumbPath(path, sizeof(path), photo.number);
+  unsigned long start = millis();
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  uint8_t* source = (uint8_t*)heap_caps_malloc(photo.size, caps);
+  uint8_t* pixels = nullptr;
+  uint8_t* thumb = nullptr;
+  size_t thumbLen = 0;
+  bool ok = false;
+
+  uint16_t width = 0, height = 0;
+  if (source && readPhoto(photo.number, source, photo.size) &&
+      readDimensions(source, photo.size, width, height)) {
+    // The decoder downscales for free, so pick the smallest factor that fits
+    uint8_t shift = 0;
+    while (shift < 3 && (width >> shift) > THUMB_MAX_WIDTH) {
+      shift++;
+    }
+    jpg_scale_t scale = (jpg_scale_t)shift;
+    uint16_t thumbWidth = (width + (1 << shift) - 1) >> shift;
+    uint16_t thumbHeight = (height + (1 << shift) - 1) >> shift;
+
+    pixels = (uint8_t*)heap_caps_malloc((size_t)thumbWidth * thumbHeight * 2, caps);
+    uint32_t convertStart = TraceRecorder::now();
+    if (pixels && jpg2rgb565(source, photo.size, pixels, scale) &&
+        fmt2jpg(pixels, (size_t)thumbWidth * thumbHeight * 2, thumbWidth, thumbHeight,
+                PIXFORMAT_RGB565, THUMB_QUALITY, &thumb, &thumbLen)) {
+      traceRecorder.record("thumb.convert", "sd", convertStart, thumbLen);
+      if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(THUMB_SD_LOCK_MS), "sdMutex") == pdTRUE) {
+        ok = photoWriter.write(path, thumb, thumbLen) == (int)thumbLen;
+        xSemaphoreGive(sdMutex);
+      }
+    }
+  }
+
+  free(thumb);
+  heap_caps_free(pixels);
+  heap_caps_free(source);
+
+  if (ok) {
+    photoIndex.setFlags(photo.number, PHOTO_FLAG_THUMB);
+    stats.generated++;
+    stats.lastMs = millis() - start;
+    if (stats.lastMs > stats.maxMs) {
+      stats.maxMs = stats.lastMs;
+    }
+  } else {
+    stats.failed++;
+    Serial.printf("⚠️ Thumbnail failed for photo #%lu\n", (unsigned long)photo.number);
+  }
+  return ok;
+}
+
+void Thumbnailer::writeStatusJson(Print& out) {
+  printfTo(out, "{\"generated\":%lu,\"failed\":%lu,\"last_ms\":%lu,\"max_ms\":%lu,\"deferred\":%lu,\"stack_free\":%u}",
+           (unsigned long)stats.generated, (unsigned long)stats.failed, (unsigned long)stats.lastMs,
+           (unsigned long)stats.maxMs, (unsigned long)stats.deferred,
+           taskHandle ? (unsigned)uxTaskGetStackHighWaterMark(taskHandle) : 0);
+}
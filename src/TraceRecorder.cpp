@@ -0,0 +1,156 @@
+#include "TraceRecorder.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <memory>
+#include <new>
+
+TraceRecorder traceRecorder;
+
+TraceRecorder::TraceRecorder()
+  : ring(nullptr), nextTicket(0), enabled(false) {
+}
+
+bool TraceRecorder::begin() {
+  if (ring) {
+    return true;
+  }
+
+  uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+  ring = (TraceSpan*)heap_caps_calloc(TRACE_RING_SIZE, sizeof(TraceSpan), caps);
+  if (!ring) {
+    Serial.println("❌ Trace recorder: ring allocation failed - tracing disabled");
+    return false;
+  }
+  for (int i = 0; i < TRACE_RING_SIZE; i++) {
+    new (&ring[i].sequence) std::atomic<uint32_t>(0);
+  }
+
+  enabled.store(true);
+  Serial.printf("✅ Trace recorder ready (%d spans)\n", TRACE_RING_SIZE);
+  return true;
+}
+
+void TraceRecorder::record(const char* name, const char* category, uint32_t beginUs, uint32_t arg) {
+  uint32_t endUs = now();
+  if (!isEnabled()) {
+    return;
+  }
+
+  // Overwrite the oldest slot; the per-slot sequence lets the exporter skip torn spans
+  uint32_t ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+  TraceSpan& span = ring[ticket & (TRACE_RING_SIZE - 1)];
+  span.sequence.store(0, std::memory_order_release);
+  span.durationUs = endUs - beginUs;
+  span.endUs = endUs;
+  span.name = name;
+  span.category = category;
+  span.arg = arg;
+  span.core = xPortGetCoreID();
+  span.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+void TraceRecorder::clear() {
+  if (!ring) {
+    return;
+  }
+  for (int i = 0; i < TRACE_RING_SIZE; i++) {
+    ring[i].sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t TraceRecorder::writeEvent(char* buffer, size_t size, const TraceSpan& span, uint64_t nowUs, bool first) {
+  // Rebuild the 64-bit end time from the 32-bit anchor (valid for spans < 71 minutes old)
+  uint64_t endUs = nowUs - (uint32_t)((uint32_t)nowUs - span.endUs);
+  uint64_t beginUs = endUs - span.durationUs;
+
+  int written = snprintf(buffer, size,
+                         "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%lu,"
+                         "\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%lu}}",
+                         first ? "" : ",\n", span.name, span.category,
+                         (unsigned long long)beginUs, (unsigned long)span.durationUs, span.core,
+                         (unsigned long)span.arg);
+  if (written < 0) {
+    return 0;
+  }
+  return (size_t)written < size ? written : size - 1;
+}
+
+AsyncWebServerResponse* TraceRecorder::beginTraceResponse(AsyncWebServerRequest* request) {
+  // Export state shared with the chunk filler; freed with the response
+  struct ExportState {
+    uint32_t ticket;
+    uint32_t end;
+    uint64_t nowUs;
+    uint8_t stage;        // 0 = header, 1 = spans, 2 = footer, 3 = done
+    bool first;
+    char pending[320];
+    size_t pendingLen;
+    size_t pendingPos;
+  };
+
+  std::shared_ptr<ExportState> state = std::make_shared<ExportState>();
+  state->end = nextTicket.load(std::memory_order_acquire);
+  state->ticket = state->end > TRACE_RING_SIZE ? state->end - TRACE_RING_SIZE : 0;
+  state->nowUs = (uint64_t)esp_timer_get_time();
+  state->stage = 0;
+  state->first = true;
+  state->pendingLen = 0;
+  state->pendingPos = 0;
+
+  return request->beginChunkedResponse("application/json",
+    [this, state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      size_t used = 0;
+      while (used < maxLen) {
+        // Flush whatever did not fit into the previous chunk
+        if (state->pendingPos < state->pendingLen) {
+          size_t n = state->pendingLen - state->pendingPos;
+          if (n > maxLen - used) n = maxLen - used;
+          memcpy(buffer + used, state->pending + state->pendingPos, n);
+          state->pendingPos += n;
+          used += n;
+          continue;
+        }
+
+        state->pendingLen = 0;
+        state->pendingPos = 0;
+        if (state->stage == 0) {
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending),
+            "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Core 0\"}},\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Core 1\"}}");
+          state->first = false;
+          state->stage = 1;
+        } else if (state->stage == 1) {
+          if (state->ticket == state->end || !ring) {
+            state->stage = 2;
+            continue;
+          }
+          // Seqlock-style copy: skip slots that were rewritten while we read them
+          const TraceSpan& slot = ring[state->ticket & (TRACE_RING_SIZE - 1)];
+          uint32_t expected = state->ticket + 1;
+          state->ticket++;
+          if (slot.sequence.load(std::memory_order_acquire) != expected) {
+            continue;
+          }
+          TraceSpan copy;
+          copy.durationUs = slot.durationUs;
+          copy.endUs = slot.endUs;
+          copy.name = slot.name;
+          copy.category = slot.category;
+          copy.arg = slot.arg;
+          copy.core = slot.core;
+          if (slot.sequence.load(std::memory_order_acquire) != expected) {
+            continue;
+          }
+          state->pendingLen = writeEvent(state->pending, sizeof(state->pending), copy, state->nowUs, state->first);
+          state->first = false;
+        } else if (state->stage == 2) {
+          state->pendingLen = snprintf(state->pending, sizeof(state->pending), "\n]}\n");
+          state->stage = 3;
+        } else {
+          break;
+        }
+      }
+      return used;
+    });
+}
@@ -0,0 +1,48 @@
+#include "WebAssets.h"
+#include "RequestArena.h"
+#include "PhotoHttp.h"
+#include "WebAssets.generated.h"
+
+#define WEB_ASSET_COUNT (sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]))
+
+const WebAsset* WebAssets::find(const char* route) {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    if (strcmp(WEB_ASSETS[i].route, route) == 0) {
+      return &WEB_ASSETS[i];
+    }
+  }
+  return nullptr;
+}
+
+const char* WebAssets::url(const char* route) {
+  const WebAsset* asset = find(route);
+  return asset ? asset->url : route;
+}
+
+bool WebAssets::send(AsyncWebServerRequest* request, const char* route) {
+  const WebAsset* asset = find(route);
+  if (!asset) {
+    return false;
+  }
+  // Hashed URLs never change content; pages keep their URL, so revalidate them
+  const char* cacheControl = asset->versioned ? PHOTO_CACHE_IMMUTABLE : PHOTO_CACHE_REVALIDATE;
+  if (PhotoHttp::sendNotModified(request, asset->etag, cacheControl)) {
+    return true;
+  }
+  // Only the gzip form exists; every browser we serve sends Accept-Encoding: gzip
+  AsyncWebServerResponse* response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+  response->addHeader("Content-Encoding", "gzip");
+  response->addHeader("Vary", "Accept-Encoding");
+  response->addHeader("ETag", asset->etag);
+  response->addHeader("Cache-Control", cacheControl);
+  request->send(response);
+  return true;
+}
+
+void WebAssets::writeStatusJson(Print& out) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    bytes += WEB_ASSETS[i].length;
+  }
+  printfTo(out, "{\"assets\":%u,\"gzip_bytes\":%u}", (unsigned)WEB_ASSET_COUNT, (unsigned)bytes);
+}
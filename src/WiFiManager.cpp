@@ -1,6 +1,17 @@
 #include "WiFiManager.h"
+#include "RequestArena.h"
+#include "esp_system.h"
 
-WiFiManager::WiFiManager() {
+// Link event bits
+#define WIFI_LINK_UP_BIT     (1 << 0)
+#define WIFI_LINK_FAILED_BIT (1 << 1)
+
+WiFiManager::WiFiManager()
+  : linkState(WIFI_LINK_IDLE), reconnectEnabled(false), attemptIsFast(false),
+    attemptStart(0), outageStart(0), failedInRow(0), linkBits(NULL), reconnectTimer(NULL),
+    reconnectDue(false) {
+  memset(&cache, 0, sizeof(cache));
+  memset(&stats, 0, sizeof(stats));
 }
 
 void WiFiManager::begin() {
@@ -20,6 +31,20 @@ void WiFiManager::begin() {
       Serial.println("ℹ No saved WiFi configuration found");
     }
     
+    Serial.println("📋 Step 3: Registering WiFi event handlers...");
+    loadFastConnectCache();
+    linkBits = xEventGroupCreate();
+    reconnectTimer = xTimerCreate("wifiReconnect", pdMS_TO_TICKS(WIFI_BACKOFF_MIN_MS),
+                                  pdFALSE, this, reconnectTimerCallback);
+    
+    // We own reconnects (with backoff) and NVS writes, not the driver
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+      this->onWiFiEvent(event, info);
+    });
+    Serial.println("✓ WiFi event handlers registered");
+    
     Serial.println("✓ WiFi manager initialization completed");
     
   } catch (const std::exception& e) {
@@ -48,41 +73,194 @@ bool WiFiManager::connectToWiFi(const WiFiConfig& config) {
   Serial.printf("🔗 Connecting to WiFi network: %s\n", config.ssid.c_str());
   Serial.println("⏳ Connection attempt in progress...");
   
-  // Set WiFi mode and start connection
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(config.ssid.c_str(), config.password.c_str());
-  
-  int attempts = 0;
-  const int maxAttempts = 20; // 10 seconds total
-  
-  while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
-    delay(500);
-    attempts++;
-    
-    if (attempts % 4 == 0) {
-      Serial.printf("🔄 Connection attempt %d/%d - Status: %d\n", 
-                    attempts, maxAttempts, WiFi.status());
-    } else {
-      Serial.print(".");
-    }
+  if (!startConnect(config)) {
+    return false;
   }
-  Serial.println();
   
-  if (WiFi.status() == WL_CONNECTED) {
-    currentConfig = config;
+  // Block on the link event instead of polling WiFi.status()
+  EventBits_t bits = xEventGroupWaitBits(linkBits, WIFI_LINK_UP_BIT, pdFALSE, pdFALSE,
+                                         pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS));
+  
+  if (bits & WIFI_LINK_UP_BIT) {
     Serial.println("🎉 Successfully connected to WiFi!");
     Serial.printf("✓ SSID: %s\n", config.ssid.c_str());
     Serial.printf("✓ IP Address: %s\n", WiFi.localIP().toString().c_str());
     Serial.printf("✓ Gateway: %s\n", WiFi.gatewayIP().toString().c_str());
     Serial.printf("✓ DNS: %s\n", WiFi.dnsIP().toString().c_str());
     Serial.printf("✓ Signal Strength: %d dBm\n", WiFi.RSSI());
+    Serial.printf("✓ Connected in %lu ms\n", (unsigned long)stats.lastConnectMs);
     return true;
   } else {
-    Serial.printf("❌ Failed to connect to WiFi after %d attempts\n", attempts);
+    Serial.printf("❌ Failed to connect to WiFi within %d ms\n", WIFI_CONNECT_TIMEOUT_MS);
     Serial.printf("⚠ Final status code: %d\n", WiFi.status());
     Serial.println("💡 Will start configuration mode instead");
+    disconnect();
+    return false;
+  }
+}
+
+bool WiFiManager::startConnect(const WiFiConfig& config) {
+  if (!config.isValid() || linkBits == NULL) {
     return false;
   }
+  
+  // A different network invalidates the cached BSSID/channel/lease
+  if (config.ssid != currentConfig.ssid) {
+    clearFastConnectCache();
+  }
+  currentConfig = config;
+  
+  // Keep the setup AP running alongside the station if it is up
+  wifi_mode_t mode = WiFi.getMode();
+  if (mode == WIFI_AP) {
+    WiFi.mode(WIFI_AP_STA);
+  } else if (mode == WIFI_OFF) {
+    WiFi.mode(WIFI_STA);
+  }
+  
+  reconnectEnabled = true;
+  failedInRow = 0;
+  xEventGroupClearBits(linkBits, WIFI_LINK_UP_BIT | WIFI_LINK_FAILED_BIT);
+  attemptConnect();
+  return true;
+}
+
+void WiFiManager::disconnect() {
+  reconnectEnabled = false;
+  if (reconnectTimer) {
+    xTimerStop(reconnectTimer, 0);
+  }
+  WiFi.disconnect();
+  linkState = WIFI_LINK_IDLE;
+  if (linkBits) {
+    xEventGroupClearBits(linkBits, WIFI_LINK_UP_BIT);
+  }
+}
+
+void WiFiManager::attemptConnect() {
+  attemptStart = millis();
+  attemptIsFast = cache.valid;
+  linkState = WIFI_LINK_CONNECTING;
+  
+  if (attemptIsFast) {
+    // Fast path: no scan (known BSSID + channel) and no DHCP round trip (cached lease)
+    if (cache.ip != 0) {
+      WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway),
+                  IPAddress(cache.subnet), IPAddress(cache.dns));
+    }
+    WiFi.begin(currentConfig.ssid.c_str(), currentConfig.password.c_str(),
+               cache.channel, cache.bssid);
+  } else {
+    // Full scan and DHCP
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    WiFi.begin(currentConfig.ssid.c_str(), currentConfig.password.c_str());
+  }
+}
+
+void WiFiManager::scheduleReconnect() {
+  if (!reconnectEnabled || reconnectTimer == NULL || xTimerIsTimerActive(reconnectTimer)) {
+    return;
+  }
+  
+  // Exponential backoff with up to 25% jitter so a fleet does not reconnect in lockstep
+  uint32_t backoff = WIFI_BACKOFF_MIN_MS << min((int)failedInRow, 8);
+  if (backoff > WIFI_BACKOFF_MAX_MS) {
+    backoff = WIFI_BACKOFF_MAX_MS;
+  }
+  backoff += esp_random() % (backoff / 4 + 1);
+  
+  stats.currentBackoffMs = backoff;
+  linkState = WIFI_LINK_BACKOFF;
+  xTimerChangePeriod(reconnectTimer, pdMS_TO_TICKS(backoff), 0);  // Also starts the timer
+}
+
+void WiFiManager::reconnectTimerCallback(TimerHandle_t timer) {
+  // The timer service task has a small stack and must never block, so
+  // WiFi.begin() and its logging run from loop() instead
+  WiFiManager* self = (WiFiManager*)pvTimerGetTimerID(timer);
+  self->reconnectDue.store(true);
+}
+
+void WiFiManager::loop() {
+  if (reconnectDue.exchange(false) && reconnectEnabled && linkState == WIFI_LINK_BACKOFF) {
+    attemptConnect();
+  }
+}
+
+void WiFiManager::onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED: {
+      stats.lastAssociationMs = millis() - attemptStart;
+      // Remember where we associated; committed to NVS once we have an IP
+      memcpy(cache.bssid, info.wifi_sta_connected.bssid, sizeof(cache.bssid));
+      cache.channel = info.wifi_sta_connected.channel;
+      break;
+    }
+    
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP: {
+      unsigned long now = millis();
+      stats.lastConnectMs = now - attemptStart;
+      stats.connects++;
+      if (attemptIsFast) {
+        stats.fastConnects++;
+      }
+      if (outageStart != 0) {
+        stats.lastOutageMs = now - outageStart;
+        stats.totalOutageMs += stats.lastOutageMs;
+        outageStart = 0;
+      }
+      failedInRow = 0;
+      stats.currentBackoffMs = 0;
+      linkState = WIFI_LINK_CONNECTED;
+      
+      const esp_netif_ip_info_t& ipInfo = info.got_ip.ip_info;
+      cache.ip = ipInfo.ip.addr;
+      cache.gateway = ipInfo.gw.addr;
+      cache.subnet = ipInfo.netmask.addr;
+      cache.dns = (uint32_t)WiFi.dnsIP();
+      saveFastConnectCache();
+      // SNTP runs in the background; photos get real timestamps once it answers
+      configTime(0, 0, NTP_SERVER);
+      
+      Serial.printf("📶 WiFi up: %s in %lu ms (assoc %lu ms, %s)\n",
+                    WiFi.localIP().toString().c_str(), (unsigned long)stats.lastConnectMs,
+                    (unsigned long)stats.lastAssociationMs, attemptIsFast ? "fast path" : "full scan");
+      xEventGroupClearBits(linkBits, WIFI_LINK_FAILED_BIT);
+      xEventGroupSetBits(linkBits, WIFI_LINK_UP_BIT);
+      break;
+    }
+    
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED: {
+      if (!reconnectEnabled) {
+        break;
+      }
+      xEventGroupClearBits(linkBits, WIFI_LINK_UP_BIT);
+      
+      if (linkState == WIFI_LINK_CONNECTED) {
+        stats.outages++;
+        outageStart = millis();
+        Serial.printf("📴 WiFi link lost (reason %d) - outage #%lu\n",
+                      info.wifi_sta_disconnected.reason, (unsigned long)stats.outages);
+      } else if (linkState == WIFI_LINK_CONNECTING) {
+        stats.failedAttempts++;
+        if (failedInRow < 255) {
+          failedInRow++;
+        }
+        if (attemptIsFast) {
+          // The AP may have moved channel or the lease expired - next attempt does a full scan
+          Serial.println("⚠ Fast reconnect failed - falling back to full scan and DHCP");
+          cache.valid = false;
+        }
+      }
+      
+      xEventGroupSetBits(linkBits, WIFI_LINK_FAILED_BIT);
+      scheduleReconnect();
+      break;
+    }
+    
+    default:
+      break;
+  }
 }
 
 void WiFiManager::saveConfig(const WiFiConfig& config) {
@@ -93,8 +271,10 @@ void WiFiManager::saveConfig(const WiFiConfig& config) {
 }
 
 void WiFiManager::clearConfig() {
+  disconnect();
   preferences.clear();
   currentConfig = WiFiConfig();
+  memset(&cache, 0, sizeof(cache));
   Serial.println("WiFi config cleared from memory");
 }
 
@@ -133,7 +313,38 @@ int WiFiManager::getSignalStrength() const {
 }
 
 bool WiFiManager::isConnected() const {
-  return WiFi.status() == WL_CONNECTED;
+  return linkState == WIFI_LINK_CONNECTED;
+}
+
+WiFiLinkState WiFiManager::getLinkState() const {
+  return linkState;
+}
+
+WiFiLinkStats WiFiManager::getStats() const {
+  return stats;
+}
+
+void WiFiManager::writeStatusJson(Print& out) const {
+  static const char* stateNames[] = { "idle", "connecting", "connected", "backoff" };
+  
+  unsigned long outageNow = outageStart != 0 ? millis() - outageStart : 0;
+  IPAddress ip = WiFi.localIP();
+  
+  printfTo(out, "{\"state\":\"%s\",\"ssid\":", stateNames[linkState]);
+  // SSIDs are arbitrary bytes; quotes, backslashes and control characters are escaped
+  printJsonString(out, currentConfig.ssid.c_str());
+  printfTo(out, ",\"ip\":\"%u.%u.%u.%u\",\"rssi\":%d", ip[0], ip[1], ip[2], ip[3], isConnected() ? WiFi.RSSI() : 0);
+  printfTo(out, ",\"bssid\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"channel\":%u,\"fast_connect_cached\":%s",
+           cache.bssid[0], cache.bssid[1], cache.bssid[2], cache.bssid[3], cache.bssid[4], cache.bssid[5],
+           (unsigned)cache.channel, cache.valid ? "true" : "false");
+  printfTo(out, ",\"connects\":%lu,\"fast_connects\":%lu,\"failed_attempts\":%lu,\"outages\":%lu",
+           (unsigned long)stats.connects, (unsigned long)stats.fastConnects, (unsigned long)stats.failedAttempts,
+           (unsigned long)stats.outages);
+  printfTo(out, ",\"last_association_ms\":%lu,\"last_connect_ms\":%lu,\"last_outage_ms\":%lu",
+           (unsigned long)stats.lastAssociationMs, (unsigned long)stats.lastConnectMs,
+           (unsigned long)stats.lastOutageMs);
+  printfTo(out, ",\"total_outage_ms\":%lu,\"current_outage_ms\":%lu,\"backoff_ms\":%lu}",
+           (unsigned long)(stats.totalOutageMs + outageNow), outageNow, (unsigned long)stats.currentBackoffMs);
 }
 
 WiFiConfig WiFiManager::loadConfig() {
@@ -146,4 +357,59 @@ WiFiConfig WiFiManager::loadConfig() {
   }
   
   return config;
-} 
\ No newline at end of file
+}
+
+void WiFiManager::loadFastConnectCache() {
+  memset(&cache, 0, sizeof(cache));
+  if (preferences.getBytes("fc_bssid", cache.bssid, sizeof(cache.bssid)) != sizeof(cache.bssid)) {
+    return;
+  }
+  cache.channel = preferences.getUChar("fc_channel", 0);
+  cache.ip = preferences.getUInt("fc_ip", 0);
+  cache.gateway = preferences.getUInt("fc_gw", 0);
+  cache.subnet = preferences.getUInt("fc_mask", 0);
+  cache.dns = preferences.getUInt("fc_dns", 0);
+  cache.valid = cache.channel != 0;
+  
+  if (cache.valid) {
+    Serial.printf("✓ Fast-connect cache: channel %d, lease %s\n",
+                  cache.channel, IPAddress(cache.ip).toString().c_str());
+  }
+}
+
+void WiFiManager::saveFastConnectCache() {
+  // Only touch NVS when something changed - reconnects after outages are frequent
+  WiFiFastConnectCache stored;
+  memset(&stored, 0, sizeof(stored));
+  preferences.getBytes("fc_bssid", stored.bssid, sizeof(stored.bssid));
+  stored.channel = preferences.getUChar("fc_channel", 0);
+  stored.ip = preferences.getUInt("fc_ip", 0);
+  stored.gateway = preferences.getUInt("fc_gw", 0);
+  stored.subnet = preferences.getUInt("fc_mask", 0);
+  stored.dns = preferences.getUInt("fc_dns", 0);
+  
+  cache.valid = true;
+  if (memcmp(stored.bssid, cache.bssid, sizeof(cache.bssid)) == 0 &&
+      stored.channel == cache.channel && stored.ip == cache.ip &&
+      stored.gateway == cache.gateway && stored.subnet == cache.subnet && stored.dns == cache.dns) {
+    return;
+  }
+  
+  preferences.putBytes("fc_bssid", cache.bssid, sizeof(cache.bssid));
+  preferences.putUChar("fc_channel", cache.channel);
+  preferences.putUInt("fc_ip", cache.ip);
+  preferences.putUInt("fc_gw", cache.gateway);
+  preferences.putUInt("fc_mask", cache.subnet);
+  preferences.putUInt("fc_dns", cache.dns);
+  Serial.println("Fast-connect cache saved to memory");
+}
+
+void WiFiManager::clearFastConnectCache() {
+  preferences.remove("fc_bssid");
+  preferences.remove("fc_channel");
+  preferences.remove("fc_ip");
+  preferences.remove("fc_gw");
+  preferences.remove("fc_mask");
+  preferences.remove("fc_dns");
+  memset(&cache, 0, sizeof(cache));
+}
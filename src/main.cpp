@@ -7,18 +7,47 @@
 #include "SPI.h"
 #include "FS.h"
 #include "esp_task_wdt.h"
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
+#include "CameraTuner.h"
+#include "BootSequencer.h"
+#include "WiFiManager.h"
+#include "HTMLTemplates.h"
+#include "PhotoUploader.h"
+#include "Metrics.h"
+#include "RequestProfiler.h"
+#include "DeferredLog.h"
+#include "TraceRecorder.h"
+#include "TaskMonitor.h"
+#include "MemoryGovernor.h"
+#include "RequestArena.h"
+#include "PhotoWriter.h"
+#include "HeapProfiler.h"
+#include "LatestFrame.h"
+#include "PhotoIndex.h"
+#include "Thumbnailer.h"
+#include "EventBroadcaster.h"
+#include "PhotoHttp.h"
+#include "SdReadAhead.h"
+#include "WebAssets.h"
+#include "PhotoExport.h"
+#include "AviRecorder.h"
+#include "PhotoMetadata.h"
+#include "PhotoOptimizer.h"
+#include "PhotoAging.h"
 
 // Function declarations
-void forceMemoryRecovery();
 bool initCamera();
 bool initSDCard();
 bool testSDCard();
 void photoCaptureTask(void * parameter);
 bool capturePhoto();
+void initMetrics();
+void initMemoryGovernor();
+ArRequestHandlerFunction instrumentRoute(const char* route, ArRequestHandlerFunction handler);
 
 // ===================
 // FREENOVE ESP32-S3-WROOM CAM Pin Configuration 
@@ -47,21 +76,38 @@ bool capturePhoto();
 // WiFi AP Configuration
 const char* AP_SSID = "ESP32-S3-Camera-Setup";
 const char* AP_PASSWORD = "camera12345";
+const char* MDNS_NAME = "esp32-camera";
+
+// Optional station connection to a saved network (event-driven, auto-reconnect)
+WiFiManager wifiManager;
 
 AsyncWebServer server(80);
 
-bool cameraReady = false;
-bool sdCardReady = false;
+volatile bool cameraReady = false;  // Set by the camera boot step
+volatile bool sdCardReady = false;  // Set by the SD card boot step
 String sdCardInfo = "Not initialized";
 
 // Photo capture variables
 unsigned long lastPhotoTime = 0;
-unsigned long photoCount = 0;
-String lastPhotoFilename = "";
+unsigned long photoCount = 0;  // Owned by sdMutex holders; other tasks read latestFrame instead
 // Photo capture interval (embedded optimized)
 const unsigned long PHOTO_INTERVAL = 10000; // 10 seconds (embedded optimized)
 bool clearingInProgress = false; // Flag to pause photo capture during clearing
 
+// Camera driver auto-tuning (XCLK, fb_count, grab mode, buffer location)
+CameraTuner cameraTuner;
+unsigned long calibrationRestartTime = 0; // Non-zero when a calibration reboot is pending
+
+// Store-and-forward upload of committed photos to an HTTP collector
+PhotoUploader photoUploader;
+
+// Parallel boot sequence (camera, SD card and WiFi start concurrently)
+BootSequencer bootSequencer;
+int bootStepCamera = -1;
+int bootStepSDCard = -1;
+int bootStepWiFi = -1;
+int bootStepWebServer = -1;
+
 // ===================
 // DUAL-CORE ARCHITECTURE - Photo capture on Core 1, Web server on Core 0
 // ===================
@@ -120,8 +166,31 @@ bool initCamera() {
   config.fb_location = CAMERA_FB_IN_DRAM; // Store in DRAM, not PSRAM
   Serial.println("🎯 EMBEDDED: Using 320x240, Quality 20 for minimal memory");
 
+  // One-shot calibration: benchmark every driver combination and keep the best
+  // (cameraTuner.begin() ran in setup(), which kept the other boot steps back)
+  if (cameraTuner.isCalibrationRequested()) {
+    if (!cameraTuner.runCalibration(config)) {
+      Serial.println("❌ Camera init failed after calibration");
+      return false;
+    }
+    Serial.println("✅ Camera initialized with calibrated settings!");
+    return true;
+  }
+
+  // Measured settings from a previous calibration override the defaults above
+  cameraTuner.applyTo(config);
+
   // Initialize the camera
   esp_err_t err = esp_camera_init(&config);
+  if (err != ESP_OK && cameraTuner.hasTuning()) {
+    Serial.printf("⚠️ Camera init failed with tuned settings (0x%x) - retrying with defaults\n", err);
+    cameraTuner.clearTuning();
+    config.xclk_freq_hz = 10000000;
+    config.fb_count = 1;
+    config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+    config.fb_location = CAMERA_FB_IN_DRAM;
+    err = esp_camera_init(&config);
+  }
   if (err != ESP_OK) {
     Serial.printf("❌ Camera init failed with error 0x%x\n", err);
     return false;
@@ -131,12 +200,271 @@ bool initCamera() {
   return true;
 }
 
+// ===================
+// METRICS - lock-free counters updated by the tasks, scraped via /metrics
+// ===================
+
+// SD write latency buckets (milliseconds, open + write + close)
+static const uint32_t SD_WRITE_BUCKETS_MS[] = { 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 };
+
+struct CaptureMetrics {
+  MetricCounter* framesCaptured;
+  MetricCounter* droppedCamera;
+  MetricCounter* droppedSdBusy;
+  MetricCounter* droppedOpenError;
+  MetricCounter* droppedWriteError;
+  MetricCounter* skippedLowMemory;
+  MetricCounter* skippedQueueFull;
+  MetricCounter* framesWritten;
+  MetricCounter* bytesWritten;
+  MetricHistogram* sdWriteLatency;
+  MetricGauge* queueDepth;
+  MetricGauge* heapFreeInternal;
+  MetricGauge* heapFreePsram;
+  MetricGauge* heapLargestInternal;
+  MetricGauge* heapLargestPsram;
+  MetricGauge* heapMinFreeInternal;
+  MetricGauge* wifiRssi;
+  MetricGauge* uptimeSeconds;
+  MetricGauge* uploaderBacklog;
+  MetricCounter* uploaderPhotos;
+  MetricCounter* uploaderBytes;
+  MetricCounter* uploaderFailures;
+  MetricCounter* logRecordsDropped;
+  MetricGauge* memoryPressure;
+  MetricCounter* memoryTransitions;
+  MetricCounter* requestsRejected;
+  MetricGauge* captureInternalBlocks;
+  MetricCounter* capturesWithInternalAllocs;
+};
+CaptureMetrics captureMetrics;
+
+// Internal-heap blocks held across one capture (fb_get to fb_return). IDF 4.4 has no
+// allocation hooks, so this is the net change in allocated blocks while the capture
+// ran; it should stay at zero, and anything else points at the capture path or a
+// task that allocated concurrently.
+// With the heap profiler built in, the task's own malloc count gives the exact figure.
+struct CaptureAllocProbe {
+  int32_t lastBlocks;
+  int32_t lastBytes;
+  int32_t worstBlocks;
+  uint32_t captures;
+  uint32_t capturesWithAllocs;
+  uint32_t lastGrossAllocs;   // Heap profiler builds only
+};
+CaptureAllocProbe captureAllocs = { 0, 0, 0, 0, 0, 0 };
+
+struct CaptureHeapSample {
+  multi_heap_info_t info;
+  uint32_t taskAllocs;
+};
+
+static void sampleInternalHeap(CaptureHeapSample& sample) {
+  heap_caps_get_info(&sample.info, MALLOC_CAP_INTERNAL);
+  sample.taskAllocs = heapProfiler.getTaskAllocs(xTaskGetCurrentTaskHandle());
+}
+
+static void recordCaptureAllocs(const CaptureHeapSample& before) {
+  CaptureHeapSample after;
+  sampleInternalHeap(after);
+  captureAllocs.lastBlocks = (int32_t)after.info.allocated_blocks - (int32_t)before.info.allocated_blocks;
+  captureAllocs.lastBytes = (int32_t)after.info.total_allocated_bytes - (int32_t)before.info.total_allocated_bytes;
+  captureAllocs.lastGrossAllocs = after.taskAllocs - before.taskAllocs;
+  if (heapProfiler.isActive()) {
+    captureAllocs.lastBlocks = captureAllocs.lastGrossAllocs;
+  }
+  if (captureAllocs.lastBlocks > captureAllocs.worstBlocks) {
+    captureAllocs.worstBlocks = captureAllocs.lastBlocks;
+  }
+  captureAllocs.captures++;
+  captureMetrics.captureInternalBlocks->set(captureAllocs.lastBlocks);
+  if (captureAllocs.lastBlocks != 0) {
+    captureAllocs.capturesWithAllocs++;
+    captureMetrics.capturesWithInternalAllocs->inc();
+  }
+}
+
+// Sampled right before each scrape so the hot paths never pay for them
+void collectSystemMetrics() {
+  captureMetrics.queueDepth->set(photoQueue ? uxQueueMessagesWaiting(photoQueue) : 0);
+  captureMetrics.heapFreeInternal->set(heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+  captureMetrics.heapFreePsram->set(heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+  captureMetrics.heapLargestInternal->set(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+  captureMetrics.heapLargestPsram->set(heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+  captureMetrics.heapMinFreeInternal->set(heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+  captureMetrics.wifiRssi->set(WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+  captureMetrics.uptimeSeconds->set(millis() / 1000);
+
+  UploaderStats uploader = photoUploader.getStats();
+  captureMetrics.uploaderBacklog->set(photoUploader.getBacklog());
+  captureMetrics.uploaderPhotos->store(uploader.photosUploaded);
+  captureMetrics.uploaderBytes->store(uploader.bytesUploaded);
+  captureMetrics.uploaderFailures->store(uploader.failedPosts);
+  captureMetrics.logRecordsDropped->store(deferredLog.getDropped());
+
+  MemoryGovernorStats governor = memoryGovernor.getStats();
+  captureMetrics.memoryPressure->set(memoryGovernor.getLevel());
+  captureMetrics.memoryTransitions->store(governor.transitions);
+  captureMetrics.requestsRejected->store(governor.rejectedRequests);
+}
+
+// Registered once in setup() before any task can update them
+void initMetrics() {
+  captureMetrics.framesCaptured = metrics.counter("camera_frames_captured_total", "Frames returned by the camera driver");
+  captureMetrics.droppedCamera = metrics.counter("camera_frames_dropped_total", "Frames lost before reaching the SD card", "reason=\"camera\"");
+  captureMetrics.droppedSdBusy = metrics.counter("camera_frames_dropped_total", "Frames lost before reaching the SD card", "reason=\"sd_busy\"");
+  captureMetrics.droppedOpenError = metrics.counter("camera_frames_dropped_total", "Frames lost before reaching the SD card", "reason=\"open_error\"");
+  captureMetrics.droppedWriteError = metrics.counter("camera_frames_dropped_total", "Frames lost before reaching the SD card", "reason=\"write_error\"");
+  captureMetrics.skippedLowMemory = metrics.counter("camera_captures_skipped_total", "Capture requests refused before queueing", "reason=\"low_memory\"");
+  captureMetrics.skippedQueueFull = metrics.counter("camera_captures_skipped_total", "Capture requests refused before queueing", "reason=\"queue_full\"");
+  captureMetrics.framesWritten = metrics.counter("camera_frames_written_total", "Photos committed to the SD card");
+  captureMetrics.bytesWritten = metrics.counter("camera_bytes_written_total", "JPEG bytes committed to the SD card");
+  captureMetrics.uploaderPhotos = metrics.counter("camera_uploader_photos_total", "Photos acknowledged by the collector");
+  captureMetrics.uploaderBytes = metrics.counter("camera_uploader_bytes_total", "Bytes uploaded to the collector");
+  captureMetrics.uploaderFailures = metrics.counter("camera_uploader_failures_total", "Failed upload POSTs");
+  captureMetrics.logRecordsDropped = metrics.counter("camera_log_records_dropped_total", "Deferred log records lost to a full ring");
+  captureMetrics.memoryTransitions = metrics.counter("camera_memory_pressure_transitions_total", "Memory governor level changes");
+  captureMetrics.requestsRejected = metrics.counter("camera_http_rejected_total", "Requests refused by the memory governor client cap");
+
+  captureMetrics.sdWriteLatency = metrics.histogram("camera_sd_write_latency_ms", "SD open+write+close time per photo",
+                                                    SD_WRITE_BUCKETS_MS, sizeof(SD_WRITE_BUCKETS_MS) / sizeof(SD_WRITE_BUCKETS_MS[0]));
+
+  captureMetrics.queueDepth = metrics.gauge("camera_capture_queue_depth", "Capture commands waiting for the capture task");
+  captureMetrics.heapFreeInternal = metrics.gauge("camera_heap_free_bytes", "Free heap by region", "region=\"internal\"");
+  captureMetrics.heapFreePsram = metrics.gauge("camera_heap_free_bytes", "Free heap by region", "region=\"psram\"");
+  captureMetrics.heapLargestInternal = metrics.gauge("camera_heap_largest_block_bytes", "Largest free block by region", "region=\"internal\"");
+  captureMetrics.heapLargestPsram = metrics.gauge("camera_heap_largest_block_bytes", "Largest free block by region", "region=\"psram\"");
+  captureMetrics.heapMinFreeInternal = metrics.gauge("camera_heap_min_free_bytes", "Internal heap low-water mark since boot");
+  captureMetrics.wifiRssi = metrics.gauge("camera_wifi_rssi_dbm", "Station RSSI (0 when not connected)");
+  captureMetrics.uptimeSeconds = metrics.gauge("camera_uptime_seconds", "Seconds since boot");
+  captureMetrics.uploaderBacklog = metrics.gauge("camera_uploader_backlog", "Committed photos not yet uploaded");
+  captureMetrics.captureInternalBlocks = metrics.gauge("camera_capture_internal_alloc_blocks", "Internal heap blocks still held after the last capture (target 0)");
+  captureMetrics.capturesWithInternalAllocs = metrics.counter("camera_capture_internal_alloc_events_total", "Captures that changed the internal heap block count");
+  captureMetrics.memoryPressure = metrics.gauge("camera_memory_pressure_level", "Memory governor level (0 normal - 4 emergency)");
+
+  metrics.addCollector(collectSystemMetrics);
+}
+
+// Wraps a route handler with its per-route request counter and latency profiling
+ArRequestHandlerFunction instrumentRoute(const char* route, ArRequestHandlerFunction handler) {
+  static char labels[PROFILER_MAX_ROUTES][48];
+  static uint8_t labelCount = 0;
+  const char* routeLabel = "route=\"other\"";
+  if (labelCount < PROFILER_MAX_ROUTES) {
+    snprintf(labels[labelCount], sizeof(labels[labelCount]), "route=\"%s\"", route);
+    routeLabel = labels[labelCount++];
+  }
+  MetricCounter* requests = metrics.counter("camera_http_requests_total", "HTTP requests by route", routeLabel);
+  ArRequestHandlerFunction timed = requestProfiler.wrap(route, handler);
+  return [requests, timed](AsyncWebServerRequest *request) {
+    requests->inc();
+    // Under memory pressure only a few responses may be in flight at once
+    if (!memoryGovernor.admitRequest(requestProfiler.getInFlight())) {
+      AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Busy - low memory, retry shortly");
+      response->addHeader("Retry-After", "5");
+      request->send(response);
+      return;
+    }
+    timed(request);
+  };
+}
+
+// Single-module status routes: the module writes its JSON straight into a request arena
+template <typename Writer>
+static void sendStatusJson(AsyncWebServerRequest *request, Writer write) {
+  RequestArena* out = requestArenas.acquire(request);
+  if (!out) {
+    RequestArenaPool::sendBusy(request);
+    return;
+  }
+  write(*out);
+  requestArenas.send(request, out, 200, "application/json");
+}
+
+// ===================
+// MEMORY GOVERNOR - graded relief actions, applied in order as pressure rises
+// ===================
+
+// ELEVATED: the uploader's TCP connection and lwIP buffers come from internal RAM
+void reliefPauseUploads(bool active) {
+  photoUploader.setPaused(active);
+}
+
+// ELEVATED: stop re-encoding old photos (two photo-sized PSRAM buffers each)
+void reliefPauseOptimizer(bool active) {
+  photoOptimizer.setPaused(active);
+}
+
+// ELEVATED: stop downsampling old photos (decoded pixels plus two encodes in PSRAM)
+void reliefPauseAging(bool active) {
+  photoAging.setPaused(active);
+}
+
+// ELEVATED: stop copying frames into the PSRAM cache (readers fall back to the SD card)
+void reliefStopFrameCache(bool active) {
+  frameCache.setEnabled(!active);
+}
+
+// CRITICAL: smaller frames and stronger JPEG compression until pressure eases
+void reliefLowerCaptureProfile(bool active) {
+  static framesize_t savedFrameSize = FRAMESIZE_QVGA;
+  static int savedQuality = 20;
+  sensor_t *sensor = esp_camera_sensor_get();
+  if (!cameraReady || !sensor) {
+    return;
+  }
+  if (active) {
+    savedFrameSize = sensor->status.framesize;
+    savedQuality = sensor->status.quality;
+    sensor->set_framesize(sensor, FRAMESIZE_QQVGA);
+    sensor->set_quality(sensor, 30);
+  } else {
+    sensor->set_framesize(sensor, savedFrameSize);
+    sensor->set_quality(sensor, savedQuality);
+  }
+}
+
+void initMemoryGovernor() {
+  memoryGovernor.begin();
+  memoryGovernor.addReliefHandler("pause uploads", MEMORY_ELEVATED, reliefPauseUploads);
+  memoryGovernor.addReliefHandler("stop frame cache", MEMORY_ELEVATED, reliefStopFrameCache);
+  memoryGovernor.addReliefHandler("pause optimizer", MEMORY_ELEVATED, reliefPauseOptimizer);
+  memoryGovernor.addReliefHandler("pause aging", MEMORY_ELEVATED, reliefPauseAging);
+  memoryGovernor.addReliefHandler("lower capture profile", MEMORY_CRITICAL, reliefLowerCaptureProfile);
+}
+
+// Continuous recording: the frame goes into the open AVI segment instead of a
+// photo file. Photo numbers do not advance; /latest serves the frame from RAM.
+static void recordFrame(camera_fb_t* fb) {
+  unsigned long writeStart = millis();
+  if (!aviRecorder.append(fb->buf, fb->len, fb->width, fb->height)) {
+    captureMetrics.droppedWriteError->inc();
+    DLOGW("⚠️ Recording write failed (%zu bytes)", fb->len);
+    return;
+  }
+  captureMetrics.sdWriteLatency->observe(millis() - writeStart);
+  captureMetrics.framesWritten->inc();
+  captureMetrics.bytesWritten->add(fb->len);
+
+  LatestFrameInfo latest;
+  memset(&latest, 0, sizeof(latest));
+  latest.number = photoCount;
+  latest.size = fb->len;
+  latest.capturedMs = millis();
+  time_t now = time(nullptr);
+  latest.unixTime = now > 1600000000 ? (uint32_t)now : 0;
+  latest.cache = frameCache.store(fb->buf, fb->len);
+  latest.storage = latest.cache ? FRAME_STORED_CACHE : 0;
+  latestFrame.publish(latest);
+  bootSequencer.mark("first-photo");
+}
+
 // ===================
 // DUAL-CORE PHOTO CAPTURE TASK (Core 1)
 // ===================
 
 void photoCaptureTask(void * parameter) {
-  Serial.println("📸 Photo capture task started on Core " + String(xPortGetCoreID()));
+  DLOGI("📸 Photo capture task started on Core %d", xPortGetCoreID());
   
   // Set task priority and watchdog
   esp_task_wdt_add(NULL);
@@ -148,65 +476,107 @@ void photoCaptureTask(void * parameter) {
       if (cmd.capture && cameraReady && sdCardReady && !clearingInProgress) {
         
         // Take picture with camera
+        uint32_t grabStart = TraceRecorder::now();
         camera_fb_t * fb = esp_camera_fb_get();
+        traceRecorder.record("esp_camera_fb_get", "camera", grabStart, fb ? fb->len : 0);
         if (!fb) {
-          Serial.println("❌ Camera capture failed on Core " + String(xPortGetCoreID()));
+          captureMetrics.droppedCamera->inc();
+          DLOGE("❌ Camera capture failed");
           continue;
         }
+        captureMetrics.framesCaptured->inc();
+        HEAP_PROFILE_SCOPE("capture");
+        CaptureHeapSample heapBefore;
+        sampleInternalHeap(heapBefore);
         
         // Generate filename with sequential numbering
-        char filename[50];
-        snprintf(filename, sizeof(filename), "/photos/photo_%06lu.jpg", photoCount + 1);
+        char filename[PHOTO_PATH_LEN];
+        PhotoWriter::formatPhotoPath(filename, sizeof(filename), photoCount + 1);
         
         // Use mutex to protect SD card access - IMPROVED MUTEX HANDLING
-        if (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(3000)) == pdTRUE) {
+        if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(3000), "sdMutex") == pdTRUE) {
           
-          // Save to SD card
-          File file = SD_MMC.open(filename, FILE_WRITE);
-          if (file) {
-            size_t bytesWritten = file.write(fb->buf, fb->len);
-            file.close();
+          if (aviRecorder.isRecording()) {
+            recordFrame(fb);
+          } else {
+            // Capture settings go into an APP11 segment, written ahead of the untouched frame
+            time_t now = time(nullptr);
+            uint32_t unixTime = now > 1600000000 ? (uint32_t)now : 0;
+            PhotoMetadata meta;
+            PhotoMetadataFormat::capture(meta, photoCount + 1, unixTime);
+            uint8_t segment[PHOTO_META_MAX];
+            size_t split = PhotoMetadataFormat::insertionOffset(fb->buf, fb->len);
+            size_t segmentLen = split ? PhotoMetadataFormat::buildSegment(segment, sizeof(segment), meta) : 0;
+            PhotoWritePart parts[3] = {{fb->buf, split}, {segment, segmentLen}, {fb->buf + split, fb->len - split}};
+            size_t photoSize = fb->len + segmentLen;
+            
+            // Save to SD card (fixed path buffer, POSIX I/O, preallocated DMA staging)
+            unsigned long writeStart = millis();
+            int bytesWritten = photoWriter.writeParts(filename, parts, 3);
+            if (bytesWritten >= 0) {
+              captureMetrics.sdWriteLatency->observe(millis() - writeStart);
             
-            if (bytesWritten == fb->len) {
-              // Update shared variables (protected by mutex)
-              lastPhotoFilename = String(filename);
-              photoCount++; // Increment photo count on successful save
-              Serial.printf("📸 Photo saved: %s (Size: %zu bytes) on Core %d\n", 
-                          filename, fb->len, xPortGetCoreID());
+              if ((size_t)bytesWritten == photoSize) {
+                captureMetrics.framesWritten->inc();
+                captureMetrics.bytesWritten->add(photoSize);
+                // Update shared variables (protected by mutex)
+                photoCount++; // Increment photo count on successful save
+              
+                // Publish the new frame for the web handlers on core 0 (lock-free)
+                LatestFrameInfo latest;
+                memset(&latest, 0, sizeof(latest));
+                latest.number = photoCount;
+                latest.size = photoSize;
+                latest.capturedMs = millis();
+                latest.unixTime = unixTime;
+                latest.cache = frameCache.store(parts, 3);
+                latest.storage = FRAME_STORED_SD | (latest.cache ? FRAME_STORED_CACHE : 0);
+                strncpy(latest.path, filename, sizeof(latest.path));
+                latestFrame.publish(latest);
+                photoIndex.append(photoCount, photoSize, latest.unixTime);
+                eventBroadcaster.publish(EVENT_PHOTO, "{\"n\":%lu,\"size\":%u,\"ts\":%lu,\"url\":\"%s?v=%u\"}",
+                                         photoCount, (unsigned)photoSize, (unsigned long)latest.unixTime, filename,
+                                         (unsigned)photoSize);
+                bootSequencer.mark("first-photo");
+                photoUploader.notifyCommitted(photoCount);
+                DLOGI("📸 Photo saved: /photos/photo_%06lu.jpg (Size: %zu bytes)", photoCount, photoSize);
+              } else {
+                captureMetrics.droppedWriteError->inc();
+                DLOGW("⚠️ Write incomplete: %d/%zu bytes to /photos/photo_%06lu.jpg",
+                      bytesWritten, photoSize, photoCount + 1);
+              }
             } else {
-              Serial.printf("⚠️ Write incomplete: %zu/%zu bytes to %s\n", 
-                          bytesWritten, fb->len, filename);
+              captureMetrics.droppedOpenError->inc();
+              DLOGE("❌ Failed to open file: /photos/photo_%06lu.jpg", photoCount + 1);
             }
-          } else {
-            Serial.printf("❌ Failed to open file: %s on Core %d\n", filename, xPortGetCoreID());
           }
           
           // Release mutex - CRITICAL!
           xSemaphoreGive(sdMutex);
           
         } else {
-          Serial.println("⚠️ Could not acquire SD mutex on Core " + String(xPortGetCoreID()));
+          captureMetrics.droppedSdBusy->inc();
+          DLOGW("⚠️ Could not acquire SD mutex");
         }
         
         // Always return frame buffer
         esp_camera_fb_return(fb);
+        recordCaptureAllocs(heapBefore);
         
         // 🧹 AGGRESSIVE MEMORY CLEANUP AFTER EACH PHOTO
         yield();
         esp_task_wdt_reset();
         
-        // Check memory after photo capture
-        int photoHeap = ESP.getFreeHeap();
-        if (photoHeap < 40000) {
-          Serial.printf("⚠️ Low memory after photo: %d bytes - forcing cleanup\n", photoHeap);
-          delay(100); // Give system time to recover
-          yield();
+        // Back off while the memory governor reports serious pressure
+        if (memoryGovernor.getLevel() >= MEMORY_CRITICAL) {
+          DLOGW("⚠️ Memory pressure after photo - backing off");
+          vTaskDelay(pdMS_TO_TICKS(100));
         }
         
         // 🚀 QUEUE MANAGEMENT - Process faster when queue is getting full
         UBaseType_t queueSpaces = uxQueueSpacesAvailable(photoQueue);
         if (queueSpaces < 5) {
-          Serial.printf("🚀 Queue management: %d spaces left - processing faster\n", queueSpaces);
+          DLOGD("🚀 Queue management: %d spaces left - processing faster", queueSpaces);
           vTaskDelay(pdMS_TO_TICKS(5)); // Reduce delay to process faster
         } else {
           vTaskDelay(pdMS_TO_TICKS(10)); // Normal delay
@@ -226,7 +596,6 @@ void photoCaptureTask(void * parameter) {
 // ===================
 
 // EMBEDDED OPTIMIZATIONS - Treat like tiny device
-#define MIN_HEAP_FOR_PHOTO 20000  // Reduced to 20KB for embedded
 #define MIN_QUEUE_SPACES 2         // Reduced queue spaces
 #define PHOTO_TASK_STACK 8192      // Reduced stack size
 #define PHOTO_QUEUE_SIZE 5         // Reduced queue size
@@ -236,29 +605,18 @@ bool capturePhoto() {
     return false;
   }
   
-  // Check system health (improved memory management)
-  int freeHeap = ESP.getFreeHeap();
-  int minFreeHeap = ESP.getMinFreeHeap();
-  
-  // More aggressive memory management
-  if (freeHeap < MIN_HEAP_FOR_PHOTO) {
-    Serial.printf("⚠️ Low memory (%d bytes, min: %d) - skipping photo capture\n", freeHeap, minFreeHeap);
-    
-    // 🧹 FORCE MEMORY RECOVERY WHEN CRITICALLY LOW
-    if (freeHeap < 25000) { // Very low memory
-      Serial.println("🚨 CRITICAL: Forcing memory recovery...");
-      forceMemoryRecovery();
-      
-      Serial.printf("🧹 Memory after recovery: %d bytes\n", ESP.getFreeHeap());
-    }
-    
+  // Capture is paused by the memory governor at EMERGENCY level (free + largest block per region)
+  if (!memoryGovernor.allowCapture()) {
+    captureMetrics.skippedLowMemory->inc();
+    DLOGW("⚠️ Memory pressure %s - skipping photo capture", MemoryGovernor::levelName(memoryGovernor.getLevel()));
     return false;
   }
   
   // Check if queue is getting full
   UBaseType_t queueSpaces = uxQueueSpacesAvailable(photoQueue);
   if (queueSpaces < MIN_QUEUE_SPACES) {
-    Serial.printf("⚠️ Queue nearly full (%d spaces left) - skipping photo capture\n", queueSpaces);
+    captureMetrics.skippedQueueFull->inc();
+    DLOGW("⚠️ Queue nearly full (%d spaces left) - skipping photo capture", queueSpaces);
     return false;
   }
   
@@ -266,49 +624,18 @@ bool capturePhoto() {
   PhotoCommand cmd;
   cmd.capture = true;
   cmd.timestamp = millis() / 1000;
-  cmd.photoNumber = photoCount + 1;  // This will be the actual photo number
+  cmd.photoNumber = latestFrame.getNumber() + 1;  // This will be the actual photo number
   
   // Send command to photo capture task with timeout
   if (xQueueSend(photoQueue, &cmd, pdMS_TO_TICKS(200)) == pdTRUE) {
     return true;
   } else {
-    Serial.printf("⚠️ Could not send photo command to Core 1 (queue full: %d spaces)\n", queueSpaces);
+    captureMetrics.skippedQueueFull->inc();
+    DLOGW("⚠️ Could not send photo command to Core 1 (queue full: %d spaces)", queueSpaces);
     return false;
   }
 }
 
-// Memory recovery function
-void forceMemoryRecovery() {
-  Serial.println("🧹 FORCING COMPREHENSIVE MEMORY RECOVERY...");
-  
-  // Step 1: Clear all large string objects
-  lastPhotoFilename = "";
-  yield();
-  delay(100);
-  
-  // Step 2: Force garbage collection
-  esp_task_wdt_reset();
-  yield();
-  delay(200);
-  
-  // Step 3: Check if we need to restart web server - REMOVED TO AVOID MUTEX CONFLICTS
-  int heapAfterCleanup = ESP.getFreeHeap();
-  if (heapAfterCleanup < 20000) {
-    Serial.println("🚨 CRITICAL: Memory still low after cleanup - forcing SD sync...");
-    
-    // SAFER: Force SD card filesystem sync instead of web server restart
-    if (sdCardReady) {
-      Serial.println("💾 Forcing SD card filesystem sync...");
-      // Don't restart SD card - just sync
-      yield();
-      delay(500);
-    }
-  }
-  
-  int finalHeap = ESP.getFreeHeap();
-  Serial.printf("🧹 Memory recovery complete: %d bytes free\n", finalHeap);
-}
-
 bool initSDCard() {
   Serial.println("💾 Initializing SD card for ESP32-S3-WROOM CAM...");
   
@@ -358,6 +685,9 @@ bool initSDCard() {
   if (!sdSuccess) {
     Serial.println("🔧 Method 2: SPI SD Card (alternative pins)...");
     
+    // The SPI fallback pins overlap the camera bus - let camera init finish first
+    bootSequencer.waitFor(bootStepCamera, pdMS_TO_TICKS(15000));
+    
     // Freenove ESP32-S3 SPI SD card pins (common configuration)
     #define SD_CS_PIN    5   // CS pin for SPI SD card
     #define SD_MOSI_PIN  23  // MOSI pin
@@ -478,106 +808,303 @@ bool testSDCard() {
   return false;
 }
 
-void setup() {
-  Serial.begin(115200);
-  delay(1000);
-  
-  Serial.println("=== ESP32-S3 CLEAN TEST ===");
-  Serial.println("🚀 Step 1: ESP32-S3 started!");
-  Serial.printf("📊 Chip: %s, Rev: %d, CPU: %dMHz\n", ESP.getChipModel(), ESP.getChipRevision(), ESP.getCpuFreqMHz());
-  Serial.printf("💾 Free Heap: %d bytes\n", ESP.getFreeHeap());
-  
-  // Step 2: Check PSRAM
-  Serial.println("🧠 Step 2: Checking PSRAM...");
-  if (psramFound()) {
-    Serial.printf("✅ PSRAM: %d MB available\n", ESP.getPsramSize() / 1024 / 1024);
-  } else {
-    Serial.println("❌ PSRAM: Not detected");
-  }
-  
-  // Step 3: Initialize WiFi Access Point
-  Serial.println("📡 Step 3: Starting WiFi Access Point...");
+// ===================
+// PARALLEL BOOT STEPS - each runs as its own task under BootSequencer
+// ===================
+
+bool bootStartWiFi() {
+  Serial.println("📡 Starting WiFi Access Point...");
   WiFi.mode(WIFI_AP);
-  WiFi.softAP(AP_SSID, AP_PASSWORD);
+  if (!WiFi.softAP(AP_SSID, AP_PASSWORD)) {
+    Serial.println("❌ WiFi AP failed to start");
+    return false;
+  }
   Serial.printf("✅ WiFi AP: %s\n", AP_SSID);
   Serial.printf("📱 IP Address: %s\n", WiFi.softAPIP().toString().c_str());
   Serial.printf("🔑 Password: %s\n", AP_PASSWORD);
   
-  // Step 4: Initialize FreeRTOS components for dual-core
-  Serial.println("🔧 Step 4: Initializing dual-core architecture...");
-  
-  // Create queue for photo commands (increased size for better memory management)
-  photoQueue = xQueueCreate(PHOTO_QUEUE_SIZE, sizeof(PhotoCommand));
-  if (photoQueue == NULL) {
-    Serial.println("❌ Failed to create photo queue");
-    return;
+  // Also join the saved network, if any; reconnects happen in the background
+  // and never block the capture pipeline
+  wifiManager.begin();
+  WiFiConfig savedConfig = wifiManager.getCurrentConfig();
+  if (savedConfig.isValid()) {
+    Serial.printf("🔗 Joining saved network '%s' in the background...\n", savedConfig.ssid.c_str());
+    wifiManager.startConnect(savedConfig);
   }
-  
-  // Create mutex for SD card access
-  sdMutex = xSemaphoreCreateMutex();
-  if (sdMutex == NULL) {
-    Serial.println("❌ Failed to create SD mutex");
-    return;
+  return true;
+}
+
+bool bootStartCamera() {
+  Serial.println("📷 Initializing camera...");
+  cameraReady = initCamera();
+  if (cameraReady) {
+    Serial.println("✅ Camera initialization successful!");
+  } else {
+    Serial.println("❌ Camera initialization failed - continuing without camera");
   }
-  
-  // Create photo capture task on Core 1 (increased stack for memory management)
-  xTaskCreatePinnedToCore(
-    photoCaptureTask,    // Task function
-    "PhotoCapture",      // Task name
-    PHOTO_TASK_STACK,    // Stack size (bytes) - DOUBLED for memory management
-    NULL,                // Task parameters
-    2,                   // Task priority (0-24, higher = more priority)
-    &photoTaskHandle,    // Task handle
-    1                    // Core ID (1 for Core 1)
-  );
-  
-  if (photoTaskHandle == NULL) {
-    Serial.println("❌ Failed to create photo capture task");
-    return;
+  return cameraReady;
+}
+
+bool bootStartSDCard() {
+  Serial.println("💾 Initializing SD card storage...");
+  bool mounted = initSDCard();
+  if (mounted) {
+    Serial.println("✅ SD card initialization successful!");
+    // Continue numbering after the newest photo on the card instead of overwriting from #1
+    photoOptimizer.begin(sdMutex);
+    photoAging.begin(sdMutex);
+    photoIndex.rebuild();
+    photoCount = photoIndex.getLastNumber();
+    latestFrame.publishStored(photoCount);
+    thumbnailer.begin(sdMutex);
+    aviRecorder.begin(sdMutex);
+    photoUploader.begin(sdMutex);
+    photoOptimizer.start();
+    photoAging.start();
+  } else {
+    Serial.println("❌ SD card initialization failed - continuing without storage");
   }
+  sdCardReady = mounted;   // Capture starts only once numbering is known
+  eventBroadcaster.publish(EVENT_SD, "{\"ready\":%s,\"photos\":%lu}", mounted ? "true" : "false",
+                           (unsigned long)photoIndex.getCount());
+  return sdCardReady;
+}
+
+bool bootStartWebServer() {
+  Serial.println("🌐 Starting web server...");
   
-  Serial.println("✅ Dual-core architecture initialized");
-  
-  // Step 5: Start web server (Core 0)
-  Serial.println("🌐 Step 5: Starting web server...");
-  
-  // Route for ULTRA-MINIMAL main page
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-    String html = "<!DOCTYPE html><html><head><title>ESP32 Camera</title>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<style>body{font-family:Arial;margin:10px;}";
-    html += ".status{background:#f0f0f0;padding:10px;margin:10px 0;}";
-    html += ".btn{display:inline-block;padding:8px 16px;background:#4CAF50;color:white;text-decoration:none;margin:5px;}";
-    html += ".photo{max-width:100%;height:auto;margin:10px 0;}";
-    html += "</style></head><body>";
-    html += "<h1>ESP32 Camera</h1>";
-    
-    html += "<div class='status'>";
-    html += "<strong>Status:</strong> " + String(cameraReady ? "Ready" : "Not Ready") + "<br>";
-    html += "<strong>SD:</strong> " + String(sdCardReady ? "Ready" : "Not Ready") + "<br>";
-    html += "<strong>Photos:</strong> " + String(photoCount) + "<br>";
-    html += "<strong>Memory:</strong> " + String(ESP.getFreeHeap()) + " bytes<br>";
-    html += "<strong>Uptime:</strong> " + String(millis() / 1000) + "s";
-    html += "</div>";
-    
-    if (lastPhotoFilename.length() > 0 && cameraReady && sdCardReady) {
-      html += "<img src='" + lastPhotoFilename + "' class='photo' alt='Latest Photo'>";
+  // Main page: a static shell from flash; its values come from /api/status and /events
+  server.on("/", HTTP_GET, instrumentRoute("/", [](AsyncWebServerRequest *request){
+    bootSequencer.mark("first-http-response");
+    WebAssets::send(request, "/");
+  }));
+
+  // Shared stylesheet and the main page script (linked with ?v=<hash>, cached for good)
+  server.on("/app.css", HTTP_GET, instrumentRoute("/app.css", [](AsyncWebServerRequest *request){
+    WebAssets::send(request, "/app.css");
+  }));
+  server.on("/app.js", HTTP_GET, instrumentRoute("/app.js", [](AsyncWebServerRequest *request){
+    WebAssets::send(request, "/app.js");
+  }));
+
+  // Route for the main page's dynamic values (JSON)
+  server.on("/api/status", HTTP_GET, instrumentRoute("/api/status", [](AsyncWebServerRequest *request){
+    RequestArena* json = requestArenas.acquire(request);
+    if (!json) {
+      RequestArenaPool::sendBusy(request);
+      return;
     }
-    
-    html += "<br><a href='/gallery' class='btn'>View Latest Photos</a>";
-    html += "<a href='/clear-photos' class='btn' style='background:#f44336;'>Clear Photos</a>";
-    html += "<a href='/diagnostics' class='btn' style='background:#9C27B0;'>Diagnostics</a>";
-    html += "<a href='/format-sd' class='btn' style='background:#FF5722;'>⚠️ Format SD Card</a>";
-    
-    html += "</body></html>";
-    request->send(200, "text/html", html);
+    LatestFrameInfo latest = latestFrame.read();
+    json->appendf("{\"camera\":%s,\"sd\":%s,\"photos\":%lu,\"free_heap\":%lu,\"memory\":\"%s\",\"uptime\":%lu,\"rssi\":%d,\"latest\":",
+                  cameraReady ? "true" : "false", sdCardReady ? "true" : "false",
+                  (unsigned long)latest.number, (unsigned long)ESP.getFreeHeap(),
+                  MemoryGovernor::levelName(memoryGovernor.getLevel()), millis() / 1000,
+                  WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+    if (latest.path[0] != '\0') {
+      char url[PHOTO_PATH_LEN + 16];
+      if (latest.size) {
+        PhotoHttp::formatPhotoUrl(url, sizeof(url), latest.number, latest.size);
+      } else {
+        snprintf(url, sizeof(url), "%s", latest.path);
+      }
+      json->appendf("{\"n\":%lu,\"size\":%lu,\"url\":\"%s\"}}", (unsigned long)latest.number,
+                    (unsigned long)latest.size, url);
+    } else {
+      json->print("null}");
+    }
+    requestArenas.send(request, json, 200, "application/json");
+  }));
+
+  // Route to serve individual photos from SD card. Numbered photos never change, so
+  // they carry strong validators and repeat views are answered from the index.
+  server.addHandler(new PrefixRequestHandler("/photos/", instrumentRoute("/photos/*", [](AsyncWebServerRequest *request){
+    const char* path = request->url().c_str();
+    uint32_t number = PhotoHttp::parsePhotoPath(path);
+    PhotoEntry photo;
+    if (number && photoIndex.find(number, photo)) {
+      char etag[PHOTO_ETAG_LEN];
+      PhotoHttp::formatETag(etag, sizeof(etag), 'p', photo.number, photo.size);
+      if (PhotoHttp::sendNotModified(request, etag, PHOTO_CACHE_IMMUTABLE)) {
+        return;
+      }
+      uint32_t modified = (photo.flags & PHOTO_FLAG_TIME_ESTIMATED) ? 0 : photo.timestamp;
+      PhotoHttp::sendFile(request, path, "image/jpeg", etag, modified, PHOTO_CACHE_IMMUTABLE);
+      return;
+    }
+    // Not in the index (copied on by hand, or the index is full): plain file, revalidated
+    if (!sdCardReady) {
+      request->send(404, "text/plain", "Photo not found");
+      return;
+    }
+    PhotoHttp::sendFile(request, path, "", nullptr, 0, PHOTO_CACHE_REVALIDATE);
+  })));
+
+  // Newest photo. Revalidated on every view, but an unchanged photo costs a 304
+  // decided from RAM, and a fresh one is usually served from the frame cache.
+  server.on("/latest", HTTP_GET, instrumentRoute("/latest", [](AsyncWebServerRequest *request){
+    LatestFrameInfo latest = latestFrame.read();
+    uint32_t size = latest.size;
+    uint32_t modified = latest.unixTime;
+    PhotoEntry photo;
+    if (latest.number != 0 && size == 0 && photoIndex.find(latest.number, photo)) {
+      size = photo.size;     // Published from the index at boot or after a clear
+      modified = (photo.flags & PHOTO_FLAG_TIME_ESTIMATED) ? 0 : photo.timestamp;
+    }
+    if (latest.storage == FRAME_STORED_CACHE) {
+      // Recorded frame: only in RAM (and inside the open AVI segment)
+      char etag[PHOTO_ETAG_LEN];
+      PhotoHttp::formatETag(etag, sizeof(etag), 'f', latest.capturedMs, latest.size);
+      if (PhotoHttp::sendNotModified(request, etag, PHOTO_CACHE_REVALIDATE) ||
+          PhotoHttp::sendCached(request, latest.cache, "image/jpeg", etag, modified, PHOTO_CACHE_REVALIDATE)) {
+        return;
+      }
+      request->send(404, "text/plain", "Frame no longer cached");
+      return;
+    }
+    if (latest.number == 0 || size == 0) {
+      request->send(404, "text/plain", "No photo available");
+      return;
+    }
+    char etag[PHOTO_ETAG_LEN];
+    PhotoHttp::formatETag(etag, sizeof(etag), 'p', latest.number, size);
+    if (PhotoHttp::sendNotModified(request, etag, PHOTO_CACHE_REVALIDATE)) {
+      return;
+    }
+    if ((latest.storage & FRAME_STORED_CACHE) &&
+        PhotoHttp::sendCached(request, latest.cache, "image/jpeg", etag, modified, PHOTO_CACHE_REVALIDATE)) {
+      return;
+    }
+    PhotoHttp::sendFile(request, latest.path, "image/jpeg", etag, modified, PHOTO_CACHE_REVALIDATE);
+  }));
+
+  // Photo list as JSON, paged by cursor and optionally limited to a time range.
+  // Answered from the in-memory index and streamed, so large pages cost no RAM.
+  server.on("/api/photos", HTTP_GET, instrumentRoute("/api/photos", [](AsyncWebServerRequest *request){
+    PhotoListQuery query;
+    query.cursor = request->hasParam("cursor") ? strtoul(request->getParam("cursor")->value().c_str(), nullptr, 10) : 0;
+    query.limit = PHOTO_LIST_DEFAULT_LIMIT;
+    if (request->hasParam("limit")) {
+      query.limit = strtoul(request->getParam("limit")->value().c_str(), nullptr, 10);
+      if (query.limit < 1) query.limit = 1;
+      if (query.limit > PHOTO_LIST_MAX_LIMIT) query.limit = PHOTO_LIST_MAX_LIMIT;
+    }
+    query.from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+    query.to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : 0;
+    query.ascending = request->hasParam("order") && request->getParam("order")->value() == "asc";
+    request->send(photoIndex.beginListResponse(request, query));
+  }));
+
+  // One photo as JSON with the capture settings from its APP11 segment: /api/photo?n=N.
+  // "meta" is null for photos written before the segment existed.
+  server.on("/api/photo", HTTP_GET, instrumentRoute("/api/photo", [](AsyncWebServerRequest *request){
+    uint32_t number = request->hasParam("n") ? strtoul(request->getParam("n")->value().c_str(), nullptr, 10) : 0;
+    PhotoEntry photo;
+    if (!sdCardReady || number == 0 || !photoIndex.find(number, photo)) {
+      request->send(404, "text/plain", "Photo not found");
+      return;
+    }
+    // A photo's bytes never change under its number and size, nor does its metadata
+    char etag[PHOTO_ETAG_LEN];
+    PhotoHttp::formatETag(etag, sizeof(etag), 'm', photo.number, photo.size);
+    if (PhotoHttp::sendNotModified(request, etag, PHOTO_CACHE_IMMUTABLE)) {
+      return;
+    }
+    char meta[PHOTO_META_MAX];
+    if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(1000), "sdMutex") != pdTRUE) {
+      request->send(503, "text/plain", "SD card busy - try again");
+      return;
+    }
+    bool found = PhotoMetadataFormat::readFromFile(number, meta, sizeof(meta));
+    xSemaphoreGive(sdMutex);
+
+    char json[PHOTO_META_MAX + 192];
+    snprintf(json, sizeof(json),
+             "{\"n\":%lu,\"size\":%lu,\"ts\":%lu,\"url\":\"/photos/photo_%06lu.jpg?v=%lu\","
+             "\"thumb\":\"/thumb?n=%lu&v=%lu\",\"flags\":%lu,\"tier\":%u,\"meta\":%s}",
+             (unsigned long)photo.number, (unsigned long)photo.size, (unsigned long)photo.timestamp,
+             (unsigned long)photo.number, (unsigned long)photo.size, (unsigned long)photo.number,
+             (unsigned long)photo.size, (unsigned long)photo.flags, (unsigned)photoTier(photo),
+             found ? meta : "null");
+    AsyncWebServerResponse* response = request->beginResponse(200, "application/json", json);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", PHOTO_CACHE_IMMUTABLE);
+    request->send(response);
+  }));
+
+  // Route for bulk download: /export?from=&to=&format=tar|zip (unix times, both optional)
+  server.on("/export", HTTP_GET, instrumentRoute("/export", [](AsyncWebServerRequest *request){
+    if (!sdCardReady) {
+      request->send(503, "text/plain", "SD card not ready");
+      return;
+    }
+    photoExport.handleRequest(request);
+  }));
+
+  // Route for time-lapse review: /timelapse.avi?from=&to=&fps=&stride= (MJPEG AVI of the stored photos)
+  server.on("/timelapse.avi", HTTP_GET, instrumentRoute("/timelapse.avi", [](AsyncWebServerRequest *request){
+    if (!sdCardReady) {
+      request->send(503, "text/plain", "SD card not ready");
+      return;
+    }
+    photoExport.handleTimelapse(request);
+  }));
+
+  // Recorded segments: /recordings/rec_000001.avi, with ranges so players can seek.
+  // The open segment keeps growing until it is finalized, so none are cached.
+  server.addHandler(new PrefixRequestHandler(RECORDER_DIR "/", instrumentRoute(RECORDER_DIR "/*", [](AsyncWebServerRequest *request){
+    const char* path = request->url().c_str();
+    uint32_t number;
+    if (!sdCardReady || !AviRecorder::parseSegmentNumber(path + strlen(RECORDER_DIR "/"), number)) {
+      request->send(404, "text/plain", "Recording not found");
+      return;
+    }
+    PhotoHttp::sendFile(request, path, "video/x-msvideo", nullptr, 0, PHOTO_CACHE_REVALIDATE);
+  })));
+
+  // Server-Sent Events: photo, job, SD and memory-pressure updates. Not instrumented -
+  // the stream stays open for as long as the page does, and counting it as in flight
+  // would eat into the governor's client cap under pressure.
+  server.on("/events", HTTP_GET, [](AsyncWebServerRequest *request){
+    eventBroadcaster.handleRequest(request);
   });
 
-  // Route to serve individual photos from SD card
-  server.serveStatic("/photos/", SD_MMC, "/photos/");
+  // Small preview of one photo, made on first request and cached on the card. It is
+  // made on the thumbnail task; until then the client is asked to retry.
+  server.on("/thumb", HTTP_GET, instrumentRoute("/thumb", [](AsyncWebServerRequest *request){
+    uint32_t number = request->hasParam("n") ? strtoul(request->getParam("n")->value().c_str(), nullptr, 10) : 0;
+    PhotoEntry photo;
+    if (!sdCardReady || !photoIndex.find(number, photo)) {
+      request->send(404, "text/plain", "Photo not found");
+      return;
+    }
+    // The thumbnail is derived from the photo, so the photo's size identifies it too
+    char etag[PHOTO_ETAG_LEN];
+    PhotoHttp::formatETag(etag, sizeof(etag), 't', photo.number, photo.size);
+    if (PhotoHttp::sendNotModified(request, etag, PHOTO_CACHE_IMMUTABLE)) {
+      return;
+    }
+    char path[PHOTO_PATH_LEN];
+    uint32_t modified = (photo.flags & PHOTO_FLAG_TIME_ESTIMATED) ? 0 : photo.timestamp;
+    ThumbState state = thumbnailer.request(photo, path, sizeof(path));
+    if (state == THUMB_PENDING) {
+      AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Thumbnail in progress");
+      response->addHeader("Retry-After", THUMB_RETRY_AFTER);
+      response->addHeader("Cache-Control", PHOTO_CACHE_NONE);
+      request->send(response);
+      return;
+    }
+    if (state == THUMB_UNAVAILABLE) {
+      // Fall back to the full photo so the gallery still shows something, but
+      // never let it be cached under the thumbnail URL
+      PhotoWriter::formatPhotoPath(path, sizeof(path), number);
+      PhotoHttp::sendFile(request, path, "image/jpeg", nullptr, modified, PHOTO_CACHE_NONE);
+      return;
+    }
+    PhotoHttp::sendFile(request, path, "image/jpeg", etag, modified, PHOTO_CACHE_IMMUTABLE);
+  }));
 
   // Route for SEQUENTIAL photo gallery with EFFICIENT PAGINATION
-  server.on("/gallery", HTTP_GET, [](AsyncWebServerRequest *request){
+  server.on("/gallery", HTTP_GET, instrumentRoute("/gallery", [](AsyncWebServerRequest *request){
     unsigned long startTime = millis();
     
     // Get pagination parameters
@@ -595,138 +1122,122 @@ void setup() {
       if (perPage > 12) perPage = 12; // Can handle more now
     }
     
-    // 🚨 CRITICAL: PAUSE PHOTO CAPTURE DURING GALLERY LOADING
-    Serial.println("🔄 Gallery loading - pausing photo capture...");
-    clearingInProgress = true;
-    delay(200);
+    // Pages come from the in-memory photo index, so capture keeps running and the
+    // card is not touched; numbering may have gaps after a partial clear
     
-    // ENHANCED HTML with pagination controls
-    String html = "<!DOCTYPE html><html><head><title>Photo Gallery</title>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<style>";
-    html += "body{font-family:Arial;margin:10px;}";
-    html += ".photo{display:inline-block;margin:5px;border:1px solid #ccc;border-radius:5px;}";
-    html += ".photo img{width:150px;height:100px;object-fit:cover;border-radius:3px;}";
-    html += ".info{font-size:10px;padding:5px;background:#f9f9f9;}";
-    html += ".nav{text-align:center;margin:10px 0;}";
-    html += ".nav a{padding:8px 16px;background:#4CAF50;color:white;text-decoration:none;margin:2px;border-radius:3px;}";
-    html += ".nav span{padding:8px 16px;background:#2196F3;color:white;margin:2px;border-radius:3px;}";
-    html += ".nav .disabled{padding:8px 16px;background:#ccc;color:#666;margin:2px;border-radius:3px;}";
-    html += ".page-info{text-align:center;margin:10px 0;font-weight:bold;}";
-    html += ".per-page{text-align:center;margin:10px 0;}";
-    html += ".per-page select{padding:5px;margin:0 5px;}";
-    html += "</style></head><body>";
-    html += "<h2>Photo Gallery</h2>";
-    html += "<div class='nav'>";
-    html += "<a href='/'>← Back to Main</a>";
-    html += "<a href='/clear-photos' style='background:#f44336;'>Clear Photos</a>";
-    html += "<a href='/format-sd' style='background:#FF5722;'>⚠️ Format SD</a>";
-    html += "</div>";
+    // ENHANCED HTML with pagination controls, built in the request arena
+    RequestArena* html = requestArenas.acquire(request);
+    if (!html) {
+      RequestArenaPool::sendBusy(request);
+      return;
+    }
+    html->appendf("<!DOCTYPE html><html><head><title>Photo Gallery</title>"
+                "<meta name='viewport' content='width=device-width, initial-scale=1'>"
+                "<link rel='stylesheet' href='%s'>"
+                "</head><body class='gallery'>"
+                "<h2>Photo Gallery</h2>"
+                "<div class='nav'>"
+                "<a href='/'>← Back to Main</a>"
+                "<a href='/clear-photos' style='background:#f44336;'>Clear Photos</a>"
+                "<a href='/format-sd' style='background:#FF5722;'>⚠️ Format SD</a>"
+                "<a href='/export?format=zip' style='background:#2196F3;'>Download All (ZIP)</a>"
+                "<a href='/timelapse.avi?fps=10' style='background:#9C27B0;'>Time-lapse (AVI)</a>"
+                "</div>", WebAssets::url("/app.css"));
     
     int photosDisplayed = 0;
     int startPhoto = (page - 1) * perPage;
+    unsigned long totalPhotos = photoIndex.getCount();   // Snapshot; capture keeps running on core 1
     
     // Calculate total pages
-    int totalPages = (photoCount > 0) ? ((photoCount + perPage - 1) / perPage) : 1;
+    int totalPages = (totalPhotos > 0) ? ((totalPhotos + perPage - 1) / perPage) : 1;
     
     // Show page info
-    html += "<div class='page-info'>";
-    html += "Page " + String(page) + " of " + String(totalPages) + " | Total Photos: " + String(photoCount);
-    html += "</div>";
+    html->appendf("<div class='page-info'>Page %d of %d | Total Photos: %lu</div>", page, totalPages, totalPhotos);
     
     // Per-page selector
-    html += "<div class='per-page'>";
-    html += "<label>Photos per page: </label>";
-    html += "<select onchange='changePerPage(this.value)'>";
-    html += "<option value='4'" + String(perPage == 4 ? " selected" : "") + ">4 photos</option>";
-    html += "<option value='6'" + String(perPage == 6 ? " selected" : "") + ">6 photos</option>";
-    html += "<option value='8'" + String(perPage == 8 ? " selected" : "") + ">8 photos</option>";
-    html += "<option value='10'" + String(perPage == 10 ? " selected" : "") + ">10 photos</option>";
-    html += "<option value='12'" + String(perPage == 12 ? " selected" : "") + ">12 photos</option>";
-    html += "</select>";
-    html += "</div>";
+    html->print("<div class='per-page'>"
+                "<label>Photos per page: </label>"
+                "<select onchange='changePerPage(this.value)'>");
+    for (int option = 4; option <= 12; option += 2) {
+      html->appendf("<option value='%d'%s>%d photos</option>", option, perPage == option ? " selected" : "", option);
+    }
+    html->print("</select>"
+                "</div>"
+                "<script>"
+                "function changePerPage(value) {"
+                "  window.location.href = '/gallery?page=1&per_page=' + value;"
+                "}"
+                // /thumb answers 503 while the thumbnail is being made
+                "function thumbRetry(img) {"
+                "  var n = +(img.dataset.retry || 0);"
+                "  if (n >= 8) return;"
+                "  img.dataset.retry = n + 1;"
+                "  setTimeout(function() { img.src = img.src.replace(/&r=\\d+|$/, '&r=' + (n + 1)); }, 1000 * (n + 1));"
+                "}"
+                "</script>");
     
-    html += "<script>";
-    html += "function changePerPage(value) {";
-    html += "  window.location.href = '/gallery?page=1&per_page=' + value;";
-    html += "}";
-    html += "</script>";
+    // Newest first, skipping the earlier pages
+    PhotoEntry* photos = (PhotoEntry*)html->alloc(perPage * sizeof(PhotoEntry));
+    uint32_t found = photos ? photoIndex.copyNewest(startPhoto, photos, perPage) : 0;
     
-    // SEQUENTIAL PHOTO LOADING - Try each photo number
-    if (sdCardReady) {
-      if (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(2000)) == pdTRUE) {
-        html += "<div style='text-align:center;'>";
-        
-        // SIMPLIFIED: Just show photos without file existence checks
-        for (int i = 0; i < perPage && i < photoCount; i++) {
-          unsigned long photoNumber = photoCount - startPhoto - i;
-          if (photoNumber <= 0) break;
-          
-          char filename[50];
-          snprintf(filename, sizeof(filename), "/photos/photo_%06lu.jpg", photoNumber);
-          
-          String photoPath = String(filename);
-          
-          html += "<div class='photo'>";
-          html += "<img src='" + photoPath + "' alt='Photo " + String(photoNumber) + "'>";
-          html += "<div class='info'>Photo " + String(photoNumber) + "</div>";
-          html += "</div>";
-          
-          photosDisplayed++;
-          yield();
-          esp_task_wdt_reset();
-        }
-        
-        html += "</div>";
-        
-        // Enhanced pagination controls
-        if (photoCount > perPage) {
-          html += "<div class='nav'>";
-          
-          // Previous page
-          if (page > 1) {
-            html += "<a href='/gallery?page=" + String(page - 1) + "&per_page=" + String(perPage) + "'>← Previous " + String(perPage) + "</a>";
-          } else {
-            html += "<span class='disabled'>← Previous " + String(perPage) + "</span>";
-          }
-          
-          // Current page indicator
-          html += "<span>Page " + String(page) + "</span>";
-          
-          // Next page
-          if (page < totalPages) {
-            html += "<a href='/gallery?page=" + String(page + 1) + "&per_page=" + String(perPage) + "'>Next " + String(perPage) + " →</a>";
-          } else {
-            html += "<span class='disabled'>Next " + String(perPage) + " →</span>";
-          }
-          
-          html += "</div>";
-        }
-        
-        xSemaphoreGive(sdMutex);
+    html->print("<div style='text-align:center;'>");
+    for (uint32_t i = 0; i < found; i++) {
+      char url[PHOTO_PATH_LEN + 16];
+      PhotoHttp::formatPhotoUrl(url, sizeof(url), photos[i].number, photos[i].size);
+      
+      html->appendf("<div class='photo'><a href='%s'><img src='/thumb?n=%lu&v=%lu' loading='lazy' onerror='thumbRetry(this)' alt='Photo %lu'></a>"
+                    "<div class='info'>Photo %lu</div></div>",
+                    url, (unsigned long)photos[i].number, (unsigned long)photos[i].size,
+                    (unsigned long)photos[i].number, (unsigned long)photos[i].number);
+      photosDisplayed++;
+    }
+    html->print("</div>");
+    
+    // Enhanced pagination controls
+    if (totalPhotos > perPage) {
+      html->print("<div class='nav'>");
+      
+      // Previous page
+      if (page > 1) {
+        html->appendf("<a href='/gallery?page=%d&per_page=%d'>← Previous %d</a>", page - 1, perPage, perPage);
+      } else {
+        html->appendf("<span class='disabled'>← Previous %d</span>", perPage);
       }
+      
+      // Current page indicator
+      html->appendf("<span>Page %d</span>", page);
+      
+      // Next page
+      if (page < totalPages) {
+        html->appendf("<a href='/gallery?page=%d&per_page=%d'>Next %d →</a>", page + 1, perPage, perPage);
+      } else {
+        html->appendf("<span class='disabled'>Next %d →</span>", perPage);
+      }
+      
+      html->print("</div>");
     }
     
     if (photosDisplayed == 0) {
-      html += "<p>No photos yet</p>";
+      html->print("<p>No photos yet</p>");
     }
     
-    html += "</body></html>";
-    
-    // Send response and cleanup
-    request->send(200, "text/html", html);
-    html = "";
+    html->print("</body></html>");
     
-    // Resume photo capture
-    clearingInProgress = false;
-    Serial.printf("📸 Sequential gallery: %d photos (page %d) in %lu ms\n", photosDisplayed, page, millis() - startTime);
-  });
+    // Send straight from the arena; it is recycled once the response has gone out
+    requestArenas.send(request, html, 200, "text/html");
+    Serial.printf("📸 Gallery: %d photos (page %d) in %lu ms\n", photosDisplayed, page, millis() - startTime);
+  }));
 
   // Route to clear ALL photos from SD card - WATCHDOG-SAFE BATCH PROCESSING
-  server.on("/clear-photos", HTTP_GET, [](AsyncWebServerRequest *request){
+  server.on("/clear-photos", HTTP_GET, instrumentRoute("/clear-photos", [](AsyncWebServerRequest *request){
     int deletedCount = 0;
     unsigned long startTime = millis();
     
+    RequestArena* html = requestArenas.acquire(request);
+    if (!html) {
+      RequestArenaPool::sendBusy(request);
+      return;
+    }
     Serial.println("🗑️ Starting WATCHDOG-SAFE photo deletion...");
     clearingInProgress = true; // Pause photo capture during clearing
     
@@ -734,7 +1245,7 @@ void setup() {
     delay(500); // Reduced delay
     
     // Acquire mutex for clearing operation
-    if (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(5000)) == pdTRUE) { // Reduced timeout
+    if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(5000), "sdMutex") == pdTRUE) { // Reduced timeout
       Serial.println("🔒 SD mutex acquired for clearing");
       
       if (sdCardReady) {
@@ -742,20 +1253,28 @@ void setup() {
         if (root) {
           File file = root.openNextFile();
           int batchCount = 0;
+          uint32_t deletedNumbers[50];   // Photo numbers to drop from the index
+          uint32_t deletedPhotos = 0;
           
           while (file) {
             // WATCHDOG-SAFE: Process in small batches
             if (!file.isDirectory()) {
-              String fullPath = "/photos/" + String(file.name());
-              String fileName = String(file.name());
+              char fullPath[8 + 256];    // FAT long names run to 255 characters
+              snprintf(fullPath, sizeof(fullPath), "/photos/%s", file.name());
+              const char* fileName = fullPath + strlen("/photos/");
               file.close();
               
               // Delete the file
               if (SD_MMC.remove(fullPath)) {
                 deletedCount++;
-                Serial.printf("🗑️ Deleted: %s (%d)\n", fileName.c_str(), deletedCount);
+                unsigned long number = 0;
+                if (sscanf(fileName, "photo_%lu.jpg", &number) == 1 && deletedPhotos < 50) {
+                  deletedNumbers[deletedPhotos++] = number;
+                  Thumbnailer::remove(number);
+                }
+                Serial.printf("🗑️ Deleted: %s (%d)\n", fileName, deletedCount);
               } else {
-                Serial.printf("⚠️ Failed to delete: %s\n", fileName.c_str());
+                Serial.printf("⚠️ Failed to delete: %s\n", fileName);
               }
               
               batchCount++;
@@ -786,11 +1305,12 @@ void setup() {
           }
           root.close();
           
-          // Update photo counter
-          photoCount = (photoCount > deletedCount) ? (photoCount - deletedCount) : 0;
-          if (photoCount == 0) {
-            lastPhotoFilename = "";
-          }
+          // Numbering resumes after the newest photo left; gaps below it stay gaps
+          photoIndex.removeBatch(deletedNumbers, deletedPhotos);
+          photoCount = photoIndex.getLastNumber();
+          latestFrame.publishStored(photoCount);
+          eventBroadcaster.publish(EVENT_JOB, "{\"job\":\"clear\",\"done\":%d,\"remaining\":%lu}",
+                                   deletedCount, (unsigned long)photoIndex.getCount());
           
           Serial.printf("✅ WATCHDOG-SAFE Clear: %d files deleted in %lu ms\n", 
                        deletedCount, millis() - startTime);
@@ -807,31 +1327,32 @@ void setup() {
       
     } else {
       Serial.println("⚠️ Could not acquire SD mutex for clearing - operation cancelled");
+      clearingInProgress = false;
       request->send(503, "text/plain", "⚠️ SD card busy - try again in a few seconds");
+      return;
     }
     
-    String message = "Cleared " + String(deletedCount) + " files from SD card. ";
-    if (photoCount > 0) {
-      message += "Click 'Clear Photos' again to delete remaining " + String(photoCount) + " files.";
+    unsigned long remaining = photoIndex.getCount();
+    html->appendf("<html><head><meta http-equiv='refresh' content='3;url=/'></head><body>"
+                  "<h2>Photos Cleared!</h2><p>Cleared %d files from SD card. ", deletedCount);
+    if (remaining > 0) {
+      html->appendf("Click 'Clear Photos' again to delete remaining %lu files.</p>", remaining);
     } else {
-      message += "All files deleted!";
+      html->print("All files deleted!</p>");
     }
-    
-    String html = "<html><head><meta http-equiv='refresh' content='3;url=/'></head><body>";
-    html += "<h2>Photos Cleared!</h2><p>" + message + "</p>";
-    html += "<p>✅ Deleted " + String(deletedCount) + " files successfully.</p>";
-    if (photoCount > 0) {
-      html += "<p><strong>Note:</strong> Batch limit reached. Click 'Clear Photos' again to delete remaining files.</p>";
+    html->appendf("<p>✅ Deleted %d files successfully.</p>", deletedCount);
+    if (remaining > 0) {
+      html->print("<p><strong>Note:</strong> Batch limit reached. Click 'Clear Photos' again to delete remaining files.</p>");
     }
-    html += "</body></html>";
+    html->print("</body></html>");
     
     clearingInProgress = false; // Resume photo capture
     Serial.printf("🗑️ User cleared %d files (watchdog-safe)\n", deletedCount);
-    request->send(200, "text/html", html);
-  });
+    requestArenas.send(request, html, 200, "text/html");
+  }));
 
   // Route to manually refresh SD card filesystem - PROPER MUTEX HANDLING
-  server.on("/refresh-sd", HTTP_GET, [](AsyncWebServerRequest *request){
+  server.on("/refresh-sd", HTTP_GET, instrumentRoute("/refresh-sd", [](AsyncWebServerRequest *request){
     Serial.println("🔄 Manual SD card refresh requested...");
     
     // Pause photo capture during refresh
@@ -842,7 +1363,7 @@ void setup() {
     delay(1000);
     
     // Try to acquire mutex with timeout - PROPER MUTEX HANDLING
-    if (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(5000)) == pdTRUE) {
+    if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(5000), "sdMutex") == pdTRUE) {
       Serial.println("🔒 SD mutex acquired for refresh");
       
       // End SD_MMC safely
@@ -852,17 +1373,19 @@ void setup() {
       // Restart SD_MMC with proper configuration
       if (SD_MMC.begin("/sdcard", true, false)) {
         Serial.println("✅ SD card manually refreshed");
+        eventBroadcaster.publish(EVENT_SD, "{\"ready\":true,\"refreshed\":true}");
         
-        String html = "<html><head><meta http-equiv='refresh' content='2;url=/'></head><body>";
-        html += "<h2>SD Card Refreshed!</h2>";
-        html += "<p>File system cache cleared. Photos should now be current.</p>";
-        html += "<p>Redirecting to main page...</p>";
-        html += "</body></html>";
-        
-        request->send(200, "text/html", html);
+        // Fixed page, sent from flash without a copy
+        request->send_P(200, "text/html",
+                        "<html><head><meta http-equiv='refresh' content='2;url=/'></head><body>"
+                        "<h2>SD Card Refreshed!</h2>"
+                        "<p>File system cache cleared. Photos should now be current.</p>"
+                        "<p>Redirecting to main page...</p>"
+                        "</body></html>");
       } else {
         Serial.println("❌ Failed to refresh SD card");
         sdCardReady = false;
+        eventBroadcaster.publish(EVENT_SD, "{\"ready\":false}");
         request->send(500, "text/plain", "❌ Failed to refresh SD card - check serial monitor");
       }
       
@@ -879,39 +1402,42 @@ void setup() {
     if (wasCapturing) {
       clearingInProgress = false;
     }
-  });
+  }));
 
   // Route to format SD card - ACTUAL FORMAT WITH FILE DELETION
-  server.on("/format-sd", HTTP_GET, [](AsyncWebServerRequest *request){
+  server.on("/format-sd", HTTP_GET, instrumentRoute("/format-sd", [](AsyncWebServerRequest *request){
+    RequestArena* html = requestArenas.acquire(request);
+    if (!html) {
+      RequestArenaPool::sendBusy(request);
+      return;
+    }
     Serial.println("🔄 Starting ACTUAL SD card format process...");
     
     // 🚨 CRITICAL: PAUSE PHOTO CAPTURE DURING FORMAT
     clearingInProgress = true; // Pause photo capture during formatting
     delay(1000); // Wait for any ongoing operations
     
-    String html = "<html><head><title>Formatting SD Card</title>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<style>body{font-family:Arial;margin:20px;text-align:center;}";
-    html += ".status{background:#fff3cd;border:1px solid #ffeaa7;padding:20px;border-radius:5px;margin:20px 0;}";
-    html += ".btn{padding:10px 20px;background:#4CAF50;color:white;text-decoration:none;border-radius:5px;margin:10px;}";
-    html += "</style></head><body>";
-    html += "<h2>SD Card Format</h2>";
+    html->appendf("<html><head><title>Formatting SD Card</title>"
+                  "<meta name='viewport' content='width=device-width, initial-scale=1'>"
+                  "<link rel='stylesheet' href='%s'>"
+                  "</head><body class='format'>"
+                  "<h2>SD Card Format</h2>", WebAssets::url("/app.css"));
     
     if (sdCardReady) {
-      html += "<div class='status'>";
-      html += "<h3>⚠️ WARNING: This will delete ALL files on the SD card!</h3>";
-      html += "<p>This action cannot be undone.</p>";
-      html += "<p>Photo capture is paused during formatting.</p>";
-      html += "</div>";
+      html->print("<div class='status'>"
+                  "<h3>⚠️ WARNING: This will delete ALL files on the SD card!</h3>"
+                  "<p>This action cannot be undone.</p>"
+                  "<p>Photo capture is paused during formatting.</p>"
+                  "</div>");
       
       // Acquire mutex for formatting operation
-      if (xSemaphoreTake(sdMutex, pdMS_TO_TICKS(15000)) == pdTRUE) { // Increased timeout
+      if (traceSemaphoreTake(sdMutex, pdMS_TO_TICKS(15000), "sdMutex") == pdTRUE) { // Increased timeout
         Serial.println("🔒 SD mutex acquired for formatting");
         
-        html += "<div class='status'>";
-        html += "<h3>🔄 Formatting SD Card...</h3>";
-        html += "<p>Please wait, this may take a few seconds...</p>";
-        html += "</div>";
+        html->print("<div class='status'>"
+                    "<h3>🔄 Formatting SD Card...</h3>"
+                    "<p>Please wait, this may take a few seconds...</p>"
+                    "</div>");
         
         int deletedCount = 0;
         
@@ -925,14 +1451,14 @@ void setup() {
             File file = photosDir.openNextFile();
             while (file) {
               if (!file.isDirectory()) {
-                String fullPath = "/photos/" + String(file.name());
-                String fileName = String(file.name());
+                char fullPath[8 + 256];  // FAT long names run to 255 characters
+                snprintf(fullPath, sizeof(fullPath), "/photos/%s", file.name());
                 file.close();
                 
                 // Delete the file
                 if (SD_MMC.remove(fullPath)) {
                   deletedCount++;
-                  Serial.printf("🗑️ Deleted: %s (%d)\n", fileName.c_str(), deletedCount);
+                  Serial.printf("🗑️ Deleted: %s (%d)\n", fullPath + strlen("/photos/"), deletedCount);
                 }
                 
                 // Yield every 5 files
@@ -955,20 +1481,27 @@ void setup() {
           }
         }
         
+        // Cached thumbnails go with the photos
+        deletedCount += Thumbnailer::removeAll();
+        
+        // And recordings, with the open segment closed first
+        aviRecorder.closeSegment();
+        deletedCount += AviRecorder::removeAll();
+        
         // Then, delete all files in the root directory
         File root = SD_MMC.open("/");
         if (root) {
           File file = root.openNextFile();
           while (file) {
             if (!file.isDirectory()) {
-              String fullPath = "/" + String(file.name());
-              String fileName = String(file.name());
+              char fullPath[1 + 256];
+              snprintf(fullPath, sizeof(fullPath), "/%s", file.name());
               file.close();
               
               // Delete the file
               if (SD_MMC.remove(fullPath)) {
                 deletedCount++;
-                Serial.printf("🗑️ Deleted: %s (%d)\n", fileName.c_str(), deletedCount);
+                Serial.printf("🗑️ Deleted: %s (%d)\n", fullPath + 1, deletedCount);
               }
               
               // Yield every 5 files
@@ -1012,23 +1545,31 @@ void setup() {
           }
           
           // Reset photo counter
+          SD_MMC.mkdir("/photos");
+          thumbnailer.begin(sdMutex);
+          aviRecorder.begin(sdMutex);
+          photoOptimizer.reset();
+          photoAging.reset();
+          photoIndex.clear();
           photoCount = 0;
-          lastPhotoFilename = "";
+          latestFrame.publishStored(0);
+          eventBroadcaster.publish(EVENT_SD, "{\"ready\":true,\"formatted\":true,\"photos\":0}");
           
-          html += "<div class='status' style='background:#d4edda;border-color:#c3e6cb;'>";
-          html += "<h3>✅ SD Card Formatted Successfully!</h3>";
-          html += "<p>Deleted " + String(deletedCount) + " files before format.</p>";
-          html += "<p>All files have been removed.</p>";
-          html += "<p>Photo counter reset to 0.</p>";
-          html += "<p>Photo capture will resume automatically.</p>";
-          html += "</div>";
+          html->appendf("<div class='status' style='background:#d4edda;border-color:#c3e6cb;'>"
+                        "<h3>✅ SD Card Formatted Successfully!</h3>"
+                        "<p>Deleted %d files before format.</p>"
+                        "<p>All files have been removed.</p>"
+                        "<p>Photo counter reset to 0.</p>"
+                        "<p>Photo capture will resume automatically.</p>"
+                        "</div>", deletedCount);
           
         } else {
           Serial.println("❌ SD card reinitialization failed");
-          html += "<div class='status' style='background:#f8d7da;border-color:#f5c6cb;'>";
-          html += "<h3>❌ SD Card Format Failed</h3>";
-          html += "<p>Please check the SD card and try again.</p>";
-          html += "</div>";
+          eventBroadcaster.publish(EVENT_SD, "{\"ready\":false}");
+          html->print("<div class='status' style='background:#f8d7da;border-color:#f5c6cb;'>"
+                      "<h3>❌ SD Card Format Failed</h3>"
+                      "<p>Please check the SD card and try again.</p>"
+                      "</div>");
         }
         
         // Release mutex
@@ -1037,141 +1578,488 @@ void setup() {
         
       } else {
         Serial.println("⚠️ Could not acquire SD mutex for formatting");
-        html += "<div class='status' style='background:#f8d7da;border-color:#f5c6cb;'>";
-        html += "<h3>⚠️ SD Card Busy</h3>";
-        html += "<p>Please try again in a few seconds.</p>";
-        html += "</div>";
+        html->print("<div class='status' style='background:#f8d7da;border-color:#f5c6cb;'>"
+                    "<h3>⚠️ SD Card Busy</h3>"
+                    "<p>Please try again in a few seconds.</p>"
+                    "</div>");
       }
       
     } else {
-      html += "<div class='status' style='background:#f8d7da;border-color:#f5c6cb;'>";
-      html += "<h3>❌ SD Card Not Ready</h3>";
-      html += "<p>Cannot format - SD card not detected.</p>";
-      html += "</div>";
+      html->print("<div class='status' style='background:#f8d7da;border-color:#f5c6cb;'>"
+                  "<h3>❌ SD Card Not Ready</h3>"
+                  "<p>Cannot format - SD card not detected.</p>"
+                  "</div>");
     }
     
-    html += "<div style='margin:20px 0;'>";
-    html += "<a href='/' class='btn'>← Back to Main</a>";
-    html += "<a href='/gallery' class='btn'>View Gallery</a>";
-    html += "</div>";
-    html += "</body></html>";
+    html->print("<div style='margin:20px 0;'>"
+                "<a href='/' class='btn'>← Back to Main</a>"
+                "<a href='/gallery' class='btn'>View Gallery</a>"
+                "</div>"
+                "</body></html>");
     
     // Resume photo capture
     clearingInProgress = false;
     Serial.println("🔄 Photo capture RESUMED after SD format");
     
-    request->send(200, "text/html", html);
-  });
+    requestArenas.send(request, html, 200, "text/html");
+  }));
 
   // Route for system diagnostics
-  server.on("/diagnostics", HTTP_GET, [](AsyncWebServerRequest *request){
-    String html = "<html><head><title>ESP32-S3 Diagnostics</title></head><body>";
-    html += "<h1>System Diagnostics</h1>";
-    html += "<h2>Memory Status</h2>";
-    html += "<p><strong>Free Heap:</strong> " + String(ESP.getFreeHeap()) + " bytes</p>";
-    html += "<p><strong>Min Free Heap:</strong> " + String(ESP.getMinFreeHeap()) + " bytes</p>";
-    html += "<p><strong>Heap Size:</strong> " + String(ESP.getHeapSize()) + " bytes</p>";
-    html += "<h2>System Status</h2>";
-    html += "<p><strong>Uptime:</strong> " + String(millis() / 1000) + " seconds</p>";
-    html += "<p><strong>WiFi Clients:</strong> " + String(WiFi.softAPgetStationNum()) + "</p>";
-    html += "<p><strong>Camera:</strong> " + String(cameraReady ? "✅ Ready" : "❌ Failed") + "</p>";
-    html += "<p><strong>SD Card:</strong> " + String(sdCardReady ? "✅ Ready" : "❌ Failed") + "</p>";
-    html += "<p><strong>Photos Count:</strong> " + String(photoCount) + "</p>";
-    html += "<p><strong>Clearing In Progress:</strong> " + String(clearingInProgress ? "Yes" : "No") + "</p>";
-    html += "<h2>Dual-Core Status</h2>";
-    html += "<p><strong>Photo Task:</strong> " + String(photoTaskHandle != NULL ? "✅ Running on Core 1" : "❌ Not Running") + "</p>";
-    html += "<p><strong>Web Server:</strong> ✅ Running on Core 0</p>";
-    html += "<p><strong>Current Core:</strong> " + String(xPortGetCoreID()) + "</p>";
-    html += "<h2>SD Card Info</h2>";
+  // ?format=json returns the task sampler (CPU share, stack headroom, per-core idle) as JSON
+  server.on("/diagnostics", HTTP_GET, instrumentRoute("/diagnostics", [](AsyncWebServerRequest *request){
+    RequestArena* out = requestArenas.acquire(request);
+    if (!out) {
+      RequestArenaPool::sendBusy(request);
+      return;
+    }
+    if (request->hasParam("format") && request->getParam("format")->value() == "json") {
+      LatestFrameInfo latest = latestFrame.read();
+      out->appendf("{\"uptime\":%lu,\"free_heap\":%lu,\"min_free_heap\":%lu,\"free_psram\":%lu,\"photo_count\":%lu",
+                   millis() / 1000, (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(),
+                   (unsigned long)ESP.getFreePsram(), (unsigned long)latest.number);
+      out->appendf(",\"latest_frame\":{\"number\":%lu,\"size\":%lu,\"captured_ms\":%lu,\"unix_time\":%lu,"
+                   "\"path\":\"%s\",\"cached\":%s,\"version\":%lu,\"read_retries\":%lu}",
+                   (unsigned long)latest.number, (unsigned long)latest.size, (unsigned long)latest.capturedMs,
+                   (unsigned long)latest.unixTime, latest.path,
+                   (latest.storage & FRAME_STORED_CACHE) ? "true" : "false",
+                   (unsigned long)latestFrame.getVersion(), (unsigned long)latestFrame.getRetries());
+      // Each module still renders its own status object
+      out->print(",\"photo_index\":");
+      photoIndex.writeStatusJson(*out);
+      out->print(",\"thumbnails\":");
+      thumbnailer.writeStatusJson(*out);
+      out->print(",\"events\":");
+      eventBroadcaster.writeStatusJson(*out);
+      out->print(",\"frame_cache\":");
+      frameCache.writeStatusJson(*out);
+      out->print(",\"sd_readahead\":");
+      sdReadAhead.writeStatusJson(*out);
+      out->print(",\"web_assets\":");
+      WebAssets::writeStatusJson(*out);
+      out->print(",\"export\":");
+      photoExport.writeStatusJson(*out);
+      out->print(",\"recorder\":");
+      aviRecorder.writeStatusJson(*out);
+      out->print(",\"optimizer\":");
+      photoOptimizer.writeStatusJson(*out);
+      out->print(",\"aging\":");
+      photoAging.writeStatusJson(*out);
+      out->appendf(",\"capture_internal_allocs\":{\"last_blocks\":%ld,\"last_bytes\":%ld,\"worst_blocks\":%ld,"
+                   "\"captures\":%lu,\"captures_with_allocs\":%lu,\"exact\":%s}",
+                   (long)captureAllocs.lastBlocks, (long)captureAllocs.lastBytes,
+                   (long)captureAllocs.worstBlocks, (unsigned long)captureAllocs.captures,
+                   (unsigned long)captureAllocs.capturesWithAllocs, heapProfiler.isActive() ? "true" : "false");
+      out->appendf(",\"photo_writer\":{\"direct_bytes\":%llu}", (unsigned long long)photoWriter.getDirectBytes());
+      out->print(",\"request_arenas\":");
+      requestArenas.writeStatusJson(*out);
+      out->print(",\"scheduler\":");
+      taskMonitor.writeJson(*out);
+      out->print("}");
+      requestArenas.send(request, out, 200, "application/json");
+      return;
+    }
+
+    WiFiLinkStats wifiStats = wifiManager.getStats();
+    out->appendf("<html><head><title>ESP32-S3 Diagnostics</title></head><body>"
+                 "<h1>System Diagnostics</h1>"
+                 "<h2>Memory Status</h2>"
+                 "<p><strong>Free Heap:</strong> %lu bytes</p>"
+                 "<p><strong>Min Free Heap:</strong> %lu bytes</p>"
+                 "<p><strong>Heap Size:</strong> %lu bytes</p>"
+                 "<p><strong>Capture Heap Allocations:</strong> %ld blocks last capture, %lu of %lu captures allocated</p>",
+                 (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(), (unsigned long)ESP.getHeapSize(),
+                 (long)captureAllocs.lastBlocks, (unsigned long)captureAllocs.capturesWithAllocs,
+                 (unsigned long)captureAllocs.captures);
+    out->appendf("<h2>System Status</h2>"
+                 "<p><strong>Uptime:</strong> %lu seconds</p>"
+                 "<p><strong>WiFi Clients:</strong> %d</p>",
+                 millis() / 1000, (int)WiFi.softAPgetStationNum());
+    if (wifiManager.isConnected()) {
+      IPAddress ip = WiFi.localIP();
+      out->appendf("<p><strong>Station:</strong> ✅ %u.%u.%u.%u</p>", ip[0], ip[1], ip[2], ip[3]);
+    } else {
+      out->print("<p><strong>Station:</strong> ❌ Not connected</p>");
+    }
+    out->appendf("<p><strong>Station Outages:</strong> %lu (%lu ms total)</p>"
+                 "<p><strong>Last Association:</strong> %lu ms (%lu/%lu fast)</p>"
+                 "<p><strong>Camera:</strong> %s</p>"
+                 "<p><strong>SD Card:</strong> %s</p>"
+                 "<p><strong>Photos Count:</strong> %lu</p>"
+                 "<p><strong>Clearing In Progress:</strong> %s</p>",
+                 (unsigned long)wifiStats.outages, (unsigned long)wifiStats.totalOutageMs,
+                 (unsigned long)wifiStats.lastConnectMs, (unsigned long)wifiStats.fastConnects,
+                 (unsigned long)wifiStats.connects, cameraReady ? "✅ Ready" : "❌ Failed",
+                 sdCardReady ? "✅ Ready" : "❌ Failed", (unsigned long)latestFrame.getNumber(),
+                 clearingInProgress ? "Yes" : "No");
+    out->appendf("<h2>Dual-Core Status</h2>"
+                 "<p><strong>Photo Task:</strong> %s</p>"
+                 "<p><strong>Web Server:</strong> ✅ Running on Core 0</p>"
+                 "<p><strong>Current Core:</strong> %d</p>"
+                 "<h2>Tasks</h2>",
+                 photoTaskHandle != NULL ? "✅ Running on Core 1" : "❌ Not Running", (int)xPortGetCoreID());
+    taskMonitor.writeTaskTableHtml(*out);
+    out->print("<p><a href='/diagnostics?format=json'>JSON with history</a></p>"
+               "<h2>SD Card Info</h2>");
     if (sdCardReady) {
       uint64_t cardSize = SD_MMC.cardSize() / (1024 * 1024);
       uint64_t usedBytes = SD_MMC.usedBytes() / (1024 * 1024);
       uint64_t totalBytes = SD_MMC.totalBytes() / (1024 * 1024);
-      html += "<p><strong>Card Size:</strong> " + String((uint32_t)cardSize) + " MB</p>";
-      html += "<p><strong>Used Space:</strong> " + String((uint32_t)usedBytes) + " MB</p>";
-      html += "<p><strong>Total Space:</strong> " + String((uint32_t)totalBytes) + " MB</p>";
+      out->appendf("<p><strong>Card Size:</strong> %lu MB</p>"
+                   "<p><strong>Used Space:</strong> %lu MB</p>"
+                   "<p><strong>Total Space:</strong> %lu MB</p>",
+                   (unsigned long)cardSize, (unsigned long)usedBytes, (unsigned long)totalBytes);
     } else {
-      html += "<p>SD Card not available</p>";
+      out->print("<p>SD Card not available</p>");
     }
-    html += "<p><a href='/'>← Back to Main</a> | <a href='/gallery'>View Gallery</a></p>";
-    html += "</body></html>";
-    request->send(200, "text/html", html);
-  });
+    out->print("<p><a href='/'>← Back to Main</a> | <a href='/gallery'>View Gallery</a></p>"
+               "</body></html>");
+    requestArenas.send(request, out, 200, "text/html");
+  }));
+
+  // Route to request a one-shot camera calibration (runs on the next boot)
+  server.on("/calibrate-camera", HTTP_GET, instrumentRoute("/calibrate-camera", [](AsyncWebServerRequest *request){
+    cameraTuner.requestCalibration();
+    
+    RequestArena* page = requestArenas.acquire(request);
+    if (page) {
+      page->print("<html><head><meta http-equiv='refresh' content='90;url=/camera-tuning'></head><body>"
+                  "<h2>Camera Calibration</h2>"
+                  "<p>The device will restart and benchmark every XCLK / frame buffer / grab mode combination.</p>"
+                  "<p>This takes about a minute. Results will be shown at <a href='/camera-tuning'>/camera-tuning</a>.</p>"
+                  "</body></html>");
+      requestArenas.send(request, page, 200, "text/html");
+    } else {
+      RequestArenaPool::sendBusy(request);
+    }
+    
+    // Restart from loop() once the response has been sent
+    calibrationRestartTime = millis() + 2000;
+  }));
+
+  // Route for current camera tuning and the results of this boot's calibration run
+  server.on("/camera-tuning", HTTP_GET, instrumentRoute("/camera-tuning", [](AsyncWebServerRequest *request){
+    sendStatusJson(request, [](Print& out) { cameraTuner.writeStatusJson(out); });
+  }));
+
+  // Route for station WiFi setup (form posts to /save)
+  server.on("/wifi", HTTP_GET, instrumentRoute("/wifi", [](AsyncWebServerRequest *request){
+    WebAssets::send(request, "/wifi");
+  }));
+
+  // Route to save station credentials and start connecting (AP stays up)
+  server.on("/save", HTTP_POST, instrumentRoute("/save", [](AsyncWebServerRequest *request){
+    if (!request->hasParam("ssid", true) || !request->hasParam("password", true)) {
+      request->send(400, "text/plain; charset=utf-8", "Missing SSID or password");
+      return;
+    }
+    
+    WiFiConfig newConfig;
+    newConfig.ssid = request->getParam("ssid", true)->value();
+    newConfig.password = request->getParam("password", true)->value();
+    
+    wifiManager.saveConfig(newConfig);
+    wifiManager.startConnect(newConfig);
+    RequestArena* page = requestArenas.acquire(request);
+    if (!page) {
+      RequestArenaPool::sendBusy(request);
+      return;
+    }
+    HTMLTemplates::writeConnectingPage(*page, newConfig.ssid.c_str());
+    requestArenas.send(request, page, 200, "text/html; charset=utf-8");
+  }));
+
+  // Route for station link state, association timing and outage counters (JSON)
+  server.on("/wifi-status", HTTP_GET, instrumentRoute("/wifi-status", [](AsyncWebServerRequest *request){
+    sendStatusJson(request, [](Print& out) { wifiManager.writeStatusJson(out); });
+  }));
+
+  // Route for uploader status; ?url=http://host:port/path, ?batch=N, ?enabled=0|1 configure it
+  server.on("/uploader", HTTP_GET, instrumentRoute("/uploader", [](AsyncWebServerRequest *request){
+    if (request->hasParam("url")) {
+      if (!photoUploader.setCollectorUrl(request->getParam("url")->value())) {
+        request->send(400, "text/plain", "Invalid collector URL - expected http://host[:port]/path");
+        return;
+      }
+    }
+    if (request->hasParam("batch")) {
+      photoUploader.setBatchSize(request->getParam("batch")->value().toInt());
+    }
+    if (request->hasParam("enabled")) {
+      photoUploader.setEnabled(request->getParam("enabled")->value().toInt() != 0);
+    }
+    sendStatusJson(request, [](Print& out) { photoUploader.writeStatusJson(out); });
+  }));
+
+  // Route for continuous recording status; ?enabled=0|1 starts or stops it,
+  // ?minutes=N and ?mb=N set the segment rotation, ?fps=N the playback rate
+  server.on("/recorder", HTTP_GET, instrumentRoute("/recorder", [](AsyncWebServerRequest *request){
+    if (request->hasParam("minutes") || request->hasParam("mb") || request->hasParam("fps")) {
+      RecorderConfig config = aviRecorder.getConfig();
+      aviRecorder.setLimits(
+        request->hasParam("minutes") ? request->getParam("minutes")->value().toInt() : config.segmentMinutes,
+        request->hasParam("mb") ? request->getParam("mb")->value().toInt() : config.segmentMB,
+        request->hasParam("fps") ? request->getParam("fps")->value().toInt() : config.fps);
+    }
+    if (request->hasParam("enabled")) {
+      if (!sdCardReady) {
+        request->send(503, "text/plain", "SD card not ready");
+        return;
+      }
+      if (!aviRecorder.setEnabled(request->getParam("enabled")->value().toInt() != 0)) {
+        request->send(503, "text/plain", "SD card busy - try again");
+        return;
+      }
+    }
+    sendStatusJson(request, [](Print& out) { aviRecorder.writeStatusJson(out); });
+  }));
+
+  // Route for the background Huffman optimizer status; ?enabled=0|1 turns it off or on
+  server.on("/optimizer", HTTP_GET, instrumentRoute("/optimizer", [](AsyncWebServerRequest *request){
+    if (request->hasParam("enabled")) {
+      photoOptimizer.setEnabled(request->getParam("enabled")->value().toInt() != 0);
+    }
+    sendStatusJson(request, [](Print& out) { photoOptimizer.writeStatusJson(out); });
+  }));
+
+  // Route for tiered aging status and policy:
+  // ?enabled=0|1&half_hours=&eighth_hours=&budget_kbps= (0 hours turns a tier off)
+  server.on("/aging", HTTP_GET, instrumentRoute("/aging", [](AsyncWebServerRequest *request){
+    if (request->hasParam("enabled")) {
+      photoAging.setEnabled(request->getParam("enabled")->value().toInt() != 0);
+    }
+    if (request->hasParam("half_hours") || request->hasParam("eighth_hours") || request->hasParam("budget_kbps")) {
+      AgingConfig config = photoAging.getConfig();
+      if (request->hasParam("half_hours")) {
+        config.halfAfterHours = constrain(request->getParam("half_hours")->value().toInt(), 0, 65535);
+      }
+      if (request->hasParam("eighth_hours")) {
+        config.eighthAfterHours = constrain(request->getParam("eighth_hours")->value().toInt(), 0, 65535);
+      }
+      if (request->hasParam("budget_kbps")) {
+        config.budgetKBps = constrain(request->getParam("budget_kbps")->value().toInt(), 1, 4096);
+      }
+      photoAging.setConfig(config);
+    }
+    sendStatusJson(request, [](Print& out) { photoAging.writeStatusJson(out); });
+  }));
+
+  // Route for per-step boot timing (JSON)
+  server.on("/boot-profile", HTTP_GET, instrumentRoute("/boot-profile", [](AsyncWebServerRequest *request){
+    sendStatusJson(request, [](Print& out) { bootSequencer.writeProfileJson(out); });
+  }));
+
+  // Memory governor state and tuning (JSON)
+  // ?region=internal|dma|psram&kind=free|largest&values=a,b,c,d sets thresholds (ELEVATED..EMERGENCY)
+  // ?recovery=percent, ?max_clients=n, ?reset=1
+  server.on("/memory", HTTP_GET, instrumentRoute("/memory", [](AsyncWebServerRequest *request){
+    if (request->hasParam("reset")) {
+      memoryGovernor.resetThresholds();
+    }
+    if (request->hasParam("region") && request->hasParam("kind") && request->hasParam("values")) {
+      if (!memoryGovernor.setThreshold(request->getParam("region")->value(),
+                                       request->getParam("kind")->value(),
+                                       request->getParam("values")->value())) {
+        request->send(400, "application/json", "{\"error\":\"expected region, kind and four descending values\"}");
+        return;
+      }
+    }
+    if (request->hasParam("recovery") &&
+        !memoryGovernor.setRecoveryPercent(request->getParam("recovery")->value().toInt())) {
+      request->send(400, "application/json", "{\"error\":\"recovery must be 0-100\"}");
+      return;
+    }
+    if (request->hasParam("max_clients") &&
+        !memoryGovernor.setMaxClients(request->getParam("max_clients")->value().toInt())) {
+      request->send(400, "application/json", "{\"error\":\"max_clients must be 1-255\"}");
+      return;
+    }
+    sendStatusJson(request, [](Print& out) { memoryGovernor.writeStatusJson(out); });
+  }));
+
+  // Per-route time-to-first-byte / total latency histograms (JSON)
+  server.on("/route-latency", HTTP_GET, instrumentRoute("/route-latency", [](AsyncWebServerRequest *request){
+    request->send(200, "application/json", requestProfiler.getRoutesJson());
+  }));
+
+  // Slowest recent requests with their parameters (JSON); ?threshold=ms adjusts the cut-off
+  server.on("/slow-requests", HTTP_GET, instrumentRoute("/slow-requests", [](AsyncWebServerRequest *request){
+    if (request->hasParam("threshold")) {
+      requestProfiler.setSlowThreshold(request->getParam("threshold")->value().toInt());
+    }
+    request->send(200, "application/json", requestProfiler.getSlowRequestsJson());
+  }));
+
+  // Recent deferred log records (text); ?level=1..4 filters by severity
+  server.on("/logs", HTTP_GET, instrumentRoute("/logs", [](AsyncWebServerRequest *request){
+    uint8_t level = DLOG_LEVEL_DEBUG;
+    if (request->hasParam("level")) {
+      level = request->getParam("level")->value().toInt();
+    }
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; charset=utf-8", 4096);
+    deferredLog.writeHistory(*response, level);
+    request->send(response);
+  }));
+
+  // Span timeline in Chrome Trace Event format (load in chrome://tracing or Perfetto)
+  // ?enable=0|1 toggles recording, ?clear=1 empties the ring
+  server.on("/trace.json", HTTP_GET, instrumentRoute("/trace.json", [](AsyncWebServerRequest *request){
+    if (request->hasParam("enable")) {
+      traceRecorder.setEnabled(request->getParam("enable")->value().toInt() != 0);
+    }
+    if (request->hasParam("clear")) {
+      traceRecorder.clear();
+      request->send(200, "application/json", "{\"cleared\":true}");
+      return;
+    }
+    request->send(traceRecorder.beginTraceResponse(request));
+  }));
+
+  // Prometheus scrape endpoint - reads atomics only, never takes the SD mutex
+  server.on("/metrics", HTTP_GET, instrumentRoute("/metrics", [](AsyncWebServerRequest *request){
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    metrics.writePrometheus(*response);
+    request->send(response);
+  }));
+
+  // Allocation profile by task and route (?top=N&sort=peak|bytes|count&reset=1)
+  // Only populated in the heapprof build; otherwise reports enabled:false
+  server.on("/heap-profile", HTTP_GET, instrumentRoute("/heap-profile", [](AsyncWebServerRequest *request){
+    HeapProfileSort sort = HEAP_SORT_PEAK;
+    if (request->hasParam("sort")) {
+      const String& key = request->getParam("sort")->value();
+      if (key == "bytes") sort = HEAP_SORT_BYTES;
+      else if (key == "count") sort = HEAP_SORT_COUNT;
+    }
+    int top = request->hasParam("top") ? request->getParam("top")->value().toInt() : 20;
+    if (top < 1 || top > HEAP_PROFILER_MAX_TAGS) top = HEAP_PROFILER_MAX_TAGS;
+
+    RequestArena* report = requestArenas.acquire(request);
+    if (!report) {
+      RequestArenaPool::sendBusy(request);
+      return;
+    }
+    heapProfiler.writeReportJson(*report, top, sort);
+    if (request->hasParam("reset")) {
+      heapProfiler.reset();
+    }
+    requestArenas.send(request, report, 200, "application/json");
+  }));
 
   server.begin();
   Serial.println("✅ Web server started successfully!");
   Serial.printf("🌐 Open browser to: http://%s\n", WiFi.softAPIP().toString().c_str());
+  return true;
+}
+
+void setup() {
+  Serial.begin(115200);
+  heapProfiler.begin();   // No-op unless built with HEAP_PROFILER; early so boot allocations are tagged
   
-  // Step 6: Initialize Camera
-  Serial.println("📷 Step 6: Initializing camera...");
-  cameraReady = initCamera();
-  if (cameraReady) {
-    Serial.println("✅ Camera initialization successful!");
+  Serial.println("=== ESP32-S3 CLEAN TEST ===");
+  Serial.println("🚀 Step 1: ESP32-S3 started!");
+  Serial.printf("📊 Chip: %s, Rev: %d, CPU: %dMHz\n", ESP.getChipModel(), ESP.getChipRevision(), ESP.getCpuFreqMHz());
+  Serial.printf("💾 Free Heap: %d bytes\n", ESP.getFreeHeap());
+  
+  // Step 2: Check PSRAM
+  Serial.println("🧠 Step 2: Checking PSRAM...");
+  if (psramFound()) {
+    Serial.printf("✅ PSRAM: %d MB available\n", ESP.getPsramSize() / 1024 / 1024);
   } else {
-    Serial.println("❌ Camera initialization failed - continuing without camera");
+    Serial.println("❌ PSRAM: Not detected");
   }
   
-  // Step 7: Initialize SD Card
-  Serial.println("💾 Step 7: Initializing SD card storage...");
-  sdCardReady = initSDCard();
-  if (sdCardReady) {
-    Serial.println("✅ SD card initialization successful!");
-  } else {
-    Serial.println("❌ SD card initialization failed - continuing without storage");
+  // Step 3: Initialize FreeRTOS components for dual-core
+  Serial.println("🔧 Step 3: Initializing dual-core architecture...");
+  initMetrics();
+  deferredLog.begin();
+  traceRecorder.begin();
+  requestArenas.begin();
+  photoWriter.begin();
+  frameCache.begin();
+  sdReadAhead.begin();
+  photoIndex.begin();
+  eventBroadcaster.begin();
+  taskMonitor.begin();
+  initMemoryGovernor();
+  
+  // Create queue for photo commands (increased size for better memory management)
+  photoQueue = xQueueCreate(PHOTO_QUEUE_SIZE, sizeof(PhotoCommand));
+  if (photoQueue == NULL) {
+    Serial.println("❌ Failed to create photo queue");
+    return;
+  }
+  
+  // Create mutex for SD card access
+  sdMutex = xSemaphoreCreateMutex();
+  if (sdMutex == NULL) {
+    Serial.println("❌ Failed to create SD mutex");
+    return;
   }
   
-  Serial.println("🎯 System Complete: WiFi + Web Server + Camera + Storage + Dual-Core!");
-  Serial.printf("📱 System ready - connect to '%s' and visit http://%s\n", 
-                AP_SSID, WiFi.softAPIP().toString().c_str());
+  // Create photo capture task on Core 1 (increased stack for memory management)
+  xTaskCreatePinnedToCore(
+    photoCaptureTask,    // Task function
+    "PhotoCapture",      // Task name
+    PHOTO_TASK_STACK,    // Stack size (bytes) - DOUBLED for memory management
+    NULL,                // Task parameters
+    2,                   // Task priority (0-24, higher = more priority)
+    &photoTaskHandle,    // Task handle
+    1                    // Core ID (1 for Core 1)
+  );
+  
+  if (photoTaskHandle == NULL) {
+    Serial.println("❌ Failed to create photo capture task");
+    return;
+  }
+  
+  Serial.println("✅ Dual-core architecture initialized");
+  
+  // Step 4: Launch camera, SD card and WiFi concurrently; the web server waits for WiFi only
+  Serial.println("🚀 Step 4: Launching parallel boot sequence...");
+  bootStepCamera = bootSequencer.addStep("camera", bootStartCamera, 0, 1, 8192);
+  bootStepSDCard = bootSequencer.addStep("sd-card", bootStartSDCard, 0, 0, 6144);
+  bootStepWiFi = bootSequencer.addStep("wifi", bootStartWiFi, 0, 0, 4096);
+  bootStepWebServer = bootSequencer.addStep("web-server", bootStartWebServer,
+                                            BOOT_DEP(bootStepWiFi), 0, 6144);
+  // A calibration ranks candidates by frame rate and heap cost; card, WiFi and
+  // web server start-up beside it would skew both, so on that boot they wait
+  cameraTuner.begin();
+  if (cameraTuner.isCalibrationRequested()) {
+    Serial.println("📐 Camera calibration pending - other boot steps wait for it");
+    bootSequencer.runAfter(bootStepSDCard, BOOT_DEP(bootStepCamera));
+    bootSequencer.runAfter(bootStepWiFi, BOOT_DEP(bootStepCamera));
+  }
+  bootSequencer.addMilestone("first-http-response");
+  bootSequencer.addMilestone("first-photo");
+  bootSequencer.start();
+  
+  // Photo capture in loop() starts on its own once cameraReady && sdCardReady
+  Serial.printf("📱 Boot launched - connect to '%s' and visit /boot-profile for timings\n", AP_SSID);
 }
 
 void loop() {
   // AsyncWebServer is event-driven - no handleClient() needed
   
-  // 📊 AGGRESSIVE MEMORY MONITORING - Check every 5 seconds
+  // 🧠 MEMORY GOVERNOR - samples every heap region once per second and applies graded relief
+  memoryGovernor.update();
+
+  // 📶 WiFi reconnect attempts scheduled by the backoff timer
+  wifiManager.loop();
+  
+  // 📊 Memory summary every 5 seconds
   static unsigned long lastMemoryCheck = 0;
-  static unsigned long lastRecoveryCycle = 0;
-  if (millis() - lastMemoryCheck > 5000) { // Reduced to 5 seconds
-    int currentHeap = ESP.getFreeHeap();
-    int minHeap = ESP.getMinFreeHeap();
-    
-    Serial.printf("📊 Memory: %d bytes free (min: %d)\n", currentHeap, minHeap);
-    
-    // EMBEDDED: More aggressive thresholds
-    if (currentHeap < 30000) {
-      Serial.printf("⚠️ Low memory: %d bytes\n", currentHeap);
-    }
-    
-    if (currentHeap < 20000) {
-      Serial.printf("🚨 CRITICAL: %d bytes - forcing cleanup\n", currentHeap);
-      forceMemoryRecovery();
-    }
-    
-    // EMBEDDED: More frequent recovery cycles (every 60 seconds)
-    if (millis() - lastRecoveryCycle > 60000) { // 1 minute
-      Serial.println("🔄 Periodic memory recovery...");
-      
-      // Only do memory recovery if memory is actually low
-      if (currentHeap < 30000) {
-        forceMemoryRecovery();
-      } else {
-        Serial.println("📊 Memory OK - skipping recovery cycle");
-      }
-      lastRecoveryCycle = millis();
-    }
-    
+  if (millis() - lastMemoryCheck > 5000) {
+    MemoryRegionSample internal = memoryGovernor.getRegion(MEMORY_REGION_INTERNAL);
+    Serial.printf("📊 Memory: %lu bytes free (largest %lu, min %lu) - pressure %s\n",
+                  (unsigned long)internal.freeBytes, (unsigned long)internal.largestBlock,
+                  (unsigned long)internal.minFree, MemoryGovernor::levelName(memoryGovernor.getLevel()));
     lastMemoryCheck = millis();
   }
   
-  // EMBEDDED photo capture - every 10 seconds with strict memory management
+  // EMBEDDED photo capture - every 10 seconds, gated by the memory governor
   static unsigned long lastPhotoTime = 0;
   if (millis() - lastPhotoTime > PHOTO_INTERVAL) {
-    // EMBEDDED: Stricter memory thresholds
-    int currentHeap = ESP.getFreeHeap();
-    if (currentHeap < 20000) {
-      Serial.printf("🚨 EMBEDDED: Pausing photo capture - only %d bytes free\n", currentHeap);
-      lastPhotoTime = millis(); // Reset timer
-    } else if (capturePhoto()) {
+    if (capturePhoto()) {
       // Photo count is now incremented in the photo capture task
     }
     lastPhotoTime = millis();
@@ -1180,21 +2068,29 @@ void loop() {
   // Update system status every 10 seconds
   static unsigned long lastStatusTime = 0;
   if (millis() - lastStatusTime > 10000) {
+    LatestFrameInfo latest = latestFrame.read();
     UBaseType_t queueSpaces = uxQueueSpacesAvailable(photoQueue);
     Serial.printf("⏱️  Uptime: %lu sec | Heap: %d bytes | WiFi: %d clients | Camera: %s | SD: %s | Photos: %d | Queue: %d/%d\n",
                   millis() / 1000, ESP.getFreeHeap(), WiFi.softAPgetStationNum(),
                   cameraReady ? "✅ Ready" : "❌ Failed",
-                  sdCardReady ? "✅ Ready" : "❌ Failed", photoCount, 
+                  sdCardReady ? "✅ Ready" : "❌ Failed", (int)latest.number, 
                   queueSpaces, PHOTO_QUEUE_SIZE);
     
-    if (lastPhotoFilename.length() > 0) {
+    if (latest.path[0] != '\0') {
       Serial.printf("🌐 Web interface: http://%s (Latest photo: %s)\n", 
-                    WiFi.softAPIP().toString().c_str(), lastPhotoFilename.c_str());
+                    WiFi.softAPIP().toString().c_str(), latest.path);
     }
     
     lastStatusTime = millis();
   }
   
+  // Pending calibration reboot requested via /calibrate-camera
+  if (calibrationRestartTime != 0 && millis() >= calibrationRestartTime) {
+    Serial.println("📐 Restarting into camera calibration...");
+    Serial.flush();
+    ESP.restart();
+  }
+  
   // Feed watchdog
   esp_task_wdt_reset();
   yield();
@@ -0,0 +1,164 @@
+// Host test for ArchiveFormat: writes a TAR and a ZIP the way PhotoExport streams
+// them, checks that the lengths computed up front match what was written, and
+// leaves both files for run.sh to validate with tar, unzip and Python.
+//
+//     g++ -std=c++17 -Wall -Wformat-truncation=2 -Iinclude -o archive_format_test
+//         test/host/archive_format_test.cpp src/ArchiveFormat.cpp
+//     ./archive_format_test /tmp/out        # writes /tmp/out/photos.tar, .zip, .manifest
+
+#include "ArchiveFormat.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                          \
+    }                                                                      \
+  } while (0)
+
+struct Entry {
+  std::string name;
+  std::vector<uint8_t> data;
+  uint32_t mtime;
+  uint32_t crc;
+};
+
+// Sizes around the TAR block boundary, an empty file, and a photo-sized one
+static std::vector<Entry> makeEntries() {
+  const uint32_t sizes[] = {0, 1, 511, 512, 513, 1024, 70001};
+  const uint32_t mtimes[] = {0, 315532800UL, 1700000000UL, 1700000001UL, 1700003600UL, 2000000000UL, 1234567890UL};
+  std::vector<Entry> entries;
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    Entry entry;
+    char name[32];
+    snprintf(name, sizeof(name), "photos/photo_%06u.jpg", (unsigned)(i + 1));
+    entry.name = name;
+    entry.mtime = mtimes[i];
+    entry.data.resize(sizes[i]);
+    for (auto& byte : entry.data) {
+      seed = seed * 1103515245 + 12345;
+      byte = seed >> 16;
+    }
+    entries.push_back(entry);
+  }
+  return entries;
+}
+
+static void append(std::vector<uint8_t>& out, const uint8_t* data, size_t len) {
+  out.insert(out.end(), data, data + len);
+}
+
+static std::vector<uint8_t> buildTar(const std::vector<Entry>& entries, uint64_t& expected) {
+  std::vector<uint8_t> out;
+  uint8_t record[ARCHIVE_HEADER_MAX];
+  expected = ARCHIVE_TAR_TRAILER;
+  for (const Entry& entry : entries) {
+    expected += ArchiveFormat::tarEntryBytes(entry.data.size());
+    size_t len = ArchiveFormat::tarHeader(record, entry.name.c_str(), entry.data.size(), entry.mtime);
+    CHECK(len == ARCHIVE_TAR_BLOCK);
+    append(out, record, len);
+    append(out, entry.data.data(), entry.data.size());
+    out.resize(out.size() + ArchiveFormat::tarPadding(entry.data.size()), 0);
+  }
+  out.resize(out.size() + ARCHIVE_TAR_TRAILER, 0);
+  return out;
+}
+
+static std::vector<uint8_t> buildZip(std::vector<Entry>& entries, uint64_t& expected) {
+  std::vector<uint8_t> out;
+  uint8_t record[ARCHIVE_HEADER_MAX];
+  uint64_t localBytes = 0, centralBytes = 0;
+  for (const Entry& entry : entries) {
+    localBytes += ArchiveFormat::zipEntryBytes(entry.name.size(), entry.data.size());
+    centralBytes += ArchiveFormat::zipCentralBytes(entry.name.size());
+  }
+  expected = localBytes + centralBytes + ARCHIVE_ZIP_END;
+
+  std::vector<uint32_t> offsets;
+  for (Entry& entry : entries) {
+    offsets.push_back(out.size());
+    append(out, record, ArchiveFormat::zipLocalHeader(record, entry.name.c_str(), entry.data.size(), entry.mtime));
+    // Chained in uneven pieces, as the export reads the card
+    uint32_t crc = 0;
+    size_t done = 0;
+    while (done < entry.data.size()) {
+      size_t piece = std::min<size_t>(4093, entry.data.size() - done);
+      crc = ArchiveFormat::crc32(crc, entry.data.data() + done, piece);
+      done += piece;
+    }
+    entry.crc = crc;
+    append(out, entry.data.data(), entry.data.size());
+    append(out, record, ArchiveFormat::zipDescriptor(record, crc, entry.data.size()));
+  }
+  CHECK(out.size() == localBytes);
+  uint32_t centralStart = out.size();
+  for (size_t i = 0; i < entries.size(); i++) {
+    const Entry& entry = entries[i];
+    append(out, record, ArchiveFormat::zipCentralHeader(record, entry.name.c_str(), entry.data.size(), entry.crc,
+                                                        entry.mtime, offsets[i]));
+  }
+  CHECK(out.size() - centralStart == centralBytes);
+  append(out, record, ArchiveFormat::zipEnd(record, entries.size(), out.size() - centralStart, centralStart));
+  return out;
+}
+
+static bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s output-dir\n", argv[0]);
+    return 2;
+  }
+  std::string dir = argv[1];
+
+  // Check value of the CRC-32 catalogue
+  CHECK(ArchiveFormat::crc32(0, (const uint8_t*)"123456789", 9) == 0xCBF43926UL);
+  CHECK(ArchiveFormat::crc32(ArchiveFormat::crc32(0, (const uint8_t*)"1234", 4), (const uint8_t*)"56789", 5) ==
+        0xCBF43926UL);
+  CHECK(ArchiveFormat::tarPadding(0) == 0);
+  CHECK(ArchiveFormat::tarPadding(1) == 511);
+  CHECK(ArchiveFormat::tarPadding(512) == 0);
+
+  std::vector<Entry> entries = makeEntries();
+  uint64_t tarExpected = 0, zipExpected = 0;
+  std::vector<uint8_t> tar = buildTar(entries, tarExpected);
+  std::vector<uint8_t> zip = buildZip(entries, zipExpected);
+  CHECK(tar.size() == tarExpected);
+  CHECK(tar.size() % ARCHIVE_TAR_BLOCK == 0);
+  CHECK(zip.size() == zipExpected);
+
+  // Manifest for the external tools: name, size, mtime, CRC per line
+  std::string manifest;
+  for (const Entry& entry : entries) {
+    char line[96];
+    snprintf(line, sizeof(line), "%s %zu %u %08x\n", entry.name.c_str(), entry.data.size(),
+             (unsigned)entry.mtime, (unsigned)entry.crc);
+    manifest += line;
+  }
+  CHECK(writeFile(dir + "/photos.tar", tar));
+  CHECK(writeFile(dir + "/photos.zip", zip));
+  CHECK(writeFile(dir + "/photos.manifest", std::vector<uint8_t>(manifest.begin(), manifest.end())));
+
+  if (failures) {
+    fprintf(stderr, "archive_format_test: %d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("archive_format_test: ok (%zu entries, tar %zu bytes, zip %zu bytes)\n", entries.size(), tar.size(),
+         zip.size());
+  return 0;
+}
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Validates the archives written by archive_format_test with Python's own
+readers: every entry must be present with the expected name, size, CRC and
+modification time, and read back intact."""
+
+import sys
+import tarfile
+import time
+import zipfile
+import zlib
+
+DOS_EPOCH = 315532800  # 1980-01-01, the earliest ZIP date
+
+
+def main(directory):
+    expected = []
+    with open(f"{directory}/photos.manifest") as manifest:
+        for line in manifest:
+            name, size, mtime, crc = line.split()
+            expected.append((name, int(size), int(mtime), int(crc, 16)))
+
+    with tarfile.open(f"{directory}/photos.tar") as tar:
+        members = tar.getmembers()
+        assert [m.name for m in members] == [e[0] for e in expected], "tar names"
+        for member, (name, size, mtime, crc) in zip(members, expected):
+            assert member.isfile(), name
+            assert member.size == size, f"{name}: tar size {member.size} != {size}"
+            assert member.mtime == mtime, f"{name}: tar mtime {member.mtime} != {mtime}"
+            data = tar.extractfile(member).read()
+            assert zlib.crc32(data) == crc, f"{name}: tar content"
+
+    with zipfile.ZipFile(f"{directory}/photos.zip") as archive:
+        assert archive.testzip() is None, "zip CRC check"
+        infos = archive.infolist()
+        assert [i.filename for i in infos] == [e[0] for e in expected], "zip names"
+        for info, (name, size, mtime, crc) in zip(infos, expected):
+            assert info.compress_type == zipfile.ZIP_STORED, name
+            assert info.file_size == size and info.compress_size == size, f"{name}: zip size"
+            assert info.CRC == crc, f"{name}: zip CRC"
+            # DOS time: local fields, two-second resolution, clamped to 1980
+            want = time.gmtime(max(mtime, DOS_EPOCH))[:6]
+            got = info.date_time
+            assert got[:5] == want[:5] and abs(got[5] - want[5]) <= 1, f"{name}: zip time {got} != {want}"
+            assert zlib.crc32(archive.read(info)) == crc, f"{name}: zip content"
+
+    print(f"check_archives: ok ({len(expected)} entries)")
+
+
+if __name__ == "__main__":
+    main(sys.argv[1])
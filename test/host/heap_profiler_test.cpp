@@ -0,0 +1,234 @@
+// Host test for HeapProfiler: linked with the same define and --wrap flags as the
+// esp32-s3-devkitc-1-heapprof environment, so the malloc family below goes through
+// the hooks and the live-allocation table.
+//
+//     g++ -std=c++17 -fno-builtin -pthread -DHEAP_PROFILER=1 -Iinclude -o heap_profiler_test
+//         -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+//         test/host/heap_profiler_test.cpp src/HeapProfiler.cpp
+//
+// Only calls made from objects linked here are wrapped; operator new inside the
+// shared libstdc++ is not, so the test allocates with malloc directly.
+
+#include "HeapProfiler.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                          \
+    }                                                                      \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                         \
+  do {                                                                     \
+    long long a_ = (long long)(actual), e_ = (long long)(expected);        \
+    if (a_ != e_) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK_EQ failed: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+      failures++;                                                          \
+    }                                                                      \
+  } while (0)
+
+// Keeps the pointers observable so the compiler cannot drop malloc/free pairs
+static void* volatile blocks[HEAP_PROFILER_MAX_LIVE + 512];
+
+static const HeapTagStats* findContext(HeapTagStats* tags, uint8_t count, const char* context) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (tags[i].context && strcmp(tags[i].context, context) == 0) {
+      return &tags[i];
+    }
+  }
+  return nullptr;
+}
+
+static void testCounts() {
+  HeapProfilerTotals before = heapProfiler.getTotals();
+
+  blocks[0] = malloc(100);
+  blocks[1] = malloc(200);
+  blocks[2] = calloc(10, 30);
+  HeapProfilerTotals t = heapProfiler.getTotals();
+  CHECK_EQ(t.allocs - before.allocs, 3);
+  CHECK_EQ(t.frees - before.frees, 0);
+  CHECK_EQ(t.liveBlocks - before.liveBlocks, 3);
+  CHECK_EQ(t.liveBytes - before.liveBytes, 600);
+  CHECK(t.peakLiveBytes >= t.liveBytes);
+
+  free(blocks[1]);
+  free(nullptr);                              // Not an allocation, not counted
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.frees - before.frees, 1);
+  CHECK_EQ(t.liveBlocks - before.liveBlocks, 2);
+  CHECK_EQ(t.liveBytes - before.liveBytes, 400);
+
+  // realloc is booked as a free plus a new allocation of the new size
+  blocks[0] = realloc(blocks[0], 5000);
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.allocs - before.allocs, 4);
+  CHECK_EQ(t.frees - before.frees, 2);
+  CHECK_EQ(t.liveBlocks - before.liveBlocks, 2);
+  CHECK_EQ(t.liveBytes - before.liveBytes, 5300);
+  CHECK(t.peakLiveBytes - before.liveBytes >= 5300);
+
+  blocks[1] = realloc(nullptr, 64);           // Same as malloc
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.allocs - before.allocs, 5);
+  CHECK_EQ(t.liveBlocks - before.liveBlocks, 3);
+
+  free(blocks[0]);
+  free(blocks[1]);
+  free(blocks[2]);
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.allocs - before.allocs, 5);
+  CHECK_EQ(t.frees - before.frees, 5);
+  CHECK_EQ(t.liveBlocks, before.liveBlocks);
+  CHECK_EQ(t.liveBytes, before.liveBytes);
+}
+
+static void testReset() {
+  blocks[0] = malloc(1000);
+  heapProfiler.reset();
+  HeapProfilerTotals t = heapProfiler.getTotals();
+  CHECK_EQ(t.allocs, 0);
+  CHECK_EQ(t.frees, 0);
+  CHECK_EQ(t.peakLiveBytes, t.liveBytes);     // Peak restarts from what is outstanding
+
+  // A block allocated before the reset is still matched when it is freed
+  uint32_t liveBefore = t.liveBytes;
+  free(blocks[0]);
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.frees, 1);
+  CHECK_EQ(liveBefore - t.liveBytes, 1000);
+}
+
+static void testContexts() {
+  heapProfiler.reset();
+  {
+    HEAP_PROFILE_SCOPE("/outer");
+    blocks[0] = malloc(10);
+    {
+      HEAP_PROFILE_SCOPE("/inner");
+      blocks[1] = malloc(20);
+      blocks[2] = malloc(30);
+    }
+    blocks[3] = malloc(40);
+    free(blocks[1]);                          // Charged to /inner, which allocated it
+  }
+  blocks[4] = malloc(50);                     // No context any more
+
+  HeapTagStats tags[HEAP_PROFILER_MAX_TAGS];
+  uint8_t count = heapProfiler.getTopTags(tags, HEAP_PROFILER_MAX_TAGS, HEAP_SORT_COUNT);
+  const HeapTagStats* outer = findContext(tags, count, "/outer");
+  const HeapTagStats* inner = findContext(tags, count, "/inner");
+  CHECK(outer && inner);
+  if (outer && inner) {
+    CHECK_EQ(outer->allocs, 2);
+    CHECK_EQ(outer->liveBytes, 50);
+    CHECK_EQ(inner->allocs, 2);
+    CHECK_EQ(inner->frees, 1);
+    CHECK_EQ(inner->liveBytes, 30);
+    CHECK_EQ(inner->peakLiveBytes, 50);
+    CHECK_EQ(inner->largest, 30);
+    CHECK(strcmp(inner->taskName, "host") == 0);
+  }
+  // Sorted largest first
+  for (uint8_t i = 1; i < count; i++) {
+    CHECK(tags[i - 1].allocs >= tags[i].allocs);
+  }
+  for (int i = 0; i < 5; i++) {
+    if (i != 1) {
+      free(blocks[i]);
+    }
+  }
+}
+
+static void testThreads() {
+  heapProfiler.reset();
+  HeapProfilerTotals before = heapProfiler.getTotals();
+  std::thread worker([] {
+    HEAP_PROFILE_SCOPE("/worker");
+    for (int i = 0; i < 100; i++) {
+      free(malloc(16 + i));
+    }
+  });
+  {
+    HEAP_PROFILE_SCOPE("/main");
+    for (int i = 0; i < 100; i++) {
+      free(malloc(16 + i));
+    }
+  }
+  worker.join();
+
+  HeapTagStats tags[HEAP_PROFILER_MAX_TAGS];
+  uint8_t count = heapProfiler.getTopTags(tags, HEAP_PROFILER_MAX_TAGS, HEAP_SORT_COUNT);
+  const HeapTagStats* mainTag = findContext(tags, count, "/main");
+  const HeapTagStats* workerTag = findContext(tags, count, "/worker");
+  CHECK(mainTag && workerTag);
+  if (mainTag && workerTag) {
+    CHECK(mainTag->task != workerTag->task);
+    CHECK_EQ(mainTag->allocs, 100);
+    CHECK_EQ(workerTag->allocs, 100);
+    CHECK_EQ(workerTag->frees, 100);
+    CHECK_EQ(workerTag->liveBytes, 0);
+  }
+  CHECK_EQ(heapProfiler.getTotals().liveBlocks, before.liveBlocks);
+}
+
+// Fills the live table past its limit and frees in a scrambled order, which
+// exercises the linear probing and backward-shift deletion
+static void testLiveTable() {
+  heapProfiler.reset();
+  HeapProfilerTotals before = heapProfiler.getTotals();
+  const uint32_t limit = HEAP_PROFILER_MAX_LIVE - HEAP_PROFILER_MAX_LIVE / 8;
+  const uint32_t n = sizeof(blocks) / sizeof(blocks[0]);
+  for (uint32_t i = 0; i < n; i++) {
+    blocks[i] = malloc(8 + (i % 64));
+  }
+  HeapProfilerTotals t = heapProfiler.getTotals();
+  CHECK_EQ(t.allocs, n);
+  CHECK_EQ(t.liveBlocks, limit);
+  CHECK_EQ(t.untracked, n - (limit - before.liveBlocks));
+
+  for (uint32_t step = 0; step < n; step++) {
+    free(blocks[(step * 1237) % n]);          // 1237 is prime and does not divide n
+  }
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.frees, limit - before.liveBlocks);
+  CHECK_EQ(t.liveBlocks, before.liveBlocks);
+  CHECK_EQ(t.liveBytes, before.liveBytes);
+
+  // The table is usable again after draining
+  blocks[0] = malloc(123);
+  t = heapProfiler.getTotals();
+  CHECK_EQ(t.liveBlocks, before.liveBlocks + 1);
+  free(blocks[0]);
+}
+
+int main() {
+  CHECK(!heapProfiler.isActive());
+  void* early = malloc(32);                   // Before begin(): never tracked
+  CHECK(heapProfiler.begin());
+  CHECK(heapProfiler.isActive());
+  CHECK(heapProfiler.begin());                // Second call is a no-op
+  HeapProfilerTotals t = heapProfiler.getTotals();
+  free(early);
+  CHECK_EQ(heapProfiler.getTotals().frees, t.frees);
+
+  testCounts();
+  testReset();
+  testContexts();
+  testThreads();
+  testLiveTable();
+
+  if (failures) {
+    fprintf(stderr, "heap_profiler_test: %d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("heap_profiler_test: ok\n");
+  return 0;
+}
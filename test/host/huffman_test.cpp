@@ -0,0 +1,353 @@
+// Host test for JpegHuffman: re-optimizes the Huffman tables of the JPEGs in
+// test/host/jpeg (regenerated by make_corpus.py there) and checks, with a separate
+// baseline entropy decoder, that every DCT coefficient of the output matches the
+// source. Further files on the command line (e.g. photos copied off the card) are
+// checked the same way, and the size and time per file make it a benchmark too.
+//
+//     g++ -std=c++17 -O2 -Iinclude -o huffman_test test/host/huffman_test.cpp src/JpegHuffman.cpp
+//     ./huffman_test test/host/jpeg [/path/to/photos/*.jpg]
+//
+// Every result is optimized a second time as a consistency check: the symbol
+// statistics of an optimized file must reproduce the same tables, so the second
+// pass has to report "not smaller".
+
+#include "JpegHuffman.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                          \
+    }                                                                      \
+  } while (0)
+
+// The corpus and what optimize() has to make of each file
+static const struct {
+  const char* name;
+  JpegOptimizeResult expected;
+} corpus[] = {
+  {"camera_422.jpg", JPEG_OPT_OK},
+  {"odd_420.jpg", JPEG_OPT_OK},
+  {"gray.jpg", JPEG_OPT_OK},
+  {"restart_444.jpg", JPEG_OPT_OK},
+  {"progressive.jpg", JPEG_OPT_UNSUPPORTED},
+};
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  bool ok = size > 0 && fread(data.data(), 1, size, f) == (size_t)size;
+  fclose(f);
+  return ok;
+}
+
+// Straightforward T.81 F.2.2 decoder, deliberately sharing nothing with
+// JpegHuffman.cpp so a bug there cannot cancel out here
+struct HuffTable {
+  bool defined = false;
+  int maxCode[18];
+  int valuePointer[17];
+  int minCode[17];
+  uint8_t values[256];
+};
+
+class CoefficientDecoder {
+public:
+  // Appends every coefficient of the scan, DC as absolute values, in stream order
+  bool decode(const std::vector<uint8_t>& jpeg, std::vector<int>& coefficients) {
+    data = jpeg.data();
+    len = jpeg.size();
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+      return false;
+    }
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+      if (data[pos] != 0xFF) {
+        return false;
+      }
+      uint8_t marker = data[pos + 1];
+      size_t segment = (data[pos + 2] << 8) | data[pos + 3];
+      const uint8_t* body = data + pos + 4;
+      if (segment < 2 || pos + 2 + segment > len) {
+        return false;
+      }
+      if (marker == 0xC0 || marker == 0xC1) {
+        height = (body[1] << 8) | body[2];
+        width = (body[3] << 8) | body[4];
+        components = body[5];
+        for (int i = 0; i < components; i++) {
+          ids[i] = body[6 + i * 3];
+          h[i] = body[7 + i * 3] >> 4;
+          v[i] = body[7 + i * 3] & 15;
+        }
+      } else if (marker == 0xC4 && !readTables(body, segment - 2)) {
+        return false;
+      } else if (marker == 0xDD) {
+        restartInterval = (body[0] << 8) | body[1];
+      } else if (marker == 0xDA) {
+        return decodeScan(body, pos + 2 + segment, coefficients);
+      }
+      pos += 2 + segment;
+    }
+    return false;
+  }
+
+private:
+  const uint8_t* data;
+  size_t len;
+  int width = 0, height = 0, components = 0, restartInterval = 0;
+  int ids[4], h[4], v[4];
+  HuffTable tables[2][4];
+  size_t pos;
+  uint32_t acc;
+  int bits;
+  bool overrun;
+
+  bool readTables(const uint8_t* body, size_t size) {
+    size_t i = 0;
+    while (i + 17 <= size) {
+      int tableClass = body[i] >> 4, id = body[i] & 15;
+      if (tableClass > 1 || id > 3) {
+        return false;
+      }
+      HuffTable& table = tables[tableClass][id];
+      const uint8_t* counts = body + i + 1;
+      int total = 0, code = 0;
+      for (int length = 1; length <= 16; length++) {
+        table.valuePointer[length] = total;
+        table.minCode[length] = code;
+        code += counts[length - 1];
+        total += counts[length - 1];
+        table.maxCode[length] = counts[length - 1] ? code - 1 : -1;
+        code <<= 1;
+      }
+      table.maxCode[17] = 0x7FFFFFFF;
+      if (total > 256 || i + 17 + total > size) {
+        return false;
+      }
+      memcpy(table.values, body + i + 17, total);
+      table.defined = true;
+      i += 17 + total;
+    }
+    return i == size;
+  }
+
+  int bit() {
+    if (bits == 0) {
+      acc = 0;
+      if (pos < len && data[pos] == 0xFF && pos + 1 < len && data[pos + 1] == 0x00) {
+        acc = 0xFF;
+        pos += 2;
+      } else if (pos < len && data[pos] != 0xFF) {
+        acc = data[pos++];
+      } else {
+        overrun = true;                     // Ran into a marker or the end
+      }
+      bits = 8;
+    }
+    bits--;
+    return (acc >> bits) & 1;
+  }
+
+  int receive(int n) {
+    int value = 0;
+    for (int i = 0; i < n; i++) {
+      value = (value << 1) | bit();
+    }
+    return value;
+  }
+
+  static int extend(int value, int n) {
+    return n && value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+  }
+
+  int symbol(const HuffTable& table) {
+    int code = bit();
+    int length = 1;
+    while (length <= 16 && code > table.maxCode[length]) {
+      code = (code << 1) | bit();
+      length++;
+    }
+    if (length > 16) {
+      return -1;
+    }
+    return table.values[table.valuePointer[length] + code - table.minCode[length]];
+  }
+
+  bool decodeScan(const uint8_t* body, size_t scanStart, std::vector<int>& coefficients) {
+    int count = body[0];
+    int comp[4], dcTable[4], acTable[4];
+    for (int i = 0; i < count; i++) {
+      comp[i] = -1;
+      for (int c = 0; c < components; c++) {
+        if (ids[c] == body[1 + i * 2]) {
+          comp[i] = c;
+        }
+      }
+      dcTable[i] = body[2 + i * 2] >> 4;
+      acTable[i] = body[2 + i * 2] & 15;
+      if (comp[i] < 0 || dcTable[i] > 3 || acTable[i] > 3 || !tables[0][dcTable[i]].defined ||
+          !tables[1][acTable[i]].defined) {
+        return false;
+      }
+    }
+    int hMax = 1, vMax = 1;
+    for (int c = 0; c < components; c++) {
+      hMax = h[c] > hMax ? h[c] : hMax;
+      vMax = v[c] > vMax ? v[c] : vMax;
+    }
+    // A single-component scan is not interleaved and covers only that component's blocks
+    long mcus;
+    if (count == 1) {
+      int c = comp[0];
+      long cols = ((width * h[c] + hMax - 1) / hMax + 7) / 8;
+      long rows = ((height * v[c] + vMax - 1) / vMax + 7) / 8;
+      mcus = cols * rows;
+    } else {
+      mcus = (long)((width + 8 * hMax - 1) / (8 * hMax)) * ((height + 8 * vMax - 1) / (8 * vMax));
+    }
+
+    pos = scanStart;
+    bits = 0;
+    overrun = false;
+    int predictor[4] = {0, 0, 0, 0};
+    int restartsSeen = 0;
+    for (long mcu = 0; mcu < mcus; mcu++) {
+      if (restartInterval && mcu > 0 && mcu % restartInterval == 0) {
+        bits = 0;                           // Padding bits of the last byte
+        if (overrun || pos + 1 >= len || data[pos] != 0xFF || data[pos + 1] != 0xD0 + (restartsSeen & 7)) {
+          return false;
+        }
+        pos += 2;
+        restartsSeen++;
+        memset(predictor, 0, sizeof(predictor));
+      }
+      for (int i = 0; i < count; i++) {
+        int blocks = count == 1 ? 1 : h[comp[i]] * v[comp[i]];
+        for (int b = 0; b < blocks; b++) {
+          int size = symbol(tables[0][dcTable[i]]);
+          if (size < 0 || size > 11) {
+            return false;
+          }
+          predictor[i] += extend(receive(size), size);
+          coefficients.push_back(predictor[i]);
+          for (int k = 1; k < 64; k++) {
+            int rs = symbol(tables[1][acTable[i]]);
+            if (rs < 0) {
+              return false;
+            }
+            int run = rs >> 4, ac = rs & 15;
+            if (ac == 0 && run != 15) {
+              coefficients.insert(coefficients.end(), 64 - k, 0);   // EOB
+              break;
+            }
+            if (k + run > 63) {
+              return false;
+            }
+            coefficients.insert(coefficients.end(), run, 0);
+            k += run;
+            coefficients.push_back(ac ? extend(receive(ac), ac) : 0);
+          }
+        }
+      }
+    }
+    // Only the padding of the last byte may be left before EOI
+    return !overrun && pos + 1 < len && data[pos] == 0xFF && data[pos + 1] == 0xD9;
+  }
+};
+
+struct Totals {
+  unsigned long long in = 0, out = 0;
+  double ms = 0;
+  int files = 0, optimized = 0;
+};
+
+static void checkFile(const char* path, const JpegOptimizeResult* expected, Totals& totals) {
+  std::vector<uint8_t> in;
+  if (!readFile(path, in)) {
+    fprintf(stderr, "%s: unreadable\n", path);
+    failures++;
+    return;
+  }
+  std::vector<uint8_t> out(in.size()), again(in.size());
+  size_t outLen = 0, againLen = 0;
+  auto start = std::chrono::steady_clock::now();
+  JpegOptimizeResult result = JpegHuffman::optimize(in.data(), in.size(), out.data(), out.size(), &outLen);
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  totals.in += in.size();
+  totals.ms += ms;
+  totals.files++;
+  if (expected && result != *expected) {
+    fprintf(stderr, "%s: %s, expected %s\n", path, JpegHuffman::resultName(result),
+            JpegHuffman::resultName(*expected));
+    failures++;
+  }
+  if (result != JPEG_OPT_OK) {
+    printf("%-40s %8zu  %s\n", path, in.size(), JpegHuffman::resultName(result));
+    totals.out += in.size();
+    return;
+  }
+  out.resize(outLen);
+  totals.out += outLen;
+  totals.optimized++;
+
+  std::vector<int> before, after;
+  bool decoded = CoefficientDecoder().decode(in, before) && CoefficientDecoder().decode(out, after);
+  bool same = decoded && !before.empty() && before == after;
+  JpegOptimizeResult second = JpegHuffman::optimize(out.data(), outLen, again.data(), again.size(), &againLen);
+  printf("%-40s %8zu -> %8zu  %5.1f%%  %6.2f ms  %zu coefficients%s%s\n", path, in.size(), outLen,
+         100.0 * (in.size() - outLen) / in.size(), ms, before.size(), same ? "" : "  MISMATCH",
+         second != JPEG_OPT_NOT_SMALLER ? "  INCONSISTENT" : "");
+  CHECK(outLen < in.size());
+  CHECK(same);
+  CHECK(second == JPEG_OPT_NOT_SMALLER);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s corpus-dir [photo.jpg ...]\n", argv[0]);
+    return 2;
+  }
+  Totals totals;
+  for (const auto& file : corpus) {
+    std::string path = std::string(argv[1]) + "/" + file.name;
+    checkFile(path.c_str(), &file.expected, totals);
+  }
+  for (int i = 2; i < argc; i++) {
+    checkFile(argv[i], nullptr, totals);
+  }
+
+  // Cut short inside the scan, the input must be rejected rather than padded out
+  std::vector<uint8_t> in;
+  std::string path = std::string(argv[1]) + "/" + corpus[0].name;
+  if (readFile(path.c_str(), in)) {
+    std::vector<uint8_t> out(in.size());
+    size_t outLen = 0;
+    in.resize(in.size() / 2);
+    CHECK(JpegHuffman::optimize(in.data(), in.size(), out.data(), out.size(), &outLen) != JPEG_OPT_OK);
+  }
+
+  printf("\n%d of %d optimized: %llu -> %llu bytes, %.1f%% reclaimed, %.2f ms/file on this host\n",
+         totals.optimized, totals.files, totals.in, totals.out,
+         totals.in ? 100.0 * (totals.in - totals.out) / totals.in : 0.0,
+         totals.files ? totals.ms / totals.files : 0.0);
+  if (failures) {
+    fprintf(stderr, "huffman_test: %d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("huffman_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""Regenerates the JPEG corpus of test/host/huffman_test.cpp. Needs Pillow.
+
+The files are checked in, so run.sh does not need Pillow; rerun this only to
+change the corpus:
+
+    python3 test/host/jpeg/make_corpus.py
+"""
+
+import math
+import os
+import random
+
+from PIL import Image
+
+
+def scene(width, height, seed):
+    """Smooth gradients with some noise, roughly what the camera sees"""
+    rng = random.Random(seed)
+    image = Image.new("RGB", (width, height))
+    pixels = image.load()
+    for y in range(height):
+        for x in range(width):
+            r = int(128 + 100 * math.sin(x / 7.0) * math.cos(y / 11.0))
+            g = x * 255 // max(1, width - 1)
+            b = (y * 255 // max(1, height - 1)) ^ rng.randrange(32)
+            pixels[x, y] = (r, g, b)
+    return image
+
+
+def main():
+    out = os.path.dirname(os.path.abspath(__file__))
+    photo = scene(160, 120, 7)
+    # Standard Annex K tables, as the camera writes them (4:2:2)
+    photo.save(os.path.join(out, "camera_422.jpg"), quality=80, subsampling=1, optimize=False)
+    # Partial MCUs on both edges
+    scene(97, 61, 8).save(os.path.join(out, "odd_420.jpg"), quality=60, subsampling=2, optimize=False)
+    # One component, so a non-interleaved scan
+    scene(64, 48, 9).convert("L").save(os.path.join(out, "gray.jpg"), quality=90, optimize=False)
+    photo.save(os.path.join(out, "restart_444.jpg"), quality=95, subsampling=0, optimize=False,
+               restart_marker_blocks=5)
+    photo.save(os.path.join(out, "progressive.jpg"), quality=80, progressive=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,31 @@
+#!/bin/bash
+# Host tests for the modules that build without Arduino or FreeRTOS. Needs g++,
+# tar, unzip and python3. Run from anywhere: bash test/host/run.sh
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")/../.." && pwd)"
+OUT="$(mktemp -d)"
+trap 'rm -rf "$OUT"' EXIT
+CXX="${CXX:-g++}"
+CXXFLAGS="-std=c++17 -O1 -g -Wall -Wextra -Wformat-truncation=2 -Werror -I$ROOT/include"
+
+echo "== ArchiveFormat"
+$CXX $CXXFLAGS "$ROOT/test/host/archive_format_test.cpp" "$ROOT/src/ArchiveFormat.cpp" -o "$OUT/archive_format_test"
+"$OUT/archive_format_test" "$OUT"
+tar -tvf "$OUT/photos.tar" > /dev/null
+unzip -tq "$OUT/photos.zip"
+python3 "$ROOT/test/host/check_archives.py" "$OUT"
+
+echo "== HeapProfiler"
+# Same define and linker flags as the esp32-s3-devkitc-1-heapprof environment;
+# -fno-builtin keeps the compiler from folding the test's malloc/free pairs
+$CXX $CXXFLAGS -fno-builtin -pthread -DHEAP_PROFILER=1 \
+  -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free \
+  "$ROOT/test/host/heap_profiler_test.cpp" "$ROOT/src/HeapProfiler.cpp" -o "$OUT/heap_profiler_test"
+"$OUT/heap_profiler_test"
+
+echo "== JpegHuffman"
+$CXX $CXXFLAGS "$ROOT/test/host/huffman_test.cpp" "$ROOT/src/JpegHuffman.cpp" -o "$OUT/huffman_test"
+"$OUT/huffman_test" "$ROOT/test/host/jpeg"
+
+echo "all host tests passed"
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Stand-in photo collector for exercising the uploader on a Linux host.
+
+Accepts the uploader's chunked keep-alive POSTs, stores each photo under the
+output directory and prints per-request and aggregate throughput.
+
+    python3 tools/collector.py --port 8080 --out ./collected
+    curl 'http://192.168.4.1/uploader?url=http://192.168.4.2:8080/upload'
+
+--fail-every N answers every Nth request with 503 to exercise retries, and
+--close-every N drops keep-alive on every Nth response.
+"""
+
+import argparse
+import os
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class CollectorHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive
+    requests_seen = 0
+    photos = 0
+    total_bytes = 0
+    started = time.monotonic()
+
+    def read_body(self):
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            body = bytearray()
+            while True:
+                size = int(self.rfile.readline().split(b";")[0].strip(), 16)
+                if size == 0:
+                    # Trailer section ends with an empty line
+                    while self.rfile.readline() not in (b"\r\n", b"\n", b""):
+                        pass
+                    return bytes(body)
+                body += self.rfile.read(size)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def do_POST(self):
+        cls = CollectorHandler
+        cls.requests_seen += 1
+        start = time.monotonic()
+        body = self.read_body()
+        elapsed = max(time.monotonic() - start, 1e-6)
+
+        if self.server.fail_every and cls.requests_seen % self.server.fail_every == 0:
+            self.respond(503, b"simulated failure\n")
+            print(f"#{cls.requests_seen}: simulated 503")
+            return
+
+        number = self.headers.get("X-Photo-Number", "unknown")
+        name = os.path.basename(self.headers.get("X-Photo-Name", f"photo_{number}.jpg"))
+        with open(os.path.join(self.server.out_dir, name), "wb") as f:
+            f.write(body)
+
+        cls.photos += 1
+        cls.total_bytes += len(body)
+        total_elapsed = time.monotonic() - cls.started
+        valid = body[:2] == b"\xff\xd8"
+        print(f"#{cls.requests_seen}: photo {number} {len(body)} B "
+              f"{len(body) / elapsed / 1024:.1f} KB/s{'' if valid else ' (not a JPEG!)'} | "
+              f"total {cls.photos} photos, {cls.total_bytes / 1024:.0f} KB, "
+              f"{cls.total_bytes / total_elapsed / 1024:.1f} KB/s avg")
+
+        close = self.server.close_every and cls.requests_seen % self.server.close_every == 0
+        self.respond(200, b"ok\n", close)
+
+    def respond(self, status, body, close=False):
+        self.send_response(status)
+        self.send_header("Content-Length", str(len(body)))
+        if close:
+            self.send_header("Connection", "close")
+            self.close_connection = True
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--out", default="collected")
+    parser.add_argument("--fail-every", type=int, default=0)
+    parser.add_argument("--close-every", type=int, default=0)
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    server = ThreadingHTTPServer(("0.0.0.0", args.port), CollectorHandler)
+    server.out_dir = args.out
+    server.fail_every = args.fail_every
+    server.close_every = args.close_every
+    print(f"Collector listening on :{args.port}, saving to {args.out}/")
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
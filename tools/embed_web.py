@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Embeds the web UI (web/*) into the firmware as pre-gzipped flash arrays.
+
+Runs before every PlatformIO build (extra_scripts = pre:tools/embed_web.py) and
+can also be run by hand:
+
+    python3 tools/embed_web.py
+
+Each file is minified, gzipped and written to include/WebAssets.generated.h as a
+constexpr byte array with its route, content type and ETag. index.html is served
+at /, other pages at their name without .html (wifi.html -> /wifi), and CSS/JS
+at their file name. In pages, {{asset:app.css}} expands to /app.css?v=<hash>, so
+stylesheets and scripts can be cached as immutable. The header is only rewritten
+when its content changes, so an unchanged UI does not trigger a recompile.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+
+CONTENT_TYPES = {
+    ".html": "text/html; charset=utf-8",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    text = re.sub(r"\n\s*", "\n", text)
+    # Whitespace between tags can be significant inline ("</strong> <span>"),
+    # so it collapses to one space instead of going away
+    text = re.sub(r">\s+<", "> <", text)
+    return text.strip()
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{}:;,>])\s*", r"\1", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_js(text):
+    # Conservative: whole-line comments and indentation only. Newlines stay so
+    # automatic semicolon insertion behaves exactly as in the source.
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if line and not line.startswith("//"):
+            lines.append(line)
+    return "\n".join(lines)
+
+
+MINIFIERS = {".html": minify_html, ".css": minify_css, ".js": minify_js}
+
+
+def route_for(name):
+    base, ext = os.path.splitext(name)
+    if ext == ".html":
+        return "/" if base == "index" else "/" + base
+    return "/" + name
+
+
+def symbol_for(name):
+    return "WEB_ASSET_" + re.sub(r"[^A-Za-z0-9]", "_", name).upper()
+
+
+def load_asset(path, name, versions):
+    with open(path, "rb") as f:
+        data = f.read()
+    ext = os.path.splitext(name)[1]
+    minify = MINIFIERS.get(ext)
+    if minify:
+        text = data.decode("utf-8")
+        text = re.sub(r"\{\{asset:([^}]+)\}\}", lambda m: versions[m.group(1)], text)
+        data = minify(text).encode("utf-8")
+    # mtime=0 keeps the output byte-identical between builds
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+    digest = hashlib.sha1(data).hexdigest()[:8]
+    return data, packed, digest
+
+
+def format_bytes(packed):
+    rows = []
+    for i in range(0, len(packed), 20):
+        rows.append("  " + ",".join("0x%02x" % b for b in packed[i:i + 20]) + ",")
+    return "\n".join(rows)
+
+
+def generate(project_dir):
+    web_dir = os.path.join(project_dir, "web")
+    out_path = os.path.join(project_dir, "include", "WebAssets.generated.h")
+    names = sorted(n for n in os.listdir(web_dir)
+                   if os.path.splitext(n)[1] in CONTENT_TYPES)
+
+    # Stylesheets and scripts first, so pages can reference their versioned URLs
+    names.sort(key=lambda n: n.endswith(".html"))
+    versions = {}
+    assets = []
+    for name in names:
+        raw_size = os.path.getsize(os.path.join(web_dir, name))
+        data, packed, digest = load_asset(os.path.join(web_dir, name), name, versions)
+        route = route_for(name)
+        versioned = not name.endswith(".html")
+        url = "%s?v=%s" % (route, digest) if versioned else route
+        versions[name] = url
+        assets.append((name, route, url, versioned, packed, digest))
+        print("embed_web: %-12s %6d -> %5d bytes minified -> %5d gzipped" %
+              (name, raw_size, len(data), len(packed)))
+
+    out = ["// Generated by tools/embed_web.py from web/ - do not edit, not checked in",
+           "#ifndef WEB_ASSETS_GENERATED_H",
+           "#define WEB_ASSETS_GENERATED_H",
+           ""]
+    for name, route, url, versioned, packed, digest in assets:
+        out.append("constexpr uint8_t %s[] PROGMEM = {" % symbol_for(name))
+        out.append(format_bytes(packed))
+        out.append("};")
+        out.append("")
+    out.append("constexpr WebAsset WEB_ASSETS[] = {")
+    for name, route, url, versioned, packed, digest in assets:
+        out.append('  {"%s", "%s", "%s", "\\"w-%s\\"", %s, sizeof(%s), %s},' %
+                   (route, url, CONTENT_TYPES[os.path.splitext(name)[1]], digest,
+                    symbol_for(name), symbol_for(name), "true" if versioned else "false"))
+    out.append("};")
+    out.append("")
+    out.append("#endif")
+    content = "\n".join(out) + "\n"
+
+    try:
+        with open(out_path) as f:
+            if f.read() == content:
+                return
+    except OSError:
+        pass
+    with open(out_path, "w") as f:
+        f.write(content)
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
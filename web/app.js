@@ -0,0 +1,38 @@
+// Main page: initial values from /api/status, live updates from /events
+function $(id) { return document.getElementById(id); }
+
+function showLatest(url) {
+  var img = $('latest');
+  if (!url) return;
+  img.src = url;
+  img.hidden = false;
+}
+
+function loadStatus() {
+  fetch('/api/status', {cache: 'no-store'}).then(function(r) { return r.json(); }).then(function(s) {
+    $('camera').textContent = s.camera ? 'Ready' : 'Not Ready';
+    $('sd').textContent = s.sd ? 'Ready' : 'Not Ready';
+    $('photos').textContent = s.photos;
+    $('heap').textContent = s.free_heap;
+    $('mem').textContent = s.memory;
+    $('uptime').textContent = s.uptime;
+    if (s.camera && s.sd && s.latest) showLatest(s.latest.url);
+  }).catch(function() {});
+}
+
+loadStatus();
+
+var es = new EventSource('/events');
+es.addEventListener('photo', function(e) {
+  var d = JSON.parse(e.data);
+  $('photos').textContent = d.n;
+  showLatest(d.url);
+});
+es.addEventListener('sd', function(e) { $('sd').textContent = JSON.parse(e.data).ready ? 'Ready' : 'Not Ready'; });
+es.addEventListener('memory', function(e) { $('mem').textContent = JSON.parse(e.data).level; });
+es.addEventListener('job', function(e) {
+  var d = JSON.parse(e.data);
+  $('job').textContent = d.job + ': ' + d.done + (d.total ? ' / ' + d.total : '');
+});
+// Missed events: fetch a fresh snapshot instead of reloading the page
+es.addEventListener('resync', loadStatus);